@@ -0,0 +1,170 @@
+/* cache_bench.c
+ * Result cache benchmark: checks a set of files without a cache, then
+ * through an empty one (every file a miss, its entry written) and through
+ * the filled one (every file a hit), on one thread, checking that all
+ * print the same. Reports the time per pass and how fast XXH64 alone
+ * hashes the files, which bounds a warm pass. Finally trims the cache to
+ * half its size and checks that the entries used least recently went.
+ *
+ *     bench_cache [-r repetitions] cachedir file...
+ *
+ * cachedir should not exist yet. Exits with status 1 if any results
+ * differ or the cache misses when it should not.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../include/cache.h"
+#include "../include/check.h"
+#include "../include/xxhash.h"
+
+#define DEFAULT_REPETITIONS 10
+
+typedef struct {
+    char *data;
+    size_t length;
+} Output;
+
+// Check every file once; returns the wall time, outputs into out
+static double check_all(CompilationUnit *unit, char **paths, int count, const Options *options, Output *out) {
+    double before = stats_now().wall;
+    for (int i = 0; i < count; i++) {
+        if (unit_load(unit, paths[i]) != 0) {
+            fprintf(stderr, "Error reading file %s: %s\n", paths[i], strerror(errno));
+            exit(1);
+        }
+        check_unit(unit, paths[i], options, &out[i].data, &out[i].length);
+    }
+    return stats_now().wall - before;
+}
+
+// Free out, counting the files whose output differs from expected
+static int compare(Output *expected, Output *out, int count) {
+    int differ = 0;
+    for (int i = 0; i < count; i++) {
+        differ += out[i].length != expected[i].length || memcmp(out[i].data, expected[i].data, out[i].length) != 0;
+        free(out[i].data);
+    }
+    return differ;
+}
+
+int main(int argc, char *argv[]) {
+    int repetitions = DEFAULT_REPETITIONS;
+    int first = 1;
+
+    if (argc > 2 && strcmp(argv[1], "-r") == 0) {
+        repetitions = atoi(argv[2]);
+        first = 3;
+    }
+    if (first + 1 >= argc || repetitions < 1) {
+        fprintf(stderr, "usage: bench_cache [-r repetitions] cachedir file...\n");
+        return 2;
+    }
+    const char *dir = argv[first];
+    char **paths = argv + first + 1;
+    int count = argc - first - 1;
+
+    Cache cache;
+    if (cache_open(&cache, dir, CACHE_DEFAULT_LIMIT) != 0) {
+        fprintf(stderr, "Cannot use cache %s: %s\n", dir, strerror(errno));
+        return 1;
+    }
+    CompilationUnit unit;
+    unit_init(&unit);
+    Options plain = {DIAG_FORMAT_TEXT, 1, BACKEND_NONE, STATS_OFF, NULL};
+    Options cached = plain;
+    cached.cache = &cache;
+    Output *expected = calloc((size_t)count, sizeof(Output));
+    Output *out = calloc((size_t)count, sizeof(Output));
+    int differ = 0;
+
+    // Sizes and hashing speed, from memory
+    size_t bytes = 0;
+    double hashing = 0;
+    volatile uint64_t sink = 0;
+    for (int i = 0; i < count; i++) {
+        if (unit_load(&unit, paths[i]) != 0) {
+            fprintf(stderr, "Error reading file %s: %s\n", paths[i], strerror(errno));
+            return 1;
+        }
+        bytes += unit.input.length;
+        double before = stats_now().wall;
+        for (int r = 0; r < repetitions; r++) {
+            sink += xxh64(unit.input.data, unit.input.length, (uint64_t)r);
+        }
+        hashing += stats_now().wall - before;
+        unit_reset(&unit);
+    }
+    hashing /= repetitions;
+
+    double uncached = 0;
+    for (int r = 0; r < repetitions; r++) {
+        uncached += check_all(&unit, paths, count, &plain, r == 0 ? expected : out);
+        if (r > 0) differ += compare(expected, out, count);
+    }
+    uncached /= repetitions;
+
+    double cold = check_all(&unit, paths, count, &cached, out);
+    differ += compare(expected, out, count);
+    uint64_t stored = unit.stats.cache_misses;
+
+    unit.stats.cache_hits = 0;
+    double warm = 0;
+    for (int r = 0; r < repetitions; r++) {
+        warm += check_all(&unit, paths, count, &cached, out);
+        differ += compare(expected, out, count);
+    }
+    warm /= repetitions;
+    int all_hit = unit.stats.cache_hits == (uint64_t)count * (uint64_t)repetitions;
+
+    // Use the second half of the files last, far enough apart in time for
+    // the file system's clock, then keep half: only files of the first half
+    // may miss
+    int half = count / 2;
+    check_all(&unit, paths, half, &cached, out);
+    differ += compare(expected, out, half);
+    usleep(50000);
+    check_all(&unit, paths + half, count - half, &cached, out + half);
+    differ += compare(expected + half, out + half, count - half);
+
+    Stats trim = {0};
+    cache.limit = UINT64_MAX;
+    uint64_t total = cache_trim(&cache, &trim);
+    cache.limit = total / 2;
+    uint64_t kept = cache_trim(&cache, &trim);
+    uint64_t hits = 0;
+    int kept_last = 1;
+    for (int i = 0; i < count; i++) {
+        uint64_t before = unit.stats.cache_hits;
+        check_all(&unit, paths + i, 1, &cached, out + i);
+        int hit = unit.stats.cache_hits > before;
+        hits += (uint64_t)hit;
+        if (!hit && i >= half) kept_last = 0;
+    }
+    differ += compare(expected, out, count);
+    if (hits + trim.cache_evicted != (uint64_t)count) kept_last = 0;
+
+    printf("%d files, %.1f MB; times per pass, one thread\n", count, (double)bytes / 1e6);
+    printf("  uncached %9.2f ms\n", uncached * 1e3);
+    printf("  cold     %9.2f ms   %llu entries written\n", cold * 1e3, (unsigned long long)stored);
+    printf("  warm     %9.2f ms   %.1fx faster than uncached%s\n", warm * 1e3, uncached / warm,
+           all_hit ? "" : "   MISSED");
+    printf("  XXH64    %9.2f ms   %.2f GB/s\n", hashing * 1e3, (double)bytes / hashing / 1e9);
+    printf("  trimmed to %llu of %llu bytes: %llu entries evicted, %llu hits after%s\n",
+           (unsigned long long)kept, (unsigned long long)total, (unsigned long long)trim.cache_evicted,
+           (unsigned long long)hits, kept_last ? "" : "   WRONG ENTRIES");
+    int failed = differ || !all_hit || !kept_last;
+    printf("%s\n", failed ? "MISMATCH" : "same output");
+
+    for (int i = 0; i < count; i++) {
+        free(expected[i].data);
+    }
+    unit_free(&unit);
+    cache_close(&cache);
+    free(expected);
+    free(out);
+    return failed;
+}
@@ -0,0 +1,140 @@
+/* check_bench.c
+ * Lex / parse / check benchmark. Times each phase separately over every
+ * input file and reports mean, standard deviation and best time, with
+ * throughput in MB/s and statements/s.
+ *
+ *     bench_check [-r repetitions] file...
+ *
+ * "lex" is a standalone pass over the tokens without interning; "parse"
+ * includes the lexing the parser pulls as it goes; "check" is name
+ * resolution and type checking. Each repetition reloads the file into the
+ * same unit, as the driver does, and one warm-up run is discarded.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/lexer.h"
+#include "../include/parser.h"
+#include "../include/semantic.h"
+#include "../include/stats.h"
+#include "../include/unit.h"
+
+#define DEFAULT_REPETITIONS 10
+
+enum { BENCH_LEX, BENCH_PARSE, BENCH_CHECK, BENCH_TOTAL, BENCH_PHASES };
+
+static const char *phase_names[BENCH_PHASES] = {"lex", "parse", "check", "total"};
+
+static int is_statement(ASTNodeType kind) {
+    switch (kind) {
+        case AST_VARDECL:
+        case AST_ASSIGN:
+        case AST_PRINT:
+        case AST_IF:
+        case AST_WHILE:
+        case AST_REPEAT:
+        case AST_FACTORIAL:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Time one run of each phase into times[]; returns the statement count
+static long run_once(CompilationUnit *unit, const char *path, double *times) {
+    if (unit_load(unit, path) != 0) {
+        perror(path);
+        exit(1);
+    }
+    unit->diags.trace = 0;
+
+    double start = stats_now().wall;
+    Lexer lexer;
+    Token token;
+    lexer_init(&lexer, unit->input.data, NULL);
+    do {
+        token = get_next_token(&lexer);
+    } while (token.type != TOKEN_EOF);
+    lexer_free(&lexer);
+    double lexed = stats_now().wall;
+
+    Parser parser;
+    parser_init(&parser, unit);
+    NodeId root = parse(&parser);
+    double parsed = stats_now().wall;
+
+    analyze_semantics(root, unit);
+    double checked = stats_now().wall;
+
+    times[BENCH_LEX] = lexed - start;
+    times[BENCH_PARSE] = parsed - lexed;
+    times[BENCH_CHECK] = checked - parsed;
+    times[BENCH_TOTAL] = checked - start;
+
+    long statements = 0;
+    for (uint32_t node = 1; node < unit->ast.count; node++) {
+        statements += is_statement((ASTNodeType)unit->ast.kind[node]);
+    }
+    return statements;
+}
+
+static void bench_file(CompilationUnit *unit, const char *path, int repetitions) {
+    double *times = malloc(sizeof(double) * BENCH_PHASES * repetitions);
+    double warm_up[BENCH_PHASES];
+    if (!times) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+
+    long statements = run_once(unit, path, warm_up);
+    double megabytes = unit->input.length / 1e6;
+    for (int r = 0; r < repetitions; r++) {
+        run_once(unit, path, &times[r * BENCH_PHASES]);
+    }
+    unit_reset(unit);
+
+    printf("%s: %.2f MB, %ld statements, %d runs\n", path, megabytes, statements, repetitions);
+    printf("  %-6s %10s %10s %10s %10s %12s\n", "phase", "mean ms", "stddev ms", "best ms", "MB/s", "stmts/s");
+    for (int p = 0; p < BENCH_PHASES; p++) {
+        double sum = 0, best = INFINITY;
+        for (int r = 0; r < repetitions; r++) {
+            double t = times[r * BENCH_PHASES + p];
+            sum += t;
+            if (t < best) best = t;
+        }
+        double mean = sum / repetitions;
+        double squares = 0;
+        for (int r = 0; r < repetitions; r++) {
+            double d = times[r * BENCH_PHASES + p] - mean;
+            squares += d * d;
+        }
+        double stddev = repetitions > 1 ? sqrt(squares / (repetitions - 1)) : 0;
+        printf("  %-6s %10.2f %10.2f %10.2f %10.1f %12.0f\n", phase_names[p], mean * 1e3, stddev * 1e3,
+               best * 1e3, megabytes / mean, statements / mean);
+    }
+    free(times);
+}
+
+int main(int argc, char *argv[]) {
+    int repetitions = DEFAULT_REPETITIONS;
+    int first = 1;
+
+    if (argc > 2 && strcmp(argv[1], "-r") == 0) {
+        repetitions = atoi(argv[2]);
+        first = 3;
+    }
+    if (first >= argc || repetitions < 1) {
+        fprintf(stderr, "usage: bench_check [-r repetitions] file...\n");
+        return 2;
+    }
+
+    CompilationUnit unit;
+    unit_init(&unit);
+    for (int i = first; i < argc; i++) {
+        bench_file(&unit, argv[i], repetitions);
+    }
+    unit_free(&unit);
+    return 0;
+}
@@ -0,0 +1,84 @@
+/* keyword_bench.c
+ * Microbenchmark for keyword classification: compares the previous linear
+ * strcmp scan over the keyword table with the generated perfect hash used by
+ * the lexer (is_keyword), over the same stream of identifiers.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../include/tokens.h"
+#include "../include/lexer.h"
+
+#define IDENTIFIER_COUNT 1000000
+#define ROUNDS 20
+
+static const struct {
+    const char *word;
+    TokenType type;
+} keywords[] = {
+#define KEYWORD(word, token) {word, token},
+#include "../include/tokens.def"
+};
+
+#define KEYWORD_COUNT ((int)(sizeof(keywords) / sizeof(keywords[0])))
+
+// The classifier the lexer used before the perfect hash
+static int linear_is_keyword(const char *word) {
+    for (int i = 0; i < KEYWORD_COUNT; i++) {
+        if (strcmp(word, keywords[i].word) == 0) {
+            return keywords[i].type;
+        }
+    }
+    return 0;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(void) {
+    // Identifier stream: roughly one keyword in four, the rest random names
+    char *pool = malloc((size_t)IDENTIFIER_COUNT * 16);
+    char **words = malloc(IDENTIFIER_COUNT * sizeof(char *));
+    int *lengths = malloc(IDENTIFIER_COUNT * sizeof(int));
+    char *p = pool;
+
+    srand(42);
+    for (int i = 0; i < IDENTIFIER_COUNT; i++) {
+        words[i] = p;
+        if (rand() % 4 == 0) {
+            strcpy(p, keywords[rand() % KEYWORD_COUNT].word);
+        } else {
+            int len = 1 + rand() % 12;
+            for (int j = 0; j < len; j++) p[j] = "abcdefghijklmnopqrstuvwxyz_"[rand() % 27];
+            p[len] = '\0';
+        }
+        lengths[i] = (int)strlen(p);
+        p += lengths[i] + 1;
+    }
+
+    volatile long sink = 0;
+    double start = now_seconds();
+    for (int r = 0; r < ROUNDS; r++)
+        for (int i = 0; i < IDENTIFIER_COUNT; i++) sink += linear_is_keyword(words[i]);
+    double linear = now_seconds() - start;
+
+    start = now_seconds();
+    for (int r = 0; r < ROUNDS; r++)
+        for (int i = 0; i < IDENTIFIER_COUNT; i++) sink += is_keyword(words[i], lengths[i]);
+    double hashed = now_seconds() - start;
+
+    double total = (double)IDENTIFIER_COUNT * ROUNDS;
+    printf("linear strcmp scan: %8.1f M identifiers/s\n", total / linear / 1e6);
+    printf("perfect hash:       %8.1f M identifiers/s\n", total / hashed / 1e6);
+    printf("speedup:            %8.2fx\n", linear / hashed);
+
+    free(lengths);
+    free(words);
+    free(pool);
+    return 0;
+}
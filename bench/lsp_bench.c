@@ -0,0 +1,181 @@
+/* lsp_bench.c
+ * Language server latency benchmark: opens each file as a document, then
+ * types into it, inserting one character at a random place and deleting it
+ * again, timing each edit from the change to the diagnostics rendered as
+ * they would be published. Reports the time to open the document and the
+ * mean, median, 99th percentile and worst edit, then checks that the
+ * diagnostics after every few edits are what checking the same text from
+ * scratch gives.
+ *
+ *     bench_lsp [-r edits] file...
+ *
+ * The characters typed leave the nesting of blocks alone; opening a block
+ * encloses everything up to its end, so that case is timed on its own, as
+ * an unbalanced '{' typed at the start of a random line and deleted.
+ * Exits with status 1 if any diagnostics differ.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/lsp.h"
+#include "../include/stats.h"
+
+#define DEFAULT_EDITS 1000
+#define VERIFY_EVERY 100
+#define BRACE_EDITS 4
+
+static const char typed[] = "a1 ;+=\n";
+
+static char *read_file(const char *path, size_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        exit(1);
+    }
+    fseek(file, 0, SEEK_END);
+    *length = (size_t)ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *text = malloc(*length + 1);
+    if (!text || fread(text, 1, *length, file) != *length) {
+        fprintf(stderr, "Could not read %s\n", path);
+        exit(1);
+    }
+    text[*length] = '\0';
+    fclose(file);
+    return text;
+}
+
+// Render doc's diagnostics into *out, as publishing them would
+static void render(const Document *doc, char **out, size_t *length) {
+    free(*out);
+    FILE *file = open_memstream(out, length);
+    if (!file) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    document_write_diagnostics(doc, file);
+    fclose(file);
+}
+
+// Time one edit through rendering its diagnostics
+static double timed_edit(Document *doc, size_t start, size_t end, const char *text, char **out,
+                         size_t *length) {
+    double before = stats_now().wall;
+    document_edit(doc, start, end, text, strlen(text));
+    render(doc, out, length);
+    return stats_now().wall - before;
+}
+
+// Do doc's diagnostics match a fresh document's with the same text?
+static int verify(const Document *doc) {
+    char *incremental = NULL, *scratch = NULL;
+    size_t incremental_length, scratch_length;
+    Document *fresh = document_open(doc->text, doc->length);
+    render(doc, &incremental, &incremental_length);
+    render(fresh, &scratch, &scratch_length);
+    int same = incremental_length == scratch_length && memcmp(incremental, scratch, scratch_length) == 0;
+    document_close(fresh);
+    free(incremental);
+    free(scratch);
+    return same;
+}
+
+static int compare_times(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// A random byte offset of doc that is not inside a string literal or a
+// comment, so typing there changes only the statement around it
+static size_t pick_offset(const Document *doc) {
+    for (;;) {
+        size_t offset = (size_t)rand() % (doc->length + 1);
+        size_t line = offset;
+        while (line > 0 && doc->text[line - 1] != '\n') line--;
+        const char *p = doc->text + line;
+        int quoted = 0;
+        for (; p < doc->text + offset && *p != '/'; p++) {
+            if (*p == '"') quoted = !quoted;
+        }
+        if (!quoted && p == doc->text + offset) return offset;
+    }
+}
+
+static size_t line_start(const Document *doc) {
+    size_t offset = (size_t)rand() % (doc->length + 1);
+    while (offset > 0 && doc->text[offset - 1] != '\n') offset--;
+    return offset;
+}
+
+static int bench_file(const char *path, int edits) {
+    size_t length;
+    char *text = read_file(path, &length);
+    char *out = NULL;
+    size_t out_length;
+    int mismatch = 0;
+
+    double before = stats_now().wall;
+    Document *doc = document_open(text, length);
+    render(doc, &out, &out_length);
+    double open_time = stats_now().wall - before;
+
+    double *times = malloc((size_t)edits * 2 * sizeof(double));
+    size_t timed = 0, checked = 0;
+    for (int i = 0; i < edits; i++) {
+        size_t offset = pick_offset(doc);
+        char insert[2] = {typed[rand() % (sizeof(typed) - 1)], '\0'};
+        times[timed++] = timed_edit(doc, offset, offset, insert, &out, &out_length);
+        checked += doc->checked;
+        times[timed++] = timed_edit(doc, offset, offset + 1, "", &out, &out_length);
+        checked += doc->checked;
+        if ((i + 1) % VERIFY_EVERY == 0) mismatch |= !verify(doc);
+    }
+    mismatch |= !verify(doc);
+
+    double brace = 0;
+    for (int i = 0; i < BRACE_EDITS; i++) {
+        size_t offset = line_start(doc);
+        brace += timed_edit(doc, offset, offset, "{", &out, &out_length);
+        mismatch |= !verify(doc);
+        brace += timed_edit(doc, offset, offset + 1, "", &out, &out_length);
+    }
+    mismatch |= !verify(doc);
+
+    qsort(times, timed, sizeof(double), compare_times);
+    double sum = 0;
+    for (size_t i = 0; i < timed; i++) sum += times[i];
+    printf("%-28s %7zu lines   open %7.1f ms   edit mean %6.3f  median %6.3f  p99 %6.3f  max %7.3f ms"
+           "   %4.1f checks   brace %7.1f ms   %s\n",
+           path, doc->line_count, open_time * 1e3, sum / (double)timed * 1e3, times[timed / 2] * 1e3,
+           times[timed * 99 / 100] * 1e3, times[timed - 1] * 1e3, (double)checked / (double)timed,
+           brace / (BRACE_EDITS * 2) * 1e3, mismatch ? "MISMATCH" : "same diagnostics");
+
+    document_close(doc);
+    free(times);
+    free(out);
+    free(text);
+    return mismatch;
+}
+
+int main(int argc, char *argv[]) {
+    int edits = DEFAULT_EDITS;
+    int first = 1;
+    int failures = 0;
+
+    if (argc > 2 && strcmp(argv[1], "-r") == 0) {
+        edits = atoi(argv[2]);
+        first = 3;
+    }
+    if (first >= argc || edits < 1) {
+        fprintf(stderr, "usage: bench_lsp [-r edits] file...\n");
+        return 2;
+    }
+
+    srand(1);
+    printf("%d characters typed and deleted per file; times in ms include rendering the diagnostics\n", edits);
+    for (int i = first; i < argc; i++) {
+        failures += bench_file(argv[i], edits);
+    }
+    return failures > 0;
+}
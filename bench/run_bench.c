@@ -0,0 +1,148 @@
+/* run_bench.c
+ * Execution benchmark: runs each program on the VM, which is the reference,
+ * and with the JIT, checks that both print the same output and stop the
+ * same way, and reports the time each takes.
+ *
+ *     bench_run [-r repetitions] file...
+ *
+ * Times include building and optimising the IR and compiling it to
+ * bytecode or to machine code. Exits with status 1 if any program's results
+ * differ, or if a program does not pass semantic analysis.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/bytecode.h"
+#include "../include/ir.h"
+#include "../include/jit.h"
+#include "../include/parser.h"
+#include "../include/semantic.h"
+#include "../include/stats.h"
+#include "../include/unit.h"
+#include "../include/vm.h"
+
+#define DEFAULT_REPETITIONS 3
+
+// Output and outcome of one run
+typedef struct {
+    char *output;
+    size_t length;
+    int completed;
+    int error_line;       // Line of the runtime error, if it stopped on one
+    double seconds;
+} Run;
+
+static Run run_once(CompilationUnit *unit, NodeId root, int jit) {
+    Run run = {0};
+    FILE *out = open_memstream(&run.output, &run.length);
+    if (!out) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+
+    double start = stats_now().wall;
+    Ir ir;
+    ir_init(&ir);
+    ir_build(&ir, unit, root);
+    ir_optimize(&ir);
+    if (jit) {
+        run.completed = jit_run(&ir, out);
+        ir_free(&ir);
+    } else {
+        Chunk chunk;
+        chunk_init(&chunk);
+        bytecode_compile(&chunk, &ir);
+        ir_free(&ir);
+        run.completed = vm_run(&chunk, out, &unit->diags);
+        chunk_free(&chunk);
+    }
+    run.seconds = stats_now().wall - start;
+    if (!run.completed && unit->diags.count > 0) {
+        run.error_line = unit->diags.items[unit->diags.count - 1].line;
+    }
+    fclose(out);
+    return run;
+}
+
+static int same_results(const Run *a, const Run *b) {
+    return a->completed == b->completed && a->error_line == b->error_line && a->length == b->length &&
+           memcmp(a->output, b->output, a->length) == 0;
+}
+
+// Best of repetitions runs. Every run must match reference, or the first
+// run when reference is NULL; *mismatch is set if one does not.
+static Run run_best(CompilationUnit *unit, NodeId root, int jit, int repetitions, const Run *reference,
+                    int *mismatch) {
+    Run best = run_once(unit, root, jit);
+    if (reference && !same_results(&best, reference)) *mismatch = 1;
+    for (int r = 1; r < repetitions; r++) {
+        Run run = run_once(unit, root, jit);
+        if (!same_results(&run, reference ? reference : &best)) *mismatch = 1;
+        if (run.seconds < best.seconds) best.seconds = run.seconds;
+        free(run.output);
+    }
+    return best;
+}
+
+static int bench_file(CompilationUnit *unit, const char *path, int repetitions) {
+    if (unit_load(unit, path) != 0) {
+        perror(path);
+        exit(1);
+    }
+    unit->diags.trace = 0;
+
+    Parser parser;
+    parser_init(&parser, unit);
+    NodeId root = parse(&parser);
+    if (!analyze_semantics(root, unit) || parser_error_count(&parser) > 0) {
+        fprintf(stderr, "%s: does not pass semantic analysis\n", path);
+        return 1;
+    }
+
+    int mismatch = 0;
+    Run vm = run_best(unit, root, 0, repetitions, NULL, &mismatch);
+    printf("%-32s vm  %9.2f ms", path, vm.seconds * 1e3);
+    Ir ir;
+    ir_init(&ir);
+    ir_build(&ir, unit, root);
+    ir_optimize(&ir);
+    int supported = jit_supported(&ir);
+    ir_free(&ir);
+    if (supported) {
+        Run jit = run_best(unit, root, 1, repetitions, &vm, &mismatch);
+        printf("   jit %9.2f ms   %6.1fx", jit.seconds * 1e3, vm.seconds / jit.seconds);
+        free(jit.output);
+    } else {
+        printf("   jit       n/a");
+    }
+    printf("   %s\n", mismatch ? "MISMATCH" : "same output");
+
+    free(vm.output);
+    unit_reset(unit);
+    return mismatch;
+}
+
+int main(int argc, char *argv[]) {
+    int repetitions = DEFAULT_REPETITIONS;
+    int first = 1;
+    int failures = 0;
+
+    if (argc > 2 && strcmp(argv[1], "-r") == 0) {
+        repetitions = atoi(argv[2]);
+        first = 3;
+    }
+    if (first >= argc || repetitions < 1) {
+        fprintf(stderr, "usage: bench_run [-r repetitions] file...\n");
+        return 2;
+    }
+
+    printf("Best of %d runs\n", repetitions);
+    CompilationUnit unit;
+    unit_init(&unit);
+    for (int i = first; i < argc; i++) {
+        failures += bench_file(&unit, argv[i], repetitions);
+    }
+    unit_free(&unit);
+    return failures > 0;
+}
@@ -0,0 +1,274 @@
+/* server_bench.c
+ * Compile server latency benchmark: checks each file over and over by
+ * starting semantic_main for it, and through a running server both by path
+ * and as in-memory source, checks that all three print the same, and
+ * reports the mean time per check. Then checks all the files at once, with
+ * and without --run, through semantic_main --client and directly, which
+ * must print the same and exit with the same status.
+ *
+ *     bench_server [-r repetitions] socket file...
+ *
+ * The server must already be listening at socket; semantic_main is run
+ * from the current directory. Exits with status 1 if any results differ.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../include/stats.h"
+
+#define DEFAULT_REPETITIONS 1000
+#define SEMANTIC_MAIN "./semantic_main"
+
+extern char **environ;
+
+typedef struct {
+    char *data;
+    size_t length, capacity;
+} Buffer;
+
+static void append(Buffer *buffer, const char *data, size_t length) {
+    if (buffer->length + length + 1 > buffer->capacity) {
+        buffer->capacity = (buffer->length + length + 1) * 2;
+        buffer->data = realloc(buffer->data, buffer->capacity);
+        if (!buffer->data) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+    buffer->data[buffer->length] = '\0';
+}
+
+// Append what one read of at most limit bytes from fd returns; returns 0
+// at the end of the stream
+static size_t read_some(int fd, Buffer *out, size_t limit) {
+    char chunk[4096];
+    ssize_t n;
+    do {
+        n = read(fd, chunk, limit < sizeof(chunk) ? limit : sizeof(chunk));
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        perror("read");
+        exit(1);
+    }
+    append(out, chunk, (size_t)n);
+    return (size_t)n;
+}
+
+// Read from fd until length bytes are in out, or until the end when
+// length is SIZE_MAX
+static void read_into(int fd, Buffer *out, size_t length) {
+    while (out->length < length) {
+        if (read_some(fd, out, length - out->length) == 0) {
+            if (length == SIZE_MAX) return;
+            fprintf(stderr, "Server closed the connection\n");
+            exit(1);
+        }
+    }
+}
+
+static void write_all(int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            perror("write");
+            exit(1);
+        }
+        data += n;
+        length -= (size_t)n;
+    }
+}
+
+// Run semantic_main with argv, with what it prints in out; returns its
+// exit status
+static int run_process(char *const *argv, Buffer *out) {
+    int pipe_fds[2];
+    if (pipe(pipe_fds) != 0) {
+        perror("pipe");
+        exit(1);
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, pipe_fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, pipe_fds[0]);
+    pid_t pid;
+    if (posix_spawn(&pid, SEMANTIC_MAIN, &actions, NULL, argv, environ) != 0) {
+        fprintf(stderr, "Could not start %s\n", SEMANTIC_MAIN);
+        exit(1);
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    close(pipe_fds[1]);
+    out->length = 0;
+    read_into(pipe_fds[0], out, SIZE_MAX);
+    close(pipe_fds[0]);
+    int status;
+    if (waitpid(pid, &status, 0) < 0) {
+        perror("waitpid");
+        exit(1);
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+// Check path in a new process, with what it prints in out
+static void check_process(const char *path, Buffer *out) {
+    char *argv[] = {SEMANTIC_MAIN, "-q", (char *)path, NULL};
+    run_process(argv, out);
+}
+
+// Send one request over fd and read the reply's output into out
+static void check_server(int fd, const char *header, const Buffer *source, Buffer *out) {
+    Buffer reply = {0};
+    Buffer request = {0};
+    append(&request, header, strlen(header));
+    if (source) append(&request, source->data, source->length);
+    write_all(fd, request.data, request.length);
+    free(request.data);
+
+    // The header line of the reply
+    while (!reply.data || !memchr(reply.data, '\n', reply.length)) {
+        if (read_some(fd, &reply, SIZE_MAX) == 0) {
+            fprintf(stderr, "Server closed the connection\n");
+            exit(1);
+        }
+    }
+    char *newline = memchr(reply.data, '\n', reply.length);
+    char *tab = memchr(reply.data, '\t', (size_t)(newline - reply.data));
+    if (!tab || strncmp(reply.data, "error", 5) == 0) {
+        fprintf(stderr, "Server error: %.*s\n", (int)reply.length, reply.data);
+        exit(1);
+    }
+    size_t length = strtoull(tab + 1, NULL, 10);
+    size_t have = reply.length - (size_t)(newline + 1 - reply.data);
+    out->length = 0;
+    append(out, newline + 1, have);
+    read_into(fd, out, length);
+    free(reply.data);
+}
+
+static int connect_server(const char *socket_path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        fprintf(stderr, "Could not connect to %s: %s\n", socket_path, strerror(errno));
+        exit(1);
+    }
+    return fd;
+}
+
+static int bench_file(int fd, const char *path, int repetitions) {
+    char resolved[PATH_MAX];
+    Buffer source = {0};
+    int file = open(path, O_RDONLY);
+    if (file < 0 || !realpath(path, resolved)) {
+        perror(path);
+        exit(1);
+    }
+    read_into(file, &source, SIZE_MAX);
+    close(file);
+    if (!source.data) append(&source, "", 0);
+
+    char check_header[PATH_MAX * 2 + 32];
+    char source_header[PATH_MAX + 64];
+    snprintf(check_header, sizeof(check_header), "check\t-q\t%s\t%s\n", path, resolved);
+    snprintf(source_header, sizeof(source_header), "source\t-q\t%s\t%zu\n", path, source.length);
+
+    Buffer expected = {0}, out = {0};
+    int mismatch = 0;
+    double times[3] = {0, 0, 0};
+    for (int r = 0; r < repetitions; r++) {
+        double start = stats_now().wall;
+        check_process(path, r == 0 ? &expected : &out);
+        double checked = stats_now().wall;
+        check_server(fd, check_header, NULL, &out);
+        mismatch |= out.length != expected.length || memcmp(out.data, expected.data, out.length) != 0;
+        double sent = stats_now().wall;
+        check_server(fd, source_header, &source, &out);
+        mismatch |= out.length != expected.length || memcmp(out.data, expected.data, out.length) != 0;
+        double end = stats_now().wall;
+        times[0] += checked - start;
+        times[1] += sent - checked;
+        times[2] += end - sent;
+    }
+
+    printf("%-32s process %8.1f us   server path %6.1f us   source %6.1f us   %6.1fx   %s\n", path,
+           times[0] / repetitions * 1e6, times[1] / repetitions * 1e6, times[2] / repetitions * 1e6,
+           times[0] / times[1], mismatch ? "MISMATCH" : "same output");
+    free(source.data);
+    free(expected.data);
+    free(out.data);
+    return mismatch;
+}
+
+// Check all the files through semantic_main --client and directly, with
+// option if it is not NULL; returns 1 if the output or status differ
+static int compare_client(const char *socket_path, char **paths, int count, char *option) {
+    char client[PATH_MAX + 16];
+    snprintf(client, sizeof(client), "--client=%s", socket_path);
+    char **argv = calloc((size_t)count + 4, sizeof(char *));
+    if (!argv) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    int first = 0;
+    argv[first++] = SEMANTIC_MAIN;
+    argv[first++] = client;
+    if (option) argv[first++] = option;
+    memcpy(argv + first, paths, (size_t)count * sizeof(char *));
+
+    Buffer direct = {0}, through = {0};
+    double start = stats_now().wall;
+    int through_status = run_process(argv, &through);
+    double end = stats_now().wall;
+    // The same command line without --client
+    memmove(argv + 1, argv + 2, (size_t)(first - 2 + count + 1) * sizeof(char *));
+    int direct_status = run_process(argv, &direct);
+
+    int mismatch = through_status != direct_status || through.length != direct.length ||
+                   memcmp(through.data, direct.data, through.length) != 0;
+    printf("--client %-23s %8.1f ms   status %d   %s\n", option ? option : "", (end - start) * 1e3,
+           through_status, mismatch ? "MISMATCH" : "same output");
+    free(direct.data);
+    free(through.data);
+    free(argv);
+    return mismatch;
+}
+
+int main(int argc, char *argv[]) {
+    int repetitions = DEFAULT_REPETITIONS;
+    int first = 1;
+    int failures = 0;
+
+    if (argc > 2 && strcmp(argv[1], "-r") == 0) {
+        repetitions = atoi(argv[2]);
+        first = 3;
+    }
+    if (first + 1 >= argc || repetitions < 1) {
+        fprintf(stderr, "usage: bench_server [-r repetitions] socket file...\n");
+        return 2;
+    }
+
+    printf("Mean of %d checks\n", repetitions);
+    int fd = connect_server(argv[first]);
+    for (int i = first + 1; i < argc; i++) {
+        failures += bench_file(fd, argv[i], repetitions);
+    }
+    close(fd);
+    failures += compare_client(argv[first], argv + first + 1, argc - first - 1, NULL);
+    failures += compare_client(argv[first], argv + first + 1, argc - first - 1, "--run");
+    return failures > 0;
+}
@@ -0,0 +1,37 @@
+/* arena.h */
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Default chunk size; larger requests get a chunk of their own
+#define ARENA_CHUNK_SIZE (256 * 1024)
+
+typedef struct ArenaChunk ArenaChunk;
+
+// Bump allocator. Allocations are never freed individually; arena_reset
+// releases everything at once in O(1) and keeps the chunks for reuse.
+typedef struct {
+    ArenaChunk *first;    // Chunk list, in allocation order
+    ArenaChunk *current;  // Chunk being bumped
+    char *ptr;            // Next free byte in current
+    char *end;            // End of current
+    size_t allocated;     // Bytes handed out since the last reset
+} Arena;
+
+void arena_init(Arena *arena);
+
+// Allocate size bytes aligned for any type; never returns NULL (aborts when
+// out of memory)
+void *arena_alloc(Arena *arena, size_t size);
+
+// Allocate and zero-fill
+void *arena_calloc(Arena *arena, size_t size);
+
+// Release every allocation, keeping the chunks
+void arena_reset(Arena *arena);
+
+// Return all chunks to the system
+void arena_free(Arena *arena);
+
+#endif /* ARENA_H */
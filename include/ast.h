@@ -0,0 +1,107 @@
+/* ast.h */
+#ifndef AST_H
+#define AST_H
+
+#include <stdint.h>
+#include "tokens.h"
+
+// Basic node types for AST
+typedef enum {
+    AST_PROGRAM,        // Program node
+    AST_VARDECL,        // Variable declaration (int x)
+    AST_ASSIGN,         // Assignment (x = 5)
+    AST_PRINT,          // Print statement
+    AST_NUMBER,         // Number literal
+    AST_STRING_LITERAL,  // String literal
+    AST_IDENTIFIER,     // Variable name
+    AST_IF,
+    AST_CONDITION,
+    AST_WHILE,
+    AST_REPEAT,
+    AST_BLOCK,
+    AST_FACTORIAL,
+    AST_BINOP,
+    AST_COMPARISON,
+    AST_ERROR,          // Statement skipped after a syntax error
+    AST_KIND_COUNT      // Number of node kinds
+} ASTNodeType;
+
+typedef enum {
+    TYPE_INT,
+    TYPE_CHAR,
+    TYPE_FLOAT,
+    TYPE_STRING
+} VarType;
+
+// Index of a node in an Ast; AST_NONE is never a valid node
+typedef uint32_t NodeId;
+
+#define AST_NONE 0
+
+// Binding of a VARDECL that was not given a frame slot
+#define SLOT_NONE UINT32_MAX
+
+// Flat AST. Nodes live in parallel columns indexed by NodeId, and each node
+// refers to the source token it was built from through the token columns,
+// which parent and child share when they come from the same token.
+//
+// Children of a node, in order:
+//   PROGRAM, BLOCK       statements
+//   ASSIGN               IDENTIFIER, expression
+//   IF, WHILE            condition expression, body statement
+//   REPEAT               BLOCK, CONDITION
+//   PRINT, FACTORIAL     expression
+//   CONDITION            COMPARISON
+//   BINOP, COMPARISON    left operand, right operand
+typedef struct {
+    uint8_t *kind;          // ASTNodeType
+    uint8_t *var_type;      // VarType of a VARDECL, or of an expression
+                            // once semantic analysis has typed it
+    NodeId *first_child;
+    NodeId *next_sibling;
+    uint32_t *token;        // Index into the token columns
+    uint32_t *binding;      // Set by name resolution: the VARDECL of an
+                            // IDENTIFIER, or the frame slot of a VARDECL,
+                            // SLOT_NONE if it was rejected
+    uint32_t count;         // Nodes in use, including the AST_NONE slot
+    uint32_t capacity;
+    uint32_t slot_count;    // Frame slots the resolved program needs
+
+    size_t *token_start;    // Source span of each token
+    uint32_t *token_length;
+    InternId *token_id;     // Interned name or literal value
+    uint32_t token_count;
+    uint32_t token_capacity;
+} Ast;
+
+// Columns of node n's token
+#define AST_START(ast, n) ((ast)->token_start[(ast)->token[n]])
+#define AST_LENGTH(ast, n) ((ast)->token_length[(ast)->token[n]])
+#define AST_ID(ast, n) ((ast)->token_id[(ast)->token[n]])
+
+// Second child of n, for the two-operand nodes
+#define AST_SECOND_CHILD(ast, n) ((ast)->next_sibling[(ast)->first_child[n]])
+
+void ast_init(Ast *ast);
+
+// Append a token to the token columns and return its index
+uint32_t ast_add_token(Ast *ast, Token token);
+
+// Append a childless node built from token index `token`
+NodeId ast_add_node(Ast *ast, ASTNodeType kind, uint32_t token);
+
+// Drop every node and token, keeping the columns for the next file
+void ast_reset(Ast *ast);
+
+// Release the columns
+void ast_free(Ast *ast);
+
+// Bytes held by the columns currently in use
+size_t ast_memory(const Ast *ast);
+
+const char *var_type_to_string(VarType type);
+
+// Name of a node kind, e.g. "BinaryOp"
+const char *ast_kind_name(ASTNodeType kind);
+
+#endif /* AST_H */
@@ -0,0 +1,63 @@
+/* bytecode.h */
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+struct Ir;
+
+// Instructions are listed in opcodes.def
+typedef enum {
+#define OPCODE(name) name,
+#include "opcodes.def"
+    OPCODE_COUNT
+} Opcode;
+
+// Immutable string value; strings share their bytes freely
+typedef struct {
+    size_t length;
+    char bytes[];
+} VmString;
+
+// A slot, stack entry or constant. The instruction using it knows which
+// member is live; a NULL string is the empty string.
+typedef union {
+    int64_t i;
+    double f;
+    const VmString *s;
+} Value;
+
+// Source position of the instructions from offset on, for runtime errors
+typedef struct {
+    uint32_t offset;       // Code offset
+    int line;
+    size_t start;          // Span of the node they were compiled from
+    uint32_t length;
+} LineEntry;
+
+// A compiled program
+typedef struct {
+    uint8_t *code;
+    size_t count, capacity;
+    Value *constants;
+    uint32_t constant_count, constant_capacity;
+    LineEntry *lines;      // In code order
+    size_t line_count, line_capacity;
+    uint32_t slot_count;   // Frame slots, for the values kept in one
+    uint32_t max_stack;    // Deepest the operand stack gets
+    Arena strings;         // String constants
+} Chunk;
+
+void chunk_init(Chunk *chunk);
+void chunk_free(Chunk *chunk);
+
+// Compile a program from its IR, usually optimised; see ir.h
+void bytecode_compile(Chunk *chunk, const struct Ir *ir);
+
+// Position of the instruction at offset
+const LineEntry *chunk_line(const Chunk *chunk, uint32_t offset);
+
+#endif /* BYTECODE_H */
@@ -0,0 +1,55 @@
+/* cache.h
+ * On-disk cache of check results, so that files unchanged since an earlier
+ * run are not parsed again.
+ *
+ * An entry holds a file's pass/fail result and its rendered output. It is
+ * keyed by the XXH64 of the source bytes, seeded with the checker's
+ * version, together with the name the output quotes and the options that
+ * shape it. The version is the hash of the running executable, so a
+ * rebuilt checker never reads what an older one wrote.
+ *
+ * Entries live in dir/xx/, one file each, written to a temporary file and
+ * renamed into place, so processes sharing a directory never see half an
+ * entry. A hit refreshes the entry's modification time; cache_trim then
+ * deletes the least recently used entries once the total exceeds the size
+ * limit.
+ */
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "stats.h"
+
+#define CACHE_DEFAULT_LIMIT (256ULL << 20)
+
+typedef struct {
+    char *dir;
+    uint64_t limit;       // Bytes kept by cache_trim
+    uint64_t version;     // Hash of the checker
+} Cache;
+
+// Use dir, creating it if need be, as a cache of at most limit bytes;
+// returns 0 on success, -1 with errno set
+int cache_open(Cache *cache, const char *dir, uint64_t limit);
+void cache_close(Cache *cache);
+
+// Key of source checked as name, with the options that shape its output
+// encoded in variant
+uint64_t cache_key(const Cache *cache, const char *source, size_t length, const char *name,
+                   uint32_t variant);
+
+// The entry for key, if there is one: its result in *failed and its output
+// in a new buffer *output. Returns 1 on a hit, 0 on a miss.
+int cache_lookup(const Cache *cache, uint64_t key, int *failed, char **output, size_t *output_length);
+
+// Record the result and output for key; a failure to write is ignored and
+// just leaves the entry out
+void cache_store(const Cache *cache, uint64_t key, int failed, const char *output, size_t output_length);
+
+// Delete the least recently used entries until the rest fit in the limit,
+// counting them in stats; returns the bytes the rest take
+uint64_t cache_trim(const Cache *cache, Stats *stats);
+
+#endif /* CACHE_H */
@@ -0,0 +1,17 @@
+/* cgen.h */
+#ifndef CGEN_H
+#define CGEN_H
+
+#include <stdio.h>
+
+#include "ast.h"
+#include "unit.h"
+
+// Write the program at root, which must have passed semantic analysis, to
+// out as a self-contained C program that prints what the VM would. int is
+// int64_t, float double, char signed char and string an immutable rt_string;
+// a division by zero prints the VM's runtime error on stderr and exits with
+// status 1.
+void cgen_emit(CompilationUnit *unit, NodeId root, FILE *out);
+
+#endif /* CGEN_H */
@@ -0,0 +1,48 @@
+/* check.h */
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stddef.h>
+
+#include "cache.h"
+#include "diag.h"
+#include "unit.h"
+
+typedef enum {
+    STATS_OFF,
+    STATS_TEXT,
+    STATS_JSON,
+} StatsMode;
+
+// What to do with the files that pass
+typedef enum {
+    BACKEND_NONE,
+    BACKEND_VM,           // Execute them
+    BACKEND_JIT,          // Execute them as native code where possible
+    BACKEND_C,            // Translate them to C
+    BACKEND_IR,           // Write their optimised IR
+} Backend;
+
+// Output options
+typedef struct {
+    DiagFormat format;
+    int quiet;
+    Backend backend;
+    StatsMode stats;
+    const Cache *cache;   // Results to reuse and add to, if not NULL
+} Options;
+
+// Apply arg if it is one of the output options (-q, --run, --jit, --emit-c,
+// --dump-ir, --format=, --stats); returns 0 if it is not
+int check_option(const char *arg, Options *options);
+
+// Parse and analyze the source loaded into unit, naming it name, then
+// render its diagnostics into a new buffer *output; with a backend, run it
+// if it passed. With a cache, a source checked before with the same name
+// and options is not parsed: its output comes from the cache. The unit is
+// reset afterwards. Returns 1 if the source did not pass, or with a backend
+// did not run through.
+int check_unit(CompilationUnit *unit, const char *name, const Options *options, char **output,
+               size_t *output_length);
+
+#endif /* CHECK_H */
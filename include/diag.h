@@ -0,0 +1,85 @@
+/* diag.h */
+#ifndef DIAG_H
+#define DIAG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef enum {
+    DIAG_NOTE,
+    DIAG_WARNING,
+    DIAG_ERROR,
+} DiagSeverity;
+
+// Which enum a diagnostic's code belongs to
+typedef enum {
+    DIAG_LEXICAL,   // ErrorType (tokens.h)
+    DIAG_SYNTAX,    // ParseError (parser.h)
+    DIAG_SEMANTIC,  // SemanticErrorType (semantic.h)
+    DIAG_SYMBOL,    // Symbol trace; code unused
+    DIAG_RUNTIME,   // RuntimeError (vm.h)
+} DiagPhase;
+
+// One recorded diagnostic. Nothing is formatted when it is reported: the
+// message is rendered from the code and arguments when the buffer is
+// written out.
+typedef struct {
+    uint8_t severity;      // DiagSeverity
+    uint8_t phase;         // DiagPhase
+    uint16_t code;
+    int line;              // 1-based; 0 when not tied to a line
+    size_t offset;         // Span in the source
+    uint32_t length;
+    const char *text;      // Quoted in the message: the span's text unless
+    int text_length;       // overridden
+    int args[2];           // Code-specific: nesting limit; symbol type, scope
+} Diagnostic;
+
+// Diagnostics of one compilation unit, in the order they were reported.
+// Like the AST columns, the array is kept across units.
+typedef struct {
+    Diagnostic *items;
+    size_t count, capacity;
+    size_t error_count;
+    const char *source;    // Source text spans refer to
+    int trace;             // Record symbol trace notes
+} Diagnostics;
+
+typedef enum {
+    DIAG_FORMAT_TEXT,      // The classic "... Error at line N: ..." lines
+    DIAG_FORMAT_JSONL,     // One JSON object per line
+} DiagFormat;
+
+void diag_init(Diagnostics *diags);
+
+// Forget the recorded diagnostics, keeping the memory
+void diag_reset(Diagnostics *diags, const char *source);
+void diag_free(Diagnostics *diags);
+
+// Record a diagnostic over [offset, offset + length) of the source and
+// return it, so the caller can fill in text or args
+Diagnostic *diag_add(Diagnostics *diags, DiagSeverity severity, DiagPhase phase,
+                     int code, int line, size_t offset, size_t length);
+
+// Write out every diagnostic; path names the unit in JSON Lines output
+void diag_render(const Diagnostics *diags, DiagFormat format, const char *path, FILE *out);
+
+// Write out the diagnostics from index first on
+void diag_render_from(const Diagnostics *diags, size_t first, DiagFormat format, const char *path,
+                      FILE *out);
+
+// Write one diagnostic as text
+void diag_print(const Diagnostic *diag, FILE *out);
+
+// Write text as a quoted, escaped JSON string
+void diag_write_json_string(const char *text, size_t length, FILE *out);
+
+// Write the message of one diagnostic, without its position, as a JSON
+// string
+void diag_write_json_message(const Diagnostic *diag, FILE *out);
+
+// Name of a diagnostic's code as in JSON output, e.g. "undeclared-variable"
+const char *diag_code_name(const Diagnostic *diag);
+
+#endif /* DIAG_H */
@@ -0,0 +1,35 @@
+/* input.h */
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stddef.h>
+
+// Size of each read() when input has to be streamed (pipes, stdin)
+#define INPUT_CHUNK_SIZE (64 * 1024)
+
+// Source text handed to the lexer. The text is always NUL-terminated and is
+// never rewritten: "\r\n" line endings are handled by the lexer.
+typedef struct {
+    const char *data;   // Source text, data[length] == '\0'
+    size_t length;      // Length in bytes, excluding the terminator
+    size_t map_length;  // Size of the mapping when mapped, else 0
+    int mapped;         // data is an mmap'd view of the file
+    int borrowed;       // data belongs to the caller of input_borrow
+} SourceInput;
+
+// Open path ("-" reads stdin). Regular files of at least INPUT_CHUNK_SIZE
+// bytes are memory-mapped with a zero page behind them, so no copy of the
+// file is made; anything else is read in INPUT_CHUNK_SIZE chunks into a
+// growing buffer. Returns 0 on success, -1 on
+// failure with errno describing the reason; nothing is printed, so callers
+// on worker threads can report it in order.
+int input_open(SourceInput *input, const char *path);
+
+// Use the length bytes at data, which must be followed by a '\0', as the
+// source text without copying them; data must outlive the input
+void input_borrow(SourceInput *input, const char *data, size_t length);
+
+// Release the mapping or buffer
+void input_close(SourceInput *input);
+
+#endif /* INPUT_H */
@@ -0,0 +1,52 @@
+/* intern.h */
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+// Stable 32-bit handle for an interned string; equal strings get equal IDs,
+// so names compare with ==. 0 is never a valid ID.
+typedef uint32_t InternId;
+
+#define INTERN_NONE 0
+
+typedef struct {
+    const char *text;    // Interned bytes, NUL-terminated
+    uint32_t length;     // Length in bytes, excluding the terminator
+    uint32_t hash;
+} InternEntry;
+
+typedef struct {
+    InternEntry *entries;   // Indexed by ID; entries[0] is unused
+    uint32_t count;         // Number of IDs handed out, including 0
+    uint32_t capacity;
+    uint32_t *slots;        // Open-addressing table of IDs (0 = empty)
+    uint32_t slot_mask;     // Slot count - 1 (power of two)
+    Arena *arena;           // Storage for the interned bytes
+    char *scratch;          // Decode buffer for string literals
+    size_t scratch_size;
+} Interner;
+
+// Create / destroy an interner. Interned bytes are allocated from arena and
+// live until it is reset; the lookup tables are owned by the interner.
+void intern_init(Interner *interner, Arena *arena);
+void intern_free(Interner *interner);
+
+// Forget every string (call together with resetting the arena); the tables
+// keep their capacity
+void intern_reset(Interner *interner);
+
+// Intern length bytes of text and return their ID
+InternId intern(Interner *interner, const char *text, size_t length);
+
+// Intern the value of a string literal body (the raw text between the
+// quotes), decoding \n, \t, \\ and \" escapes first
+InternId intern_string_literal(Interner *interner, const char *body, size_t length);
+
+// Text of an interned string; length is optional
+const char *intern_text(const Interner *interner, InternId id, size_t *length);
+
+#endif /* INTERN_H */
@@ -0,0 +1,123 @@
+/* ir.h */
+#ifndef IR_H
+#define IR_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "arena.h"
+#include "ast.h"
+#include "bytecode.h"
+#include "unit.h"
+
+// Operations are listed in ir_ops.def
+typedef enum {
+#define IR_OP(name) IR_##name,
+#include "ir_ops.def"
+    IR_OP_COUNT
+} IrOp;
+
+// A value, named by the index of the instruction defining it; IR_NONE is
+// never a valid value
+typedef uint32_t IrValue;
+
+#define IR_NONE 0
+
+// Block of an instruction that has been removed
+#define IR_NO_BLOCK UINT32_MAX
+
+typedef struct {
+    uint8_t op;            // IrOp
+    uint8_t type;          // VarType of the value
+    uint32_t block;        // Block the instruction is in
+    IrValue operands[2];   // A phi's are in the order of its block's preds
+    Value constant;        // IR_CONST; a NULL string is the empty string
+    NodeId node;           // The operator of a DIV_INT, where a division by
+                           // zero is reported; the VARDECL of a PHI or COPY
+} IrInstr;
+
+// How a block ends
+typedef enum {
+    IR_EXIT_RETURN,        // End of the program
+    IR_EXIT_JUMP,          // To succs[0]
+    IR_EXIT_BRANCH,        // To succs[0] if condition is non-zero, else succs[1]
+} IrExit;
+
+// Basic block. The language has no break or goto, so a block has at most
+// two predecessors: the join of an if or of && and ||, and a loop header,
+// whose first predecessor is the block before the loop and whose second is
+// the end of the loop.
+typedef struct {
+    IrValue *code;         // Instructions in order, phis first
+    uint32_t count, capacity;
+    uint32_t preds[2];
+    uint32_t pred_count;
+    uint8_t exit;          // IrExit
+    IrValue condition;
+    uint32_t succs[2];
+    int removed;           // Unreachable, and emptied
+} IrBlock;
+
+// A program in SSA form: a control-flow graph over blocks of instructions,
+// block 0 being the entry
+typedef struct Ir {
+    CompilationUnit *unit; // Source of names and positions
+    IrInstr *values;       // Indexed by IrValue
+    uint32_t value_count, value_capacity;
+    IrBlock *blocks;
+    uint32_t block_count, block_capacity;
+    Arena strings;         // String constants
+    IrValue *constant_table;   // Open addressing; see ir_constant
+    uint32_t constant_capacity, constant_count;
+
+    // Filled by ir_analyze
+    uint32_t *order;       // Reachable blocks in reverse postorder
+    uint32_t order_count;
+    uint32_t *order_index; // Position of each block in order
+    uint32_t *idom;        // Immediate dominator; the entry's is itself
+    uint32_t *dom_enter;   // When a depth-first walk of the dominator tree
+    uint32_t *dom_exit;    // enters and leaves each block, so dominance
+                           // is nesting of these intervals
+} Ir;
+
+void ir_init(Ir *ir);
+void ir_free(Ir *ir);
+
+// Lower the program at root, which must have passed semantic analysis
+void ir_build(Ir *ir, CompilationUnit *unit, NodeId root);
+
+// Optimise in place: constant and copy propagation, jump threading, common
+// subexpression elimination, loop-invariant code motion and dead code
+// elimination
+void ir_optimize(Ir *ir);
+
+// Write the IR out as text
+void ir_print(const Ir *ir, FILE *out);
+
+// Compute the block order and dominators; needed again after the
+// control-flow graph changes
+void ir_analyze(Ir *ir);
+
+// Does block a dominate block b? Both must be reachable. Constant time.
+int ir_dominates(const Ir *ir, uint32_t a, uint32_t b);
+
+// Give each value with slotted[v] set a slot in homes[v], and return the
+// number of slots. A phi shares its slot with the operands whose live
+// ranges do not overlap its own, so that the copies on the edges into its
+// block vanish; the rest of homes is left as it was.
+uint32_t ir_assign_slots(const Ir *ir, const uint8_t *slotted, uint32_t *homes);
+
+// Number of operands of an instruction
+int ir_operand_count(const Ir *ir, IrValue value);
+
+// Append a new instruction to block, or with IR_NO_BLOCK to no block
+IrValue ir_add(Ir *ir, uint32_t block, IrOp op, VarType type, IrValue a, IrValue b);
+
+// Integer, float or string constant of the given type, shared with any
+// equal constant made before
+IrValue ir_constant(Ir *ir, VarType type, Value value);
+
+// Remove block's predecessor pred, and the matching operand of its phis
+void ir_remove_pred(Ir *ir, uint32_t block, uint32_t pred);
+
+#endif /* IR_H */
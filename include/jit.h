@@ -0,0 +1,22 @@
+/* jit.h */
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdio.h>
+
+#include "ir.h"
+
+// Native code for x86-64 programs whose variables and expressions are all
+// int; other programs, and other machines, run on the VM instead
+
+// Can jit_run compile the program in ir?
+int jit_supported(const Ir *ir);
+
+// Compile the program in ir, optimised or not, to machine code and execute
+// it, writing what it prints to out. A runtime error stops the program and
+// is recorded in the diagnostics of ir's unit, as the VM does. Returns 1 if
+// the program ran to completion, 0 if it stopped with an error, -1 if it
+// could not be compiled.
+int jit_run(const Ir *ir, FILE *out);
+
+#endif /* JIT_H */
@@ -0,0 +1,42 @@
+/* json.h */
+#ifndef JSON_H
+#define JSON_H
+
+#include <stddef.h>
+
+#include "arena.h"
+
+typedef enum {
+    JSON_NULL,
+    JSON_FALSE,
+    JSON_TRUE,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT,
+} JsonType;
+
+// A parsed JSON value. The elements of an array and the members of an
+// object are a list through next.
+typedef struct JsonValue {
+    JsonType type;
+    double number;
+    const char *string;        // Decoded and NUL-terminated, for a string
+    size_t length;
+    const char *key;           // Name of an object member
+    size_t key_length;
+    struct JsonValue *first;   // First element or member
+    struct JsonValue *next;    // Next element or member of the parent
+} JsonValue;
+
+// Deepest nesting of arrays and objects accepted
+#define JSON_MAX_DEPTH 256
+
+// Parse length bytes of text as one JSON value, allocating from arena;
+// NULL if it is not well-formed
+JsonValue *json_parse(Arena *arena, const char *text, size_t length);
+
+// Member key of an object; NULL if value is not an object or has none
+const JsonValue *json_get(const JsonValue *value, const char *key);
+
+#endif /* JSON_H */
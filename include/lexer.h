@@ -2,11 +2,33 @@
 #ifndef LEXER_H
 #define LEXER_H
 
+#include <stdio.h>
+
 #include "tokens.h"
 
+// Lexer state for one input. Each compilation unit has its own, so units
+// can be lexed concurrently.
+typedef struct {
+    const char* input;     // NUL-terminated source text
+    size_t position;       // Offset of the next token
+    Interner* interner;    // Receives identifiers and string literal values
+    size_t* line_starts;   // Offset of the first byte of each line, built on
+    int line_count;        // first use by source_line
+} Lexer;
+
 // Lexer functions that need to be visible to other files
-Token get_next_token(const char* input, int* pos);
-void print_token(Token token);
-void print_error(ErrorType error, int line, const char* lexeme);
+// interner receives every identifier and string literal value; it may be
+// NULL when only the token stream is needed
+void lexer_init(Lexer* lexer, const char* input, Interner* interner);
+void lexer_free(Lexer* lexer);
+Token get_next_token(Lexer* lexer);
+void print_token(Lexer* lexer, Token token);
+void print_error(FILE* out, ErrorType error, int line, const char* lexeme, int length);
+int is_keyword(const char* word, int length);
+
+// Map a byte offset / token to its 1-based line number. The line-offset table
+// is built lazily on the first call, so the lexer itself never tracks lines.
+int source_line(Lexer* lexer, size_t offset);
+int token_line(Lexer* lexer, Token token);
 
 #endif /* LEXER_H */
\ No newline at end of file
@@ -0,0 +1,30 @@
+/* lexer_simd.h */
+#ifndef LEXER_SIMD_H
+#define LEXER_SIMD_H
+
+#include <stddef.h>
+
+// Run-skipping kernels used by the lexer's DFA fast paths. Each returns a
+// pointer to the first byte at or after p that ends the run; the NUL
+// terminator always ends a run. Kernels only issue aligned vector loads, so
+// they never read across a page boundary past the terminator.
+//
+// The AVX2, SSE2 or scalar implementation is picked on first use from the
+// running CPU. Build with -DLEXER_NO_SIMD to force the scalar versions.
+
+// First byte that is not ' ', '\t', '\r' or '\n'
+const char* simd_skip_space(const char* p);
+
+// First byte that is not [A-Za-z0-9_]
+const char* simd_skip_ident(const char* p);
+
+// First byte equal to a, b or NUL
+const char* simd_find_byte2(const char* p, char a, char b);
+
+// Number of '\n' bytes before the NUL terminator
+size_t simd_count_newlines(const char* p);
+
+// Name of the selected implementation ("avx2", "sse2" or "scalar")
+const char* simd_implementation(void);
+
+#endif /* LEXER_SIMD_H */
@@ -0,0 +1,77 @@
+/* lsp.h
+ * Language server: keeps each open document checked as it is edited and
+ * publishes its diagnostics, speaking the Language Server Protocol over
+ * stdio.
+ *
+ * A document is checked one top-level statement at a time. Each statement
+ * is a segment, checked alone against the state its names are in when it
+ * starts: declared or not, with which type, assigned on every path or not.
+ * An edit re-parses only the segments whose text it touches, and a segment
+ * whose text is unchanged is checked again only when the state one of its
+ * names starts in has changed, so a keystroke costs work in proportion to
+ * what it changes rather than to the size of the document.
+ */
+#ifndef LSP_H
+#define LSP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "unit.h"
+
+typedef struct Segment Segment;
+typedef struct Name Name;
+
+// A segment and where it starts, which is where the previous one ends
+typedef struct {
+    size_t start;
+    Segment *segment;
+} PlacedSegment;
+
+// An open document
+typedef struct {
+    char *text;              // NUL-terminated
+    size_t length, capacity;
+    size_t *line_starts;     // Offset of each line's first byte
+    size_t line_count, line_capacity;
+
+    PlacedSegment *segments; // In document order
+    size_t segment_count, segment_capacity;
+    Segment **diagnosed;     // Those with diagnostics, in document order
+    size_t diagnosed_count, diagnosed_capacity;
+    Name **names;            // Every name any segment has used, by hash
+    uint32_t name_count, name_capacity;
+    uint32_t mark;           // Tags the names gathered by one check
+
+    Segment **queue;         // Segments to check, a heap by position
+    size_t queue_count, queue_capacity;
+    CompilationUnit unit;    // Checks one segment at a time
+    char *scratch;           // The segment being checked, NUL-terminated
+    size_t scratch_capacity;
+
+    // Work done by the last edit
+    size_t parsed;           // Statements parsed to find the new segments
+    size_t checked;          // Segments checked
+} Document;
+
+Document *document_open(const char *text, size_t length);
+void document_close(Document *doc);
+
+// Replace bytes [start, end) of the document with length bytes of text and
+// check again what that affects
+void document_edit(Document *doc, size_t start, size_t end, const char *text, size_t length);
+
+// Byte offset of an LSP position: a 0-based line and a character offset
+// in UTF-16 code units, clamped to the line
+size_t document_offset(const Document *doc, uint32_t line, uint32_t character);
+
+// Write the document's diagnostics as a JSON array of LSP Diagnostics
+void document_write_diagnostics(const Document *doc, FILE *out);
+
+// Serve requests read from in, writing replies and notifications to out,
+// until the client sends exit. Returns 0 if it had asked for shutdown
+// first, as the protocol has it, else 1.
+int lsp_run(FILE *in, FILE *out);
+
+#endif /* LSP_H */
@@ -1,68 +1,93 @@
-/* parser.h */
-#ifndef PARSER_H
-#define PARSER_H
-
-#include "tokens.h"
-
-// Basic node types for AST
-typedef enum {
-    AST_PROGRAM,        // Program node
-    AST_VARDECL,        // Variable declaration (int x)
-    AST_ASSIGN,         // Assignment (x = 5)
-    AST_PRINT,          // Print statement
-    AST_NUMBER,         // Number literal
-    AST_STRING_LITERAL,  // String literal
-    AST_IDENTIFIER,     // Variable name
-    AST_IF,
-    AST_CONDITION,
-    AST_WHILE,
-    AST_REPEAT,
-    AST_BLOCK,
-    AST_FACTORIAL,
-    AST_BINOP,
-    AST_COMPARISON
-} ASTNodeType;
-
-typedef enum {
-    PARSE_ERROR_NONE,
-    PARSE_ERROR_UNEXPECTED_TOKEN,
-    PARSE_ERROR_MISSING_SEMICOLON,
-    PARSE_ERROR_MISSING_IDENTIFIER,
-    PARSE_ERROR_MISSING_EQUALS,
-    PARSE_ERROR_INVALID_EXPRESSION,
-    PARSE_ERROR_MISSING_LPAREN,
-    PARSE_ERROR_MISSING_RPAREN,
-    PARSE_ERROR_MISSING_LBRACE,
-    PARSE_ERROR_MISSING_RBRACE,
-    PARSE_ERROR_MISSING_LBRACK,
-    PARSE_ERROR_MISSING_RBRACK,
-    PARSE_ERROR_INVALID_STATEMENT,
-    PARSE_ERROR_MISSING_UNTIL,
-    PARSE_ERROR_INVALID_COMPARISON,
-} ParseError;
-
-typedef enum {
-    TYPE_INT,
-    TYPE_CHAR,
-    TYPE_FLOAT,
-    TYPE_STRING
-} VarType;
-
-// AST Node structure
-typedef struct ASTNode {
-    ASTNodeType type;           // Type of node
-    Token token;               // Token associated with this node
-    struct ASTNode* left;      // Left child
-    struct ASTNode* right;     // Right child
-    struct ASTNode* next;
-    VarType var_type;         // Variable type (if applicable)
-} ASTNode;
-
-// Parser functions
-void parser_init(const char* input);
-ASTNode* parse(void);
-void print_ast(ASTNode* node, int level);
-void free_ast(ASTNode* node);
-const char* var_type_to_string(VarType type);
-
+/* parser.h */
+#ifndef PARSER_H
+#define PARSER_H
+
+#include "diag.h"
+#include "lexer.h"
+#include "tokens.h"
+#include "unit.h"
+
+typedef enum {
+    PARSE_ERROR_NONE,
+    PARSE_ERROR_UNEXPECTED_TOKEN,
+    PARSE_ERROR_MISSING_SEMICOLON,
+    PARSE_ERROR_MISSING_IDENTIFIER,
+    PARSE_ERROR_MISSING_EQUALS,
+    PARSE_ERROR_INVALID_EXPRESSION,
+    PARSE_ERROR_MISSING_LPAREN,
+    PARSE_ERROR_MISSING_RPAREN,
+    PARSE_ERROR_MISSING_LBRACE,
+    PARSE_ERROR_MISSING_RBRACE,
+    PARSE_ERROR_MISSING_LBRACK,
+    PARSE_ERROR_MISSING_RBRACK,
+    PARSE_ERROR_INVALID_STATEMENT,
+    PARSE_ERROR_MISSING_UNTIL,
+    PARSE_ERROR_INVALID_COMPARISON,
+    PARSE_ERROR_NESTING_TOO_DEEP,
+    PARSE_ERROR_TOO_MANY_ERRORS,
+} ParseError;
+
+// Deepest nesting of statements and parentheses the parser accepts before
+// reporting an error; keeps recursion well inside the default 8 MB stack
+#ifndef PARSER_MAX_DEPTH
+#define PARSER_MAX_DEPTH 10000
+#endif
+
+// Syntax errors reported before the parser gives up on the rest of the input
+#ifndef PARSER_MAX_ERRORS
+#define PARSER_MAX_ERRORS 50
+#endif
+
+// Parser state for one compilation unit; separate parsers can run on
+// separate threads
+typedef struct {
+    Lexer *lexer;
+    Ast *ast;
+    const char *source;
+    Diagnostics *diags;          // Where syntax errors are recorded
+    Token current_token;
+
+    // Index of current_token in the AST's token columns, if already recorded
+    uint32_t current_token_index;
+    int current_token_recorded;
+    size_t previous_end;         // End of the last token consumed, quotes
+                                 // included; where lexing started before
+                                 // the first
+
+    // Nesting of statements and parenthesised expressions being parsed
+    int depth;
+    int max_depth;
+
+    // Error recovery: after reporting an error the parser is panicking, and
+    // further errors are suppressed until the broken statement has been
+    // skipped. Once max_errors have been reported, or nesting is too deep to
+    // continue, the parser stops and treats the rest of the input as missing.
+    int panicking;
+    int stopped;
+    int error_count;
+    int max_errors;
+
+    uint64_t tokens;             // Tokens pulled from the lexer, for --stats
+} Parser;
+
+// Parser functions
+// The tree is built into the unit's Ast and released with it. Syntax errors
+// are reported and recovered from: each broken statement becomes an
+// AST_ERROR node and parsing continues with the next one.
+void parser_init(Parser* p, CompilationUnit* unit);
+NodeId parse(Parser* p);
+
+// Parse the next top-level statement alone, for callers that take a
+// program one statement at a time; AST_NONE at the end of the input, or
+// once the parser has stopped. The statement's source, with the space
+// before it, runs from previous_end before the call to previous_end after
+// it, and it gets max_errors of its own.
+NodeId parse_next_statement(Parser* p);
+void parser_set_max_depth(Parser* p, int limit);
+void parser_set_max_errors(Parser* p, int limit);
+
+// Syntax errors reported by the last parse
+int parser_error_count(const Parser* p);
+void print_ast(const CompilationUnit* unit, NodeId node, int level);
+
 #endif /* PARSER_H */
\ No newline at end of file
@@ -6,33 +6,102 @@
 
 // Basic symbol structure
 typedef struct Symbol {
-    char name[100];      // Variable name
+    InternId name;       // Variable name
     VarType type;            // Data type (int, etc.)
     int scope_level;     // Scope nesting level
     int line_declared;   // Line where declared
-    int is_initialized;  // Has been assigned a value?
-    struct Symbol *next; // For linked list implementation
+    NodeId decl;         // VARDECL that declared it
+    struct Symbol *shadowed;   // Outer declaration of the same name
+    struct Symbol *scope_next; // Next symbol declared in the same scope
 } Symbol;
 
+// Hash table slot: a name and its innermost visible declaration, whose
+// shadowed chain leads to the outer ones. A slot keeps its name once used,
+// with symbol NULL while no declaration is visible.
+typedef struct {
+    InternId name;
+    Symbol *symbol;
+} SymbolSlot;
+
 // Symbol table
+// Open-addressing hash table keyed by interned name, plus a scope stack
+// holding the symbols each open scope declared, so declaring and looking up
+// are O(1) and leaving a scope costs only that scope's symbols
 typedef struct {
-    Symbol *head;      // First symbol in the table
+    SymbolSlot *slots;     // Linear probing, capacity is a power of two
+    uint32_t capacity;
+    uint32_t used;         // Slots holding a name
+    Symbol **scopes;       // Symbols declared by each open scope
+    int scope_capacity;
     int current_scope; // Current scope level
+    Arena *arena;      // Symbols are allocated from here
+    Symbol *free_list; // Symbols of exited scopes, reused by add_symbol
+    Interner *names;   // Spells symbol names for the trace
+    Diagnostics *trace; // add_symbol notes each symbol here; NULL for none
+
+    // Counted only when built with STATS
+    uint64_t symbols;         // add_symbol calls
+    uint64_t lookups;         // lookup_symbol calls
+    uint64_t probes;          // Slots examined by lookup_symbol
+    uint64_t scopes_entered;
+    uint64_t scopes_exited;
 } SymbolTable;
 
+// Work stacks of resolve_names, check_statement and check_expression
+typedef struct {
+    NodeId node;
+    int exit_scope; // Leave the block's scope, restoring live
+    uint32_t live;  // Slots in use outside the block
+} ResolveFrame;
+
+typedef struct {
+    NodeId node;
+    int started;   // Nested statements are being checked
+    NodeId cursor; // Next statement of a block
+} StatementFrame;
+
+typedef struct {
+    NodeId node;
+    int state;     // Operands pushed so far
+    int result;    // Operands checked so far all passed
+} ExpressionFrame;
+
+// Analyzer state for one compilation unit, so units can be analyzed on
+// separate threads
+typedef struct {
+    Ast *ast;                // AST being analyzed
+    const char *source;      // Buffer it was parsed from
+    Lexer *lexer;            // Maps offsets in source to lines
+    Diagnostics *diags;      // Where semantic errors are recorded
+    uint8_t *uninitialized;  // Per IDENTIFIER: may it be read before it is
+                             // assigned? Set by analyze_initialization
+    uint32_t assigned_slots; // Slots below this hold outer variables that
+                             // are assigned on entry
+    uint8_t *exit_assigned;  // Per slot, if not NULL: is it assigned on
+                             // every path to the end? Set likewise
+
+    ResolveFrame *resolve_stack;
+    size_t resolve_count, resolve_capacity;
+    StatementFrame *statement_stack;
+    size_t statement_count, statement_capacity;
+    ExpressionFrame *expression_stack;
+    size_t expression_count, expression_capacity;
+} Analyzer;
+
 // Initialize a new symbol table
-// Creates an empty symbol table structure with scope level set to 0
-SymbolTable *init_symbol_table();
+// Creates an empty symbol table structure with scope level set to 0, whose
+// memory comes from arena and is released when the arena is reset
+SymbolTable *init_symbol_table(Arena *arena);
 
 // Add a symbol to the table
 // Inserts a new variable with given name, type, and line number into the
 // current scope
-void add_symbol(SymbolTable *table, const char *name, VarType type, int line);
+void add_symbol(SymbolTable *table, InternId name, VarType type, int line);
 
 // Look up a symbol in the table
 // Searches for a variable by name across all accessible scopes
 // Returns the symbol if found, NULL otherwise
-Symbol *lookup_symbol(SymbolTable *table, const char *name);
+Symbol *lookup_symbol(SymbolTable *table, InternId name);
 
 // Enter a new scope level
 // Increments the current scope level when entering a block (e.g., if, while)
@@ -47,36 +116,65 @@ void exit_scope(SymbolTable *table);
 // Cleans up symbols that are no longer accessible after leaving a scope
 void remove_symbols_in_current_scope(SymbolTable *table);
 
-// Free the symbol table memory
-// Releases all allocated memory when the symbol table is no longer needed
-void free_symbol_table(SymbolTable *table);
-
 // Main semantic analysis function
-int analyze_semantics(ASTNode *ast);
+// root is the PROGRAM node of the unit's AST; errors and the symbol trace are
+// recorded in the unit's diagnostics
+int analyze_semantics(NodeId root, CompilationUnit *unit);
+
+// A variable declared at scope 0 by source outside the program analyzed,
+// such as the statements before it in a document checked a statement at a
+// time by the language server
+typedef struct {
+    InternId name;
+    VarType type;
+    int assigned;        // Assigned on every path through that source
+} OuterVariable;
+
+// analyze_semantics for a program that continues separately checked
+// source: the outer variables, whose names must differ, are visible at
+// scope 0 as if declared before root. On return *scope lists every
+// variable at scope 0 after the program, outer ones included, with whether
+// every path through both assigns it; it is allocated from the unit's
+// arena.
+int analyze_fragment(NodeId root, CompilationUnit *unit, const OuterVariable *outer,
+                     size_t outer_count, OuterVariable **scope, size_t *scope_count);
+
+// Resolve every name once: binds each IDENTIFIER to its VARDECL and gives
+// each VARDECL a frame slot, reporting undeclared and redeclared variables.
+// The check_* functions below run afterwards and use the bindings.
+int resolve_names(Analyzer *sema, NodeId root, SymbolTable *table);
+
+// Flag every read of a variable that some path reaches without assigning
+// it; runs after resolve_names, and check_expression reports the reads
+// flagged. See dataflow.c.
+void analyze_initialization(Analyzer *sema, NodeId root);
 
 // Check a variable declaration
-int check_declaration(ASTNode *node, SymbolTable *table);
+int check_declaration(Analyzer *sema, NodeId node, SymbolTable *table);
 
 // Check a variable assignment
-int check_assignment(ASTNode *node, SymbolTable *table);
+int check_assignment(Analyzer *sema, NodeId node);
 
 // Check an expression for type correctness
-int check_expression(ASTNode *node, SymbolTable *table);
+int check_expression(Analyzer *sema, NodeId node);
 
 // Check a block of statements, handling scope
-int check_block(ASTNode *node, SymbolTable *table);
+int check_block(Analyzer *sema, NodeId node);
 
 // Check a condition (e.g., in if statements)
-int check_condition(ASTNode *node, SymbolTable *table);
+int check_condition(Analyzer *sema, NodeId node);
 
 // Check program node
-int check_program(ASTNode *node, SymbolTable *table);
+int check_program(Analyzer *sema, NodeId node);
 
 // Check statement node
-int check_statement(ASTNode *node, SymbolTable *table);
+int check_statement(Analyzer *sema, NodeId node);
+
+// Check a statement and the siblings following it
+int check_statements(Analyzer *sema, NodeId node);
 
 // Check assignment node
-int check_assignment(ASTNode *node, SymbolTable *table);
+int check_assignment(Analyzer *sema, NodeId node);
 
 typedef enum {
     SEM_ERROR_NONE,
@@ -89,6 +187,7 @@ typedef enum {
 } SemanticErrorType;
 
 // Report semantic errors
-void semantic_error(SemanticErrorType error, const char *name, int line);
+// Records error over [offset, offset + length) of the source
+void semantic_error(Diagnostics *diags, SemanticErrorType error, size_t offset, size_t length, int line);
 
 #endif /* SEMANTIC_H */
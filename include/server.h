@@ -0,0 +1,46 @@
+/* server.h
+ * Compile server: checks sources on request over a Unix domain socket, so
+ * a check costs neither a process start nor cold allocations.
+ *
+ * A connection carries any number of requests, each answered in turn. A
+ * request is one header line of tab-separated fields:
+ *
+ *     check  TAB options TAB name TAB path   LF
+ *     source TAB options TAB name TAB length LF  followed by length bytes
+ *
+ * "check" reads the file at path, "source" checks the bytes that follow.
+ * options is a space-separated list of the driver's output options (-q,
+ * --format=jsonl, --run, ...), possibly empty; --stats is ignored. name is
+ * what the diagnostics call the source. The reply is
+ *
+ *     status TAB length LF  followed by length bytes
+ *
+ * where status is "passed", "failed" (did not pass, or with a backend did
+ * not run through) or "error", and the bytes are what the driver would
+ * write for the file, or for an error a message. A malformed request, or
+ * a source longer than SERVER_MAX_SOURCE or too large to hold, is answered
+ * with an error and the connection closed.
+ */
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stddef.h>
+
+#include "check.h"
+
+// Longest source a request may send; the language server takes messages
+// of up to the same length
+#define SERVER_MAX_SOURCE ((size_t)256 << 20)
+
+// Listen on socket_path with worker_count threads, each keeping its own
+// CompilationUnit warm across requests, until SIGINT or SIGTERM; then
+// remove the socket. Returns 0, or 1 if the socket could not be set up.
+int server_run(const char *socket_path, int worker_count);
+
+// Check each of the paths through the server at socket_path, "-" sending
+// stdin as source, and write the results out like the driver does.
+// Returns the number of paths that could not be read, or with a backend
+// that failed to check or run; -1 if the server could not be reached.
+int client_run(const char *socket_path, char *const *paths, size_t count, const Options *options);
+
+#endif /* SERVER_H */
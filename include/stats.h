@@ -0,0 +1,82 @@
+/* stats.h */
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ast.h"
+
+// Build with STATS=0 to compile the counters in the hot paths away; --stats
+// then reports timings and AST totals only
+#ifndef STATS
+#define STATS 1
+#endif
+
+#if STATS
+#define STATS_INC(counter) ((counter)++)
+#define STATS_ADD(counter, n) ((counter) += (n))
+#else
+#define STATS_INC(counter) ((void)0)
+#define STATS_ADD(counter, n) ((void)0)
+#endif
+
+typedef enum {
+    PHASE_LOAD,       // Opening / mapping the file
+    PHASE_CACHE,      // Hashing it and reading or writing its cache entry
+    PHASE_PARSE,      // Parsing, including the lexing it pulls as it goes
+    PHASE_ANALYZE,    // Name resolution and type checking
+    PHASE_RUN,        // Compiling to bytecode and executing, with --run
+    PHASE_RENDER,     // Formatting diagnostics
+    PHASE_COUNT
+} Phase;
+
+// Point in time on both clocks
+typedef struct {
+    double wall;      // Monotonic seconds
+    double cpu;       // CPU seconds of the calling thread
+} StatsTime;
+
+// Counters and timings, summed over every file checked
+typedef struct {
+    double wall[PHASE_COUNT];
+    double cpu[PHASE_COUNT];
+    uint64_t files;
+    uint64_t tokens;
+    uint64_t nodes[AST_KIND_COUNT];
+    size_t peak_ast_bytes;     // Largest single AST
+
+    // Symbol table
+    uint64_t symbols;          // Declarations added
+    uint64_t peak_names;       // Most distinct names in one table
+    uint64_t peak_slots;       // Largest slot array
+    uint64_t lookups;          // lookup_symbol calls
+    uint64_t probes;           // Slots examined by those lookups
+    uint64_t scopes_entered;
+    uint64_t scopes_exited;
+
+    // Result cache, with --cache
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+    uint64_t cache_evicted;        // Entries deleted to keep within the limit
+    uint64_t cache_evicted_bytes;
+} Stats;
+
+StatsTime stats_now(void);
+
+// Charge the time since *since to phase and restart *since from now
+void stats_phase(Stats *stats, Phase phase, StatsTime *since);
+
+// Count the nodes of a freshly parsed AST
+void stats_count_ast(Stats *stats, const Ast *ast);
+
+void stats_merge(Stats *into, const Stats *from);
+
+// Human-readable report; elapsed is the wall time of the whole run
+void stats_print_text(const Stats *stats, double elapsed, FILE *out);
+
+// The same report as one JSON object on one line
+void stats_print_json(const Stats *stats, double elapsed, FILE *out);
+
+#endif /* STATS_H */
@@ -2,39 +2,15 @@
 #ifndef TOKENS_H
 #define TOKENS_H
 
+#include <stddef.h>
+
+#include "intern.h"
+
+// Token types are listed in tokens.def together with the lexical rules
 typedef enum
 {
-    TOKEN_NUMBER,           // e.g., "123", "3.14" (if you add floating point support)
-    TOKEN_IDENTIFIER,       // e.g., variable names, function names
-    TOKEN_STRING_LITERAL,   // e.g., "Hello World"
-    TOKEN_OPERATOR,         // e.g., "+", "-", "*", "/"
-    TOKEN_COMPARISON,       // e.g., "<", ">", "==", "<=", ">=", "!=", "&&", "||"
-    TOKEN_EQUALS,           // =
-    TOKEN_SEMICOLON,        // ;
-    TOKEN_LPAREN,           // (
-    TOKEN_RPAREN,           // )
-    TOKEN_LBRACE,           // {
-    TOKEN_RBRACE,           // }
-    TOKEN_LBRACK,           // [
-    TOKEN_RBRACK,           // ]
-    TOKEN_IF,               // if 
-    TOKEN_ELSE,             // else
-    TOKEN_REPEAT,           // repeat
-    TOKEN_UNTIL,            // until
-    TOKEN_FOR,              // for
-    TOKEN_WHILE,            // while
-    TOKEN_BREAK,            // break 
-    TOKEN_PRINT,            // print statement keyword
-    TOKEN_FACTORIAL,        // print statement keyword
-    TOKEN_RETURN,           // return
-    TOKEN_VOID,             // void
-    TOKEN_CONST,            // const
-    TOKEN_INT,              // int 
-    TOKEN_FLOAT,            // float
-    TOKEN_CHAR,             // char
-    TOKEN_STRING,           // string
-    TOKEN_EOF,              // End Of File
-    TOKEN_ERROR             // Generic error token
+#define TOKEN(name) name,
+#include "tokens.def"
 } TokenType;
 
 typedef enum
@@ -46,15 +22,21 @@ typedef enum
     ERROR_INVALID_IDENTIFIER,
     ERROR_UNEXPECTED_TOKEN,
     ERROR_UNTERMINATED_STRING,     // e.g., "Hello
-    ERROR_UNKNOWN_ESCAPE_SEQUENCE  // e.g., "\q"
+    ERROR_UNKNOWN_ESCAPE_SEQUENCE, // e.g., "\q"
+    ERROR_UNTERMINATED_COMMENT     // e.g., /* comment
 } ErrorType;
 
+// Tokens do not own their text: the lexeme is the span [start, start + length)
+// of the source buffer they were lexed from, and the line number is derived
+// from start on demand (see token_line in lexer.h). Identifiers and string
+// literal values are also interned, so they can be compared by id.
 typedef struct
 {
     TokenType type;
-    char lexeme[100]; // Actual text of the token
-    int line;         // Line number in source file
     ErrorType error;  // Error type if any
+    size_t start;     // Byte offset of the lexeme in the source buffer
+    size_t length;    // Length of the lexeme in bytes
+    InternId id;      // Interned name / literal value, INTERN_NONE otherwise
 } Token;
 
 #endif /* TOKENS_H */
\ No newline at end of file
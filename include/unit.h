@@ -0,0 +1,45 @@
+/* unit.h */
+#ifndef UNIT_H
+#define UNIT_H
+
+#include "arena.h"
+#include "ast.h"
+#include "diag.h"
+#include "input.h"
+#include "intern.h"
+#include "lexer.h"
+#include "stats.h"
+
+// A compilation unit: one source text and everything derived from it.
+// Symbols and interned strings are allocated from the unit's arena and the
+// AST's columns are kept across files, so releasing a file's data is one
+// O(1) unit_reset and the unit can be reused for the next file without going
+// back to malloc. A unit holds no shared state, so separate units can be
+// checked on separate threads.
+typedef struct {
+    SourceInput input;   // Source text being checked
+    Arena arena;         // Owns the symbols and interned strings
+    Interner interner;   // Identifiers and string literal values
+    Ast ast;             // Syntax tree of the source
+    Lexer lexer;         // Token stream and line table of the source
+    Diagnostics diags;   // Reported while checking, rendered by the caller
+    Stats stats;         // Summed over every file checked with the unit
+    int loaded;          // input holds an open file
+} CompilationUnit;
+
+void unit_init(CompilationUnit *unit);
+
+// Open path as the unit's source; returns 0 on success
+int unit_load(CompilationUnit *unit, const char *path);
+
+// Use source, length bytes followed by a '\0', as the unit's source
+// without copying it; the caller keeps it alive until the unit is reset
+void unit_load_source(CompilationUnit *unit, const char *source, size_t length);
+
+// Release the source and everything allocated for it, keeping the memory
+// for the next file
+void unit_reset(CompilationUnit *unit);
+
+void unit_free(CompilationUnit *unit);
+
+#endif /* UNIT_H */
@@ -0,0 +1,30 @@
+/* vm.h */
+#ifndef VM_H
+#define VM_H
+
+#include <stdio.h>
+
+#include "bytecode.h"
+#include "diag.h"
+
+typedef enum {
+    RUNTIME_ERROR_NONE,
+    RUNTIME_ERROR_DIVISION_BY_ZERO,
+} RuntimeError;
+
+// Execute chunk, writing what the program prints to out. A runtime error
+// stops the program and is recorded in diags. Returns 1 if the program ran
+// to completion, 0 otherwise.
+int vm_run(const Chunk *chunk, FILE *out, Diagnostics *diags);
+
+// n!, wrapping around like int arithmetic; 1 for n < 2
+int64_t vm_factorial(int64_t n);
+
+// C's truncation, with NaN and out-of-range values pinned instead of
+// undefined
+int64_t vm_float_to_int(double f);
+
+// <0, 0 or >0 as a orders before, equal to or after b, bytewise
+int vm_compare_strings(const VmString *a, const VmString *b);
+
+#endif /* VM_H */
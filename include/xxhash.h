@@ -0,0 +1,13 @@
+/* xxhash.h
+ * XXH64, the 64-bit xxHash of Yann Collet: a fast non-cryptographic hash
+ * whose output matches the reference implementation's for the same seed.
+ */
+#ifndef XXHASH_H
+#define XXHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint64_t xxh64(const void *data, size_t length, uint64_t seed);
+
+#endif /* XXHASH_H */
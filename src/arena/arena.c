@@ -0,0 +1,87 @@
+/* arena.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/arena.h"
+
+#define ARENA_ALIGN 16
+
+struct ArenaChunk {
+    ArenaChunk *next;
+    size_t size;
+    _Alignas(ARENA_ALIGN) char data[];
+};
+
+static ArenaChunk *new_chunk(size_t size) {
+    ArenaChunk *chunk = malloc(sizeof(ArenaChunk) + size);
+    if (!chunk) {
+        fprintf(stderr, "Memory allocation failed\n");
+        abort();
+    }
+    chunk->next = NULL;
+    chunk->size = size;
+    return chunk;
+}
+
+static void use_chunk(Arena *arena, ArenaChunk *chunk) {
+    arena->current = chunk;
+    arena->ptr = chunk->data;
+    arena->end = chunk->data + chunk->size;
+}
+
+void arena_init(Arena *arena) {
+    arena->first = new_chunk(ARENA_CHUNK_SIZE);
+    arena->allocated = 0;
+    use_chunk(arena, arena->first);
+}
+
+// Slow path: move on to the next kept chunk if it is big enough, otherwise
+// link a new one in after the current chunk
+static void *alloc_slow(Arena *arena, size_t size) {
+    ArenaChunk *next = arena->current->next;
+    if (!next || next->size < size) {
+        ArenaChunk *chunk = new_chunk(size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE);
+        chunk->next = next;
+        arena->current->next = chunk;
+        next = chunk;
+    }
+    use_chunk(arena, next);
+
+    void *result = arena->ptr;
+    arena->ptr += size;
+    return result;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    arena->allocated += size;
+    if ((size_t)(arena->end - arena->ptr) < size) {
+        return alloc_slow(arena, size);
+    }
+    void *result = arena->ptr;
+    arena->ptr += size;
+    return result;
+}
+
+void *arena_calloc(Arena *arena, size_t size) {
+    void *result = arena_alloc(arena, size);
+    memset(result, 0, size);
+    return result;
+}
+
+void arena_reset(Arena *arena) {
+    arena->allocated = 0;
+    use_chunk(arena, arena->first);
+}
+
+void arena_free(Arena *arena) {
+    ArenaChunk *chunk = arena->first;
+    while (chunk) {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->first = arena->current = NULL;
+    arena->ptr = arena->end = NULL;
+}
@@ -0,0 +1,127 @@
+/* ast.c */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../../include/ast.h"
+
+#define AST_INITIAL_CAPACITY 1024
+
+static void *grow(void *column, size_t capacity, size_t size) {
+    void *result = realloc(column, capacity * size);
+    if (!result) {
+        fprintf(stderr, "Memory allocation failed\n");
+        abort();
+    }
+    return result;
+}
+
+void ast_init(Ast *ast) {
+    ast->kind = NULL;
+    ast->var_type = NULL;
+    ast->first_child = NULL;
+    ast->next_sibling = NULL;
+    ast->token = NULL;
+    ast->binding = NULL;
+    ast->capacity = 0;
+    ast->token_start = NULL;
+    ast->token_length = NULL;
+    ast->token_id = NULL;
+    ast->token_capacity = 0;
+    ast_reset(ast);
+}
+
+uint32_t ast_add_token(Ast *ast, Token token) {
+    if (ast->token_count == ast->token_capacity) {
+        uint32_t capacity = ast->token_capacity ? ast->token_capacity * 2 : AST_INITIAL_CAPACITY;
+        ast->token_start = grow(ast->token_start, capacity, sizeof(size_t));
+        ast->token_length = grow(ast->token_length, capacity, sizeof(uint32_t));
+        ast->token_id = grow(ast->token_id, capacity, sizeof(InternId));
+        ast->token_capacity = capacity;
+    }
+    uint32_t index = ast->token_count++;
+    ast->token_start[index] = token.start;
+    ast->token_length[index] = (uint32_t)token.length;
+    ast->token_id[index] = token.id;
+    return index;
+}
+
+NodeId ast_add_node(Ast *ast, ASTNodeType kind, uint32_t token) {
+    if (ast->count == ast->capacity) {
+        uint32_t capacity = ast->capacity ? ast->capacity * 2 : AST_INITIAL_CAPACITY;
+        ast->kind = grow(ast->kind, capacity, sizeof(uint8_t));
+        ast->var_type = grow(ast->var_type, capacity, sizeof(uint8_t));
+        ast->first_child = grow(ast->first_child, capacity, sizeof(NodeId));
+        ast->next_sibling = grow(ast->next_sibling, capacity, sizeof(NodeId));
+        ast->token = grow(ast->token, capacity, sizeof(uint32_t));
+        ast->binding = grow(ast->binding, capacity, sizeof(uint32_t));
+        ast->capacity = capacity;
+    }
+    NodeId node = ast->count++;
+    ast->kind[node] = (uint8_t)kind;
+    ast->var_type[node] = TYPE_INT;
+    ast->first_child[node] = AST_NONE;
+    ast->next_sibling[node] = AST_NONE;
+    ast->token[node] = token;
+    ast->binding[node] = AST_NONE;
+    return node;
+}
+
+void ast_reset(Ast *ast) {
+    // Slot 0 is AST_NONE
+    ast->count = 0;
+    ast->token_count = 0;
+    ast->slot_count = 0;
+    ast_add_node(ast, AST_PROGRAM, 0);
+}
+
+void ast_free(Ast *ast) {
+    free(ast->kind);
+    free(ast->var_type);
+    free(ast->first_child);
+    free(ast->next_sibling);
+    free(ast->token);
+    free(ast->binding);
+    free(ast->token_start);
+    free(ast->token_length);
+    free(ast->token_id);
+    ast->count = ast->capacity = 0;
+    ast->token_count = ast->token_capacity = 0;
+}
+
+size_t ast_memory(const Ast *ast) {
+    size_t node_size = 2 * sizeof(uint8_t) + 2 * sizeof(NodeId) + 2 * sizeof(uint32_t);
+    size_t token_size = sizeof(size_t) + sizeof(uint32_t) + sizeof(InternId);
+    return ast->count * node_size + ast->token_count * token_size;
+}
+
+const char *var_type_to_string(VarType type) {
+    switch (type) {
+        case TYPE_INT: return "int";
+        case TYPE_CHAR: return "char";
+        case TYPE_FLOAT: return "float";
+        case TYPE_STRING: return "string";
+        default: return "unknown";
+    }
+}
+
+const char *ast_kind_name(ASTNodeType kind) {
+    switch (kind) {
+        case AST_PROGRAM: return "Program";
+        case AST_VARDECL: return "VarDecl";
+        case AST_ASSIGN: return "Assign";
+        case AST_PRINT: return "Print";
+        case AST_NUMBER: return "Number";
+        case AST_STRING_LITERAL: return "String";
+        case AST_IDENTIFIER: return "Identifier";
+        case AST_IF: return "If";
+        case AST_CONDITION: return "Condition";
+        case AST_WHILE: return "While";
+        case AST_REPEAT: return "Repeat";
+        case AST_BLOCK: return "Block";
+        case AST_FACTORIAL: return "Factorial";
+        case AST_BINOP: return "BinaryOp";
+        case AST_COMPARISON: return "Comparison";
+        case AST_ERROR: return "Error";
+        default: return "Unknown";
+    }
+}
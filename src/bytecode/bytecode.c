@@ -0,0 +1,503 @@
+/* bytecode.c
+ * Compiles the SSA form of a program (ir.h) to bytecode for the VM.
+ *
+ * Every value is kept in one of three places. A constant is pushed where it
+ * is used. A value used once, by a later instruction of its block that finds
+ * it on top of the operand stack, stays on the stack, as in code compiled
+ * from a tree. Any other value gets a frame slot of its own: it is stored
+ * once computed and loaded where it is used. The phis of a block are
+ * assigned on each edge into it: the block the edge leaves pushes their
+ * operands, then stores them in reverse, which copies them in parallel.
+ * A phi shares its slot with those of its operands whose live ranges do not
+ * overlap its own, which are most of them (ir_assign_slots): a variable
+ * updated in a loop is then a single slot again, and its copies disappear.
+ *
+ * Blocks are laid out in reverse postorder, which puts the first successor
+ * of a branch right after it, so most jumps are fallthroughs.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/bytecode.h"
+#include "../../include/ir.h"
+#include "../../include/lexer.h"
+
+#define CHUNK_INITIAL_CAPACITY 256
+
+// Where a value is kept
+typedef enum {
+    PLACE_SLOT,
+    PLACE_STACK,
+    PLACE_CONSTANT,
+} Place;
+
+// A jump to a block, patched once the block is laid out
+typedef struct {
+    uint32_t at;
+    uint32_t block;
+} Fixup;
+
+typedef struct {
+    Chunk *chunk;
+    const Ir *ir;
+    const Ast *ast;
+    Lexer *lexer;
+
+    // Per value
+    uint8_t *places;       // Place
+    uint32_t *homes;       // Slot, or constant index once the constant is used
+    uint8_t *reversed;     // Operands pushed second first, under the reversed
+                           // operation
+    uint32_t *uses;
+    uint32_t *use_blocks;  // Block of the last use
+    uint8_t *phi_used;     // Used by a phi
+    uint32_t *starts;      // Code offset of each block
+    Fixup *fixups;
+    size_t fixup_count, fixup_capacity;
+    IrValue *stack;        // Values on the operand stack while planning
+    size_t stack_count, stack_capacity;
+    uint32_t depth;        // Operand stack depth while emitting
+} Compiler;
+
+static void *grow(void *array, size_t *capacity, size_t count, size_t size) {
+    if (count < *capacity) return array;
+    *capacity = *capacity ? *capacity * 2 : CHUNK_INITIAL_CAPACITY;
+    array = realloc(array, *capacity * size);
+    if (!array) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    return array;
+}
+
+void chunk_init(Chunk *chunk) {
+    memset(chunk, 0, sizeof(Chunk));
+    arena_init(&chunk->strings);
+}
+
+void chunk_free(Chunk *chunk) {
+    free(chunk->code);
+    free(chunk->constants);
+    free(chunk->lines);
+    arena_free(&chunk->strings);
+    memset(chunk, 0, sizeof(Chunk));
+}
+
+const LineEntry *chunk_line(const Chunk *chunk, uint32_t offset) {
+    // Last entry at or before offset
+    size_t low = 0, high = chunk->line_count;
+    while (high - low > 1) {
+        size_t middle = low + (high - low) / 2;
+        if (chunk->lines[middle].offset <= offset) low = middle;
+        else high = middle;
+    }
+    return chunk->line_count ? &chunk->lines[low] : NULL;
+}
+
+static uint32_t here(Compiler *c) {
+    return (uint32_t)c->chunk->count;
+}
+
+static void emit_byte(Compiler *c, uint8_t byte) {
+    Chunk *chunk = c->chunk;
+    chunk->code = grow(chunk->code, &chunk->capacity, chunk->count, 1);
+    chunk->code[chunk->count++] = byte;
+}
+
+static void emit_operand(Compiler *c, uint32_t operand) {
+    uint8_t bytes[4] = {operand, operand >> 8, operand >> 16, operand >> 24};
+    for (int i = 0; i < 4; i++) emit_byte(c, bytes[i]);
+}
+
+static void emit(Compiler *c, Opcode op) {
+    emit_byte(c, (uint8_t)op);
+}
+
+static void emit_with(Compiler *c, Opcode op, uint32_t operand) {
+    emit_byte(c, (uint8_t)op);
+    emit_operand(c, operand);
+}
+
+// Emit a forward jump and return its operand's offset, for patch_jump
+static uint32_t emit_jump(Compiler *c, Opcode op) {
+    emit_byte(c, (uint8_t)op);
+    uint32_t at = here(c);
+    emit_operand(c, 0);
+    return at;
+}
+
+static void patch_jump(Compiler *c, uint32_t at, uint32_t target) {
+    uint8_t *code = c->chunk->code + at;
+    code[0] = (uint8_t)target;
+    code[1] = (uint8_t)(target >> 8);
+    code[2] = (uint8_t)(target >> 16);
+    code[3] = (uint8_t)(target >> 24);
+}
+
+// Attribute the instructions emitted from here on to node
+static void mark_position(Compiler *c, NodeId node) {
+    Chunk *chunk = c->chunk;
+    chunk->lines = grow(chunk->lines, &chunk->line_capacity, chunk->line_count, sizeof(LineEntry));
+    LineEntry *entry = &chunk->lines[chunk->line_count];
+    if (chunk->line_count > 0 && entry[-1].offset == here(c)) {
+        entry--;   // Nothing emitted since the last mark
+    } else {
+        chunk->line_count++;
+    }
+    entry->offset = here(c);
+    entry->start = AST_START(c->ast, node);
+    entry->length = AST_LENGTH(c->ast, node);
+    entry->line = source_line(c->lexer, entry->start);
+}
+
+static uint32_t add_constant(Compiler *c, Value value) {
+    Chunk *chunk = c->chunk;
+    if (chunk->constant_count == chunk->constant_capacity) {
+        chunk->constant_capacity = chunk->constant_capacity ? chunk->constant_capacity * 2 : 64;
+        chunk->constants = realloc(chunk->constants, chunk->constant_capacity * sizeof(Value));
+        if (!chunk->constants) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    chunk->constants[chunk->constant_count] = value;
+    return chunk->constant_count++;
+}
+
+static void *allocate(size_t count, size_t size) {
+    void *array = calloc(count ? count : 1, size);
+    if (!array) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    return array;
+}
+
+static void adjust_depth(Compiler *c, int delta) {
+    c->depth += delta;
+    if (c->depth > c->chunk->max_stack) c->chunk->max_stack = c->depth;
+}
+
+static void emit_jump_to(Compiler *c, Opcode op, uint32_t block) {
+    c->fixups = grow(c->fixups, &c->fixup_capacity, c->fixup_count, sizeof(Fixup));
+    c->fixups[c->fixup_count++] = (Fixup){emit_jump(c, op), block};
+}
+
+static int is_print(IrOp op) {
+    return op >= IR_PRINT_INT;
+}
+
+// Does the phi get its operand for free, being in the same slot?
+static int is_shared(const Compiler *c, IrValue phi, IrValue operand) {
+    return c->places[operand] == PLACE_SLOT && c->homes[operand] == c->homes[phi];
+}
+
+static Opcode opcode_of(IrOp op) {
+    static const uint8_t opcodes[IR_OP_COUNT] = {
+#define SAME(name) [IR_##name] = OP_##name,
+        SAME(INT_TO_FLOAT) SAME(FLOAT_TO_INT) SAME(TO_CHAR)
+        SAME(ADD_INT) SAME(SUB_INT) SAME(MUL_INT) SAME(DIV_INT)
+        SAME(ADD_FLOAT) SAME(SUB_FLOAT) SAME(MUL_FLOAT) SAME(DIV_FLOAT) SAME(CONCAT)
+        SAME(LT_INT) SAME(LE_INT) SAME(GT_INT) SAME(GE_INT) SAME(EQ_INT) SAME(NE_INT)
+        SAME(LT_FLOAT) SAME(LE_FLOAT) SAME(GT_FLOAT) SAME(GE_FLOAT) SAME(EQ_FLOAT) SAME(NE_FLOAT)
+        SAME(LT_STRING) SAME(LE_STRING) SAME(GT_STRING) SAME(GE_STRING) SAME(EQ_STRING) SAME(NE_STRING)
+        SAME(BOOL_INT) SAME(BOOL_FLOAT) SAME(BOOL_STRING) SAME(FACTORIAL)
+        SAME(PRINT_INT) SAME(PRINT_FLOAT) SAME(PRINT_CHAR) SAME(PRINT_STRING)
+#undef SAME
+    };
+    return (Opcode)opcodes[op];
+}
+
+// The operation giving the same result with its operands swapped, or
+// IR_OP_COUNT if there is none
+static IrOp reversed_op(IrOp op) {
+    static const int swapped[6] = {2, 3, 0, 1, 4, 5};   // < <= > >= == !=
+    switch (op) {
+    case IR_ADD_INT: case IR_MUL_INT: case IR_ADD_FLOAT: case IR_MUL_FLOAT:
+        return op;
+    default:
+        if (op < IR_LT_INT || op > IR_NE_STRING) return IR_OP_COUNT;
+        return (IrOp)(IR_LT_INT + (op - IR_LT_INT) / 6 * 6 + swapped[(op - IR_LT_INT) % 6]);
+    }
+}
+
+// Placement
+
+static void add_use(Compiler *c, IrValue value, uint32_t block) {
+    c->use_blocks[value] = block;
+    c->uses[value]++;
+}
+
+static void count_uses(Compiler *c) {
+    const Ir *ir = c->ir;
+    for (uint32_t i = 0; i < ir->order_count; i++) {
+        uint32_t index = ir->order[i];
+        const IrBlock *block = &ir->blocks[index];
+        for (uint32_t j = 0; j < block->count; j++) {
+            const IrInstr *instr = &ir->values[block->code[j]];
+            int count = ir_operand_count(ir, block->code[j]);
+            for (int k = 0; k < count; k++) {
+                if (instr->op == IR_PHI) {
+                    c->phi_used[instr->operands[k]] = 1;
+                    add_use(c, instr->operands[k], block->preds[k]);
+                } else {
+                    add_use(c, instr->operands[k], index);
+                }
+            }
+        }
+        if (block->exit == IR_EXIT_BRANCH) add_use(c, block->condition, index);
+    }
+}
+
+static void place_values(Compiler *c) {
+    const Ir *ir = c->ir;
+    for (uint32_t i = 0; i < ir->order_count; i++) {
+        const IrBlock *block = &ir->blocks[ir->order[i]];
+        for (uint32_t j = 0; j < block->count; j++) {
+            IrValue value = block->code[j];
+            const IrInstr *instr = &ir->values[value];
+            if (instr->op == IR_CONST) {
+                c->places[value] = PLACE_CONSTANT;
+            } else if (instr->op != IR_PHI && c->uses[value] == 1 && !c->phi_used[value] &&
+                       c->use_blocks[value] == instr->block) {
+                c->places[value] = PLACE_STACK;
+            } else {
+                c->places[value] = PLACE_SLOT;
+            }
+        }
+    }
+}
+
+// Pop the operands of an instruction, pushed in the order given, off the
+// planned stack. Those kept on the stack must be on top of it, in order, and
+// must come before any operand pushed from elsewhere.
+static int pop_operands(Compiler *c, const IrValue *operands, int count) {
+    int stacked = 0;
+    for (int k = 0; k < count; k++) {
+        if (c->places[operands[k]] != PLACE_STACK) continue;
+        if (k != stacked) return 0;
+        stacked++;
+    }
+    if ((size_t)stacked > c->stack_count) return 0;
+    for (int k = 0; k < stacked; k++) {
+        if (c->stack[c->stack_count - stacked + k] != operands[k]) return 0;
+    }
+    c->stack_count -= stacked;
+    return 1;
+}
+
+// Walk a block as it will run, checking that each value placed on the stack
+// is where its use expects it. Returns 0 after moving a value that is not to
+// a slot, when the block must be planned again.
+static int plan_block(Compiler *c, uint32_t index) {
+    const Ir *ir = c->ir;
+    const IrBlock *block = &ir->blocks[index];
+    c->stack_count = 0;
+    for (uint32_t j = 0; j < block->count; j++) {
+        IrValue value = block->code[j];
+        const IrInstr *instr = &ir->values[value];
+        if (instr->op == IR_CONST || instr->op == IR_PHI) continue;
+
+        int count = ir_operand_count(ir, value);
+        IrValue swapped[2] = {instr->operands[1], instr->operands[0]};
+        c->reversed[value] = 0;
+        if (!pop_operands(c, instr->operands, count)) {
+            if (count == 2 && reversed_op((IrOp)instr->op) != IR_OP_COUNT && pop_operands(c, swapped, 2)) {
+                c->reversed[value] = 1;
+            } else {
+                for (int k = 0; k < count; k++) {
+                    if (c->places[instr->operands[k]] == PLACE_STACK) c->places[instr->operands[k]] = PLACE_SLOT;
+                }
+                return 0;
+            }
+        }
+        if (!is_print((IrOp)instr->op) && c->places[value] == PLACE_STACK) {
+            c->stack = grow(c->stack, &c->stack_capacity, c->stack_count, sizeof(IrValue));
+            c->stack[c->stack_count++] = value;
+        }
+    }
+    if (block->exit == IR_EXIT_BRANCH && !pop_operands(c, &block->condition, 1)) {
+        c->places[block->condition] = PLACE_SLOT;
+        return 0;
+    }
+    return 1;
+}
+
+// Emission
+
+static uint32_t constant_index(Compiler *c, IrValue value) {
+    if (c->homes[value] != UINT32_MAX) return c->homes[value];
+    const IrInstr *instr = &c->ir->values[value];
+    Value constant = instr->constant;
+    if (instr->type == TYPE_STRING && constant.s) {
+        // The chunk outlives the IR
+        size_t length = constant.s->length;
+        VmString *string = arena_alloc(&c->chunk->strings, sizeof(VmString) + length + 1);
+        string->length = length;
+        memcpy(string->bytes, constant.s->bytes, length + 1);
+        constant.s = string;
+    }
+    return c->homes[value] = add_constant(c, constant);
+}
+
+static void emit_push(Compiler *c, IrValue value) {
+    switch ((Place)c->places[value]) {
+    case PLACE_CONSTANT:
+        emit_with(c, OP_CONST, constant_index(c, value));
+        adjust_depth(c, 1);
+        break;
+    case PLACE_SLOT:
+        emit_with(c, OP_LOAD, c->homes[value]);
+        adjust_depth(c, 1);
+        break;
+    case PLACE_STACK:
+        break;   // Already on top
+    }
+}
+
+static void emit_instr(Compiler *c, IrValue value) {
+    const IrInstr *instr = &c->ir->values[value];
+    IrOp op = (IrOp)instr->op;
+    int count = ir_operand_count(c->ir, value);
+    if (c->reversed[value]) {
+        emit_push(c, instr->operands[1]);
+        emit_push(c, instr->operands[0]);
+        op = reversed_op(op);
+    } else {
+        for (int k = 0; k < count; k++) emit_push(c, instr->operands[k]);
+    }
+
+    if (op == IR_DIV_INT) mark_position(c, instr->node);
+    emit(c, opcode_of(op));
+    if (is_print(op)) {
+        adjust_depth(c, -count);
+        return;
+    }
+    adjust_depth(c, 1 - count);
+    if (c->places[value] == PLACE_SLOT) {
+        emit_with(c, OP_STORE, c->homes[value]);
+        adjust_depth(c, -1);
+    }
+}
+
+// Does the edge from block from to block to copy anything?
+static int has_copies(const Compiler *c, uint32_t from, uint32_t to) {
+    const Ir *ir = c->ir;
+    const IrBlock *target = &ir->blocks[to];
+    int k = target->preds[0] == from ? 0 : 1;
+    for (uint32_t j = 0; j < target->count && ir->values[target->code[j]].op == IR_PHI; j++) {
+        if (!is_shared(c, target->code[j], ir->values[target->code[j]].operands[k])) return 1;
+    }
+    return 0;
+}
+
+// Assign the phis of block to for the edge from block from
+static void emit_phi_copies(Compiler *c, uint32_t from, uint32_t to) {
+    const Ir *ir = c->ir;
+    const IrBlock *target = &ir->blocks[to];
+    int k = target->preds[0] == from ? 0 : 1;
+    uint32_t count = 0;
+    for (; count < target->count && ir->values[target->code[count]].op == IR_PHI; count++) {
+        IrValue phi = target->code[count];
+        if (!is_shared(c, phi, ir->values[phi].operands[k])) emit_push(c, ir->values[phi].operands[k]);
+    }
+    for (uint32_t j = count; j-- > 0;) {
+        IrValue phi = target->code[j];
+        if (is_shared(c, phi, ir->values[phi].operands[k])) continue;
+        emit_with(c, OP_STORE, c->homes[phi]);
+        adjust_depth(c, -1);
+    }
+}
+
+static void emit_block(Compiler *c, uint32_t position) {
+    const Ir *ir = c->ir;
+    uint32_t index = ir->order[position];
+    uint32_t next = position + 1 < ir->order_count ? ir->order[position + 1] : IR_NO_BLOCK;
+    const IrBlock *block = &ir->blocks[index];
+
+    c->starts[index] = here(c);
+    for (uint32_t j = 0; j < block->count; j++) {
+        IrOp op = (IrOp)ir->values[block->code[j]].op;
+        if (op != IR_CONST && op != IR_PHI) emit_instr(c, block->code[j]);
+    }
+
+    switch ((IrExit)block->exit) {
+    case IR_EXIT_RETURN:
+        emit(c, OP_HALT);
+        break;
+    case IR_EXIT_JUMP:
+        emit_phi_copies(c, index, block->succs[0]);
+        if (block->succs[0] != next) emit_jump_to(c, OP_JUMP, block->succs[0]);
+        break;
+    case IR_EXIT_BRANCH: {
+        // The false edge's phi copies go after the true edge's
+        int copies = has_copies(c, index, block->succs[1]);
+        emit_push(c, block->condition);
+        uint32_t jump = 0;
+        if (copies) jump = emit_jump(c, OP_JUMP_IF_FALSE);
+        else emit_jump_to(c, OP_JUMP_IF_FALSE, block->succs[1]);
+        adjust_depth(c, -1);
+
+        emit_phi_copies(c, index, block->succs[0]);
+        if (block->succs[0] != next || copies) emit_jump_to(c, OP_JUMP, block->succs[0]);
+        if (copies) {
+            patch_jump(c, jump, here(c));
+            emit_phi_copies(c, index, block->succs[1]);
+            if (block->succs[1] != next) emit_jump_to(c, OP_JUMP, block->succs[1]);
+        }
+        break;
+    }
+    }
+}
+
+void bytecode_compile(Chunk *chunk, const Ir *ir) {
+    Compiler c = {0};
+    c.chunk = chunk;
+    c.ir = ir;
+    c.ast = &ir->unit->ast;
+    c.lexer = &ir->unit->lexer;
+    c.places = allocate(ir->value_count, 1);
+    c.homes = allocate(ir->value_count, sizeof(uint32_t));
+    c.reversed = allocate(ir->value_count, 1);
+    c.uses = allocate(ir->value_count, sizeof(uint32_t));
+    c.use_blocks = allocate(ir->value_count, sizeof(uint32_t));
+    c.phi_used = allocate(ir->value_count, 1);
+    c.starts = allocate(ir->block_count, sizeof(uint32_t));
+    for (uint32_t v = 0; v < ir->value_count; v++) {
+        c.homes[v] = UINT32_MAX;
+    }
+
+    count_uses(&c);
+    place_values(&c);
+    for (uint32_t i = 0; i < ir->order_count; i++) {
+        while (!plan_block(&c, ir->order[i])) {
+        }
+    }
+
+    // Prints leave nothing behind to keep
+    uint8_t *slotted = allocate(ir->value_count, 1);
+    for (uint32_t v = 0; v < ir->value_count; v++) {
+        slotted[v] = c.places[v] == PLACE_SLOT && !is_print((IrOp)ir->values[v].op);
+    }
+    chunk->slot_count = ir_assign_slots(ir, slotted, c.homes);
+    free(slotted);
+
+    for (uint32_t i = 0; i < ir->order_count; i++) {
+        emit_block(&c, i);
+    }
+    if (ir->order_count == 0) emit(&c, OP_HALT);
+    for (size_t i = 0; i < c.fixup_count; i++) {
+        patch_jump(&c, c.fixups[i].at, c.starts[c.fixups[i].block]);
+    }
+
+    free(c.places);
+    free(c.homes);
+    free(c.reversed);
+    free(c.uses);
+    free(c.use_blocks);
+    free(c.phi_used);
+    free(c.starts);
+    free(c.fixups);
+    free(c.stack);
+}
@@ -0,0 +1,227 @@
+/* cache.c
+ * Result cache: one file per entry under dir/xx/, named by the rest of the
+ * key in hex, holding a header and then the output.
+ */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../../include/cache.h"
+#include "../../include/xxhash.h"
+
+// Bump when the entry layout changes
+#define CACHE_MAGIC "SMCACHE1"
+
+typedef struct {
+    char magic[8];
+    uint64_t version;
+    uint64_t key;
+    uint64_t output_length;
+    uint32_t failed;
+    uint32_t reserved;
+} EntryHeader;
+
+// Longest path of an entry or temporary file, past dir
+#define ENTRY_PATH_EXTRA sizeof("/xx/tmp.4294967295.4294967295")
+
+// Names temporary files apart across the threads of one process
+static unsigned temp_counter;
+
+static char *entry_path(const Cache *cache, uint64_t key, char *path) {
+    snprintf(path, PATH_MAX, "%s/%02x/%014llx", cache->dir, (unsigned)(key >> 56),
+             (unsigned long long)(key & 0xffffffffffffffULL));
+    return path;
+}
+
+// The running executable's hash, so each build has entries of its own
+static int checker_version(uint64_t *version) {
+    int fd = open("/proc/self/exe", O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return -1;
+    }
+    void *image = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) return -1;
+    *version = xxh64(image, (size_t)st.st_size, xxh64(CACHE_MAGIC, 8, 0));
+    munmap(image, (size_t)st.st_size);
+    return 0;
+}
+
+int cache_open(Cache *cache, const char *dir, uint64_t limit) {
+    memset(cache, 0, sizeof(*cache));
+    if (strlen(dir) + ENTRY_PATH_EXTRA > PATH_MAX) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) return -1;
+    struct stat st;
+    if (stat(dir, &st) != 0) return -1;
+    if (!S_ISDIR(st.st_mode)) {
+        errno = ENOTDIR;
+        return -1;
+    }
+    if (checker_version(&cache->version) != 0) return -1;
+    cache->dir = strdup(dir);
+    if (!cache->dir) return -1;
+    cache->limit = limit;
+    return 0;
+}
+
+void cache_close(Cache *cache) {
+    free(cache->dir);
+    cache->dir = NULL;
+}
+
+uint64_t cache_key(const Cache *cache, const char *source, size_t length, const char *name,
+                   uint32_t variant) {
+    uint64_t hash = xxh64(source, length, cache->version + variant);
+    return xxh64(name, strlen(name), hash);
+}
+
+static int read_all(int fd, void *buffer, size_t length) {
+    char *p = buffer;
+    while (length > 0) {
+        ssize_t n = read(fd, p, length);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        length -= (size_t)n;
+    }
+    return 0;
+}
+
+static int write_all(int fd, const void *buffer, size_t length) {
+    const char *p = buffer;
+    while (length > 0) {
+        ssize_t n = write(fd, p, length);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        length -= (size_t)n;
+    }
+    return 0;
+}
+
+int cache_lookup(const Cache *cache, uint64_t key, int *failed, char **output, size_t *output_length) {
+    char path[PATH_MAX];
+    int fd = open(entry_path(cache, key, path), O_RDONLY);
+    if (fd < 0) return 0;
+
+    // An entry from another build, or cut short, is a miss
+    EntryHeader header;
+    struct stat st;
+    char *data = NULL;
+    if (fstat(fd, &st) != 0 || read_all(fd, &header, sizeof(header)) != 0 ||
+        memcmp(header.magic, CACHE_MAGIC, 8) != 0 || header.version != cache->version ||
+        header.key != key || (uint64_t)st.st_size != sizeof(header) + header.output_length ||
+        !(data = malloc(header.output_length + 1)) || read_all(fd, data, header.output_length) != 0) {
+        free(data);
+        close(fd);
+        return 0;
+    }
+    data[header.output_length] = '\0';
+
+    // Recently used entries are the last evicted
+    futimens(fd, NULL);
+    close(fd);
+    *failed = (int)header.failed;
+    *output = data;
+    *output_length = header.output_length;
+    return 1;
+}
+
+void cache_store(const Cache *cache, uint64_t key, int failed, const char *output, size_t output_length) {
+    char path[PATH_MAX], temp[PATH_MAX];
+    snprintf(temp, sizeof(temp), "%s/%02x/tmp.%u.%u", cache->dir, (unsigned)(key >> 56), (unsigned)getpid(),
+             __atomic_fetch_add(&temp_counter, 1, __ATOMIC_RELAXED));
+
+    EntryHeader header = {CACHE_MAGIC, cache->version, key, output_length, (uint32_t)failed, 0};
+    int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0 && errno == ENOENT) {
+        // The first entry of its bucket
+        snprintf(path, sizeof(path), "%s/%02x", cache->dir, (unsigned)(key >> 56));
+        mkdir(path, 0777);
+        fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    }
+    if (fd < 0) return;
+    int written = write_all(fd, &header, sizeof(header)) == 0 && write_all(fd, output, output_length) == 0;
+    if (close(fd) != 0 || !written || rename(temp, entry_path(cache, key, path)) != 0) {
+        unlink(temp);
+    }
+}
+
+// A file found by cache_trim: an entry, or a temporary file left behind
+typedef struct {
+    struct timespec used;
+    uint64_t size;
+    unsigned bucket;
+    char name[32];
+} TrimEntry;
+
+static int compare_used(const void *a, const void *b) {
+    const struct timespec *x = &((const TrimEntry *)a)->used, *y = &((const TrimEntry *)b)->used;
+    if (x->tv_sec != y->tv_sec) return x->tv_sec < y->tv_sec ? -1 : 1;
+    return (x->tv_nsec > y->tv_nsec) - (x->tv_nsec < y->tv_nsec);
+}
+
+uint64_t cache_trim(const Cache *cache, Stats *stats) {
+    TrimEntry *entries = NULL;
+    size_t count = 0, capacity = 0;
+    uint64_t total = 0;
+
+    for (unsigned bucket = 0; bucket < 256; bucket++) {
+        char dir_path[PATH_MAX];
+        snprintf(dir_path, sizeof(dir_path), "%s/%02x", cache->dir, bucket);
+        DIR *dir = opendir(dir_path);
+        if (!dir) continue;
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            struct stat st;
+            if (entry->d_name[0] == '.' || strlen(entry->d_name) >= sizeof(entries->name) ||
+                fstatat(dirfd(dir), entry->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode)) {
+                continue;
+            }
+            if (count == capacity) {
+                capacity = capacity ? capacity * 2 : 1024;
+                TrimEntry *grown = realloc(entries, capacity * sizeof(TrimEntry));
+                if (!grown) break;
+                entries = grown;
+            }
+            TrimEntry *trim = &entries[count++];
+            trim->used = st.st_mtim;
+            trim->size = (uint64_t)st.st_size;
+            trim->bucket = bucket;
+            strcpy(trim->name, entry->d_name);
+            total += (uint64_t)st.st_size;
+        }
+        closedir(dir);
+    }
+
+    if (total > cache->limit) {
+        qsort(entries, count, sizeof(TrimEntry), compare_used);
+        for (size_t i = 0; i < count && total > cache->limit; i++) {
+            char path[PATH_MAX];
+            snprintf(path, sizeof(path), "%s/%02x/%s", cache->dir, entries[i].bucket, entries[i].name);
+            if (unlink(path) != 0) continue;
+            total -= entries[i].size;
+            stats->cache_evicted++;
+            stats->cache_evicted_bytes += entries[i].size;
+        }
+    }
+    free(entries);
+    return total;
+}
@@ -0,0 +1,618 @@
+/* cgen.c
+ * Translates a checked AST to C, for --emit-c.
+ *
+ * The program becomes main(), statement for statement, with each variable a
+ * C local of its declared type in the matching block. Expressions keep the
+ * tree the parser built: the language has no precedence, so an operation
+ * nested in another is always parenthesised. Operations whose meaning C
+ * does not share are calls to small inline functions in a prelude: int
+ * + - * and / (which wrap around, and stop on a division by zero), string
+ * + and comparisons, float to int conversion and factorial. gcc folds the
+ * helpers back into single instructions at -O2.
+ *
+ * Unlike the VM and the JIT, this backend works from the AST rather than
+ * the optimised IR, on purpose. The output is meant to be read next to the
+ * source, which SSA form would scatter into blocks, gotos and one local per
+ * value. And the C compiler that builds it does constant propagation,
+ * common subexpression elimination and loop-invariant code motion itself,
+ * on the structured loops it is given, so ir_optimize would add nothing.
+ *
+ * Like the compiler, the generator walks statements and expressions with
+ * explicit stacks, so deep nesting does not recurse.
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/cgen.h"
+#include "../../include/lexer.h"
+
+#define CGEN_INITIAL_CAPACITY 64
+#define INDENT_WIDTH 4
+
+// Columns of a node
+#define NODE_KIND(node) ((ASTNodeType)g->ast->kind[node])
+#define NODE_LEFT(node) (g->ast->first_child[node])
+#define NODE_RIGHT(node) AST_SECOND_CHILD(g->ast, node)
+#define NODE_TYPE(node) ((VarType)g->ast->var_type[node])
+#define NODE_BINDING(node) (g->ast->binding[node])
+#define NODE_TEXT(node) (g->source + AST_START(g->ast, node))
+
+// Runtime support emitted ahead of main(); mirrors the VM
+static const char prelude[] =
+    "#include <inttypes.h>\n"
+    "#include <stdint.h>\n"
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "#include <string.h>\n"
+    "\n"
+    "// Strings are immutable; + makes a new one, which is never freed\n"
+    "typedef struct {\n"
+    "    const char *bytes;\n"
+    "    size_t length;\n"
+    "} rt_string;\n"
+    "\n"
+    "#define RT_STRING(literal) ((rt_string){literal, sizeof(literal) - 1})\n"
+    "\n"
+    "// int arithmetic wraps around\n"
+    "static inline int64_t rt_add(int64_t a, int64_t b) { return (int64_t)((uint64_t)a + (uint64_t)b); }\n"
+    "static inline int64_t rt_sub(int64_t a, int64_t b) { return (int64_t)((uint64_t)a - (uint64_t)b); }\n"
+    "static inline int64_t rt_mul(int64_t a, int64_t b) { return (int64_t)((uint64_t)a * (uint64_t)b); }\n"
+    "\n"
+    "static inline int64_t rt_div(int64_t a, int64_t b, int line) {\n"
+    "    if (b == 0) {\n"
+    "        fflush(stdout);\n"
+    "        fprintf(stderr, \"Runtime Error at line %d: Division by zero\\n\", line);\n"
+    "        exit(1);\n"
+    "    }\n"
+    "    // INT64_MIN / -1 wraps to INT64_MIN\n"
+    "    return b == -1 ? (int64_t)(0 - (uint64_t)a) : a / b;\n"
+    "}\n"
+    "\n"
+    "// Truncates, with NaN and out-of-range values pinned\n"
+    "static inline int64_t rt_float_to_int(double f) {\n"
+    "    if (f != f) return 0;\n"
+    "    if (f >= 9223372036854775807.0) return INT64_MAX;\n"
+    "    if (f <= -9223372036854775808.0) return INT64_MIN;\n"
+    "    return (int64_t)f;\n"
+    "}\n"
+    "\n"
+    "// n!, wrapping around: 66! and above are multiples of 2^64\n"
+    "static inline int64_t rt_factorial(int64_t n) {\n"
+    "    uint64_t result = 1;\n"
+    "    if (n >= 66) return 0;\n"
+    "    for (int64_t i = 2; i <= n; i++) result *= (uint64_t)i;\n"
+    "    return (int64_t)result;\n"
+    "}\n"
+    "\n"
+    "static inline rt_string rt_concat(rt_string a, rt_string b) {\n"
+    "    if (b.length == 0) return a;\n"
+    "    if (a.length == 0) return b;\n"
+    "    char *bytes = malloc(a.length + b.length);\n"
+    "    if (!bytes) {\n"
+    "        fflush(stdout);\n"
+    "        fprintf(stderr, \"Memory allocation failed\\n\");\n"
+    "        exit(1);\n"
+    "    }\n"
+    "    memcpy(bytes, a.bytes, a.length);\n"
+    "    memcpy(bytes + a.length, b.bytes, b.length);\n"
+    "    return (rt_string){bytes, a.length + b.length};\n"
+    "}\n"
+    "\n"
+    "// Byte order, then a prefix before the longer string\n"
+    "static inline int rt_compare(rt_string a, rt_string b) {\n"
+    "    size_t length = a.length < b.length ? a.length : b.length;\n"
+    "    int order = memcmp(a.bytes, b.bytes, length);\n"
+    "    if (order != 0) return order;\n"
+    "    return (a.length > b.length) - (a.length < b.length);\n"
+    "}\n"
+    "\n"
+    "static inline int rt_nonempty(rt_string s) { return s.length != 0; }\n"
+    "\n"
+    "static inline void rt_print_int(int64_t value) { printf(\"%\" PRId64 \"\\n\", value); }\n"
+    "static inline void rt_print_float(double value) { printf(\"%g\\n\", value); }\n"
+    "static inline void rt_print_char(signed char value) { printf(\"%c\\n\", (unsigned char)value); }\n"
+    "\n"
+    "static inline void rt_print_string(rt_string value) {\n"
+    "    fwrite(value.bytes, 1, value.length, stdout);\n"
+    "    putchar('\\n');\n"
+    "}\n"
+    "\n";
+
+// Names a variable cannot keep: C keywords, what the prelude's headers
+// define as macros or types, and gcc's predefined system macros. Names
+// starting with one of reserved_prefixes cannot either.
+static const char *const reserved_names[] = {
+    "auto", "break", "case", "char", "const", "continue", "default", "do", "double", "else", "enum",
+    "extern", "float", "for", "goto", "if", "inline", "int", "long", "register", "restrict", "return",
+    "short", "signed", "sizeof", "static", "struct", "switch", "typedef", "union", "unsigned", "void",
+    "volatile", "while", "main", "int64_t", "uint64_t", "size_t", "NULL", "EOF", "BUFSIZ",
+    "FILENAME_MAX", "FOPEN_MAX", "L_tmpnam", "TMP_MAX", "SEEK_SET", "SEEK_CUR", "SEEK_END",
+    "EXIT_SUCCESS", "EXIT_FAILURE", "RAND_MAX", "MB_CUR_MAX", "stdin", "stdout", "stderr", "errno",
+    "linux", "unix", "i386",
+};
+
+static const char *const reserved_prefixes[] = {
+    "_", "v_", "rt_", "RT_", "INT", "UINT", "PRI", "SCN", "SIZE_", "PTRDIFF_", "SIG_ATOMIC_", "WCHAR_",
+    "WINT_",
+};
+
+// A statement being emitted. indent is the depth of its own lines; a body
+// block that is inline prints no braces of its own, and a lone statement is
+// the body of an if or while without braces.
+typedef struct {
+    NodeId node;
+    int state;
+    int indent;
+    int inline_block;
+    int lone;
+    NodeId cursor;     // Next statement of a block
+} StatementFrame;
+
+// An operand being emitted; nested if it is an operand of an operator
+// written infix, which it must then not bind to
+typedef struct {
+    NodeId node;
+    int state;
+    int nested;
+} ExpressionFrame;
+
+// How an operation is written: prefix, left operand, separator, right
+// operand, suffix. Operands of && and || that are strings are wrapped in
+// rt_nonempty().
+typedef struct {
+    char prefix[16];
+    char separator[8];
+    char suffix[24];
+    int infix;          // An operator expression, parenthesised when nested
+    int wrap_left, wrap_right;
+} Shape;
+
+typedef struct {
+    FILE *out;
+    const Ast *ast;
+    const char *source;
+    Lexer *lexer;
+    const Interner *interner;
+    uint8_t *types;     // VarType of each expression node
+
+    StatementFrame *frames;
+    size_t frame_count, frame_capacity;
+    ExpressionFrame *operands;
+    size_t operand_count, operand_capacity;
+    NodeId *pending;    // Declarations made by lone statements, see emit_step
+    size_t pending_count, pending_capacity;
+} Generator;
+
+static void *grow(void *array, size_t *capacity, size_t count, size_t size) {
+    if (count < *capacity) return array;
+    *capacity = *capacity ? *capacity * 2 : CGEN_INITIAL_CAPACITY;
+    array = realloc(array, *capacity * size);
+    if (!array) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    return array;
+}
+
+static void push_operand(Generator *g, NodeId node, int nested) {
+    g->operands = grow(g->operands, &g->operand_capacity, g->operand_count, sizeof(ExpressionFrame));
+    g->operands[g->operand_count++] = (ExpressionFrame){node, 0, nested};
+}
+
+static void push_statement(Generator *g, NodeId node, int indent, int inline_block, int lone) {
+    g->frames = grow(g->frames, &g->frame_capacity, g->frame_count, sizeof(StatementFrame));
+    g->frames[g->frame_count++] = (StatementFrame){node, 0, indent, inline_block, lone, AST_NONE};
+}
+
+// Static types of expressions
+
+// Type of node, whose operands are already typed. Numbers are promoted to
+// float if either operand is a float; char is an int in arithmetic.
+static VarType expression_type(Generator *g, NodeId node) {
+    switch (NODE_KIND(node)) {
+    case AST_STRING_LITERAL:
+        return TYPE_STRING;
+    case AST_IDENTIFIER:
+        return NODE_TYPE(NODE_BINDING(node));
+    case AST_CONDITION:
+        return (VarType)g->types[NODE_LEFT(node)];
+    case AST_BINOP: {
+        VarType left = (VarType)g->types[NODE_LEFT(node)];
+        VarType right = (VarType)g->types[NODE_RIGHT(node)];
+        if (left == TYPE_STRING) return TYPE_STRING;
+        return left == TYPE_FLOAT || right == TYPE_FLOAT ? TYPE_FLOAT : TYPE_INT;
+    }
+    default:
+        // Numbers, comparisons, which are 0 or 1, and statements
+        return TYPE_INT;
+    }
+}
+
+// Type every node under root, children before parents
+static void type_nodes(Generator *g, NodeId root) {
+    push_operand(g, root, 0);
+    while (g->operand_count > 0) {
+        ExpressionFrame *frame = &g->operands[g->operand_count - 1];
+        NodeId node = frame->node;
+        if (frame->state++ == 0) {
+            for (NodeId child = NODE_LEFT(node); child != AST_NONE; child = g->ast->next_sibling[child]) {
+                push_operand(g, child, 0);
+            }
+        } else {
+            g->types[node] = (uint8_t)expression_type(g, node);
+            g->operand_count--;
+        }
+    }
+}
+
+// Output
+
+static void write_indent(Generator *g, int indent) {
+    fprintf(g->out, "%*s", indent * INDENT_WIDTH, "");
+}
+
+static int is_reserved(const char *name, size_t length) {
+    for (size_t i = 0; i < sizeof(reserved_names) / sizeof(reserved_names[0]); i++) {
+        if (strlen(reserved_names[i]) == length && memcmp(reserved_names[i], name, length) == 0) return 1;
+    }
+    for (size_t i = 0; i < sizeof(reserved_prefixes) / sizeof(reserved_prefixes[0]); i++) {
+        size_t prefix = strlen(reserved_prefixes[i]);
+        if (prefix <= length && memcmp(reserved_prefixes[i], name, prefix) == 0) return 1;
+    }
+    return 0;
+}
+
+// Name of a VARDECL or IDENTIFIER. A name C cannot use as it is gets a v_
+// prefix; since names starting with v_ are reserved too, no two variables
+// can end up with the same name.
+static void write_name(Generator *g, NodeId node) {
+    const char *name = NODE_TEXT(node);
+    int length = (int)AST_LENGTH(g->ast, node);
+    fprintf(g->out, "%s%.*s", is_reserved(name, (size_t)length) ? "v_" : "", length, name);
+}
+
+// Decimal literal, wrapped around like the arithmetic does. Leading zeros
+// are dropped, as C would read the literal as octal.
+static void write_number(Generator *g, NodeId node) {
+    const char *text = NODE_TEXT(node);
+    uint32_t length = AST_LENGTH(g->ast, node);
+    uint64_t bits = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        bits = bits * 10 + (uint64_t)(text[i] - '0');
+    }
+    int64_t value = (int64_t)bits;
+
+    if (value == INT64_MIN) {
+        fputs("INT64_MIN", g->out);
+    } else if (value < 0) {
+        fprintf(g->out, "(-INT64_C(%" PRId64 "))", -value);
+    } else if (value > INT32_MAX) {
+        fprintf(g->out, "INT64_C(%" PRId64 ")", value);
+    } else {
+        fprintf(g->out, "%" PRId64, value);
+    }
+}
+
+// String literal, escaped for C
+static void write_string(Generator *g, NodeId node) {
+    size_t length;
+    const char *text = intern_text(g->interner, AST_ID(g->ast, node), &length);
+    fputs("RT_STRING(\"", g->out);
+    for (size_t i = 0; i < length; i++) {
+        unsigned char byte = (unsigned char)text[i];
+        if (byte == '"' || byte == '\\') {
+            fprintf(g->out, "\\%c", byte);
+        } else if (byte == '\n') {
+            fputs("\\n", g->out);
+        } else if (byte == '\t') {
+            fputs("\\t", g->out);
+        } else if (byte == '?' && i > 0 && text[i - 1] == '?') {
+            fputs("\\?", g->out);   // Not a trigraph
+        } else if (byte < ' ' || byte >= 0x7f) {
+            fprintf(g->out, "\\%03o", byte);
+        } else {
+            fputc(byte, g->out);
+        }
+    }
+    fputs("\")", g->out);
+}
+
+static Shape shape_of(Generator *g, NodeId node) {
+    Shape shape = {0};
+    const char *op = NODE_TEXT(node);
+    int op_length = (int)AST_LENGTH(g->ast, node);
+    VarType left = (VarType)g->types[NODE_LEFT(node)];
+    VarType right = (VarType)g->types[NODE_RIGHT(node)];
+
+    if (NODE_KIND(node) == AST_BINOP && left != TYPE_FLOAT && right != TYPE_FLOAT) {
+        // int arithmetic and string +
+        static const char *const calls[] = {"rt_add(", "rt_sub(", "rt_mul(", "rt_div("};
+        int which = *op == '+' ? 0 : *op == '-' ? 1 : *op == '*' ? 2 : 3;
+        strcpy(shape.prefix, left == TYPE_STRING ? "rt_concat(" : calls[which]);
+        strcpy(shape.separator, ", ");
+        if (which == 3 && left != TYPE_STRING) {
+            snprintf(shape.suffix, sizeof(shape.suffix), ", %d)", source_line(g->lexer, AST_START(g->ast, node)));
+        } else {
+            strcpy(shape.suffix, ")");
+        }
+        return shape;
+    }
+
+    shape.infix = 1;
+    if (NODE_KIND(node) == AST_COMPARISON && left == TYPE_STRING && *op != '&' && *op != '|') {
+        strcpy(shape.prefix, "rt_compare(");
+        strcpy(shape.separator, ", ");
+        snprintf(shape.suffix, sizeof(shape.suffix), ") %.*s 0", op_length, op);
+        return shape;
+    }
+    // float arithmetic and the comparisons C shares
+    snprintf(shape.separator, sizeof(shape.separator), " %.*s ", op_length, op);
+    shape.wrap_left = left == TYPE_STRING;
+    shape.wrap_right = right == TYPE_STRING;
+    return shape;
+}
+
+// Write the expression at node; nested if it is an operand of an infix
+// operator
+static void write_expression(Generator *g, NodeId node, int nested) {
+    size_t base = g->operand_count;
+    push_operand(g, node, nested);
+
+    while (g->operand_count > base) {
+        ExpressionFrame *frame = &g->operands[g->operand_count - 1];
+        NodeId current = frame->node;
+        int state = frame->state++;
+
+        switch (NODE_KIND(current)) {
+        case AST_NUMBER:
+            write_number(g, current);
+            break;
+        case AST_STRING_LITERAL:
+            write_string(g, current);
+            break;
+        case AST_IDENTIFIER:
+            write_name(g, current);
+            break;
+        case AST_CONDITION:
+            if (state == 0) {
+                push_operand(g, NODE_LEFT(current), frame->nested);
+                continue;
+            }
+            break;
+        case AST_BINOP:
+        case AST_COMPARISON: {
+            Shape shape = shape_of(g, current);
+            int parenthesised = shape.infix && frame->nested;
+            // Operands of an operator written infix bind to it; the
+            // arguments of a call need no parentheses
+            int operands_nested = shape.infix && shape.prefix[0] == '\0';
+            if (state == 0) {
+                if (parenthesised) fputc('(', g->out);
+                fputs(shape.prefix, g->out);
+                if (shape.wrap_left) fputs("rt_nonempty(", g->out);
+                push_operand(g, NODE_LEFT(current), operands_nested && !shape.wrap_left);
+                continue;
+            } else if (state == 1) {
+                if (shape.wrap_left) fputc(')', g->out);
+                fputs(shape.separator, g->out);
+                if (shape.wrap_right) fputs("rt_nonempty(", g->out);
+                push_operand(g, NODE_RIGHT(current), operands_nested && !shape.wrap_right);
+                continue;
+            }
+            if (shape.wrap_right) fputc(')', g->out);
+            fputs(shape.suffix, g->out);
+            if (parenthesised) fputc(')', g->out);
+            break;
+        }
+        default:
+            // AST_ERROR: a program with syntax errors is never emitted
+            break;
+        }
+        g->operand_count--;
+    }
+}
+
+// Write the expression at node converted for a variable of type target
+static void write_converted(Generator *g, NodeId node, VarType target) {
+    VarType type = (VarType)g->types[node];
+    if (target == TYPE_CHAR && type != TYPE_CHAR) {
+        // Narrowed to the low 8 bits, as the VM stores a char
+        fputs("(signed char)", g->out);
+        if (type == TYPE_FLOAT) {
+            fputs("rt_float_to_int(", g->out);
+            write_expression(g, node, 0);
+            fputc(')', g->out);
+        } else {
+            write_expression(g, node, 1);
+        }
+    } else if (target == TYPE_INT && type == TYPE_FLOAT) {
+        fputs("rt_float_to_int(", g->out);
+        write_expression(g, node, 0);
+        fputc(')', g->out);
+    } else {
+        // int and char widen to float, char to int, as C does
+        write_expression(g, node, 0);
+    }
+}
+
+// Write the truth test of a condition: nonzero numbers, nonempty strings
+static void write_condition(Generator *g, NodeId node, int nested) {
+    if (g->types[node] == TYPE_STRING) {
+        fputs("rt_nonempty(", g->out);
+        write_expression(g, node, 0);
+        fputc(')', g->out);
+    } else {
+        write_expression(g, node, nested);
+    }
+}
+
+static void write_declaration(Generator *g, NodeId node, int indent) {
+    static const char *const c_types[] = {
+        [TYPE_INT] = "int64_t",
+        [TYPE_CHAR] = "signed char",
+        [TYPE_FLOAT] = "double",
+        [TYPE_STRING] = "rt_string",
+    };
+    write_indent(g, indent);
+    fprintf(g->out, "%s ", c_types[NODE_TYPE(node)]);
+    write_name(g, node);
+    fputs(NODE_TYPE(node) == TYPE_STRING ? " = RT_STRING(\"\");\n" : " = 0;\n", g->out);
+}
+
+// Declarations left by the lone statements just emitted
+static void flush_pending(Generator *g, int indent) {
+    for (size_t i = 0; i < g->pending_count; i++) {
+        write_declaration(g, g->pending[i], indent);
+    }
+    g->pending_count = 0;
+}
+
+// Advance the frame on top of the stack by one step
+static void emit_step(Generator *g) {
+    StatementFrame *frame = &g->frames[g->frame_count - 1];
+    NodeId node = frame->node;
+    int state = frame->state++;
+    int indent = frame->indent;
+
+    switch (NODE_KIND(node)) {
+    case AST_PROGRAM:
+    case AST_BLOCK: {
+        // The program is main()'s body; a body block is its statement's
+        int inner = NODE_KIND(node) == AST_BLOCK && !frame->inline_block ? indent + 1 : indent;
+        if (state == 0) {
+            if (inner != indent) {
+                write_indent(g, indent);
+                fputs("{\n", g->out);
+            }
+            frame->cursor = NODE_LEFT(node);
+        } else {
+            flush_pending(g, inner);
+        }
+        if (frame->cursor != AST_NONE) {
+            NodeId child = frame->cursor;
+            frame->cursor = g->ast->next_sibling[child];
+            push_statement(g, child, inner, 0, 0);
+            return;
+        }
+        if (inner != indent) {
+            write_indent(g, indent);
+            fputs("}\n", g->out);
+        }
+        break;
+    }
+
+    case AST_VARDECL:
+        // A declaration is in scope from here to the end of its block, and
+        // is zeroed each time it is reached. The body of an if or while
+        // without braces declares into the enclosing block, so a lone
+        // declaration is written out after the statement; it needs no
+        // zeroing, as definite initialisation rules out reading it first.
+        if (frame->lone) {
+            g->pending = grow(g->pending, &g->pending_capacity, g->pending_count, sizeof(NodeId));
+            g->pending[g->pending_count++] = node;
+        } else {
+            write_declaration(g, node, indent);
+        }
+        break;
+
+    case AST_ASSIGN: {
+        NodeId target = NODE_LEFT(node);
+        write_indent(g, indent);
+        write_name(g, target);
+        fputs(" = ", g->out);
+        write_converted(g, NODE_RIGHT(node), NODE_TYPE(NODE_BINDING(target)));
+        fputs(";\n", g->out);
+        break;
+    }
+
+    case AST_PRINT: {
+        static const char *const prints[] = {
+            [TYPE_INT] = "rt_print_int(",
+            [TYPE_CHAR] = "rt_print_char(",
+            [TYPE_FLOAT] = "rt_print_float(",
+            [TYPE_STRING] = "rt_print_string(",
+        };
+        write_indent(g, indent);
+        fputs(prints[g->types[NODE_LEFT(node)]], g->out);
+        write_expression(g, NODE_LEFT(node), 0);
+        fputs(");\n", g->out);
+        break;
+    }
+
+    case AST_FACTORIAL:
+        // factorial(n); prints n!
+        write_indent(g, indent);
+        fputs("rt_print_int(rt_factorial(", g->out);
+        write_converted(g, NODE_LEFT(node), TYPE_INT);
+        fputs("));\n", g->out);
+        break;
+
+    case AST_IF:
+    case AST_WHILE:
+        if (state == 0) {
+            NodeId body = NODE_RIGHT(node);
+            write_indent(g, indent);
+            fputs(NODE_KIND(node) == AST_IF ? "if (" : "while (", g->out);
+            write_condition(g, NODE_LEFT(node), 0);
+            fputs(") {\n", g->out);
+            int block = NODE_KIND(body) == AST_BLOCK;
+            push_statement(g, body, indent + 1, block, !block);
+            return;
+        }
+        write_indent(g, indent);
+        fputs("}\n", g->out);
+        break;
+
+    case AST_REPEAT:
+        // Runs the body again while the until condition is false
+        if (state == 0) {
+            write_indent(g, indent);
+            fputs("do {\n", g->out);
+            push_statement(g, NODE_LEFT(node), indent + 1, 1, 0);
+            return;
+        }
+        write_indent(g, indent);
+        fputs("} while (!", g->out);
+        write_condition(g, NODE_RIGHT(node), 1);
+        fputs(");\n", g->out);
+        break;
+
+    default:
+        // AST_ERROR: a program with syntax errors is never emitted
+        break;
+    }
+
+    g->frame_count--;
+}
+
+void cgen_emit(CompilationUnit *unit, NodeId root, FILE *out) {
+    Generator g = {0};
+    g.out = out;
+    g.ast = &unit->ast;
+    g.source = unit->input.data;
+    g.lexer = &unit->lexer;
+    g.interner = &unit->interner;
+    g.types = calloc(unit->ast.count ? unit->ast.count : 1, 1);
+    if (!g.types) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+
+    fputs(prelude, out);
+    fputs("int main(void) {\n", out);
+    if (root != AST_NONE) {
+        type_nodes(&g, root);
+        push_statement(&g, root, 1, 0, 0);
+        while (g.frame_count > 0) {
+            emit_step(&g);
+        }
+    }
+    fputs("    return 0;\n}\n", out);
+
+    free(g.types);
+    free(g.frames);
+    free(g.operands);
+    free(g.pending);
+}
@@ -0,0 +1,269 @@
+/* diag.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/diag.h"
+#include "../../include/parser.h"
+#include "../../include/semantic.h"
+#include "../../include/tokens.h"
+#include "../../include/vm.h"
+
+#define DIAG_INITIAL_CAPACITY 64
+
+// Code name used in JSON output, and message format. A format may quote the
+// diagnostic's text with "%.*s"; it is always passed.
+typedef struct {
+    const char *name;
+    const char *format;
+} DiagMessage;
+
+static const DiagMessage lexical_messages[] = {
+    [ERROR_NONE]                    = {"unknown", "Unknown error"},
+    [ERROR_INVALID_CHAR]            = {"invalid-char", "Invalid character '%.*s'"},
+    [ERROR_INVALID_NUMBER]          = {"invalid-number", "Invalid number format"},
+    [ERROR_CONSECUTIVE_OPERATORS]   = {"consecutive-operators", "Consecutive operators not allowed"},
+    [ERROR_INVALID_IDENTIFIER]      = {"invalid-identifier", "Invalid identifier"},
+    [ERROR_UNEXPECTED_TOKEN]        = {"unexpected-token", "Unexpected token '%.*s'"},
+    [ERROR_UNTERMINATED_STRING]     = {"unterminated-string", "Unterminated string"},
+    [ERROR_UNKNOWN_ESCAPE_SEQUENCE] = {"unknown-escape-sequence", "Unknown escape sequence"},
+    [ERROR_UNTERMINATED_COMMENT]    = {"unterminated-comment", "Unterminated comment"},
+};
+
+static const DiagMessage syntax_messages[] = {
+    [PARSE_ERROR_NONE]               = {"unknown", "Unknown error"},
+    [PARSE_ERROR_UNEXPECTED_TOKEN]   = {"unexpected-token", "Unexpected token '%.*s'"},
+    [PARSE_ERROR_MISSING_SEMICOLON]  = {"missing-semicolon", "Missing semicolon after '%.*s'"},
+    [PARSE_ERROR_MISSING_IDENTIFIER] = {"missing-identifier", "Expected identifier after '%.*s'"},
+    [PARSE_ERROR_MISSING_EQUALS]     = {"missing-equals", "Expected '=' after '%.*s'"},
+    [PARSE_ERROR_INVALID_EXPRESSION] = {"invalid-expression", "Invalid expression after '%.*s'"},
+    [PARSE_ERROR_MISSING_LPAREN]     = {"missing-lparen", "Expected '(' after '%.*s'"},
+    [PARSE_ERROR_MISSING_RPAREN]     = {"missing-rparen", "Expected ')' after '%.*s'"},
+    [PARSE_ERROR_MISSING_LBRACE]     = {"missing-lbrace", "Expected '{' after '%.*s'"},
+    [PARSE_ERROR_MISSING_RBRACE]     = {"missing-rbrace", "Expected '}' after '%.*s'"},
+    [PARSE_ERROR_MISSING_LBRACK]     = {"missing-lbrack", "Expected '[' after '%.*s'"},
+    [PARSE_ERROR_MISSING_RBRACK]     = {"missing-rbrack", "Expected ']' after '%.*s'"},
+    [PARSE_ERROR_INVALID_STATEMENT]  = {"invalid-statement", "Invalid statement after '%.*s'"},
+    [PARSE_ERROR_MISSING_UNTIL]      = {"missing-until", "Expected 'until' after '%.*s'"},
+    [PARSE_ERROR_INVALID_COMPARISON] = {"invalid-comparison", "Invalid comparison at '%.*s'"},
+    [PARSE_ERROR_NESTING_TOO_DEEP]   = {"nesting-too-deep", NULL},
+    [PARSE_ERROR_TOO_MANY_ERRORS]    = {"too-many-errors", "too many errors, stopping"},
+};
+
+static const DiagMessage semantic_messages[] = {
+    [SEM_ERROR_NONE]                   = {"unknown", "Unknown semantic error with '%.*s'"},
+    [SEM_ERROR_UNDECLARED_VARIABLE]    = {"undeclared-variable", "Undeclared variable '%.*s'"},
+    [SEM_ERROR_REDECLARED_VARIABLE]    = {"redeclared-variable", "Variable '%.*s' already declared in this scope"},
+    [SEM_ERROR_TYPE_MISMATCH]          = {"type-mismatch", "Type mismatch involving '%.*s'"},
+    [SEM_ERROR_UNINITIALIZED_VARIABLE] = {"uninitialized-variable", "Variable '%.*s' may be used uninitialized"},
+    [SEM_ERROR_INVALID_OPERATION]      = {"invalid-operation", "Invalid operation involving '%.*s'"},
+    [SEM_ERROR_SEMANTIC_ERROR]         = {"semantic-error", "Unknown semantic error with '%.*s'"},
+};
+
+static const DiagMessage runtime_messages[] = {
+    [RUNTIME_ERROR_NONE]             = {"unknown", "Unknown runtime error"},
+    [RUNTIME_ERROR_DIVISION_BY_ZERO] = {"division-by-zero", "Division by zero"},
+};
+
+static const DiagMessage unknown_message = {"unknown", "Unknown error"};
+static const DiagMessage symbol_message = {"symbol-added", NULL};
+
+#define LOOKUP(table, code) \
+    ((code) < sizeof(table) / sizeof(table[0]) ? &table[code] : &unknown_message)
+
+static const DiagMessage *message_of(const Diagnostic *diag) {
+    switch (diag->phase) {
+    case DIAG_LEXICAL:  return LOOKUP(lexical_messages, diag->code);
+    case DIAG_SYNTAX:   return LOOKUP(syntax_messages, diag->code);
+    case DIAG_SEMANTIC: return LOOKUP(semantic_messages, diag->code);
+    case DIAG_SYMBOL:   return &symbol_message;
+    case DIAG_RUNTIME:  return LOOKUP(runtime_messages, diag->code);
+    default:            return &unknown_message;
+    }
+}
+
+void diag_init(Diagnostics *diags) {
+    diags->items = NULL;
+    diags->capacity = 0;
+    diags->trace = 1;
+    diag_reset(diags, NULL);
+}
+
+void diag_reset(Diagnostics *diags, const char *source) {
+    diags->count = 0;
+    diags->error_count = 0;
+    diags->source = source;
+}
+
+void diag_free(Diagnostics *diags) {
+    free(diags->items);
+    diags->items = NULL;
+    diags->count = diags->capacity = 0;
+}
+
+Diagnostic *diag_add(Diagnostics *diags, DiagSeverity severity, DiagPhase phase,
+                     int code, int line, size_t offset, size_t length) {
+    if (diags->count == diags->capacity) {
+        diags->capacity = diags->capacity ? diags->capacity * 2 : DIAG_INITIAL_CAPACITY;
+        diags->items = realloc(diags->items, diags->capacity * sizeof(Diagnostic));
+        if (!diags->items) {
+            fprintf(stderr, "Memory allocation failed\n");
+            abort();
+        }
+    }
+    if (severity == DIAG_ERROR) {
+        diags->error_count++;
+    }
+
+    Diagnostic *diag = &diags->items[diags->count++];
+    diag->severity = (uint8_t)severity;
+    diag->phase = (uint8_t)phase;
+    diag->code = (uint16_t)code;
+    diag->line = line;
+    diag->offset = offset;
+    diag->length = (uint32_t)length;
+    diag->text = diags->source ? diags->source + offset : "";
+    diag->text_length = diags->source ? (int)length : 0;
+    diag->args[0] = diag->args[1] = 0;
+    return diag;
+}
+
+// Format the message of diag into buffer, like snprintf
+static int format_message(char *buffer, size_t size, const Diagnostic *diag) {
+    if (diag->phase == DIAG_SYMBOL) {
+        return snprintf(buffer, size, "Added symbol: %.*s, Type: %s, Scope: %d, Line: %d",
+                        diag->text_length, diag->text, var_type_to_string((VarType)diag->args[0]),
+                        diag->args[1], diag->line);
+    }
+    if (diag->phase == DIAG_SYNTAX && diag->code == PARSE_ERROR_NESTING_TOO_DEEP) {
+        return snprintf(buffer, size, "Nesting deeper than %d levels at '%.*s'",
+                        diag->args[0], diag->text_length, diag->text);
+    }
+    return snprintf(buffer, size, message_of(diag)->format, diag->text_length, diag->text);
+}
+
+// Length of the well-formed UTF-8 sequence at text, 0 if there is none
+static size_t utf8_sequence(const unsigned char *text, size_t length) {
+    size_t size = text[0] >= 0xf0 ? 4 : text[0] >= 0xe0 ? 3 : 2;
+    if (text[0] < 0xc2 || text[0] > 0xf4 || size > length) return 0;
+    for (size_t i = 1; i < size; i++) {
+        if ((text[i] & 0xc0) != 0x80) return 0;
+    }
+    // Overlong forms, surrogates and code points past U+10FFFF
+    if ((text[0] == 0xe0 && text[1] < 0xa0) || (text[0] == 0xed && text[1] >= 0xa0) ||
+        (text[0] == 0xf0 && text[1] < 0x90) || (text[0] == 0xf4 && text[1] >= 0x90)) {
+        return 0;
+    }
+    return size;
+}
+
+void diag_write_json_string(const char *text, size_t length, FILE *out) {
+    fputc('"', out);
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)text[i];
+        if (c == '"' || c == '\\') {
+            fputc('\\', out);
+            fputc(c, out);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else if (c < 0x80) {
+            fputc(c, out);
+        } else {
+            // JSON text is UTF-8; a byte that is not part of a character,
+            // such as one quoted from a lexical error, becomes U+FFFD
+            size_t size = utf8_sequence((const unsigned char *)text + i, length - i);
+            if (size == 0) {
+                fputs("\\ufffd", out);
+                continue;
+            }
+            fwrite(text + i, 1, size, out);
+            i += size - 1;
+        }
+    }
+    fputc('"', out);
+}
+
+// Write the message of diag; as a JSON string when json is set
+static void write_message(const Diagnostic *diag, int json, FILE *out) {
+    char small[256];
+    char *message = small;
+    int length = format_message(small, sizeof(small), diag);
+
+    if (length < 0) return;
+    if ((size_t)length >= sizeof(small)) {
+        message = malloc((size_t)length + 1);
+        if (!message) {
+            fprintf(stderr, "Memory allocation failed\n");
+            abort();
+        }
+        format_message(message, (size_t)length + 1, diag);
+    }
+
+    if (json) {
+        diag_write_json_string(message, (size_t)length, out);
+    } else {
+        fwrite(message, 1, (size_t)length, out);
+    }
+
+    if (message != small) free(message);
+}
+
+void diag_write_json_message(const Diagnostic *diag, FILE *out) {
+    write_message(diag, 1, out);
+}
+
+const char *diag_code_name(const Diagnostic *diag) {
+    return message_of(diag)->name;
+}
+
+void diag_print(const Diagnostic *diag, FILE *out) {
+    switch (diag->phase) {
+    case DIAG_LEXICAL:
+        fprintf(out, "Lexical Error at line %d: ", diag->line);
+        break;
+    case DIAG_SYNTAX:
+        if (diag->line > 0)
+            fprintf(out, "Parse Error at line %d: ", diag->line);
+        else
+            fprintf(out, "Parse Error: ");
+        break;
+    case DIAG_SEMANTIC:
+        fprintf(out, "Semantic Error at line %d: ", diag->line);
+        break;
+    case DIAG_RUNTIME:
+        fprintf(out, "Runtime Error at line %d: ", diag->line);
+        break;
+    default:
+        break;
+    }
+    write_message(diag, 0, out);
+    fputc('\n', out);
+}
+
+static void print_json(const Diagnostic *diag, const char *path, FILE *out) {
+    static const char *severities[] = {"note", "warning", "error"};
+    static const char *phases[] = {"lexical", "syntax", "semantic", "symbol", "runtime"};
+
+    fputs("{\"file\":", out);
+    diag_write_json_string(path, strlen(path), out);
+    fprintf(out, ",\"line\":%d,\"offset\":%zu,\"length\":%u,\"severity\":\"%s\",\"phase\":\"%s\",\"code\":\"%s\",\"message\":",
+            diag->line, diag->offset, diag->length, severities[diag->severity],
+            phases[diag->phase], message_of(diag)->name);
+    write_message(diag, 1, out);
+    fputs("}\n", out);
+}
+
+void diag_render(const Diagnostics *diags, DiagFormat format, const char *path, FILE *out) {
+    diag_render_from(diags, 0, format, path, out);
+}
+
+void diag_render_from(const Diagnostics *diags, size_t first, DiagFormat format, const char *path,
+                      FILE *out) {
+    for (size_t i = first; i < diags->count; i++) {
+        if (format == DIAG_FORMAT_JSONL) {
+            print_json(&diags->items[i], path, out);
+        } else {
+            diag_print(&diags->items[i], out);
+        }
+    }
+}
@@ -0,0 +1,186 @@
+/* check.c
+ * Checking one loaded source and rendering its results, shared by the
+ * command-line driver and the compile server.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/bytecode.h"
+#include "../../include/cgen.h"
+#include "../../include/check.h"
+#include "../../include/ir.h"
+#include "../../include/jit.h"
+#include "../../include/parser.h"
+#include "../../include/semantic.h"
+#include "../../include/vm.h"
+
+int check_option(const char *arg, Options *options) {
+    if (strcmp(arg, "-q") == 0 || strcmp(arg, "--quiet") == 0) {
+        options->quiet = 1;
+    } else if (strcmp(arg, "--run") == 0) {
+        options->backend = BACKEND_VM;
+        options->quiet = 1;
+    } else if (strcmp(arg, "--jit") == 0) {
+        options->backend = BACKEND_JIT;
+        options->quiet = 1;
+    } else if (strcmp(arg, "--emit-c") == 0) {
+        options->backend = BACKEND_C;
+        options->quiet = 1;
+    } else if (strcmp(arg, "--dump-ir") == 0) {
+        options->backend = BACKEND_IR;
+        options->quiet = 1;
+    } else if (strcmp(arg, "--format=text") == 0) {
+        options->format = DIAG_FORMAT_TEXT;
+    } else if (strcmp(arg, "--format=jsonl") == 0) {
+        options->format = DIAG_FORMAT_JSONL;
+    } else if (strcmp(arg, "--stats") == 0 || strcmp(arg, "--stats=text") == 0) {
+        options->stats = STATS_TEXT;
+    } else if (strcmp(arg, "--stats=json") == 0) {
+        options->stats = STATS_JSON;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// Compile the checked program at root and execute it, writing what it
+// prints to out, or with BACKEND_C or BACKEND_IR write it out as C or IR;
+// returns 1 if it ran to completion
+static int run_program(CompilationUnit *unit, NodeId root, FILE *out, Backend backend) {
+    // C is written from the AST, which its compiler optimises; see cgen.c
+    if (backend == BACKEND_C) {
+        cgen_emit(unit, root, out);
+        return 1;
+    }
+
+    Ir ir;
+    ir_init(&ir);
+    ir_build(&ir, unit, root);
+    ir_optimize(&ir);
+    if (backend == BACKEND_IR) {
+        ir_print(&ir, out);
+        ir_free(&ir);
+        return 1;
+    }
+    if (backend == BACKEND_JIT && jit_supported(&ir)) {
+        int completed = jit_run(&ir, out);
+        if (completed >= 0) {
+            ir_free(&ir);
+            return completed;
+        }
+    }
+    Chunk chunk;
+    chunk_init(&chunk);
+    bytecode_compile(&chunk, &ir);
+    ir_free(&ir);
+    int completed = vm_run(&chunk, out, &unit->diags);
+    chunk_free(&chunk);
+    return completed;
+}
+
+// The options that change what is written for a file, for its cache key
+static uint32_t cache_variant(const Options *options) {
+    return (uint32_t)options->format | (uint32_t)options->quiet << 4 | (uint32_t)options->backend << 8;
+}
+
+int check_unit(CompilationUnit *unit, const char *name, const Options *options, char **output,
+               size_t *output_length) {
+    int timed = options->stats != STATS_OFF;
+    StatsTime time = timed ? stats_now() : (StatsTime){0, 0};
+
+    uint64_t key = 0;
+    if (options->cache) {
+        int failed;
+        key = cache_key(options->cache, unit->input.data, unit->input.length, name, cache_variant(options));
+        if (cache_lookup(options->cache, key, &failed, output, output_length)) {
+            STATS_INC(unit->stats.cache_hits);
+            unit_reset(unit);
+            if (timed) {
+                stats_phase(&unit->stats, PHASE_CACHE, &time);
+                unit->stats.files++;
+            }
+            return failed;
+        }
+        STATS_INC(unit->stats.cache_misses);
+        if (timed) stats_phase(&unit->stats, PHASE_CACHE, &time);
+    }
+
+    unit->diags.trace = !options->quiet;
+    Parser parser;
+    parser_init(&parser, unit);
+    NodeId root = parse(&parser);
+    if (timed) {
+        stats_phase(&unit->stats, PHASE_PARSE, &time);
+        unit->stats.tokens += parser.tokens;
+        stats_count_ast(&unit->stats, &unit->ast);
+        time = stats_now();
+    }
+
+    // print_ast(unit, root, 0);
+
+    int result = analyze_semantics(root, unit) && parser_error_count(&parser) == 0;
+    if (timed) {
+        stats_phase(&unit->stats, PHASE_ANALYZE, &time);
+    }
+
+    *output = NULL;
+    *output_length = 0;
+    FILE *out = open_memstream(output, output_length);
+    if (!out) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    int jsonl = options->format == DIAG_FORMAT_JSONL;
+    int run = result && options->backend != BACKEND_NONE;
+    int completed = 1;
+    char *program_output = NULL;
+    size_t program_output_length = 0;
+    size_t rendered = 0;
+
+    if (run) {
+        // As text, the program's output follows the diagnostics so far and
+        // precedes a runtime error; as JSON Lines it goes in the result
+        if (!jsonl) {
+            diag_render(&unit->diags, options->format, name, out);
+            rendered = unit->diags.count;
+        }
+        FILE *program_out = jsonl ? open_memstream(&program_output, &program_output_length) : out;
+        if (!program_out) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+        if (timed) time = stats_now();
+        completed = run_program(unit, root, program_out, options->backend);
+        if (timed) stats_phase(&unit->stats, PHASE_RUN, &time);
+        if (jsonl) fclose(program_out);
+    }
+    diag_render_from(&unit->diags, rendered, options->format, name, out);
+
+    if (jsonl) {
+        fputs("{\"file\":", out);
+        diag_write_json_string(name, strlen(name), out);
+        fprintf(out, ",\"result\":\"%s\"", result ? "passed" : "failed");
+        if (run) {
+            fputs(",\"output\":", out);
+            diag_write_json_string(program_output ? program_output : "", program_output_length, out);
+        }
+        fputs("}\n", out);
+    } else if (!result) {
+        fprintf(out, "Semantic analysis failed.\n");
+    } else if (options->backend == BACKEND_NONE) {
+        fprintf(out, "Semantic analysis passed.\n");
+    }
+    fclose(out);
+    free(program_output);
+    unit_reset(unit);
+    if (timed) stats_phase(&unit->stats, PHASE_RENDER, &time);
+
+    int failed = !result || !completed;
+    if (options->cache) {
+        cache_store(options->cache, key, failed, *output, *output_length);
+        if (timed) stats_phase(&unit->stats, PHASE_CACHE, &time);
+    }
+    if (timed) unit->stats.files++;
+    return failed;
+}
@@ -0,0 +1,442 @@
+/* driver.c
+ * Command-line driver. Checks every file named on the command line, and
+ * every file under each directory named, on a pool of worker threads.
+ *
+ *     semantic_main [-j N] [-q] [--run | --jit | --emit-c | --dump-ir]
+ *                   [--format=text|jsonl] [--stats[=json]]
+ *                   [--cache=DIR [--cache-size=BYTES]]
+ *                   [--client=SOCKET] [file | directory | -]...
+ *     semantic_main [-j N] --server=SOCKET
+ *     semantic_main --lsp
+ *
+ * -q/--quiet drops the "Added symbol" trace; --format=jsonl writes one JSON
+ * object per diagnostic, plus one per file with its result. --stats reports
+ * per-phase timings and counters on stderr once every file is checked.
+ *
+ * --run lowers each file that passes to SSA form, optimises it, compiles it
+ * to bytecode and executes it. The
+ * trace and the "passed" line are dropped, so a program's output is all
+ * that is written for it; in JSON Lines the output is the result object's
+ * "output" string. Any file failing to check or to run makes the exit
+ * status 1. --jit is --run with programs that only use ints compiled to
+ * native code; the others still run on the VM. --emit-c writes each file
+ * that passes as a C program in place of its output, to be built with a C
+ * compiler, and --dump-ir writes its optimised IR.
+ *
+ * --server=SOCKET runs a compile server on N threads at the Unix socket
+ * SOCKET until interrupted, and --client=SOCKET has it check the files
+ * instead of checking them in this process; see server.h.
+ *
+ * --cache=DIR keeps each file's result in DIR, keyed by the hash of its
+ * contents, and reuses it while the file, its name, the options and the
+ * checker are unchanged; see cache.h. Once a run has added to it, the
+ * least recently used entries are deleted until DIR holds at most
+ * --cache-size bytes, 256M by default (K, M and G suffixes are accepted).
+ * --stats reports hits, misses and evictions.
+ *
+ * --lsp runs a language server on stdin and stdout, re-checking each open
+ * document incrementally as the editor changes it; see lsp.h.
+ *
+ * Each worker owns a CompilationUnit and reuses it from file to file. Files
+ * are dealt out to the workers' deques up front; a worker takes files from
+ * the front of its own deque and, once that is empty, steals from the back
+ * of the others'. A file's diagnostics are recorded while it is checked and
+ * rendered into a buffer once it is done; the main thread writes the buffers
+ * out in input order, so the output does not depend on the number of threads
+ * or on scheduling.
+ */
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../../include/check.h"
+#include "../../include/lsp.h"
+#include "../../include/server.h"
+#include "../../include/unit.h"
+
+#define SEMANTIC_INPUT_FILE "test/input_semantic_error.txt"
+
+// A file to check and, once done, its buffered output
+typedef struct {
+    char *path;
+    char *output;         // Diagnostics, written out by the main thread
+    size_t output_length;
+    int error;            // errno if the file could not be read, else 0
+    int failed;           // Did not pass, or with --run did not run through
+    int done;
+} Job;
+
+// Range of job indices still to be checked by one worker: the owner takes
+// from head, thieves from tail
+typedef struct {
+    pthread_mutex_t lock;
+    size_t head, tail;
+} Deque;
+
+typedef struct {
+    Job *jobs;
+    size_t job_count;
+    Options options;
+    Stats stats;          // Workers' totals, merged under done_lock
+    Deque *deques;
+    int worker_count;
+
+    // Signalled each time a job is done
+    pthread_mutex_t done_lock;
+    pthread_cond_t done_cond;
+} Pool;
+
+typedef struct {
+    Pool *pool;
+    int id;
+    pthread_t thread;
+} Worker;
+
+typedef struct {
+    Job *jobs;
+    size_t count, capacity;
+} JobList;
+
+static void *checked_realloc(void *ptr, size_t size) {
+    ptr = realloc(ptr, size);
+    if (!ptr) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    return ptr;
+}
+
+static void add_job(JobList *list, const char *path) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->jobs = checked_realloc(list->jobs, list->capacity * sizeof(Job));
+    }
+    Job *job = &list->jobs[list->count++];
+    memset(job, 0, sizeof(Job));
+    job->path = strdup(path);
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Add every file under dir, in name order, skipping hidden entries
+static void add_directory(JobList *list, const char *dir) {
+    DIR *stream = opendir(dir);
+    if (!stream) {
+        // Reported when the job is checked
+        add_job(list, dir);
+        return;
+    }
+
+    char **names = NULL;
+    size_t count = 0, capacity = 0;
+    struct dirent *entry;
+    while ((entry = readdir(stream)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            names = checked_realloc(names, capacity * sizeof(char *));
+        }
+        names[count++] = strdup(entry->d_name);
+    }
+    closedir(stream);
+    qsort(names, count, sizeof(char *), compare_names);
+
+    size_t dir_length = strlen(dir);
+    int slash = dir_length > 0 && dir[dir_length - 1] == '/';
+    for (size_t i = 0; i < count; i++) {
+        size_t length = dir_length + strlen(names[i]) + 2;
+        char *path = checked_realloc(NULL, length);
+        snprintf(path, length, slash ? "%s%s" : "%s/%s", dir, names[i]);
+
+        struct stat st;
+        if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+            add_directory(list, path);
+        } else {
+            add_job(list, path);
+        }
+        free(path);
+        free(names[i]);
+    }
+    free(names);
+}
+
+static void add_argument(JobList *list, const char *path) {
+    struct stat st;
+    if (strcmp(path, "-") != 0 && stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+        add_directory(list, path);
+    } else {
+        add_job(list, path);
+    }
+}
+
+// Load and check one file into the job's output buffer
+static void check_job(CompilationUnit *unit, Job *job, const Options *options) {
+    int timed = options->stats != STATS_OFF;
+    StatsTime time = timed ? stats_now() : (StatsTime){0, 0};
+
+    if (unit_load(unit, job->path) != 0) {
+        job->error = errno ? errno : EIO;
+        return;
+    }
+    if (timed) stats_phase(&unit->stats, PHASE_LOAD, &time);
+    job->failed = check_unit(unit, job->path, options, &job->output, &job->output_length);
+}
+
+// Next job for worker id: from the front of its own deque, else stolen from
+// the back of another's. Returns 0 once every deque is empty.
+static int take_job(Pool *pool, int id, size_t *index) {
+    for (int i = 0; i < pool->worker_count; i++) {
+        int victim = (id + i) % pool->worker_count;
+        Deque *deque = &pool->deques[victim];
+        int found = 0;
+
+        pthread_mutex_lock(&deque->lock);
+        if (deque->head < deque->tail) {
+            *index = victim == id ? deque->head++ : --deque->tail;
+            found = 1;
+        }
+        pthread_mutex_unlock(&deque->lock);
+        if (found) return 1;
+    }
+    return 0;
+}
+
+static void *worker_main(void *arg) {
+    Worker *worker = arg;
+    Pool *pool = worker->pool;
+    CompilationUnit unit;
+    size_t index;
+
+    unit_init(&unit);
+    while (take_job(pool, worker->id, &index)) {
+        check_job(&unit, &pool->jobs[index], &pool->options);
+
+        pthread_mutex_lock(&pool->done_lock);
+        pool->jobs[index].done = 1;
+        pthread_cond_broadcast(&pool->done_cond);
+        pthread_mutex_unlock(&pool->done_lock);
+    }
+
+    pthread_mutex_lock(&pool->done_lock);
+    stats_merge(&pool->stats, &unit.stats);
+    pthread_mutex_unlock(&pool->done_lock);
+    unit_free(&unit);
+    return NULL;
+}
+
+// Check every job and write the results out in job order; returns the
+// number of files that could not be read, or with a backend that failed to
+// check or run. Totals go to *stats.
+static int run_jobs(Job *jobs, size_t job_count, int worker_count, const Options *options,
+                    Stats *stats) {
+    Pool pool = {0};
+    int failures = 0;
+
+    if ((size_t)worker_count > job_count) worker_count = (int)job_count;
+    if (worker_count < 1) worker_count = 1;
+
+    pool.jobs = jobs;
+    pool.job_count = job_count;
+    pool.options = *options;
+    pool.worker_count = worker_count;
+    pool.deques = checked_realloc(NULL, worker_count * sizeof(Deque));
+    pthread_mutex_init(&pool.done_lock, NULL);
+    pthread_cond_init(&pool.done_cond, NULL);
+
+    // Deal out contiguous runs of jobs, so each worker starts at the front
+    // of its run and results tend to finish in output order
+    for (int i = 0; i < worker_count; i++) {
+        pthread_mutex_init(&pool.deques[i].lock, NULL);
+        pool.deques[i].head = job_count * i / worker_count;
+        pool.deques[i].tail = job_count * (i + 1) / worker_count;
+    }
+
+    Worker *workers = checked_realloc(NULL, worker_count * sizeof(Worker));
+    for (int i = 0; i < worker_count; i++) {
+        workers[i].pool = &pool;
+        workers[i].id = i;
+        if (pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) != 0) {
+            fprintf(stderr, "Could not start worker thread\n");
+            exit(1);
+        }
+    }
+
+    for (size_t i = 0; i < job_count; i++) {
+        Job *job = &jobs[i];
+
+        pthread_mutex_lock(&pool.done_lock);
+        while (!job->done) {
+            pthread_cond_wait(&pool.done_cond, &pool.done_lock);
+        }
+        pthread_mutex_unlock(&pool.done_lock);
+
+        if (job_count > 1 && options->format == DIAG_FORMAT_TEXT) {
+            printf("== %s ==\n", job->path);
+        }
+        if (job->output) {
+            fwrite(job->output, 1, job->output_length, stdout);
+        }
+        if (job->error) {
+            fflush(stdout);
+            fprintf(stderr, "Error reading file %s: %s\n", job->path, strerror(job->error));
+            failures++;
+        } else if (options->backend != BACKEND_NONE && job->failed) {
+            failures++;
+        }
+        free(job->output);
+        job->output = NULL;
+    }
+
+    for (int i = 0; i < worker_count; i++) {
+        pthread_join(workers[i].thread, NULL);
+        pthread_mutex_destroy(&pool.deques[i].lock);
+    }
+    *stats = pool.stats;
+    pthread_cond_destroy(&pool.done_cond);
+    pthread_mutex_destroy(&pool.done_lock);
+    free(workers);
+    free(pool.deques);
+    return failures;
+}
+
+// Size with an optional K, M or G suffix; 0 if it is not one
+static uint64_t parse_size(const char *text) {
+    char *end;
+    unsigned long long size = strtoull(text, &end, 10);
+    if (end == text) return 0;
+    switch (*end) {
+    case 'K': case 'k': size <<= 10; end++; break;
+    case 'M': case 'm': size <<= 20; end++; break;
+    case 'G': case 'g': size <<= 30; end++; break;
+    }
+    return *end == '\0' ? size : 0;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: semantic_main [-j N] [-q] [--run | --jit | --emit-c | --dump-ir]\n"
+                    "                     [--format=text|jsonl] [--stats[=json]]\n"
+                    "                     [--cache=DIR [--cache-size=BYTES]]\n"
+                    "                     [--client=SOCKET] [file | directory | -]...\n"
+                    "       semantic_main [-j N] --server=SOCKET\n"
+                    "       semantic_main --lsp\n");
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    JobList list = {0};
+    Options options = {DIAG_FORMAT_TEXT, 0, BACKEND_NONE, STATS_OFF, NULL};
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *server = NULL;
+    const char *client = NULL;
+    const char *cache_dir = NULL;
+    uint64_t cache_limit = CACHE_DEFAULT_LIMIT;
+    Cache cache;
+    int lsp = 0;
+    static char buffer[1 << 16];
+
+    // Results are written in large blocks, never line by line
+    setvbuf(stdout, buffer, _IOFBF, sizeof(buffer));
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (check_option(arg, &options)) continue;
+        if (strcmp(arg, "-j") == 0 || strcmp(arg, "--jobs") == 0) {
+            if (++i == argc) usage();
+            jobs = atol(argv[i]);
+            if (jobs < 1) usage();
+        } else if (strncmp(arg, "--jobs=", 7) == 0) {
+            jobs = atol(arg + 7);
+            if (jobs < 1) usage();
+        } else if (strncmp(arg, "-j", 2) == 0) {
+            jobs = atol(arg + 2);
+            if (jobs < 1) usage();
+        } else if (strncmp(arg, "--server=", 9) == 0 && arg[9] != '\0') {
+            server = arg + 9;
+        } else if (strncmp(arg, "--client=", 9) == 0 && arg[9] != '\0') {
+            client = arg + 9;
+        } else if (strncmp(arg, "--cache=", 8) == 0 && arg[8] != '\0') {
+            cache_dir = arg + 8;
+        } else if (strncmp(arg, "--cache-size=", 13) == 0) {
+            cache_limit = parse_size(arg + 13);
+            if (cache_limit == 0) usage();
+        } else if (strcmp(arg, "--lsp") == 0) {
+            lsp = 1;
+        } else if (strcmp(arg, "--") == 0) {
+            while (++i < argc) add_argument(&list, argv[i]);
+        } else if (arg[0] == '-' && arg[1] != '\0') {
+            usage();
+        } else {
+            add_argument(&list, arg);
+        }
+    }
+
+    if (cache_dir && (lsp || server || client)) usage();
+    if (lsp) {
+        if (server || client || list.count > 0) usage();
+        return lsp_run(stdin, stdout);
+    }
+    if (server) {
+        if (client || list.count > 0) usage();
+        return server_run(server, (int)jobs);
+    }
+
+    // No inputs: check the default file; "-" reads stdin
+    if (list.count == 0) {
+        add_job(&list, SEMANTIC_INPUT_FILE);
+    }
+    if (jobs < 1) jobs = 1;
+
+    if (client) {
+        char **paths = checked_realloc(NULL, list.count * sizeof(char *));
+        for (size_t i = 0; i < list.count; i++) {
+            paths[i] = list.jobs[i].path;
+        }
+        int failures = client_run(client, paths, list.count, &options);
+        free(paths);
+        for (size_t i = 0; i < list.count; i++) {
+            free(list.jobs[i].path);
+        }
+        free(list.jobs);
+        return failures != 0;
+    }
+
+    // Without its cache a run is only slower
+    if (cache_dir) {
+        if (cache_open(&cache, cache_dir, cache_limit) == 0) {
+            options.cache = &cache;
+        } else {
+            fprintf(stderr, "Cannot use cache %s: %s\n", cache_dir, strerror(errno));
+        }
+    }
+
+    Stats stats;
+    StatsTime start = stats_now();
+    int failures = run_jobs(list.jobs, list.count, (int)jobs, &options, &stats);
+    if (options.cache && stats.cache_misses > 0) {
+        cache_trim(&cache, &stats);
+    }
+
+    if (options.stats != STATS_OFF) {
+        double elapsed = stats_now().wall - start.wall;
+        fflush(stdout);
+        if (options.stats == STATS_JSON) {
+            stats_print_json(&stats, elapsed, stderr);
+        } else {
+            stats_print_text(&stats, elapsed, stderr);
+        }
+    }
+
+    if (options.cache) cache_close(&cache);
+    for (size_t i = 0; i < list.count; i++) {
+        free(list.jobs[i].path);
+    }
+    free(list.jobs);
+    return failures > 0;
+}
@@ -0,0 +1,129 @@
+/* input.c */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../../include/input.h"
+
+static const char empty_source[1] = "";
+
+// Map a regular file read-only. The mapping is placed over an anonymous
+// reservation one page larger than the file, so the byte after the last one
+// is always a mapped zero that terminates the text.
+static int map_file(SourceInput *input, int fd, size_t size) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t map_length = (size + page) / page * page + page;
+
+    char *base = mmap(NULL, map_length, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        return -1;
+    }
+    if (mmap(base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, map_length);
+        return -1;
+    }
+    madvise(base, size, MADV_SEQUENTIAL);
+
+    input->data = base;
+    input->length = size;
+    input->map_length = map_length;
+    input->mapped = 1;
+    input->borrowed = 0;
+    return 0;
+}
+
+// Read a stream in bounded chunks; the buffer grows geometrically because the
+// tokens and AST refer back into the whole text
+static int read_stream(SourceInput *input, int fd) {
+    size_t capacity = INPUT_CHUNK_SIZE + 1;
+    size_t length = 0;
+    char *buffer = malloc(capacity);
+    if (!buffer) {
+        return -1;
+    }
+
+    for (;;) {
+        if (capacity - length < INPUT_CHUNK_SIZE + 1) {
+            capacity *= 2;
+            char *grown = realloc(buffer, capacity);
+            if (!grown) {
+                free(buffer);
+                return -1;
+            }
+            buffer = grown;
+        }
+
+        ssize_t n = read(fd, buffer + length, INPUT_CHUNK_SIZE);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            free(buffer);
+            return -1;
+        }
+        if (n == 0) break;
+        length += (size_t)n;
+    }
+
+    buffer[length] = '\0';
+    input->data = buffer;
+    input->length = length;
+    input->map_length = 0;
+    input->mapped = 0;
+    input->borrowed = 0;
+    return 0;
+}
+
+int input_open(SourceInput *input, const char *path) {
+    int is_stdin = strcmp(path, "-") == 0;
+    int fd = is_stdin ? STDIN_FILENO : open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    int regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+    int result;
+    if (regular && st.st_size == 0) {
+        input->data = empty_source;
+        input->length = 0;
+        input->map_length = 0;
+        input->mapped = 0;
+        input->borrowed = 0;
+        result = 0;
+    } else if (regular && st.st_size >= INPUT_CHUNK_SIZE && map_file(input, fd, (size_t)st.st_size) == 0) {
+        result = 0;
+    } else {
+        // Pipes, terminals, files too small for a mapping to pay off, or a
+        // file that could not be mapped
+        result = read_stream(input, fd);
+    }
+
+    int saved_errno = errno;
+    if (!is_stdin) {
+        close(fd);
+    }
+    errno = saved_errno;
+    return result;
+}
+
+void input_borrow(SourceInput *input, const char *data, size_t length) {
+    input->data = data;
+    input->length = length;
+    input->map_length = 0;
+    input->mapped = 0;
+    input->borrowed = 1;
+}
+
+void input_close(SourceInput *input) {
+    if (input->mapped) {
+        munmap((void *)input->data, input->map_length);
+    } else if (input->data != empty_source && !input->borrowed) {
+        free((void *)input->data);
+    }
+    input->data = NULL;
+    input->length = 0;
+}
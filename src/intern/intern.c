@@ -0,0 +1,142 @@
+/* intern.c */
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/intern.h"
+
+#define INTERN_INITIAL_SLOTS 1024
+
+static uint32_t hash_bytes(const char *text, size_t length) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void grow_slots(Interner *interner) {
+    uint32_t slot_count = (interner->slot_mask + 1) * 2;
+    free(interner->slots);
+    interner->slots = calloc(slot_count, sizeof(uint32_t));
+    interner->slot_mask = slot_count - 1;
+
+    for (uint32_t id = 1; id < interner->count; id++) {
+        uint32_t slot = interner->entries[id].hash & interner->slot_mask;
+        while (interner->slots[slot]) slot = (slot + 1) & interner->slot_mask;
+        interner->slots[slot] = id;
+    }
+}
+
+// Probe for text; returns its ID, or 0 with *slot set to the empty slot
+// where it belongs
+static InternId find(const Interner *interner, const char *text, size_t length,
+                     uint32_t hash, uint32_t *slot) {
+    uint32_t i = hash & interner->slot_mask;
+    while (interner->slots[i]) {
+        const InternEntry *entry = &interner->entries[interner->slots[i]];
+        if (entry->hash == hash && entry->length == length && memcmp(entry->text, text, length) == 0) {
+            return interner->slots[i];
+        }
+        i = (i + 1) & interner->slot_mask;
+    }
+    *slot = i;
+    return INTERN_NONE;
+}
+
+// Copy a new string into the arena and give it the next ID
+static InternId add(Interner *interner, const char *text, size_t length, uint32_t hash, uint32_t slot) {
+    if (interner->count == interner->capacity) {
+        interner->capacity *= 2;
+        interner->entries = realloc(interner->entries, interner->capacity * sizeof(InternEntry));
+    }
+
+    InternId id = interner->count++;
+    char *stored = arena_alloc(interner->arena, length + 1);
+    memcpy(stored, text, length);
+    stored[length] = '\0';
+    interner->entries[id] = (InternEntry){stored, (uint32_t)length, hash};
+    interner->slots[slot] = id;
+
+    // Keep the load factor at or below one half
+    if (interner->count * 2 > interner->slot_mask + 1) {
+        grow_slots(interner);
+    }
+    return id;
+}
+
+void intern_init(Interner *interner, Arena *arena) {
+    interner->capacity = 256;
+    interner->count = 1;
+    interner->entries = malloc(interner->capacity * sizeof(InternEntry));
+    interner->entries[0] = (InternEntry){"", 0, 0};
+    interner->slots = calloc(INTERN_INITIAL_SLOTS, sizeof(uint32_t));
+    interner->slot_mask = INTERN_INITIAL_SLOTS - 1;
+    interner->arena = arena;
+    interner->scratch = NULL;
+    interner->scratch_size = 0;
+}
+
+void intern_free(Interner *interner) {
+    free(interner->entries);
+    free(interner->slots);
+    free(interner->scratch);
+    interner->entries = NULL;
+    interner->slots = NULL;
+    interner->scratch = NULL;
+    interner->count = interner->capacity = 0;
+}
+
+void intern_reset(Interner *interner) {
+    interner->count = 1;
+    memset(interner->slots, 0, (interner->slot_mask + 1) * sizeof(uint32_t));
+}
+
+InternId intern(Interner *interner, const char *text, size_t length) {
+    uint32_t hash = hash_bytes(text, length);
+    uint32_t slot;
+    InternId id = find(interner, text, length, hash, &slot);
+    if (id != INTERN_NONE) {
+        return id;
+    }
+
+    // Only new strings are copied
+    return add(interner, text, length, hash, slot);
+}
+
+InternId intern_string_literal(Interner *interner, const char *body, size_t length) {
+    // Decoding only ever shrinks the text, so length bytes of scratch are
+    // enough; the value is copied into the arena only if it is new
+    if (interner->scratch_size < length) {
+        interner->scratch_size = length * 2;
+        interner->scratch = realloc(interner->scratch, interner->scratch_size);
+    }
+    char *value = interner->scratch;
+    size_t n = 0;
+    for (size_t i = 0; i < length; i++) {
+        char c = body[i];
+        if (c == '\\' && i + 1 < length) {
+            c = body[++i];
+            switch (c) {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                default: break; // \\, \" and unknown escapes keep the character
+            }
+        }
+        value[n++] = c;
+    }
+
+    uint32_t hash = hash_bytes(value, n);
+    uint32_t slot;
+    InternId id = find(interner, value, n, hash, &slot);
+    if (id != INTERN_NONE) {
+        return id;
+    }
+    return add(interner, value, n, hash, slot);
+}
+
+const char *intern_text(const Interner *interner, InternId id, size_t *length) {
+    if (length) *length = interner->entries[id].length;
+    return interner->entries[id].text;
+}
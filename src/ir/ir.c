@@ -0,0 +1,902 @@
+/* ir.c
+ * SSA intermediate representation: the container, its lowering from a
+ * checked AST, the block order and dominators the passes work from, and a
+ * text dump for --dump-ir.
+ *
+ * The lowering builds SSA form directly, from the structure of the program
+ * rather than from dominance frontiers. It keeps the current value of each
+ * variable, and a trail of the values it overwrites so that leaving the body
+ * of an if or a loop can restore the values from before it. An if's join
+ * gets a phi for each variable its body changed; a loop's header gets a phi
+ * for each variable assigned in the loop, whose second operand is filled in
+ * once the body is lowered. Phis that turn out to be trivial are left to
+ * copy propagation. Like the compiler, the lowering walks the tree with an
+ * explicit stack.
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/ir.h"
+#include "../../include/lexer.h"
+
+#define IR_INITIAL_CAPACITY 64
+
+// Columns of a node
+#define NODE_KIND(node) ((ASTNodeType)b->ast->kind[node])
+#define NODE_LEFT(node) (b->ast->first_child[node])
+#define NODE_RIGHT(node) AST_SECOND_CHILD(b->ast, node)
+#define NODE_TYPE(node) ((VarType)b->ast->var_type[node])
+#define NODE_BINDING(node) (b->ast->binding[node])
+#define NODE_TEXT(node) (b->source + AST_START(b->ast, node))
+
+static const char *const op_names[IR_OP_COUNT] = {
+#define IR_OP(name) #name,
+#include "../../include/ir_ops.def"
+};
+
+// A variable and a value of it
+typedef struct {
+    NodeId decl;
+    IrValue value;
+} Assignment;
+
+// A node being lowered; state counts the children already lowered
+typedef struct {
+    NodeId node;
+    int state;
+    uint32_t block;    // Join of an if or of && and ||, header of a loop
+    uint32_t exit;     // Block after a while loop
+    size_t mark;       // Trail length when a body began
+    size_t first;      // A loop's first phi in Builder.phis
+    NodeId cursor;     // Next statement of a block
+} LowerFrame;
+
+typedef struct {
+    Ir *ir;
+    const Ast *ast;
+    const char *source;
+    const Interner *interner;
+    uint32_t current;      // Block being appended to
+
+    IrValue *defs;         // Current value of each variable, by VARDECL;
+                           // IR_NONE where it is not defined
+    uint32_t *marks;       // Per node, for the scans of loops and ifs
+    uint32_t stamp;
+    Assignment *trail;     // Values overwritten, most recent last
+    size_t trail_count, trail_capacity;
+    Assignment *phis;      // Header phis of the loops being lowered, then
+                           // an if's changed variables while it is joined
+    size_t phi_count, phi_capacity;
+
+    LowerFrame *frames;
+    size_t frame_count, frame_capacity;
+    IrValue *stack;        // Values of the operands lowered so far
+    size_t stack_count, stack_capacity;
+    NodeId *scan;
+    size_t scan_count, scan_capacity;
+} Builder;
+
+static void *grow(void *array, size_t *capacity, size_t count, size_t size) {
+    if (count < *capacity) return array;
+    *capacity = *capacity ? *capacity * 2 : IR_INITIAL_CAPACITY;
+    array = realloc(array, *capacity * size);
+    if (!array) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    return array;
+}
+
+static void *grow32(void *array, uint32_t *capacity, uint32_t count, size_t size) {
+    size_t wide = *capacity;
+    array = grow(array, &wide, count, size);
+    *capacity = (uint32_t)wide;
+    return array;
+}
+
+static void *allocate(size_t count, size_t size) {
+    void *array = calloc(count ? count : 1, size);
+    if (!array) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    return array;
+}
+
+void ir_init(Ir *ir) {
+    memset(ir, 0, sizeof(Ir));
+    arena_init(&ir->strings);
+}
+
+void ir_free(Ir *ir) {
+    for (uint32_t i = 0; i < ir->block_count; i++) {
+        free(ir->blocks[i].code);
+    }
+    free(ir->values);
+    free(ir->blocks);
+    free(ir->constant_table);
+    free(ir->order);
+    free(ir->order_index);
+    free(ir->idom);
+    free(ir->dom_enter);
+    free(ir->dom_exit);
+    arena_free(&ir->strings);
+    memset(ir, 0, sizeof(Ir));
+}
+
+int ir_operand_count(const Ir *ir, IrValue value) {
+    const IrInstr *instr = &ir->values[value];
+    switch ((IrOp)instr->op) {
+    case IR_CONST:
+        return 0;
+    case IR_PHI:
+        return (int)ir->blocks[instr->block].pred_count;
+    case IR_COPY: case IR_INT_TO_FLOAT: case IR_FLOAT_TO_INT: case IR_TO_CHAR:
+    case IR_BOOL_INT: case IR_BOOL_FLOAT: case IR_BOOL_STRING: case IR_FACTORIAL:
+    case IR_PRINT_INT: case IR_PRINT_FLOAT: case IR_PRINT_CHAR: case IR_PRINT_STRING:
+        return 1;
+    default:
+        return 2;
+    }
+}
+
+IrValue ir_add(Ir *ir, uint32_t block, IrOp op, VarType type, IrValue a, IrValue b) {
+    if (ir->value_count == 0) {
+        // IR_NONE
+        ir->values = grow32(ir->values, &ir->value_capacity, 0, sizeof(IrInstr));
+        memset(&ir->values[0], 0, sizeof(IrInstr));
+        ir->value_count = 1;
+    }
+    ir->values = grow32(ir->values, &ir->value_capacity, ir->value_count, sizeof(IrInstr));
+    IrValue value = ir->value_count++;
+    IrInstr *instr = &ir->values[value];
+    memset(instr, 0, sizeof(IrInstr));
+    instr->op = (uint8_t)op;
+    instr->type = (uint8_t)type;
+    instr->block = block;
+    instr->operands[0] = a;
+    instr->operands[1] = b;
+
+    if (block != IR_NO_BLOCK) {
+        IrBlock *target = &ir->blocks[block];
+        target->code = grow32(target->code, &target->capacity, target->count, sizeof(IrValue));
+        target->code[target->count++] = value;
+    }
+    return value;
+}
+
+static uint32_t constant_hash(VarType type, int64_t bits) {
+    uint64_t hash = ((uint64_t)bits ^ type) * 0x9e3779b97f4a7c15ULL;
+    return (uint32_t)(hash >> 32);
+}
+
+IrValue ir_constant(Ir *ir, VarType type, Value value) {
+    // Equal bits and type; a string is only equal to the same string
+    Value bits;
+    memset(&bits, 0, sizeof(bits));
+    if (type == TYPE_FLOAT) bits.f = value.f;
+    else if (type == TYPE_STRING) bits.s = value.s;
+    else bits.i = value.i;
+
+    if (ir->constant_count * 2 >= ir->constant_capacity) {
+        // Rehash at half full
+        uint32_t old_capacity = ir->constant_capacity;
+        IrValue *old = ir->constant_table;
+        ir->constant_capacity = old_capacity ? old_capacity * 2 : IR_INITIAL_CAPACITY;
+        ir->constant_table = allocate(ir->constant_capacity, sizeof(IrValue));
+        for (uint32_t i = 0; i < old_capacity; i++) {
+            if (old[i] == IR_NONE) continue;
+            const IrInstr *instr = &ir->values[old[i]];
+            uint32_t slot = constant_hash((VarType)instr->type, instr->constant.i) & (ir->constant_capacity - 1);
+            while (ir->constant_table[slot] != IR_NONE) slot = (slot + 1) & (ir->constant_capacity - 1);
+            ir->constant_table[slot] = old[i];
+        }
+        free(old);
+    }
+
+    uint32_t slot = constant_hash(type, bits.i) & (ir->constant_capacity - 1);
+    for (;;) {
+        IrValue found = ir->constant_table[slot];
+        if (found == IR_NONE) break;
+        const IrInstr *instr = &ir->values[found];
+        if (instr->type == type && instr->constant.i == bits.i && instr->block != IR_NO_BLOCK) return found;
+        slot = (slot + 1) & (ir->constant_capacity - 1);
+    }
+
+    IrValue constant = ir_add(ir, 0, IR_CONST, type, IR_NONE, IR_NONE);
+    ir->values[constant].constant = bits;
+    ir->constant_table[slot] = constant;
+    ir->constant_count++;
+    return constant;
+}
+
+void ir_remove_pred(Ir *ir, uint32_t block, uint32_t pred) {
+    IrBlock *target = &ir->blocks[block];
+    uint32_t k = target->preds[0] == pred ? 0 : 1;
+    for (uint32_t i = 0; i < target->count; i++) {
+        IrInstr *instr = &ir->values[target->code[i]];
+        if (instr->op != IR_PHI) break;
+        if (k == 0) instr->operands[0] = instr->operands[1];
+        instr->operands[1] = IR_NONE;
+    }
+    if (k == 0) target->preds[0] = target->preds[1];
+    target->pred_count--;
+}
+
+// Block order and dominators
+
+void ir_analyze(Ir *ir) {
+    uint32_t count = ir->block_count;
+    free(ir->order);
+    free(ir->order_index);
+    free(ir->idom);
+    free(ir->dom_enter);
+    free(ir->dom_exit);
+    ir->order = allocate(count, sizeof(uint32_t));
+    ir->order_index = allocate(count, sizeof(uint32_t));
+    ir->idom = allocate(count, sizeof(uint32_t));
+    ir->dom_enter = allocate(count, sizeof(uint32_t));
+    ir->dom_exit = allocate(count, sizeof(uint32_t));
+    for (uint32_t i = 0; i < count; i++) {
+        ir->order_index[i] = UINT32_MAX;
+        ir->idom[i] = UINT32_MAX;
+    }
+
+    // Depth-first postorder, visiting a block's second successor before its
+    // first so that the first comes right after it in reverse postorder: a
+    // loop's body after its header, an if's body after its condition
+    uint32_t *stack = allocate(count, sizeof(uint32_t));
+    uint8_t *next = allocate(count, 1);
+    uint8_t *visited = allocate(count, 1);
+    uint32_t depth = 0, posted = 0;
+    stack[depth++] = 0;
+    visited[0] = 1;
+    while (depth > 0) {
+        uint32_t block = stack[depth - 1];
+        const IrBlock *current = &ir->blocks[block];
+        int succ_count = current->exit == IR_EXIT_BRANCH ? 2 : current->exit == IR_EXIT_JUMP ? 1 : 0;
+        if (next[block] < succ_count) {
+            uint32_t succ = current->succs[succ_count - 1 - next[block]++];
+            if (!visited[succ]) {
+                visited[succ] = 1;
+                stack[depth++] = succ;
+            }
+            continue;
+        }
+        depth--;
+        ir->order[posted++] = block;
+    }
+    for (uint32_t i = 0; i < posted / 2; i++) {
+        uint32_t swap = ir->order[i];
+        ir->order[i] = ir->order[posted - 1 - i];
+        ir->order[posted - 1 - i] = swap;
+    }
+    ir->order_count = posted;
+    for (uint32_t i = 0; i < posted; i++) ir->order_index[ir->order[i]] = i;
+    free(stack);
+    free(next);
+    free(visited);
+
+    // Cooper, Harvey and Kennedy's iteration over reverse postorder
+    ir->idom[0] = 0;
+    for (int changed = 1; changed;) {
+        changed = 0;
+        for (uint32_t i = 1; i < posted; i++) {
+            uint32_t block = ir->order[i];
+            const IrBlock *current = &ir->blocks[block];
+            uint32_t idom = UINT32_MAX;
+            for (uint32_t p = 0; p < current->pred_count; p++) {
+                uint32_t pred = current->preds[p];
+                if (ir->idom[pred] == UINT32_MAX) continue;
+                if (idom == UINT32_MAX) {
+                    idom = pred;
+                    continue;
+                }
+                uint32_t a = pred, c = idom;
+                while (a != c) {
+                    while (ir->order_index[a] > ir->order_index[c]) a = ir->idom[a];
+                    while (ir->order_index[c] > ir->order_index[a]) c = ir->idom[c];
+                }
+                idom = a;
+            }
+            if (ir->idom[block] != idom) {
+                ir->idom[block] = idom;
+                changed = 1;
+            }
+        }
+    }
+
+    // Number the dominator tree depth first, through child lists
+    uint32_t *first_child = allocate(count, sizeof(uint32_t));
+    uint32_t *next_sibling = allocate(count, sizeof(uint32_t));
+    for (uint32_t i = posted; i-- > 1;) {
+        uint32_t block = ir->order[i];
+        next_sibling[block] = first_child[ir->idom[block]];
+        first_child[ir->idom[block]] = block + 1;
+    }
+    uint32_t *path = allocate(count, sizeof(uint32_t));
+    uint32_t clock = 0;
+    depth = 0;
+    path[depth++] = 0;
+    ir->dom_enter[0] = clock++;
+    while (depth > 0) {
+        uint32_t block = path[depth - 1];
+        if (first_child[block] != 0) {
+            // Take the next child off the list as it is entered
+            uint32_t child = first_child[block] - 1;
+            first_child[block] = next_sibling[child];
+            ir->dom_enter[child] = clock++;
+            path[depth++] = child;
+            continue;
+        }
+        ir->dom_exit[block] = clock++;
+        depth--;
+    }
+    free(first_child);
+    free(next_sibling);
+    free(path);
+}
+
+int ir_dominates(const Ir *ir, uint32_t a, uint32_t b) {
+    return ir->dom_enter[a] <= ir->dom_enter[b] && ir->dom_exit[b] <= ir->dom_exit[a];
+}
+
+// Lowering
+
+static uint32_t new_block(Builder *b) {
+    Ir *ir = b->ir;
+    ir->blocks = grow32(ir->blocks, &ir->block_capacity, ir->block_count, sizeof(IrBlock));
+    memset(&ir->blocks[ir->block_count], 0, sizeof(IrBlock));
+    return ir->block_count++;
+}
+
+static void add_edge(Builder *b, uint32_t from, uint32_t to) {
+    IrBlock *target = &b->ir->blocks[to];
+    target->preds[target->pred_count++] = from;
+}
+
+// End the current block with a jump to target
+static void jump(Builder *b, uint32_t target) {
+    IrBlock *block = &b->ir->blocks[b->current];
+    block->exit = IR_EXIT_JUMP;
+    block->succs[0] = target;
+    add_edge(b, b->current, target);
+}
+
+// End the current block going to if_true when condition is non-zero, else
+// to if_false
+static void branch(Builder *b, IrValue condition, uint32_t if_true, uint32_t if_false) {
+    IrBlock *block = &b->ir->blocks[b->current];
+    block->exit = IR_EXIT_BRANCH;
+    block->condition = condition;
+    block->succs[0] = if_true;
+    block->succs[1] = if_false;
+    add_edge(b, b->current, if_true);
+    add_edge(b, b->current, if_false);
+}
+
+static IrValue emit(Builder *b, IrOp op, VarType type, IrValue a, IrValue c) {
+    return ir_add(b->ir, b->current, op, type, a, c);
+}
+
+static VarType value_type(Builder *b, IrValue value) {
+    return (VarType)b->ir->values[value].type;
+}
+
+static IrValue zero(Builder *b, VarType type) {
+    Value value;
+    memset(&value, 0, sizeof(value));
+    return ir_constant(b->ir, type, value);
+}
+
+static IrValue read_variable(Builder *b, NodeId decl) {
+    // Read before any definition only where the value cannot matter: a
+    // variable assigned in a loop it is declared in, at the loop's header
+    return b->defs[decl] != IR_NONE ? b->defs[decl] : zero(b, NODE_TYPE(decl));
+}
+
+static void write_variable(Builder *b, NodeId decl, IrValue value) {
+    b->trail = grow(b->trail, &b->trail_capacity, b->trail_count, sizeof(Assignment));
+    b->trail[b->trail_count++] = (Assignment){decl, b->defs[decl]};
+    b->defs[decl] = value;
+}
+
+// Restore the values overwritten since the trail was mark long
+static void unwind(Builder *b, size_t mark) {
+    while (b->trail_count > mark) {
+        Assignment *entry = &b->trail[--b->trail_count];
+        b->defs[entry->decl] = entry->value;
+    }
+}
+
+static void push_phi(Builder *b, NodeId decl, IrValue phi) {
+    b->phis = grow(b->phis, &b->phi_capacity, b->phi_count, sizeof(Assignment));
+    b->phis[b->phi_count++] = (Assignment){decl, phi};
+}
+
+static IrValue new_phi(Builder *b, uint32_t block, NodeId decl, IrValue first, IrValue second) {
+    IrValue phi = ir_add(b->ir, block, IR_PHI, NODE_TYPE(decl), first, second);
+    b->ir->values[phi].node = decl;
+    return phi;
+}
+
+// Give the loop whose header is the current block a phi for each variable
+// declared outside body and assigned in it
+static void add_loop_phis(Builder *b, NodeId body) {
+    uint32_t stamp = ++b->stamp;
+    b->scan_count = 0;
+    b->scan = grow(b->scan, &b->scan_capacity, b->scan_count, sizeof(NodeId));
+    b->scan[b->scan_count++] = body;
+
+    while (b->scan_count > 0) {
+        NodeId node = b->scan[--b->scan_count];
+        if (NODE_KIND(node) == AST_VARDECL) {
+            b->marks[node] = stamp;   // Local to the loop
+        } else if (NODE_KIND(node) == AST_ASSIGN) {
+            NodeId decl = NODE_BINDING(NODE_LEFT(node));
+            if (b->marks[decl] != stamp) {
+                b->marks[decl] = stamp;
+                IrValue phi = new_phi(b, b->current, decl, read_variable(b, decl), IR_NONE);
+                push_phi(b, decl, phi);
+                write_variable(b, decl, phi);
+            }
+        }
+
+        // Children in source order, so declarations come before their uses
+        size_t first = b->scan_count;
+        for (NodeId child = NODE_LEFT(node); child != AST_NONE; child = b->ast->next_sibling[child]) {
+            b->scan = grow(b->scan, &b->scan_capacity, b->scan_count, sizeof(NodeId));
+            b->scan[b->scan_count++] = child;
+        }
+        for (size_t i = first, j = b->scan_count; i + 1 < j; i++, j--) {
+            NodeId swap = b->scan[i];
+            b->scan[i] = b->scan[j - 1];
+            b->scan[j - 1] = swap;
+        }
+    }
+}
+
+// Set the second operand of the loop phis from first on to the variables'
+// values at the end of the loop, and drop them
+static void close_loop_phis(Builder *b, size_t first) {
+    for (size_t i = first; i < b->phi_count; i++) {
+        IrValue value = read_variable(b, b->phis[i].decl);   // May grow the values
+        b->ir->values[b->phis[i].value].operands[1] = value;
+    }
+    b->phi_count = first;
+}
+
+// Join the body of an if, which began when the trail was mark long and
+// ends in the current block, into join
+static void join_if(Builder *b, size_t mark, uint32_t join) {
+    uint32_t stamp = ++b->stamp;
+    size_t first = b->phi_count;
+    for (size_t i = mark; i < b->trail_count; i++) {
+        NodeId decl = b->trail[i].decl;
+        if (b->marks[decl] != stamp) {
+            b->marks[decl] = stamp;
+            push_phi(b, decl, b->defs[decl]);
+        }
+    }
+    jump(b, join);
+    unwind(b, mark);
+    b->current = join;
+
+    for (size_t i = first; i < b->phi_count; i++) {
+        NodeId decl = b->phis[i].decl;
+        IrValue before = b->defs[decl];
+        // Undefined before the if: declared in its body, and so either out
+        // of scope or, by definite initialisation, assigned before it is read
+        if (before == IR_NONE || before == b->phis[i].value) continue;
+        write_variable(b, decl, new_phi(b, join, decl, before, b->phis[i].value));
+    }
+    b->phi_count = first;
+}
+
+// Convert value for a variable of type target
+static IrValue convert(Builder *b, IrValue value, VarType target) {
+    VarType type = value_type(b, value);
+    if (target == TYPE_FLOAT && type != TYPE_FLOAT) {
+        return emit(b, IR_INT_TO_FLOAT, TYPE_FLOAT, value, IR_NONE);
+    }
+    if ((target == TYPE_INT || target == TYPE_CHAR) && type == TYPE_FLOAT) {
+        value = emit(b, IR_FLOAT_TO_INT, TYPE_INT, value, IR_NONE);
+        type = TYPE_INT;
+    }
+    if (target == TYPE_CHAR && type != TYPE_CHAR) {
+        value = emit(b, IR_TO_CHAR, TYPE_CHAR, value, IR_NONE);
+    }
+    return value;
+}
+
+// Truth value of value, 0 or 1
+static IrValue truth(Builder *b, IrValue value) {
+    switch (value_type(b, value)) {
+    case TYPE_FLOAT:  return emit(b, IR_BOOL_FLOAT, TYPE_INT, value, IR_NONE);
+    case TYPE_STRING: return emit(b, IR_BOOL_STRING, TYPE_INT, value, IR_NONE);
+    default:          return emit(b, IR_BOOL_INT, TYPE_INT, value, IR_NONE);
+    }
+}
+
+// A branch tests an int for non-zero; floats and strings need their truth
+static IrValue test(Builder *b, IrValue value) {
+    VarType type = value_type(b, value);
+    return type == TYPE_FLOAT || type == TYPE_STRING ? truth(b, value) : value;
+}
+
+// Operation of node on left and right. Numbers are promoted to float if
+// either is a float; char is an int in arithmetic.
+static IrValue binary(Builder *b, NodeId node, IrValue left, IrValue right) {
+    const char *op = NODE_TEXT(node);
+    int string = value_type(b, left) == TYPE_STRING;
+    int floating = !string && (value_type(b, left) == TYPE_FLOAT || value_type(b, right) == TYPE_FLOAT);
+    if (floating) {
+        left = convert(b, left, TYPE_FLOAT);
+        right = convert(b, right, TYPE_FLOAT);
+    }
+
+    if (NODE_KIND(node) == AST_BINOP) {
+        // string + string is the only string operation
+        if (string) return emit(b, IR_CONCAT, TYPE_STRING, left, right);
+        int which = *op == '+' ? 0 : *op == '-' ? 1 : *op == '*' ? 2 : 3;
+        IrValue value = emit(b, (IrOp)((floating ? IR_ADD_FLOAT : IR_ADD_INT) + which),
+                             floating ? TYPE_FLOAT : TYPE_INT, left, right);
+        b->ir->values[value].node = node;
+        return value;
+    }
+
+    IrOp base = string ? IR_LT_STRING : floating ? IR_LT_FLOAT : IR_LT_INT;
+    int which;
+    if (op[0] == '<') which = op[1] == '=' ? 1 : 0;
+    else if (op[0] == '>') which = op[1] == '=' ? 3 : 2;
+    else if (op[0] == '=') which = 4;
+    else which = 5;
+    // Relative to IR_LT_*: LT LE GT GE EQ NE
+    return emit(b, (IrOp)(base + which), TYPE_INT, left, right);
+}
+
+static IrValue string_constant(Builder *b, NodeId node) {
+    size_t length;
+    const char *text = intern_text(b->interner, AST_ID(b->ast, node), &length);
+    Value value;
+    memset(&value, 0, sizeof(value));
+    if (length > 0) {
+        VmString *string = arena_alloc(&b->ir->strings, sizeof(VmString) + length + 1);
+        string->length = length;
+        memcpy(string->bytes, text, length);
+        string->bytes[length] = '\0';
+        value.s = string;
+    }
+    return ir_constant(b->ir, TYPE_STRING, value);
+}
+
+// Decimal literal; wraps around like the arithmetic does
+static int64_t number_value(const char *text, uint32_t length) {
+    uint64_t value = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        value = value * 10 + (uint64_t)(text[i] - '0');
+    }
+    return (int64_t)value;
+}
+
+static void push_value(Builder *b, IrValue value) {
+    b->stack = grow(b->stack, &b->stack_capacity, b->stack_count, sizeof(IrValue));
+    b->stack[b->stack_count++] = value;
+}
+
+static IrValue pop_value(Builder *b) {
+    return b->stack[--b->stack_count];
+}
+
+static void push_frame(Builder *b, NodeId node) {
+    b->frames = grow(b->frames, &b->frame_capacity, b->frame_count, sizeof(LowerFrame));
+    b->frames[b->frame_count++] = (LowerFrame){node, 0, 0, 0, 0, 0, AST_NONE};
+}
+
+static int is_logical(Builder *b, NodeId node) {
+    const char *op = NODE_TEXT(node);
+    return NODE_KIND(node) == AST_COMPARISON && (op[0] == '&' || op[0] == '|');
+}
+
+// Advance the frame on top of the stack by one step
+static void lower_step(Builder *b) {
+    LowerFrame *frame = &b->frames[b->frame_count - 1];
+    NodeId node = frame->node;
+    int state = frame->state++;
+
+    switch (NODE_KIND(node)) {
+    case AST_PROGRAM:
+    case AST_BLOCK:
+        if (state == 0) frame->cursor = NODE_LEFT(node);
+        if (frame->cursor != AST_NONE) {
+            NodeId child = frame->cursor;
+            frame->cursor = b->ast->next_sibling[child];
+            push_frame(b, child);
+            return;
+        }
+        break;
+
+    case AST_VARDECL:
+        // Each time the declaration is reached
+        write_variable(b, node, zero(b, NODE_TYPE(node)));
+        break;
+
+    case AST_ASSIGN:
+        if (state == 0) {
+            push_frame(b, NODE_RIGHT(node));
+            return;
+        } else {
+            NodeId decl = NODE_BINDING(NODE_LEFT(node));
+            IrValue value = convert(b, pop_value(b), NODE_TYPE(decl));
+            IrValue copy = emit(b, IR_COPY, NODE_TYPE(decl), value, IR_NONE);
+            b->ir->values[copy].node = decl;
+            write_variable(b, decl, copy);
+        }
+        break;
+
+    case AST_PRINT:
+        if (state == 0) {
+            push_frame(b, NODE_LEFT(node));
+            return;
+        } else {
+            static const IrOp prints[] = {
+                [TYPE_INT] = IR_PRINT_INT,
+                [TYPE_CHAR] = IR_PRINT_CHAR,
+                [TYPE_FLOAT] = IR_PRINT_FLOAT,
+                [TYPE_STRING] = IR_PRINT_STRING,
+            };
+            IrValue value = pop_value(b);
+            emit(b, prints[value_type(b, value)], TYPE_INT, value, IR_NONE);
+        }
+        break;
+
+    case AST_FACTORIAL:
+        // factorial(n); prints n!
+        if (state == 0) {
+            push_frame(b, NODE_LEFT(node));
+            return;
+        } else {
+            IrValue n = convert(b, pop_value(b), TYPE_INT);
+            emit(b, IR_PRINT_INT, TYPE_INT, emit(b, IR_FACTORIAL, TYPE_INT, n, IR_NONE), IR_NONE);
+        }
+        break;
+
+    case AST_IF:
+        if (state == 0) {
+            push_frame(b, NODE_LEFT(node));
+            return;
+        } else if (state == 1) {
+            IrValue condition = test(b, pop_value(b));
+            uint32_t body = new_block(b);
+            frame = &b->frames[b->frame_count - 1];
+            frame->block = new_block(b);
+            branch(b, condition, body, frame->block);
+            frame->mark = b->trail_count;
+            b->current = body;
+            push_frame(b, NODE_RIGHT(node));
+            return;
+        }
+        join_if(b, frame->mark, frame->block);
+        break;
+
+    case AST_WHILE:
+        if (state == 0) {
+            uint32_t header = new_block(b);
+            jump(b, header);
+            b->current = header;
+            frame = &b->frames[b->frame_count - 1];
+            frame->block = header;
+            frame->first = b->phi_count;
+            add_loop_phis(b, NODE_RIGHT(node));
+            frame->mark = b->trail_count;
+            push_frame(b, NODE_LEFT(node));
+            return;
+        } else if (state == 1) {
+            IrValue condition = test(b, pop_value(b));
+            uint32_t body = new_block(b);
+            frame = &b->frames[b->frame_count - 1];
+            frame->exit = new_block(b);
+            branch(b, condition, body, frame->exit);
+            b->current = body;
+            push_frame(b, NODE_RIGHT(node));
+            return;
+        }
+        jump(b, frame->block);
+        close_loop_phis(b, frame->first);
+        unwind(b, frame->mark);
+        b->current = frame->exit;
+        break;
+
+    case AST_REPEAT:
+        // Runs the body again while the until condition is false
+        if (state == 0) {
+            uint32_t header = new_block(b);
+            jump(b, header);
+            b->current = header;
+            frame = &b->frames[b->frame_count - 1];
+            frame->block = header;
+            frame->first = b->phi_count;
+            add_loop_phis(b, NODE_LEFT(node));
+            push_frame(b, NODE_LEFT(node));
+            return;
+        } else if (state == 1) {
+            push_frame(b, NODE_RIGHT(node));
+            return;
+        } else {
+            IrValue condition = test(b, pop_value(b));
+            uint32_t exit = new_block(b);
+            frame = &b->frames[b->frame_count - 1];
+            branch(b, condition, exit, frame->block);
+            close_loop_phis(b, frame->first);
+            b->current = exit;
+        }
+        break;
+
+    case AST_CONDITION:
+        if (state == 0) {
+            push_frame(b, NODE_LEFT(node));
+            return;
+        }
+        break;
+
+    case AST_BINOP:
+    case AST_COMPARISON:
+        if (state == 0) {
+            push_frame(b, NODE_LEFT(node));
+            return;
+        } else if (state == 1) {
+            if (is_logical(b, node)) {
+                // Short-circuit: the right operand is only evaluated when
+                // the left is true for && or false for ||
+                IrValue left = truth(b, pop_value(b));
+                uint32_t right = new_block(b);
+                frame = &b->frames[b->frame_count - 1];
+                frame->block = new_block(b);
+                if (NODE_TEXT(node)[0] == '&') branch(b, left, right, frame->block);
+                else branch(b, left, frame->block, right);
+                b->current = right;
+            }
+            push_frame(b, NODE_RIGHT(node));
+            return;
+        }
+        if (is_logical(b, node)) {
+            IrValue right = truth(b, pop_value(b));
+            Value decided = {.i = NODE_TEXT(node)[0] == '|'};
+            jump(b, frame->block);
+            b->current = frame->block;
+            push_value(b, ir_add(b->ir, frame->block, IR_PHI, TYPE_INT, ir_constant(b->ir, TYPE_INT, decided), right));
+        } else {
+            IrValue right = pop_value(b);
+            IrValue left = pop_value(b);
+            push_value(b, binary(b, node, left, right));
+        }
+        break;
+
+    case AST_NUMBER: {
+        Value value = {.i = number_value(NODE_TEXT(node), AST_LENGTH(b->ast, node))};
+        push_value(b, ir_constant(b->ir, TYPE_INT, value));
+        break;
+    }
+
+    case AST_STRING_LITERAL:
+        push_value(b, string_constant(b, node));
+        break;
+
+    case AST_IDENTIFIER:
+        push_value(b, read_variable(b, NODE_BINDING(node)));
+        break;
+
+    default:
+        // AST_ERROR: a program with syntax errors is never lowered
+        break;
+    }
+
+    b->frame_count--;
+}
+
+void ir_build(Ir *ir, CompilationUnit *unit, NodeId root) {
+    Builder b = {0};
+    b.ir = ir;
+    b.ast = &unit->ast;
+    b.source = unit->input.data;
+    b.interner = &unit->interner;
+    b.defs = allocate(unit->ast.count, sizeof(IrValue));
+    b.marks = allocate(unit->ast.count, sizeof(uint32_t));
+    ir->unit = unit;
+
+    // The entry block holds the constants and goes to the program's first
+    // block
+    new_block(&b);
+    b.current = 0;
+    jump(&b, new_block(&b));
+    b.current = 1;
+    if (root != AST_NONE) {
+        push_frame(&b, root);
+        while (b.frame_count > 0) {
+            lower_step(&b);
+        }
+    }
+    ir->blocks[b.current].exit = IR_EXIT_RETURN;
+
+    free(b.defs);
+    free(b.marks);
+    free(b.trail);
+    free(b.phis);
+    free(b.frames);
+    free(b.stack);
+    free(b.scan);
+    ir_analyze(ir);
+}
+
+// Text dump
+
+static void print_string(const VmString *string, FILE *out) {
+    fputc('"', out);
+    for (size_t i = 0; string && i < string->length; i++) {
+        unsigned char c = (unsigned char)string->bytes[i];
+        if (c == '"' || c == '\\') fprintf(out, "\\%c", c);
+        else if (c == '\n') fputs("\\n", out);
+        else if (c == '\t') fputs("\\t", out);
+        else if (c < ' ' || c >= 0x7f) fprintf(out, "\\x%02x", c);
+        else fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+static void print_instruction(const Ir *ir, IrValue value, FILE *out) {
+    const IrInstr *instr = &ir->values[value];
+    const char *source = ir->unit->input.data;
+    const Ast *ast = &ir->unit->ast;
+
+    fputs("    ", out);
+    if (instr->op < IR_PRINT_INT) fprintf(out, "v%u = ", value);
+    for (const char *c = op_names[instr->op]; *c; c++) {
+        fputc(*c >= 'A' && *c <= 'Z' ? *c - 'A' + 'a' : *c, out);
+    }
+
+    if (instr->op == IR_CONST) {
+        fprintf(out, " %s ", var_type_to_string((VarType)instr->type));
+        if (instr->type == TYPE_FLOAT) fprintf(out, "%.17g", instr->constant.f);
+        else if (instr->type == TYPE_STRING) print_string(instr->constant.s, out);
+        else fprintf(out, "%" PRId64, instr->constant.i);
+    }
+    for (int i = 0; i < ir_operand_count(ir, value); i++) {
+        fprintf(out, "%s v%u", i ? "," : "", instr->operands[i]);
+    }
+
+    if ((instr->op == IR_PHI || instr->op == IR_COPY) && instr->node != AST_NONE) {
+        fprintf(out, "    ; %.*s", (int)AST_LENGTH(ast, instr->node), source + AST_START(ast, instr->node));
+    } else if (instr->op == IR_DIV_INT) {
+        fprintf(out, "    ; line %d", source_line(&ir->unit->lexer, AST_START(ast, instr->node)));
+    }
+    fputc('\n', out);
+}
+
+void ir_print(const Ir *ir, FILE *out) {
+    for (uint32_t i = 0; i < ir->block_count; i++) {
+        const IrBlock *block = &ir->blocks[i];
+        if (block->removed) continue;
+        fprintf(out, "b%u:", i);
+        for (uint32_t p = 0; p < block->pred_count; p++) {
+            fprintf(out, "%s b%u", p ? "," : "    ; preds", block->preds[p]);
+        }
+        fputc('\n', out);
+
+        for (uint32_t j = 0; j < block->count; j++) {
+            print_instruction(ir, block->code[j], out);
+        }
+        switch (block->exit) {
+        case IR_EXIT_RETURN:
+            fputs("    return\n", out);
+            break;
+        case IR_EXIT_JUMP:
+            fprintf(out, "    jump b%u\n", block->succs[0]);
+            break;
+        default:
+            fprintf(out, "    branch v%u, b%u, b%u\n", block->condition, block->succs[0], block->succs[1]);
+            break;
+        }
+    }
+}
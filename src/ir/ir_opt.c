@@ -0,0 +1,640 @@
+/* ir_opt.c
+ * Optimisation passes over the SSA form.
+ *
+ * A pass that replaces a value turns its instruction into a copy of the
+ * replacement; copy propagation then points every use at the value copied,
+ * simplifies the phis that are left choosing one value, and drops the
+ * copies. A pass that removes or moves an instruction takes it out of its
+ * block by changing its block, and sweep() compacts the blocks afterwards.
+ *
+ * Printing, and int division by anything but a non-zero constant, have
+ * effects: they are never removed or moved, and only division is ever
+ * merged with an identical one that dominates it, which would have stopped
+ * the program first.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/ir.h"
+#include "../../include/vm.h"
+
+#define OPT_INITIAL_CAPACITY 64
+
+static void *allocate(size_t count, size_t size) {
+    void *array = calloc(count ? count : 1, size);
+    if (!array) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    return array;
+}
+
+static void *grow(void *array, size_t *capacity, size_t count, size_t size) {
+    if (count < *capacity) return array;
+    *capacity = *capacity ? *capacity * 2 : OPT_INITIAL_CAPACITY;
+    array = realloc(array, *capacity * size);
+    if (!array) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    return array;
+}
+
+static int is_print(IrOp op) {
+    return op >= IR_PRINT_INT;
+}
+
+// A division that may stop the program
+static int may_trap(const Ir *ir, const IrInstr *instr) {
+    if (instr->op != IR_DIV_INT) return 0;
+    const IrInstr *divisor = &ir->values[instr->operands[1]];
+    return divisor->op != IR_CONST || divisor->constant.i == 0;
+}
+
+// The value value copies, following chains of copies
+static IrValue resolve(Ir *ir, IrValue value) {
+    IrValue root = value;
+    while (root != IR_NONE && ir->values[root].op == IR_COPY) root = ir->values[root].operands[0];
+    // Shorten the chain for next time
+    while (value != root) {
+        IrValue next = ir->values[value].operands[0];
+        ir->values[value].operands[0] = root;
+        value = next;
+    }
+    return root;
+}
+
+static void replace(Ir *ir, IrValue value, IrValue replacement) {
+    IrInstr *instr = &ir->values[value];
+    instr->op = IR_COPY;
+    instr->operands[0] = replacement;
+    instr->operands[1] = IR_NONE;
+}
+
+// Drop the instructions that have been removed or moved from each block
+static void sweep(Ir *ir) {
+    for (uint32_t i = 0; i < ir->block_count; i++) {
+        IrBlock *block = &ir->blocks[i];
+        uint32_t kept = 0;
+        for (uint32_t j = 0; j < block->count; j++) {
+            if (ir->values[block->code[j]].block == i) block->code[kept++] = block->code[j];
+        }
+        block->count = kept;
+    }
+}
+
+// Copy propagation
+
+static void propagate_copies(Ir *ir) {
+    for (int changed = 1; changed;) {
+        changed = 0;
+        for (uint32_t i = 0; i < ir->order_count; i++) {
+            IrBlock *block = &ir->blocks[ir->order[i]];
+            for (uint32_t j = 0; j < block->count; j++) {
+                IrValue value = block->code[j];
+                IrInstr *instr = &ir->values[value];
+                int count = ir_operand_count(ir, value);
+                for (int k = 0; k < count; k++) {
+                    instr->operands[k] = resolve(ir, instr->operands[k]);
+                }
+                if (instr->op != IR_PHI) continue;
+
+                // A phi of one value, and of itself around a loop, is that
+                // value
+                IrValue only = IR_NONE;
+                int trivial = 1;
+                for (int k = 0; k < count; k++) {
+                    IrValue operand = instr->operands[k];
+                    if (operand == value || operand == only) continue;
+                    if (only != IR_NONE) trivial = 0;
+                    only = operand;
+                }
+                if (trivial && only != IR_NONE) {
+                    replace(ir, value, only);
+                    changed = 1;
+                }
+            }
+            if (block->exit == IR_EXIT_BRANCH) block->condition = resolve(ir, block->condition);
+        }
+    }
+
+    for (uint32_t i = 0; i < ir->order_count; i++) {
+        IrBlock *block = &ir->blocks[ir->order[i]];
+        for (uint32_t j = 0; j < block->count; j++) {
+            IrInstr *instr = &ir->values[block->code[j]];
+            if (instr->op == IR_COPY) instr->block = IR_NO_BLOCK;
+        }
+    }
+    sweep(ir);
+}
+
+// Constant propagation
+
+// Is value always 0 or 1?
+static int is_boolean(const Ir *ir, IrValue value) {
+    const IrInstr *instr = &ir->values[value];
+    if (instr->op == IR_CONST) return instr->type == TYPE_INT && (instr->constant.i == 0 || instr->constant.i == 1);
+    return (instr->op >= IR_LT_INT && instr->op <= IR_NE_STRING) ||
+           (instr->op >= IR_BOOL_INT && instr->op <= IR_BOOL_STRING);
+}
+
+static int compare(IrOp op, IrOp base, int order) {
+    switch (op - base) {
+    case 0:  return order < 0;
+    case 1:  return order <= 0;
+    case 2:  return order > 0;
+    case 3:  return order >= 0;
+    case 4:  return order == 0;
+    default: return order != 0;
+    }
+}
+
+// Not by order, which NaN has none of
+static int compare_floats(IrOp op, double x, double y) {
+    switch (op) {
+    case IR_LT_FLOAT: return x < y;
+    case IR_LE_FLOAT: return x <= y;
+    case IR_GT_FLOAT: return x > y;
+    case IR_GE_FLOAT: return x >= y;
+    case IR_EQ_FLOAT: return x == y;
+    default:          return x != y;
+    }
+}
+
+static const VmString *concat(Ir *ir, const VmString *a, const VmString *b) {
+    if (!b || b->length == 0) return a;
+    if (!a || a->length == 0) return b;
+    VmString *result = arena_alloc(&ir->strings, sizeof(VmString) + a->length + b->length + 1);
+    result->length = a->length + b->length;
+    memcpy(result->bytes, a->bytes, a->length);
+    memcpy(result->bytes + a->length, b->bytes, b->length);
+    result->bytes[result->length] = '\0';
+    return result;
+}
+
+// Simplify value, given that its operands are resolved; returns its
+// replacement, or IR_NONE to keep it
+static IrValue simplify(Ir *ir, IrValue value) {
+    IrInstr *instr = &ir->values[value];
+    IrOp op = (IrOp)instr->op;
+    const IrInstr *a = &ir->values[instr->operands[0]];
+    const IrInstr *b = &ir->values[instr->operands[1]];
+    int count = ir_operand_count(ir, value);
+    if (op == IR_CONST || op == IR_PHI || op == IR_COPY || is_print(op)) return IR_NONE;
+
+    // Identities
+    if (op == IR_BOOL_INT && is_boolean(ir, instr->operands[0])) return instr->operands[0];
+    if (op == IR_TO_CHAR && a->type == TYPE_CHAR) return instr->operands[0];
+    if (b->op == IR_CONST && ((op == IR_ADD_INT && b->constant.i == 0) || (op == IR_SUB_INT && b->constant.i == 0) ||
+                              (op == IR_MUL_INT && b->constant.i == 1) || (op == IR_DIV_INT && b->constant.i == 1))) {
+        return instr->operands[0];
+    }
+    if (a->op == IR_CONST && ((op == IR_ADD_INT && a->constant.i == 0) || (op == IR_MUL_INT && a->constant.i == 1))) {
+        return instr->operands[1];
+    }
+
+    if (a->op != IR_CONST || (count == 2 && b->op != IR_CONST)) return IR_NONE;
+    if (op == IR_DIV_INT && b->constant.i == 0) return IR_NONE;   // Stops the program
+
+    // Computed as the VM computes it
+    Value x = a->constant, y = count == 2 ? b->constant : a->constant, result;
+    memset(&result, 0, sizeof(result));
+    switch (op) {
+    case IR_INT_TO_FLOAT: result.f = (double)x.i; break;
+    case IR_FLOAT_TO_INT: result.i = vm_float_to_int(x.f); break;
+    case IR_TO_CHAR:      result.i = (signed char)x.i; break;
+    case IR_ADD_INT:      result.i = (int64_t)((uint64_t)x.i + (uint64_t)y.i); break;
+    case IR_SUB_INT:      result.i = (int64_t)((uint64_t)x.i - (uint64_t)y.i); break;
+    case IR_MUL_INT:      result.i = (int64_t)((uint64_t)x.i * (uint64_t)y.i); break;
+    case IR_DIV_INT:      result.i = y.i == -1 ? (int64_t)(0 - (uint64_t)x.i) : x.i / y.i; break;
+    case IR_ADD_FLOAT:    result.f = x.f + y.f; break;
+    case IR_SUB_FLOAT:    result.f = x.f - y.f; break;
+    case IR_MUL_FLOAT:    result.f = x.f * y.f; break;
+    case IR_DIV_FLOAT:    result.f = x.f / y.f; break;
+    case IR_CONCAT:       result.s = concat(ir, x.s, y.s); break;
+    case IR_BOOL_INT:     result.i = x.i != 0; break;
+    case IR_BOOL_FLOAT:   result.i = x.f != 0.0; break;
+    case IR_BOOL_STRING:  result.i = x.s && x.s->length != 0; break;
+    case IR_FACTORIAL:    result.i = vm_factorial(x.i); break;
+    default:
+        if (op <= IR_NE_INT) result.i = compare(op, IR_LT_INT, (x.i > y.i) - (x.i < y.i));
+        else if (op <= IR_NE_FLOAT) result.i = compare_floats(op, x.f, y.f);
+        else result.i = compare(op, IR_LT_STRING, vm_compare_strings(x.s, y.s));
+        break;
+    }
+    return ir_constant(ir, (VarType)instr->type, result);
+}
+
+// Remove the blocks that can no longer be reached, and their edges
+static void remove_unreachable(Ir *ir) {
+    ir_analyze(ir);
+    for (uint32_t i = 0; i < ir->block_count; i++) {
+        IrBlock *block = &ir->blocks[i];
+        if (block->removed || ir->order_index[i] != UINT32_MAX) continue;
+        int succ_count = block->exit == IR_EXIT_BRANCH ? 2 : block->exit == IR_EXIT_JUMP ? 1 : 0;
+        for (int s = 0; s < succ_count; s++) {
+            if (ir->order_index[block->succs[s]] != UINT32_MAX) ir_remove_pred(ir, block->succs[s], i);
+        }
+        for (uint32_t j = 0; j < block->count; j++) {
+            ir->values[block->code[j]].block = IR_NO_BLOCK;
+        }
+        block->count = 0;
+        block->pred_count = 0;
+        block->exit = IR_EXIT_RETURN;
+        block->removed = 1;
+    }
+    ir_analyze(ir);
+}
+
+// Fold the instructions whose operands are constants, and the branches on
+// constants; returns whether anything changed
+static int fold_constants(Ir *ir) {
+    int changed = 0, branches = 0;
+    for (uint32_t i = 0; i < ir->order_count; i++) {
+        uint32_t index = ir->order[i];
+        IrBlock *block = &ir->blocks[index];
+        for (uint32_t j = 0; j < block->count; j++) {
+            IrValue value = block->code[j];
+            IrInstr *instr = &ir->values[value];
+            int count = ir_operand_count(ir, value);
+            for (int k = 0; k < count; k++) instr->operands[k] = resolve(ir, instr->operands[k]);
+            IrValue replacement = simplify(ir, value);
+            if (replacement != IR_NONE) {
+                replace(ir, value, replacement);
+                changed = 1;
+            }
+        }
+
+        if (block->exit != IR_EXIT_BRANCH) continue;
+        const IrInstr *condition = &ir->values[resolve(ir, block->condition)];
+        if (condition->op != IR_CONST) continue;
+        int taken = condition->constant.i != 0 ? 0 : 1;
+        ir_remove_pred(ir, block->succs[1 - taken], index);
+        block->exit = IR_EXIT_JUMP;
+        block->succs[0] = block->succs[taken];
+        branches = 1;
+    }
+    if (branches) remove_unreachable(ir);
+    return changed || branches;
+}
+
+// Jump threading: an edge into a block that does nothing but branch on a
+// phi, whose operand for the edge is a constant, goes straight to where the
+// branch would go. This is what && and || in a condition leave behind.
+static int thread_jumps(Ir *ir) {
+    uint32_t *uses = allocate(ir->value_count, sizeof(uint32_t));
+    for (uint32_t i = 0; i < ir->order_count; i++) {
+        const IrBlock *block = &ir->blocks[ir->order[i]];
+        for (uint32_t j = 0; j < block->count; j++) {
+            const IrInstr *instr = &ir->values[block->code[j]];
+            for (int k = 0; k < ir_operand_count(ir, block->code[j]); k++) uses[instr->operands[k]]++;
+        }
+        if (block->exit == IR_EXIT_BRANCH) uses[block->condition]++;
+    }
+
+    int changed = 0;
+    for (uint32_t i = 0; i < ir->order_count; i++) {
+        uint32_t join = ir->order[i];
+        IrBlock *block = &ir->blocks[join];
+        if (block->exit != IR_EXIT_BRANCH || block->count != 1) continue;
+        IrValue phi = block->code[0];
+        if (ir->values[phi].op != IR_PHI || block->condition != phi || uses[phi] != 1) continue;
+
+        // Backwards, as removing a predecessor moves the ones after it
+        for (uint32_t k = block->pred_count; k-- > 0;) {
+            uint32_t pred = block->preds[k];
+            const IrInstr *operand = &ir->values[ir->values[phi].operands[k]];
+            if (operand->op != IR_CONST || pred == join) continue;
+            uint32_t target = block->succs[operand->constant.i != 0 ? 0 : 1];
+            IrBlock *from = &ir->blocks[pred], *to = &ir->blocks[target];
+            int s = from->succs[0] == join ? 0 : 1;
+            uint32_t other = from->exit == IR_EXIT_BRANCH ? from->succs[1 - s] : IR_NO_BLOCK;
+            // A block has at most two predecessors, and a new one would need
+            // an operand for each phi
+            if (to->pred_count == 2 || (to->count > 0 && ir->values[to->code[0]].op == IR_PHI)) continue;
+            if (other == target || other == join) continue;
+
+            from->succs[s] = target;
+            ir_remove_pred(ir, join, pred);
+            to->preds[to->pred_count++] = pred;
+            changed = 1;
+        }
+    }
+    free(uses);
+    if (changed) remove_unreachable(ir);
+    return changed;
+}
+
+// Common subexpression elimination
+
+// Scoped hash table of the instructions available in the dominator tree
+// walk; entries are removed in the reverse order they were added
+typedef struct {
+    IrValue value;
+    uint32_t next;         // Next entry in the bucket, plus one
+} CseEntry;
+
+typedef struct {
+    Ir *ir;
+    uint32_t *buckets;     // First entry, plus one
+    uint32_t mask;
+    CseEntry *entries;
+    size_t entry_count, entry_capacity;
+} CseTable;
+
+static int is_commutative(IrOp op) {
+    return op == IR_ADD_INT || op == IR_MUL_INT || op == IR_ADD_FLOAT || op == IR_MUL_FLOAT || op == IR_EQ_INT ||
+           op == IR_NE_INT || op == IR_EQ_FLOAT || op == IR_NE_FLOAT || op == IR_EQ_STRING || op == IR_NE_STRING;
+}
+
+// Operands in a canonical order
+static void cse_key(const Ir *ir, IrValue value, IrValue key[2]) {
+    const IrInstr *instr = &ir->values[value];
+    key[0] = instr->operands[0];
+    key[1] = instr->operands[1];
+    if (is_commutative((IrOp)instr->op) && key[0] > key[1]) {
+        key[0] = instr->operands[1];
+        key[1] = instr->operands[0];
+    }
+}
+
+static uint32_t cse_hash(const CseTable *table, IrValue value) {
+    IrValue key[2];
+    cse_key(table->ir, value, key);
+    const IrInstr *instr = &table->ir->values[value];
+    uint64_t hash = ((uint64_t)instr->op << 56) ^ ((uint64_t)instr->type << 48) ^ ((uint64_t)key[0] << 24) ^ key[1];
+    return (uint32_t)((hash * 0x9e3779b97f4a7c15ULL) >> 32) & table->mask;
+}
+
+static int cse_equal(const Ir *ir, IrValue a, IrValue b) {
+    IrValue key_a[2], key_b[2];
+    cse_key(ir, a, key_a);
+    cse_key(ir, b, key_b);
+    return ir->values[a].op == ir->values[b].op && ir->values[a].type == ir->values[b].type &&
+           key_a[0] == key_b[0] && key_a[1] == key_b[1];
+}
+
+static void cse_block(CseTable *table, uint32_t index) {
+    Ir *ir = table->ir;
+    IrBlock *block = &ir->blocks[index];
+    for (uint32_t j = 0; j < block->count; j++) {
+        IrValue value = block->code[j];
+        IrInstr *instr = &ir->values[value];
+        IrOp op = (IrOp)instr->op;
+        int count = ir_operand_count(ir, value);
+        for (int k = 0; k < count; k++) instr->operands[k] = resolve(ir, instr->operands[k]);
+        if (op == IR_CONST || op == IR_PHI || op == IR_COPY || is_print(op)) continue;
+
+        uint32_t bucket = cse_hash(table, value);
+        IrValue found = IR_NONE;
+        for (uint32_t e = table->buckets[bucket]; e != 0; e = table->entries[e - 1].next) {
+            if (cse_equal(ir, table->entries[e - 1].value, value)) {
+                found = table->entries[e - 1].value;
+                break;
+            }
+        }
+        if (found != IR_NONE) {
+            replace(ir, value, found);
+            continue;
+        }
+        table->entries = grow(table->entries, &table->entry_capacity, table->entry_count, sizeof(CseEntry));
+        table->entries[table->entry_count++] = (CseEntry){value, table->buckets[bucket]};
+        table->buckets[bucket] = (uint32_t)table->entry_count;
+    }
+}
+
+// Replace each pure instruction by an identical one that dominates it
+static void eliminate_common_subexpressions(Ir *ir) {
+    CseTable table = {0};
+    table.ir = ir;
+    uint32_t size = OPT_INITIAL_CAPACITY;
+    while (size < ir->value_count * 2) size *= 2;
+    table.buckets = allocate(size, sizeof(uint32_t));
+    table.mask = size - 1;
+
+    // Dominator tree, as child lists
+    uint32_t *first_child = allocate(ir->block_count, sizeof(uint32_t));
+    uint32_t *next_sibling = allocate(ir->block_count, sizeof(uint32_t));
+    for (uint32_t i = ir->order_count; i-- > 1;) {
+        uint32_t block = ir->order[i];
+        next_sibling[block] = first_child[ir->idom[block]];
+        first_child[ir->idom[block]] = block + 1;
+    }
+
+    // Depth first: a block's entries stay in the table while its subtree
+    // is walked, and are removed when it is left
+    typedef struct {
+        uint32_t block;
+        uint32_t child;    // Next child to walk, plus one
+        size_t mark;       // Entries before the block's
+    } CseFrame;
+    CseFrame *stack = allocate(ir->order_count, sizeof(CseFrame));
+    size_t depth = 0;
+    stack[depth++] = (CseFrame){0, first_child[0], 0};
+    cse_block(&table, 0);
+
+    while (depth > 0) {
+        CseFrame *frame = &stack[depth - 1];
+        if (frame->child != 0) {
+            uint32_t child = frame->child - 1;
+            frame->child = next_sibling[child];
+            stack[depth++] = (CseFrame){child, first_child[child], table.entry_count};
+            cse_block(&table, child);
+            continue;
+        }
+        while (table.entry_count > frame->mark) {
+            CseEntry *entry = &table.entries[--table.entry_count];
+            table.buckets[cse_hash(&table, entry->value)] = entry->next;
+        }
+        depth--;
+    }
+
+    free(stack);
+    free(first_child);
+    free(next_sibling);
+    free(table.buckets);
+    free(table.entries);
+}
+
+// Loop-invariant code motion
+
+typedef struct {
+    uint32_t header, latch, preheader;
+    uint32_t size;         // Blocks in the loop
+} Loop;
+
+static int by_size(const void *a, const void *b) {
+    const Loop *x = a, *y = b;
+    return (x->size > y->size) - (x->size < y->size);
+}
+
+// Mark the blocks of the loop with back edge latch -> header with stamp;
+// returns how many there are and the last one's position in the order
+static uint32_t mark_loop(Ir *ir, uint32_t header, uint32_t latch, uint32_t *marks, uint32_t stamp,
+                          uint32_t *stack, uint32_t *last) {
+    uint32_t size = 1, depth = 0;
+    marks[header] = stamp;
+    *last = ir->order_index[latch];
+    if (marks[latch] != stamp) {
+        marks[latch] = stamp;
+        stack[depth++] = latch;
+        size++;
+    }
+    // Everything that reaches the latch without going through the header
+    while (depth > 0) {
+        const IrBlock *block = &ir->blocks[stack[--depth]];
+        for (uint32_t p = 0; p < block->pred_count; p++) {
+            uint32_t pred = block->preds[p];
+            if (marks[pred] == stamp) continue;
+            marks[pred] = stamp;
+            stack[depth++] = pred;
+            size++;
+            if (ir->order_index[pred] > *last) *last = ir->order_index[pred];
+        }
+    }
+    return size;
+}
+
+// Can value be computed ahead of the loop, every time the loop is entered,
+// rather than where it is?
+static int can_hoist(const Ir *ir, IrValue value) {
+    const IrInstr *instr = &ir->values[value];
+    IrOp op = (IrOp)instr->op;
+    return op != IR_CONST && op != IR_PHI && op != IR_COPY && !is_print(op) && !may_trap(ir, instr);
+}
+
+// Move the instructions of each loop whose operands are all defined outside
+// it to the end of the block before the loop. Inner loops go first, so what
+// leaves an inner loop can then leave the loops around it.
+static void hoist_loop_invariants(Ir *ir) {
+    Loop *loops = NULL;
+    size_t loop_count = 0, loop_capacity = 0;
+    uint32_t *marks = allocate(ir->block_count, sizeof(uint32_t));
+    uint32_t *stack = allocate(ir->block_count, sizeof(uint32_t));
+    uint32_t stamp = 0;
+
+    for (uint32_t i = 0; i < ir->order_count; i++) {
+        uint32_t latch = ir->order[i];
+        const IrBlock *block = &ir->blocks[latch];
+        int succ_count = block->exit == IR_EXIT_BRANCH ? 2 : block->exit == IR_EXIT_JUMP ? 1 : 0;
+        for (int s = 0; s < succ_count; s++) {
+            uint32_t header = block->succs[s];
+            if (!ir_dominates(ir, header, latch)) continue;
+            // The block before the loop must lead only into it
+            const IrBlock *head = &ir->blocks[header];
+            if (head->pred_count != 2) continue;
+            uint32_t preheader = head->preds[0] == latch ? head->preds[1] : head->preds[0];
+            if (ir->blocks[preheader].exit != IR_EXIT_JUMP) continue;
+
+            loops = grow(loops, &loop_capacity, loop_count, sizeof(Loop));
+            uint32_t end;
+            uint32_t size = mark_loop(ir, header, latch, marks, ++stamp, stack, &end);
+            loops[loop_count++] = (Loop){header, latch, preheader, size};
+        }
+    }
+    if (loop_count > 1) qsort(loops, loop_count, sizeof(Loop), by_size);
+
+    for (size_t l = 0; l < loop_count; l++) {
+        Loop *loop = &loops[l];
+        uint32_t end;
+        mark_loop(ir, loop->header, loop->latch, marks, ++stamp, stack, &end);
+        IrBlock *preheader = &ir->blocks[loop->preheader];
+
+        // In order, so an instruction's operands are hoisted before it is
+        for (uint32_t i = ir->order_index[loop->header]; i <= end; i++) {
+            uint32_t index = ir->order[i];
+            if (marks[index] != stamp) continue;
+            const IrBlock *block = &ir->blocks[index];
+            for (uint32_t j = 0; j < block->count; j++) {
+                IrValue value = block->code[j];
+                IrInstr *instr = &ir->values[value];
+                if (instr->block != index || !can_hoist(ir, value)) continue;
+                int invariant = 1;
+                for (int k = 0; k < ir_operand_count(ir, value); k++) {
+                    uint32_t home = ir->values[instr->operands[k]].block;
+                    if (marks[home] == stamp) invariant = 0;
+                }
+                if (!invariant) continue;
+
+                instr->block = loop->preheader;
+                if (preheader->count == preheader->capacity) {
+                    preheader->capacity = preheader->capacity ? preheader->capacity * 2 : OPT_INITIAL_CAPACITY;
+                    preheader->code = realloc(preheader->code, preheader->capacity * sizeof(IrValue));
+                    if (!preheader->code) {
+                        fprintf(stderr, "Memory allocation failed\n");
+                        exit(1);
+                    }
+                }
+                preheader->code[preheader->count++] = value;
+            }
+        }
+    }
+    sweep(ir);
+
+    free(loops);
+    free(marks);
+    free(stack);
+}
+
+// Dead code elimination
+
+// Remove the instructions nothing with an effect depends on
+static void eliminate_dead_code(Ir *ir) {
+    uint8_t *live = allocate(ir->value_count, 1);
+    IrValue *work = allocate(ir->value_count, sizeof(IrValue));
+    size_t work_count = 0;
+
+    for (uint32_t i = 0; i < ir->order_count; i++) {
+        const IrBlock *block = &ir->blocks[ir->order[i]];
+        for (uint32_t j = 0; j < block->count; j++) {
+            IrValue value = block->code[j];
+            const IrInstr *instr = &ir->values[value];
+            if (is_print((IrOp)instr->op) || may_trap(ir, instr)) {
+                live[value] = 1;
+                work[work_count++] = value;
+            }
+        }
+        if (block->exit == IR_EXIT_BRANCH && !live[block->condition]) {
+            live[block->condition] = 1;
+            work[work_count++] = block->condition;
+        }
+    }
+    while (work_count > 0) {
+        IrValue value = work[--work_count];
+        const IrInstr *instr = &ir->values[value];
+        for (int k = 0; k < ir_operand_count(ir, value); k++) {
+            IrValue operand = instr->operands[k];
+            if (!live[operand]) {
+                live[operand] = 1;
+                work[work_count++] = operand;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < ir->order_count; i++) {
+        const IrBlock *block = &ir->blocks[ir->order[i]];
+        for (uint32_t j = 0; j < block->count; j++) {
+            if (!live[block->code[j]]) ir->values[block->code[j]].block = IR_NO_BLOCK;
+        }
+    }
+    sweep(ir);
+    free(live);
+    free(work);
+}
+
+void ir_optimize(Ir *ir) {
+    propagate_copies(ir);
+    for (int changed = 1; changed;) {
+        changed = fold_constants(ir);
+        propagate_copies(ir);
+        changed |= thread_jumps(ir);
+    }
+    eliminate_common_subexpressions(ir);
+    propagate_copies(ir);
+    hoist_loop_invariants(ir);
+    // What left a loop may repeat what was computed before it
+    eliminate_common_subexpressions(ir);
+    propagate_copies(ir);
+    eliminate_dead_code(ir);
+}
@@ -0,0 +1,311 @@
+/* ir_slots.c
+ * Slot assignment shared by the backends: each value a backend keeps in
+ * memory gets a slot, and a phi shares one with as many of its operands as
+ * do not overlap it, so that the copies on the edges into its block vanish.
+ *
+ * Liveness is found lazily, for the values coalescing asks about, by
+ * walking back from each use to the definition. Phis are coalesced into
+ * classes with union-find; each class keeps its values in dominance order,
+ * so whether two classes overlap is one merged walk over both.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/ir.h"
+
+#define SLOTS_INITIAL_CAPACITY 256
+
+// Phis whose classes would grow past this many values keep slots of their
+// own, which bounds each interference check and so keeps coalescing linear
+// in the size of the function. Only long runs of loops updating one
+// variable reach it.
+#define COALESCE_MAX_CLASS 128
+
+// Where a value is used, as far as liveness goes: a phi uses its operand
+// at the end of the predecessor it comes from
+typedef struct {
+    uint32_t block;
+    uint32_t position;     // In the block's code; UINT32_MAX for the end
+} UseSite;
+
+typedef struct {
+    const Ir *ir;
+    const uint8_t *slotted;
+
+    // Per value
+    uint32_t *positions;   // Index in its block's code
+    uint32_t *uses;
+    uint32_t *use_start;   // Uses of v are use_sites[use_start[v]] on
+    UseSite *use_sites;    // to use_sites[use_start[v + 1]]
+    uint32_t *live_start;  // Sorted blocks v is live into, once needed:
+    uint32_t *live_count;  // live_count[v] of them from live_start[v] on
+    uint32_t *live_blocks;
+    size_t live_block_count, live_block_capacity;
+    IrValue *classes;      // Union-find of the values sharing a slot
+    IrValue **members;     // Per class of more than one value, its values
+    uint32_t *member_counts;   // in dominance order; see dominance_before
+    IrValue merged[COALESCE_MAX_CLASS];        // Two classes' values, in
+    uint8_t merged_from[COALESCE_MAX_CLASS];   // that order, which of the
+    uint32_t forest[COALESCE_MAX_CLASS];       // two each came from, and the
+                                               // path into their dominance forest
+    uint32_t *marks;       // Per block
+    uint32_t stamp;
+    uint32_t *work;
+} Slots;
+
+static void *allocate(size_t count, size_t size) {
+    void *array = calloc(count ? count : 1, size);
+    if (!array) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    return array;
+}
+
+static void *grow(void *array, size_t *capacity, size_t count, size_t size) {
+    if (count < *capacity) return array;
+    *capacity = *capacity ? *capacity * 2 : SLOTS_INITIAL_CAPACITY;
+    array = realloc(array, *capacity * size);
+    if (!array) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    return array;
+}
+
+static void add_use(Slots *s, IrValue value, uint32_t block, uint32_t position, int fill) {
+    if (fill) s->use_sites[s->use_start[value] + s->uses[value]] = (UseSite){block, position};
+    s->uses[value]++;
+}
+
+// Count the uses of each value, then, with fill, record where they are
+static void scan_uses(Slots *s, int fill) {
+    const Ir *ir = s->ir;
+    for (uint32_t i = 0; i < ir->order_count; i++) {
+        uint32_t index = ir->order[i];
+        const IrBlock *block = &ir->blocks[index];
+        for (uint32_t j = 0; j < block->count; j++) {
+            const IrInstr *instr = &ir->values[block->code[j]];
+            int count = ir_operand_count(ir, block->code[j]);
+            s->positions[block->code[j]] = j;
+            for (int k = 0; k < count; k++) {
+                if (instr->op == IR_PHI) {
+                    add_use(s, instr->operands[k], block->preds[k], UINT32_MAX, fill);
+                } else {
+                    add_use(s, instr->operands[k], index, j, fill);
+                }
+            }
+        }
+        if (block->exit == IR_EXIT_BRANCH) add_use(s, block->condition, index, block->count, fill);
+    }
+}
+
+static void count_uses(Slots *s) {
+    uint32_t count = s->ir->value_count;
+    scan_uses(s, 0);
+    for (uint32_t v = 0; v < count; v++) {
+        s->use_start[v + 1] = s->use_start[v] + s->uses[v];
+    }
+    s->use_sites = allocate(s->use_start[count], sizeof(UseSite));
+    // Counted again from zero as the sites are filled in
+    memset(s->uses, 0, count * sizeof(uint32_t));
+    scan_uses(s, 1);
+}
+
+static int compare_blocks(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// The blocks value is live into, found by walking back from each of its uses
+// to its definition
+static void find_live_in(Slots *s, IrValue value) {
+    const Ir *ir = s->ir;
+    uint32_t def = ir->values[value].block;
+    uint32_t stamp = ++s->stamp;
+    size_t start = s->live_block_count;
+    for (uint32_t u = s->use_start[value]; u < s->use_start[value + 1]; u++) {
+        uint32_t block = s->use_sites[u].block;
+        if (block == def || s->marks[block] == stamp) continue;
+        size_t depth = 0;
+        s->marks[block] = stamp;
+        s->work[depth++] = block;
+        while (depth > 0) {
+            block = s->work[--depth];
+            s->live_blocks = grow(s->live_blocks, &s->live_block_capacity, s->live_block_count, sizeof(uint32_t));
+            s->live_blocks[s->live_block_count++] = block;
+            for (uint32_t p = 0; p < ir->blocks[block].pred_count; p++) {
+                uint32_t pred = ir->blocks[block].preds[p];
+                if (pred == def || s->marks[pred] == stamp) continue;
+                s->marks[pred] = stamp;
+                s->work[depth++] = pred;
+            }
+        }
+    }
+    s->live_start[value] = (uint32_t)start;
+    s->live_count[value] = (uint32_t)(s->live_block_count - start);
+    if (s->live_count[value] > 1) {
+        qsort(s->live_blocks + start, s->live_count[value], sizeof(uint32_t), compare_blocks);
+    }
+}
+
+static int is_live_in(Slots *s, IrValue value, uint32_t block) {
+    if (s->live_start[value] == UINT32_MAX) find_live_in(s, value);
+    if (s->live_count[value] == 0) return 0;
+    return bsearch(&block, s->live_blocks + s->live_start[value], s->live_count[value], sizeof(uint32_t),
+                   compare_blocks) != NULL;
+}
+
+// Is x still needed once y is defined?
+static int is_live_at(Slots *s, IrValue x, IrValue y) {
+    const IrBlock *block = &s->ir->blocks[s->ir->values[y].block];
+    for (uint32_t u = s->use_start[x]; u < s->use_start[x + 1]; u++) {
+        const UseSite *site = &s->use_sites[u];
+        if (site->block == s->ir->values[y].block && site->position > s->positions[y]) return 1;
+    }
+    uint32_t succ_count = block->exit == IR_EXIT_BRANCH ? 2 : block->exit == IR_EXIT_JUMP ? 1 : 0;
+    for (uint32_t i = 0; i < succ_count; i++) {
+        if (is_live_in(s, x, block->succs[i])) return 1;
+    }
+    return 0;
+}
+
+static int defined_before(const Slots *s, IrValue x, IrValue y) {
+    uint32_t x_block = s->ir->values[x].block, y_block = s->ir->values[y].block;
+    if (x_block == y_block) return s->positions[x] < s->positions[y];
+    return ir_dominates(s->ir, x_block, y_block);
+}
+
+// Is x's definition before y's in a depth-first walk of the dominator tree?
+static int dominance_before(const Slots *s, IrValue x, IrValue y) {
+    uint32_t x_block = s->ir->values[x].block, y_block = s->ir->values[y].block;
+    if (x_block == y_block) return s->positions[x] < s->positions[y];
+    return s->ir->dom_enter[x_block] < s->ir->dom_enter[y_block];
+}
+
+static IrValue find_class(Slots *s, IrValue value) {
+    while (s->classes[value] != value) {
+        s->classes[value] = s->classes[s->classes[value]];
+        value = s->classes[value];
+    }
+    return value;
+}
+
+static uint32_t class_size(const Slots *s, IrValue root) {
+    return s->members[root] ? s->member_counts[root] : 1;
+}
+
+static const IrValue *class_members(const Slots *s, const IrValue *root) {
+    return s->members[*root] ? s->members[*root] : root;
+}
+
+// In SSA form two values overlap only if one is live where the other,
+// which its definition dominates, is defined. Neither class overlaps
+// within itself, so if their union does, some value overlaps the nearest
+// value dominating it in the union (Budimlić et al.), and one walk over
+// the union in dominance order finds it. The union is left in merged, for
+// joining the classes.
+static int classes_interfere(Slots *s, IrValue a, IrValue b) {
+    uint32_t a_count = class_size(s, a), b_count = class_size(s, b);
+    const IrValue *a_values = class_members(s, &a), *b_values = class_members(s, &b);
+    uint32_t i = 0, j = 0, depth = 0;
+    while (i < a_count || j < b_count) {
+        int from_b = i == a_count || (j < b_count && dominance_before(s, b_values[j], a_values[i]));
+        IrValue value = from_b ? b_values[j++] : a_values[i++];
+        while (depth > 0 && !defined_before(s, s->merged[s->forest[depth - 1]], value)) depth--;
+        if (depth > 0) {
+            uint32_t parent = s->forest[depth - 1];
+            if (s->merged_from[parent] != from_b && is_live_at(s, s->merged[parent], value)) return 1;
+        }
+        s->merged[i + j - 1] = value;
+        s->merged_from[i + j - 1] = (uint8_t)from_b;
+        s->forest[depth++] = i + j - 1;
+    }
+    return 0;
+}
+
+// Put each phi in the same slot as as many of its operands as can share it
+static void coalesce_phis(Slots *s) {
+    const Ir *ir = s->ir;
+    for (uint32_t i = 0; i < ir->order_count; i++) {
+        const IrBlock *block = &ir->blocks[ir->order[i]];
+        for (uint32_t j = 0; j < block->count && ir->values[block->code[j]].op == IR_PHI; j++) {
+            IrValue phi = block->code[j];
+            for (uint32_t k = 0; k < block->pred_count; k++) {
+                IrValue operand = ir->values[phi].operands[k];
+                if (!s->slotted[operand]) continue;
+                IrValue a = find_class(s, operand), b = find_class(s, phi);
+                if (a == b || class_size(s, a) + class_size(s, b) > COALESCE_MAX_CLASS ||
+                    classes_interfere(s, a, b)) {
+                    continue;
+                }
+                // Join the classes
+                uint32_t count = class_size(s, a) + class_size(s, b);
+                free(s->members[a]);
+                free(s->members[b]);
+                s->members[a] = NULL;
+                s->members[b] = allocate(count, sizeof(IrValue));
+                memcpy(s->members[b], s->merged, count * sizeof(IrValue));
+                s->member_counts[b] = count;
+                s->classes[a] = b;
+            }
+        }
+    }
+}
+
+uint32_t ir_assign_slots(const Ir *ir, const uint8_t *slotted, uint32_t *homes) {
+    Slots s = {0};
+    s.ir = ir;
+    s.slotted = slotted;
+    s.positions = allocate(ir->value_count, sizeof(uint32_t));
+    s.uses = allocate(ir->value_count, sizeof(uint32_t));
+    s.use_start = allocate(ir->value_count + 1, sizeof(uint32_t));
+    s.live_start = allocate(ir->value_count, sizeof(uint32_t));
+    s.live_count = allocate(ir->value_count, sizeof(uint32_t));
+    s.classes = allocate(ir->value_count, sizeof(IrValue));
+    s.members = allocate(ir->value_count, sizeof(IrValue *));
+    s.member_counts = allocate(ir->value_count, sizeof(uint32_t));
+    s.marks = allocate(ir->block_count, sizeof(uint32_t));
+    s.work = allocate(ir->block_count, sizeof(uint32_t));
+    for (uint32_t v = 0; v < ir->value_count; v++) {
+        s.live_start[v] = UINT32_MAX;
+        s.classes[v] = v;
+    }
+
+    count_uses(&s);
+    coalesce_phis(&s);
+
+    // Number the classes in the order their first values come
+    uint32_t slot_count = 0;
+    uint32_t *class_slots = allocate(ir->value_count, sizeof(uint32_t));
+    memset(class_slots, 0xff, ir->value_count * sizeof(uint32_t));
+    for (uint32_t i = 0; i < ir->order_count; i++) {
+        const IrBlock *block = &ir->blocks[ir->order[i]];
+        for (uint32_t j = 0; j < block->count; j++) {
+            IrValue value = block->code[j];
+            if (!slotted[value]) continue;
+            IrValue class = find_class(&s, value);
+            if (class_slots[class] == UINT32_MAX) class_slots[class] = slot_count++;
+            homes[value] = class_slots[class];
+        }
+    }
+
+    free(class_slots);
+    free(s.positions);
+    free(s.uses);
+    free(s.use_start);
+    free(s.use_sites);
+    free(s.live_start);
+    free(s.live_count);
+    free(s.live_blocks);
+    free(s.classes);
+    for (uint32_t v = 0; v < ir->value_count; v++) {
+        free(s.members[v]);
+    }
+    free(s.members);
+    free(s.member_counts);
+    free(s.marks);
+    free(s.work);
+    return slot_count;
+}
@@ -0,0 +1,801 @@
+/* jit.c
+ * x86-64 code generator for int-only programs.
+ *
+ * The optimised SSA form of the program (ir.h) is lowered to machine code,
+ * so the JIT runs what the VM runs, after constant propagation, common
+ * subexpression elimination and loop-invariant code motion. Values are
+ * placed as the bytecode compiler places them: a constant is used as an
+ * immediate, a value used once by the next instruction of its block stays
+ * in rax, and any other value gets a slot, shared with the phis it can be
+ * coalesced with (ir_assign_slots). A comparison that is its block's branch
+ * condition, computed last, leaves only the flags, for a conditional jump.
+ * The phis of a block are assigned on each edge into it, through the
+ * machine stack when there is more than one to copy.
+ *
+ * The four slots most used, weighted by loop nesting, live in the
+ * callee-saved registers rbx and r12-r14; the others live in a slot array
+ * addressed through r15. Blocks are laid out in reverse postorder, as in the
+ * bytecode. Printing, factorial and runtime errors call back into C. The
+ * code is built in a buffer, copied to an mmap'd region and made executable
+ * only once it is no longer writable.
+ */
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/jit.h"
+#include "../../include/lexer.h"
+#include "../../include/vm.h"
+
+#if defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+
+#define JIT_INITIAL_CAPACITY 4096
+
+// Registers, by their encoding
+enum { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+       R12 = 12, R13 = 13, R14 = 14, R15 = 15 };
+
+static const int variable_registers[] = {RBX, R12, R13, R14};
+#define VARIABLE_REGISTERS 4
+
+// Condition codes of jcc / setcc
+enum { CC_E = 0x4, CC_NE = 0x5, CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF };
+
+// Where the context pointer is kept, below the saved registers
+#define CONTEXT_OFFSET (-48)
+
+// Where a value is kept
+typedef enum {
+    PLACE_SLOT,
+    PLACE_RAX,             // Until the next instruction uses it
+    PLACE_FLAGS,           // A comparison branched on right away
+    PLACE_CONSTANT,
+} Place;
+
+// An instruction operand: a register, a variable slot in memory, or a
+// 32-bit immediate
+typedef enum { OPERAND_REGISTER, OPERAND_SLOT, OPERAND_IMMEDIATE } OperandKind;
+
+typedef struct {
+    OperandKind kind;
+    int reg;
+    int32_t value;    // Slot index or immediate
+} Operand;
+
+// Passed to the generated function and on to the callbacks
+typedef struct {
+    FILE *out;
+    CompilationUnit *unit;
+} JitContext;
+
+// Division by zero check, jumping to a stub emitted after the body
+typedef struct {
+    uint32_t patch;
+    NodeId node;
+} ErrorSite;
+
+// A jump to a block, or with IR_NO_BLOCK to the end of the program, patched
+// once the code is laid out
+typedef struct {
+    uint32_t patch;
+    uint32_t block;
+} Fixup;
+
+typedef struct {
+    const Ir *ir;
+
+    uint8_t *code;
+    size_t count, capacity;
+
+    // Per value
+    uint8_t *places;         // Place
+    uint32_t *homes;         // Slot
+    uint32_t *uses;
+    uint8_t *phi_used;       // Used by a phi
+    int8_t *slot_register;   // Register of each slot, or -1
+    uint32_t slot_count;
+
+    uint32_t *starts;        // Code offset of each block
+    Fixup *fixups;
+    size_t fixup_count, fixup_capacity;
+    ErrorSite *errors;
+    size_t error_count, error_capacity;
+    int branch_cc;           // Of the comparison left in the flags
+} JitCompiler;
+
+static void *grow(void *array, size_t *capacity, size_t count, size_t size) {
+    if (count < *capacity) return array;
+    *capacity = *capacity ? *capacity * 2 : 64;
+    array = realloc(array, *capacity * size);
+    if (!array) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    return array;
+}
+
+static void *allocate(size_t count, size_t size) {
+    void *array = calloc(count ? count : 1, size);
+    if (!array) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    return array;
+}
+
+// Callbacks from generated code
+
+static void jit_print_int(JitContext *context, int64_t value) {
+    fprintf(context->out, "%" PRId64 "\n", value);
+}
+
+static int64_t jit_factorial(int64_t n) {
+    return vm_factorial(n);
+}
+
+static void jit_division_by_zero(JitContext *context, uint32_t node) {
+    CompilationUnit *unit = context->unit;
+    size_t start = AST_START(&unit->ast, node);
+    diag_add(&unit->diags, DIAG_ERROR, DIAG_RUNTIME, RUNTIME_ERROR_DIVISION_BY_ZERO,
+             source_line(&unit->lexer, start), start, AST_LENGTH(&unit->ast, node));
+}
+
+// Encoding
+
+static uint32_t here(JitCompiler *c) {
+    return (uint32_t)c->count;
+}
+
+static void emit_byte(JitCompiler *c, uint8_t byte) {
+    if (c->count == c->capacity) {
+        c->capacity = c->capacity ? c->capacity * 2 : JIT_INITIAL_CAPACITY;
+        c->code = realloc(c->code, c->capacity);
+        if (!c->code) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    c->code[c->count++] = byte;
+}
+
+static void emit_bytes(JitCompiler *c, const uint8_t *bytes, size_t count) {
+    for (size_t i = 0; i < count; i++) emit_byte(c, bytes[i]);
+}
+
+static void emit_u32(JitCompiler *c, uint32_t value) {
+    for (int i = 0; i < 4; i++) emit_byte(c, (uint8_t)(value >> (8 * i)));
+}
+
+static void emit_u64(JitCompiler *c, uint64_t value) {
+    for (int i = 0; i < 8; i++) emit_byte(c, (uint8_t)(value >> (8 * i)));
+}
+
+// Point the rel32 at patch to target
+static void patch_rel32(JitCompiler *c, uint32_t patch, uint32_t target) {
+    uint32_t rel = target - (patch + 4);
+    for (int i = 0; i < 4; i++) c->code[patch + i] = (uint8_t)(rel >> (8 * i));
+}
+
+// 64-bit instruction: REX.W, opcode, and a ModRM with reg and the operand
+// rm, which is a register or a slot ([r15 + disp32]); immediate operands are
+// handled by the callers
+static void emit_modrm(JitCompiler *c, const uint8_t *opcode, size_t length, int reg, Operand rm) {
+    int base = rm.kind == OPERAND_REGISTER ? rm.reg : R15;
+    emit_byte(c, (uint8_t)(0x48 | (reg >= 8 ? 4 : 0) | (base >= 8 ? 1 : 0)));
+    emit_bytes(c, opcode, length);
+    if (rm.kind == OPERAND_REGISTER) {
+        emit_byte(c, (uint8_t)(0xC0 | (reg & 7) << 3 | (base & 7)));
+    } else {
+        emit_byte(c, (uint8_t)(0x80 | (reg & 7) << 3 | (base & 7)));
+        emit_u32(c, (uint32_t)rm.value * 8);
+    }
+}
+
+static Operand register_operand(int reg) {
+    return (Operand){OPERAND_REGISTER, reg, 0};
+}
+
+// Where the value in slot lives
+static Operand slot_operand(JitCompiler *c, uint32_t slot) {
+    if (c->slot_register[slot] >= 0) return register_operand(c->slot_register[slot]);
+    return (Operand){OPERAND_SLOT, 0, (int32_t)slot};
+}
+
+// mov reg, operand
+static void emit_load(JitCompiler *c, int reg, Operand operand) {
+    if (operand.kind == OPERAND_IMMEDIATE) {
+        // mov r/m64, imm32 (sign-extended)
+        emit_modrm(c, (const uint8_t[]){0xC7}, 1, 0, register_operand(reg));
+        emit_u32(c, (uint32_t)operand.value);
+    } else if (operand.kind != OPERAND_REGISTER || operand.reg != reg) {
+        emit_modrm(c, (const uint8_t[]){0x8B}, 1, reg, operand);
+    }
+}
+
+// mov operand, reg
+static void emit_store(JitCompiler *c, Operand operand, int reg) {
+    emit_modrm(c, (const uint8_t[]){0x89}, 1, reg, operand);
+}
+
+// mov reg, value
+static void emit_load_constant(JitCompiler *c, int reg, int64_t value) {
+    if (value >= INT32_MIN && value <= INT32_MAX) {
+        emit_load(c, reg, (Operand){OPERAND_IMMEDIATE, 0, (int32_t)value});
+    } else {
+        emit_byte(c, (uint8_t)(0x48 | (reg >= 8 ? 1 : 0)));
+        emit_byte(c, (uint8_t)(0xB8 | (reg & 7)));
+        emit_u64(c, (uint64_t)value);
+    }
+}
+
+// add/sub/cmp rax, operand, by their /digit in the 0x81 group and their
+// r64, r/m64 opcode
+static void emit_alu(JitCompiler *c, int digit, uint8_t opcode, Operand operand) {
+    if (operand.kind == OPERAND_IMMEDIATE) {
+        emit_modrm(c, (const uint8_t[]){0x81}, 1, digit, register_operand(RAX));
+        emit_u32(c, (uint32_t)operand.value);
+    } else {
+        emit_modrm(c, &opcode, 1, RAX, operand);
+    }
+}
+
+static void emit_call(JitCompiler *c, void *function) {
+    emit_bytes(c, (const uint8_t[]){0x48, 0xB8}, 2);   // mov rax, imm64
+    emit_u64(c, (uint64_t)(uintptr_t)function);
+    emit_bytes(c, (const uint8_t[]){0xFF, 0xD0}, 2);   // call rax
+}
+
+// mov rdi, [rbp + CONTEXT_OFFSET]
+static void emit_load_context(JitCompiler *c) {
+    emit_bytes(c, (const uint8_t[]){0x48, 0x8B, 0x7D, (uint8_t)CONTEXT_OFFSET}, 4);
+}
+
+// jmp / jcc rel32 to be patched; returns the rel32's offset
+static uint32_t emit_jump(JitCompiler *c) {
+    emit_byte(c, 0xE9);
+    uint32_t patch = here(c);
+    emit_u32(c, 0);
+    return patch;
+}
+
+static uint32_t emit_jump_if(JitCompiler *c, int cc) {
+    emit_bytes(c, (const uint8_t[]){0x0F, (uint8_t)(0x80 | cc)}, 2);
+    uint32_t patch = here(c);
+    emit_u32(c, 0);
+    return patch;
+}
+
+// Jump to block, or with IR_NO_BLOCK to the end of the program: on the
+// condition code cc, or always with -1
+static void emit_jump_to(JitCompiler *c, int cc, uint32_t block) {
+    c->fixups = grow(c->fixups, &c->fixup_capacity, c->fixup_count, sizeof(Fixup));
+    c->fixups[c->fixup_count++] = (Fixup){cc < 0 ? emit_jump(c) : emit_jump_if(c, cc), block};
+}
+
+// rax = rax != 0
+static void emit_bool(JitCompiler *c) {
+    emit_bytes(c, (const uint8_t[]){0x48, 0x85, 0xC0}, 3);        // test rax, rax
+    emit_bytes(c, (const uint8_t[]){0x0F, 0x95, 0xC0}, 3);        // setne al
+    emit_bytes(c, (const uint8_t[]){0x0F, 0xB6, 0xC0}, 3);        // movzx eax, al
+}
+
+// Condition code of an int comparison
+static int condition_code(IrOp op) {
+    static const int codes[6] = {CC_L, CC_LE, CC_G, CC_GE, CC_E, CC_NE};   // < <= > >= == !=
+    return codes[op - IR_LT_INT];
+}
+
+static int is_comparison(IrOp op) {
+    return op >= IR_LT_INT && op <= IR_NE_INT;
+}
+
+// The operation giving the same result with its operands swapped, or
+// IR_OP_COUNT if there is none
+static IrOp reversed_op(IrOp op) {
+    static const uint8_t swapped[6] = {IR_GT_INT, IR_GE_INT, IR_LT_INT, IR_LE_INT, IR_EQ_INT, IR_NE_INT};
+    if (op == IR_ADD_INT || op == IR_MUL_INT) return op;
+    return is_comparison(op) ? (IrOp)swapped[op - IR_LT_INT] : IR_OP_COUNT;
+}
+
+// rax = rax / divisor, reporting division by zero at node. INT64_MIN / -1
+// wraps around, as in the VM, instead of trapping in idiv. A power of two
+// is a shift, rounding toward zero like idiv by adding divisor - 1 to a
+// negative dividend first.
+static void emit_divide(JitCompiler *c, NodeId node, Operand divisor) {
+    if (divisor.kind == OPERAND_IMMEDIATE && divisor.value > 1 && (divisor.value & (divisor.value - 1)) == 0) {
+        uint8_t shift = (uint8_t)__builtin_ctz((uint32_t)divisor.value);
+        emit_bytes(c, (const uint8_t[]){0x48, 0x89, 0xC1}, 3);    // mov rcx, rax
+        emit_bytes(c, (const uint8_t[]){0x48, 0xC1, 0xF9, 63}, 4);    // sar rcx, 63
+        emit_bytes(c, (const uint8_t[]){0x48, 0xC1, 0xE9, (uint8_t)(64 - shift)}, 4); // shr rcx, 64 - shift
+        emit_bytes(c, (const uint8_t[]){0x48, 0x01, 0xC8}, 3);    // add rax, rcx
+        emit_bytes(c, (const uint8_t[]){0x48, 0xC1, 0xF8, shift}, 4); // sar rax, shift
+        return;
+    }
+    int checked = divisor.kind != OPERAND_IMMEDIATE || divisor.value == 0 || divisor.value == -1;
+    emit_load(c, RCX, divisor);
+    if (checked) {
+        emit_bytes(c, (const uint8_t[]){0x48, 0x85, 0xC9}, 3);    // test rcx, rcx
+        c->errors = grow(c->errors, &c->error_capacity, c->error_count, sizeof(ErrorSite));
+        c->errors[c->error_count++] = (ErrorSite){emit_jump_if(c, CC_E), node};
+        emit_bytes(c, (const uint8_t[]){0x48, 0x83, 0xF9, 0xFF}, 4); // cmp rcx, -1
+        emit_bytes(c, (const uint8_t[]){0x75, 0x05}, 2);          // jne idiv
+        emit_bytes(c, (const uint8_t[]){0x48, 0xF7, 0xD8}, 3);    // neg rax
+        emit_bytes(c, (const uint8_t[]){0xEB, 0x05}, 2);          // jmp done
+    }
+    emit_bytes(c, (const uint8_t[]){0x48, 0x99}, 2);              // cqo
+    emit_bytes(c, (const uint8_t[]){0x48, 0xF7, 0xF9}, 3);        // idiv rcx
+}
+
+// Placement
+
+static void count_uses(JitCompiler *c) {
+    const Ir *ir = c->ir;
+    for (uint32_t i = 0; i < ir->order_count; i++) {
+        const IrBlock *block = &ir->blocks[ir->order[i]];
+        for (uint32_t j = 0; j < block->count; j++) {
+            const IrInstr *instr = &ir->values[block->code[j]];
+            int count = ir_operand_count(ir, block->code[j]);
+            for (int k = 0; k < count; k++) {
+                if (instr->op == IR_PHI) c->phi_used[instr->operands[k]] = 1;
+                c->uses[instr->operands[k]]++;
+            }
+        }
+        if (block->exit == IR_EXIT_BRANCH) c->uses[block->condition]++;
+    }
+}
+
+// Is value used only by the instruction after it?
+static int used_next(const JitCompiler *c, IrValue value, IrValue previous) {
+    return value == previous && c->uses[value] == 1 && !c->phi_used[value];
+}
+
+static void place_values(JitCompiler *c) {
+    const Ir *ir = c->ir;
+    for (uint32_t i = 0; i < ir->order_count; i++) {
+        const IrBlock *block = &ir->blocks[ir->order[i]];
+        IrValue previous = IR_NONE;   // The last instruction emitting code
+        for (uint32_t j = 0; j < block->count; j++) {
+            IrValue value = block->code[j];
+            const IrInstr *instr = &ir->values[value];
+            if (instr->op == IR_CONST) {
+                c->places[value] = PLACE_CONSTANT;
+                continue;
+            }
+            c->places[value] = PLACE_SLOT;
+            if (instr->op == IR_PHI) continue;
+            int count = ir_operand_count(ir, value);
+            for (int k = 0; k < count; k++) {
+                if (used_next(c, instr->operands[k], previous)) c->places[previous] = PLACE_RAX;
+            }
+            previous = value;
+        }
+        if (block->exit == IR_EXIT_BRANCH && used_next(c, block->condition, previous)) {
+            c->places[previous] = is_comparison((IrOp)ir->values[previous].op) ? PLACE_FLAGS : PLACE_RAX;
+        }
+    }
+}
+
+// Where value is, loading a constant too wide for an immediate into scratch
+static Operand value_operand(JitCompiler *c, IrValue value, int scratch) {
+    switch ((Place)c->places[value]) {
+    case PLACE_CONSTANT: {
+        int64_t constant = c->ir->values[value].constant.i;
+        if (constant >= INT32_MIN && constant <= INT32_MAX) {
+            return (Operand){OPERAND_IMMEDIATE, 0, (int32_t)constant};
+        }
+        emit_load_constant(c, scratch, constant);
+        return register_operand(scratch);
+    }
+    case PLACE_SLOT:
+        return slot_operand(c, c->homes[value]);
+    default:
+        return register_operand(RAX);
+    }
+}
+
+static void emit_load_value(JitCompiler *c, int reg, IrValue value) {
+    emit_load(c, reg, value_operand(c, value, reg));
+}
+
+// Loop nesting of each block. A loop's header dominates its latch, its
+// second predecessor, and its body is what reaches the latch without
+// passing through the header.
+static void find_loop_depths(const Ir *ir, uint32_t *depths) {
+    uint32_t *marks = allocate(ir->block_count, sizeof(uint32_t));
+    uint32_t *work = allocate(ir->block_count, sizeof(uint32_t));
+    uint32_t stamp = 0;
+    for (uint32_t i = 0; i < ir->order_count; i++) {
+        uint32_t header = ir->order[i];
+        const IrBlock *block = &ir->blocks[header];
+        if (block->pred_count < 2 || !ir_dominates(ir, header, block->preds[1])) continue;
+        size_t count = 0;
+        marks[header] = ++stamp;
+        depths[header]++;
+        if (marks[block->preds[1]] != stamp) {
+            marks[block->preds[1]] = stamp;
+            work[count++] = block->preds[1];
+        }
+        while (count > 0) {
+            uint32_t body = work[--count];
+            depths[body]++;
+            for (uint32_t p = 0; p < ir->blocks[body].pred_count; p++) {
+                uint32_t pred = ir->blocks[body].preds[p];
+                if (marks[pred] == stamp) continue;
+                marks[pred] = stamp;
+                work[count++] = pred;
+            }
+        }
+    }
+    free(marks);
+    free(work);
+}
+
+// Give the most used slots registers. A definition or use inside n nested
+// loops counts 16^n times.
+static void choose_registers(JitCompiler *c) {
+    const Ir *ir = c->ir;
+    uint64_t *weight = allocate(c->slot_count, sizeof(uint64_t));
+    uint32_t *depths = allocate(ir->block_count, sizeof(uint32_t));
+    memset(c->slot_register, -1, c->slot_count);
+    find_loop_depths(ir, depths);
+
+    for (uint32_t i = 0; i < ir->order_count; i++) {
+        uint32_t index = ir->order[i];
+        const IrBlock *block = &ir->blocks[index];
+        uint64_t count = 1ull << (4 * (depths[index] < 12 ? depths[index] : 12));
+        for (uint32_t j = 0; j < block->count; j++) {
+            IrValue value = block->code[j];
+            const IrInstr *instr = &ir->values[value];
+            int operand_count = ir_operand_count(ir, value);
+            if (instr->op == IR_CONST) continue;
+            if (c->places[value] == PLACE_SLOT && instr->op != IR_PRINT_INT) weight[c->homes[value]] += count;
+            for (int k = 0; k < operand_count; k++) {
+                if (c->places[instr->operands[k]] == PLACE_SLOT) weight[c->homes[instr->operands[k]]] += count;
+            }
+        }
+        if (block->exit == IR_EXIT_BRANCH && c->places[block->condition] == PLACE_SLOT) {
+            weight[c->homes[block->condition]] += count;
+        }
+    }
+
+    for (int r = 0; r < VARIABLE_REGISTERS; r++) {
+        uint32_t best = c->slot_count;
+        for (uint32_t slot = 0; slot < c->slot_count; slot++) {
+            if (c->slot_register[slot] < 0 && weight[slot] > 0 &&
+                (best == c->slot_count || weight[slot] > weight[best])) {
+                best = slot;
+            }
+        }
+        if (best == c->slot_count) break;
+        c->slot_register[best] = (int8_t)variable_registers[r];
+    }
+
+    free(depths);
+    free(weight);
+}
+
+// Emission
+
+static void emit_instr(JitCompiler *c, IrValue value) {
+    const IrInstr *instr = &c->ir->values[value];
+    IrOp op = (IrOp)instr->op;
+    IrValue a = instr->operands[0], b = instr->operands[1];
+
+    if (ir_operand_count(c->ir, value) == 1) {
+        emit_load_value(c, RAX, a);
+        switch (op) {
+        case IR_BOOL_INT:
+            emit_bool(c);
+            break;
+        case IR_FACTORIAL:
+            emit_bytes(c, (const uint8_t[]){0x48, 0x89, 0xC7}, 3);  // mov rdi, rax
+            emit_call(c, (void *)jit_factorial);
+            break;
+        case IR_PRINT_INT:
+            emit_bytes(c, (const uint8_t[]){0x48, 0x89, 0xC6}, 3);  // mov rsi, rax
+            emit_load_context(c);
+            emit_call(c, (void *)jit_print_int);
+            return;
+        default:
+            break;   // A copy
+        }
+    } else {
+        // a goes in rax; b, if it is there already, swaps with it
+        Operand operand;
+        if (c->places[b] == PLACE_RAX && reversed_op(op) != IR_OP_COUNT) {
+            op = reversed_op(op);
+            operand = value_operand(c, a, RCX);
+        } else if (c->places[b] == PLACE_RAX) {
+            emit_bytes(c, (const uint8_t[]){0x48, 0x89, 0xC1}, 3);  // mov rcx, rax
+            emit_load_value(c, RAX, a);
+            operand = register_operand(RCX);
+        } else {
+            emit_load_value(c, RAX, a);
+            operand = value_operand(c, b, RCX);
+        }
+
+        switch (op) {
+        case IR_ADD_INT:
+            emit_alu(c, 0, 0x03, operand);
+            break;
+        case IR_SUB_INT:
+            emit_alu(c, 5, 0x2B, operand);
+            break;
+        case IR_MUL_INT:
+            if (operand.kind == OPERAND_IMMEDIATE) {
+                emit_modrm(c, (const uint8_t[]){0x69}, 1, RAX, register_operand(RAX));
+                emit_u32(c, (uint32_t)operand.value);
+            } else {
+                emit_modrm(c, (const uint8_t[]){0x0F, 0xAF}, 2, RAX, operand);
+            }
+            break;
+        case IR_DIV_INT:
+            emit_divide(c, instr->node, operand);
+            break;
+        default:
+            emit_alu(c, 7, 0x3B, operand);                         // cmp
+            if (c->places[value] == PLACE_FLAGS) {
+                c->branch_cc = condition_code(op);
+                return;
+            }
+            emit_bytes(c, (const uint8_t[]){0x0F, (uint8_t)(0x90 | condition_code(op)), 0xC0}, 3); // setcc al
+            emit_bytes(c, (const uint8_t[]){0x0F, 0xB6, 0xC0}, 3);  // movzx eax, al
+            break;
+        }
+    }
+    if (c->places[value] == PLACE_SLOT) emit_store(c, slot_operand(c, c->homes[value]), RAX);
+}
+
+// Does the phi get its operand for free, being in the same slot?
+static int is_shared(const JitCompiler *c, IrValue phi, IrValue operand) {
+    return c->places[operand] == PLACE_SLOT && c->homes[operand] == c->homes[phi];
+}
+
+// Number of phis of block to the edge from block from assigns
+static uint32_t count_copies(const JitCompiler *c, uint32_t from, uint32_t to) {
+    const Ir *ir = c->ir;
+    const IrBlock *target = &ir->blocks[to];
+    int k = target->preds[0] == from ? 0 : 1;
+    uint32_t copies = 0;
+    for (uint32_t j = 0; j < target->count && ir->values[target->code[j]].op == IR_PHI; j++) {
+        copies += !is_shared(c, target->code[j], ir->values[target->code[j]].operands[k]);
+    }
+    return copies;
+}
+
+// mov destination, value; rax is free between blocks
+static void emit_move(JitCompiler *c, Operand destination, IrValue value) {
+    Operand source = value_operand(c, value, RAX);
+    if (destination.kind == OPERAND_REGISTER) {
+        emit_load(c, destination.reg, source);
+    } else if (source.kind == OPERAND_IMMEDIATE) {
+        emit_modrm(c, (const uint8_t[]){0xC7}, 1, 0, destination);
+        emit_u32(c, (uint32_t)source.value);
+    } else {
+        emit_load(c, RAX, source);
+        emit_store(c, destination, RAX);
+    }
+}
+
+// Assign the phis of block to for the edge from block from: one is moved,
+// more are pushed, then popped in reverse, which copies them in parallel
+static void emit_phi_copies(JitCompiler *c, uint32_t from, uint32_t to) {
+    const Ir *ir = c->ir;
+    const IrBlock *target = &ir->blocks[to];
+    int k = target->preds[0] == from ? 0 : 1;
+    int single = count_copies(c, from, to) == 1;
+    uint32_t count = 0;
+    for (; count < target->count && ir->values[target->code[count]].op == IR_PHI; count++) {
+        IrValue phi = target->code[count], operand = ir->values[phi].operands[k];
+        if (is_shared(c, phi, operand)) continue;
+        if (single) {
+            emit_move(c, slot_operand(c, c->homes[phi]), operand);
+            continue;
+        }
+        Operand source = value_operand(c, operand, RAX);
+        if (source.kind == OPERAND_IMMEDIATE) {
+            emit_byte(c, 0x68);                                     // push imm32
+            emit_u32(c, (uint32_t)source.value);
+        } else {
+            emit_modrm(c, (const uint8_t[]){0xFF}, 1, 6, source);   // push r/m64
+        }
+    }
+    if (single) return;
+    for (uint32_t j = count; j-- > 0;) {
+        IrValue phi = target->code[j];
+        if (is_shared(c, phi, ir->values[phi].operands[k])) continue;
+        emit_modrm(c, (const uint8_t[]){0x8F}, 1, 0, slot_operand(c, c->homes[phi]));   // pop r/m64
+    }
+}
+
+// Set the flags for a branch on condition; returns the condition code for
+// true
+static int emit_condition(JitCompiler *c, IrValue condition) {
+    if (c->places[condition] == PLACE_FLAGS) return c->branch_cc;
+    Operand operand = value_operand(c, condition, RAX);
+    if (operand.kind == OPERAND_IMMEDIATE) {
+        emit_load(c, RAX, operand);
+        operand = register_operand(RAX);
+    }
+    if (operand.kind == OPERAND_REGISTER) {
+        emit_modrm(c, (const uint8_t[]){0x85}, 1, operand.reg, operand);   // test reg, reg
+    } else {
+        emit_modrm(c, (const uint8_t[]){0x83}, 1, 7, operand);  // cmp qword [slot], 0
+        emit_byte(c, 0);
+    }
+    return CC_NE;
+}
+
+static void emit_block(JitCompiler *c, uint32_t position) {
+    const Ir *ir = c->ir;
+    uint32_t index = ir->order[position];
+    uint32_t next = position + 1 < ir->order_count ? ir->order[position + 1] : IR_NO_BLOCK;
+    const IrBlock *block = &ir->blocks[index];
+
+    c->starts[index] = here(c);
+    for (uint32_t j = 0; j < block->count; j++) {
+        IrOp op = (IrOp)ir->values[block->code[j]].op;
+        if (op != IR_CONST && op != IR_PHI) emit_instr(c, block->code[j]);
+    }
+
+    switch ((IrExit)block->exit) {
+    case IR_EXIT_RETURN:
+        if (next != IR_NO_BLOCK) emit_jump_to(c, -1, IR_NO_BLOCK);
+        break;
+    case IR_EXIT_JUMP:
+        emit_phi_copies(c, index, block->succs[0]);
+        if (block->succs[0] != next) emit_jump_to(c, -1, block->succs[0]);
+        break;
+    case IR_EXIT_BRANCH: {
+        // The false edge's phi copies go after the true edge's
+        int copies = count_copies(c, index, block->succs[1]) > 0;
+        int cc = emit_condition(c, block->condition);
+        uint32_t jump = 0;
+        if (copies) jump = emit_jump_if(c, cc ^ 1);
+        else emit_jump_to(c, cc ^ 1, block->succs[1]);
+
+        emit_phi_copies(c, index, block->succs[0]);
+        if (block->succs[0] != next || copies) emit_jump_to(c, -1, block->succs[0]);
+        if (copies) {
+            patch_rel32(c, jump, here(c));
+            emit_phi_copies(c, index, block->succs[1]);
+            if (block->succs[1] != next) emit_jump_to(c, -1, block->succs[1]);
+        }
+        break;
+    }
+    }
+}
+
+static void emit_prologue(JitCompiler *c) {
+    emit_byte(c, 0x55);                                             // push rbp
+    emit_bytes(c, (const uint8_t[]){0x48, 0x89, 0xE5}, 3);          // mov rbp, rsp
+    emit_byte(c, 0x53);                                             // push rbx
+    emit_bytes(c, (const uint8_t[]){0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57}, 8); // push r12-r15
+    emit_bytes(c, (const uint8_t[]){0x48, 0x83, 0xEC, 0x08}, 4);    // sub rsp, 8
+    emit_bytes(c, (const uint8_t[]){0x48, 0x89, 0x7D, (uint8_t)CONTEXT_OFFSET}, 4); // mov [rbp-48], rdi
+    emit_bytes(c, (const uint8_t[]){0x49, 0x89, 0xF7}, 3);          // mov r15, rsi
+}
+
+// Return 1, then the error stubs, which return 0 after reporting
+static void emit_epilogue(JitCompiler *c) {
+    uint32_t finish = here(c);
+    emit_bytes(c, (const uint8_t[]){0xB8, 0x01, 0x00, 0x00, 0x00}, 5); // mov eax, 1
+    uint32_t epilogue = here(c);
+    emit_bytes(c, (const uint8_t[]){0x48, 0x8D, 0x65, 0xD8}, 4);    // lea rsp, [rbp-40]
+    emit_bytes(c, (const uint8_t[]){0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C}, 8); // pop r15-r12
+    emit_byte(c, 0x5B);                                             // pop rbx
+    emit_byte(c, 0x5D);                                             // pop rbp
+    emit_byte(c, 0xC3);                                             // ret
+
+    for (size_t i = 0; i < c->fixup_count; i++) {
+        uint32_t block = c->fixups[i].block;
+        patch_rel32(c, c->fixups[i].patch, block == IR_NO_BLOCK ? finish : c->starts[block]);
+    }
+    for (size_t i = 0; i < c->error_count; i++) {
+        patch_rel32(c, c->errors[i].patch, here(c));
+        emit_bytes(c, (const uint8_t[]){0x48, 0x83, 0xE4, 0xF0}, 4); // and rsp, -16
+        emit_load_context(c);
+        emit_byte(c, 0xBE);                                         // mov esi, node
+        emit_u32(c, c->errors[i].node);
+        emit_call(c, (void *)jit_division_by_zero);
+        emit_bytes(c, (const uint8_t[]){0x31, 0xC0}, 2);            // xor eax, eax
+        patch_rel32(c, emit_jump(c), epilogue);
+    }
+}
+
+int jit_supported(const Ir *ir) {
+    for (uint32_t i = 0; i < ir->order_count; i++) {
+        const IrBlock *block = &ir->blocks[ir->order[i]];
+        for (uint32_t j = 0; j < block->count; j++) {
+            const IrInstr *instr = &ir->values[block->code[j]];
+            switch (instr->op) {
+            case IR_CONST: case IR_PHI: case IR_COPY:
+                if (instr->type != TYPE_INT) return 0;
+                break;
+            case IR_ADD_INT: case IR_SUB_INT: case IR_MUL_INT: case IR_DIV_INT:
+            case IR_LT_INT: case IR_LE_INT: case IR_GT_INT: case IR_GE_INT: case IR_EQ_INT: case IR_NE_INT:
+            case IR_BOOL_INT: case IR_FACTORIAL: case IR_PRINT_INT:
+                break;
+            default:
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+int jit_run(const Ir *ir, FILE *out) {
+    JitCompiler c = {0};
+    c.ir = ir;
+    c.places = allocate(ir->value_count, 1);
+    c.homes = allocate(ir->value_count, sizeof(uint32_t));
+    c.uses = allocate(ir->value_count, sizeof(uint32_t));
+    c.phi_used = allocate(ir->value_count, 1);
+    c.starts = allocate(ir->block_count, sizeof(uint32_t));
+    for (uint32_t v = 0; v < ir->value_count; v++) {
+        c.homes[v] = UINT32_MAX;
+    }
+
+    count_uses(&c);
+    place_values(&c);
+    // Prints leave nothing behind to keep
+    uint8_t *slotted = allocate(ir->value_count, 1);
+    for (uint32_t v = 0; v < ir->value_count; v++) {
+        slotted[v] = c.places[v] == PLACE_SLOT && ir->values[v].op != IR_PRINT_INT;
+    }
+    c.slot_count = ir_assign_slots(ir, slotted, c.homes);
+    free(slotted);
+    c.slot_register = allocate(c.slot_count, 1);
+    choose_registers(&c);
+
+    emit_prologue(&c);
+    for (uint32_t i = 0; i < ir->order_count; i++) {
+        emit_block(&c, i);
+    }
+    emit_epilogue(&c);
+
+    // Writable while the code is copied in, executable only afterwards
+    int result = -1;
+    void *memory = mmap(NULL, c.count, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    int64_t *slots = calloc(c.slot_count ? c.slot_count : 1, sizeof(int64_t));
+    if (memory != MAP_FAILED && slots) {
+        memcpy(memory, c.code, c.count);
+        if (mprotect(memory, c.count, PROT_READ | PROT_EXEC) == 0) {
+            JitContext context = {out, ir->unit};
+            int (*program)(JitContext *, int64_t *);
+            *(void **)&program = memory;
+            result = program(&context, slots);
+        }
+    }
+    if (memory != MAP_FAILED) munmap(memory, c.count);
+
+    free(slots);
+    free(c.code);
+    free(c.places);
+    free(c.homes);
+    free(c.uses);
+    free(c.phi_used);
+    free(c.slot_register);
+    free(c.starts);
+    free(c.fixups);
+    free(c.errors);
+    return result;
+}
+
+#else
+
+int jit_supported(const Ir *ir) {
+    (void)ir;
+    return 0;
+}
+
+int jit_run(const Ir *ir, FILE *out) {
+    (void)ir;
+    (void)out;
+    return -1;
+}
+
+#endif
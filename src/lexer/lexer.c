@@ -4,318 +4,235 @@
 #include <ctype.h>
 #include <string.h>
 
+#include "../../include/diag.h"
 #include "../../include/tokens.h"
 #include "../../include/lexer.h"
-#include "../../include/parser.h"
+#include "../../include/lexer_simd.h"
 
-static int current_line = 1;
-static char last_token_type = 'x';
+// DFA tables generated from the lexical rules in include/tokens.def by
+// tools/gen_lexer.c (see the Makefile)
+#include "lexer_tables.h"
 
-// Keywords table
-static struct {
-    const char *word;
-    TokenType type;
-} 
+// Keyword recognition: keyword_table and KEYWORD_HASH are generated from
+// include/tokens.def by tools/gen_keywords.c (see the Makefile)
+#include "keyword_hash.h"
 
-keywords[] = {
-    {"if", TOKEN_IF},
-    {"int", TOKEN_INT},
-    {"print", TOKEN_PRINT},
-    {"else", TOKEN_ELSE},
-    {"repeat", TOKEN_REPEAT},
-    {"until", TOKEN_UNTIL},
-    {"for", TOKEN_FOR},
-    {"while", TOKEN_WHILE},
-    {"break", TOKEN_BREAK},
-    {"factorial", TOKEN_FACTORIAL},
-    {"return", TOKEN_RETURN},
-    {"void", TOKEN_VOID},
-    {"float", TOKEN_FLOAT},
-    {"char", TOKEN_CHAR},
-    {"const", TOKEN_CONST},
-    {"string", TOKEN_STRING}
-};
-
-static int is_keyword(const char *word)
+// Return the keyword token type for word, or 0 if it is not a keyword
+int is_keyword(const char *word, int length)
 {
-    for (int i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++)
+    if (length < KEYWORD_MIN_LENGTH || length > KEYWORD_MAX_LENGTH)
     {
-        if (strcmp(word, keywords[i].word) == 0)
-        {
-            return keywords[i].type;
-        }
+        return 0;
+    }
+
+    unsigned slot = KEYWORD_HASH(word, length);
+    if (keyword_table[slot].length == length &&
+        memcmp(word, keyword_table[slot].word, length) == 0)
+    {
+        return keyword_table[slot].type;
     }
     return 0;
 }
 
-void print_error(ErrorType error, int line, const char *lexeme)
+// Set up lexer state for a new buffer
+void lexer_init(Lexer *lexer, const char *input, Interner *names)
 {
-    printf("Lexical Error at line %d: ", line);
-    switch (error)
+    lexer->input = input;
+    lexer->position = 0;
+    lexer->interner = names;
+    lexer->line_starts = NULL;
+    lexer->line_count = 0;
+}
+
+void lexer_free(Lexer *lexer)
+{
+    free(lexer->line_starts);
+    lexer->line_starts = NULL;
+    lexer->line_count = 0;
+}
+
+static void build_line_table(Lexer *lexer)
+{
+    // Size the table exactly with a vectorised newline count, then fill it
+    // by jumping from newline to newline
+    const char *input = lexer->input;
+    size_t *line_starts = malloc((simd_count_newlines(input) + 1) * sizeof(size_t));
+    int line_count = 0;
+    line_starts[line_count++] = 0;
+
+    const char *p = input;
+    while (*(p = simd_find_byte2(p, '\n', '\n')) != '\0')
     {
-    case ERROR_INVALID_CHAR:
-        printf("Invalid character '%s'\n", lexeme);
-        break;
-    case ERROR_INVALID_NUMBER:
-        printf("Invalid number format\n");
-        break;
-    case ERROR_CONSECUTIVE_OPERATORS:
-        printf("Consecutive operators not allowed\n");
-        break;
-    case ERROR_INVALID_IDENTIFIER:
-        printf("Invalid identifier\n");
-        break;
-    case ERROR_UNEXPECTED_TOKEN:
-        printf("Unexpected token '%s'\n", lexeme);
-        break;
-    case ERROR_UNKNOWN_ESCAPE_SEQUENCE:
-        printf("Unknown escape sequence\n");
-        break;
-    case ERROR_UNTERMINATED_STRING:
-        printf("Unterminated string\n");
-    default:
-        printf("Unknown error\n");
+        p++;
+        line_starts[line_count++] = (size_t)(p - input);
     }
+    lexer->line_starts = line_starts;
+    lexer->line_count = line_count;
 }
 
-void print_token(Token token)
+int source_line(Lexer *lexer, size_t offset)
 {
-    if (token.error != ERROR_NONE)
+    if (!lexer->line_starts)
     {
-        print_error(token.error, token.line, token.lexeme);
-        return;
+        build_line_table(lexer);
     }
 
-    printf("Token: ");
-    switch (token.type)
+    // Binary search for the last line starting at or before offset
+    const size_t *line_starts = lexer->line_starts;
+    int lo = 0, hi = lexer->line_count - 1;
+    while (lo < hi)
     {
-    case TOKEN_NUMBER:      printf("NUMBER"); break;
-        case TOKEN_OPERATOR:    printf("OPERATOR"); break;
-        case TOKEN_COMPARISON:  printf("COMPARISON"); break;
-        case TOKEN_IDENTIFIER:  printf("IDENTIFIER"); break;
-        case TOKEN_EQUALS:      printf("EQUALS"); break;
-        case TOKEN_SEMICOLON:   printf("SEMICOLON"); break;
-        case TOKEN_LPAREN:      printf("LPAREN"); break;
-        case TOKEN_RPAREN:      printf("RPAREN"); break;
-        case TOKEN_LBRACE:      printf("LBRACE"); break;
-        case TOKEN_RBRACE:      printf("RBRACE"); break;
-        case TOKEN_LBRACK:      printf("LBRACK"); break;
-        case TOKEN_RBRACK:      printf("RBRACK"); break;
-        case TOKEN_IF:          printf("IF"); break;
-        case TOKEN_ELSE:        printf("ELSE"); break;
-        case TOKEN_REPEAT:      printf("REPEAT"); break;
-        case TOKEN_UNTIL:       printf("UNTIL"); break;
-        case TOKEN_FOR:         printf("FOR"); break;
-        case TOKEN_BREAK:       printf("BREAK"); break;
-        case TOKEN_VOID:        printf("VOID"); break;
-        case TOKEN_CONST:       printf("CONST"); break;
-        case TOKEN_INT:         printf("INT"); break;
-        case TOKEN_FLOAT:       printf("FLOAT"); break;
-        case TOKEN_CHAR:        printf("CHAR"); break;
-        case TOKEN_PRINT:       printf("PRINT"); break;
-        case TOKEN_EOF:         printf("EOF"); break;
-        default:                printf("UNKNOWN");
-    }
-    printf(" | Lexeme: '%s' | Line: %d\n", token.lexeme, token.line);
-}
-int is_operator_char(char c) {
-    switch (c) {
-        case '+':
-        case '-':
-        case '*':
-        case '/':
-            return TOKEN_OPERATOR;
-        case '<':
-        case '>':
-        case '!':
-            return TOKEN_COMPARISON;
-        case '=':
-            return TOKEN_EQUALS;
-        default:
-            return 0;
+        int mid = (lo + hi + 1) / 2;
+        if (line_starts[mid] <= offset)
+            lo = mid;
+        else
+            hi = mid - 1;
     }
+    return lo + 1;
 }
 
-int is_delimiter(char c) {
-    switch (c) {
-        case ';':   return TOKEN_SEMICOLON;
-        case '(':   return TOKEN_LPAREN;
-        case ')':   return TOKEN_RPAREN;
-        case '{':   return TOKEN_LBRACE;
-        case '}':   return TOKEN_RBRACE;
-        case '[':   return TOKEN_LBRACK;
-        case ']':   return TOKEN_RBRACK;
-        default:    return 0;
-            
-    }
+int token_line(Lexer *lexer, Token token)
+{
+    return source_line(lexer, token.start);
 }
 
-Token get_next_token(const char *input, int *pos)
+void print_error(FILE *out, ErrorType error, int line, const char *lexeme, int length)
 {
-    Token token = {TOKEN_ERROR, "", current_line, ERROR_NONE};
-    char c;
+    Diagnostic diag = {0};
+    diag.severity = DIAG_ERROR;
+    diag.phase = DIAG_LEXICAL;
+    diag.code = (uint16_t)error;
+    diag.line = line;
+    diag.length = (uint32_t)length;
+    diag.text = lexeme;
+    diag.text_length = length;
+    diag_print(&diag, out);
+}
 
-    // Skip whitespace and track line numbers
-    while ((c = input[*pos]) != '\0' && (c == ' ' || c == '\n' || c == '\t'))
+void print_token(Lexer *lexer, Token token)
+{
+    const char *lexeme = lexer->input + token.start;
+    int length = (int)token.length;
+    if (token.type == TOKEN_EOF)
     {
-        if (c == '\n')
-        {
-            current_line++;
-        }
-        (*pos)++;
+        lexeme = "EOF";
+        length = 3;
     }
 
-    if (input[*pos] == '\0')
+    if (token.error != ERROR_NONE)
     {
-        token.type = TOKEN_EOF;
-        strcpy(token.lexeme, "EOF");
-        return token;
+        print_error(stdout, token.error, token_line(lexer, token), lexeme, length);
+        return;
     }
 
-    c = input[*pos];
-
-    // Handle numbers
-    if (isdigit(c))
+    printf("Token: ");
+    switch (token.type)
     {
-        int i = 0;
-        do
-        {
-            token.lexeme[i++] = c;
-            (*pos)++;
-            c = input[*pos];
-        } while (isdigit(c) && i < sizeof(token.lexeme) - 1);
-
-        token.lexeme[i] = '\0';
-        token.type = TOKEN_NUMBER;
-        return token;
+#define TOKEN(name) case name: printf("%s", #name + 6); break;
+#include "../../include/tokens.def"
+        default:                printf("UNKNOWN");
     }
+    printf(" | Lexeme: '%.*s' | Line: %d\n", length, lexeme, token_line(lexer, token));
+}
 
-    // Handle identifiers and keywords
-    if (isalpha(c) || c == '_')
+// Skip the rest of a run the DFA would otherwise walk byte by byte
+static size_t fast_forward(const char *input, size_t pos, const LexStateInfo *info)
+{
+    switch (info->fast)
     {
-        int i = 0;
-        do
-        {
-            token.lexeme[i++] = c;
-            (*pos)++;
-            c = input[*pos];
-        } while ((isalnum(c) || c == '_') && i < sizeof(token.lexeme) - 1);
+    case LEX_FAST_SPACE:
+        return (size_t)(simd_skip_space(input + pos) - input);
+    case LEX_FAST_IDENT:
+        return (size_t)(simd_skip_ident(input + pos) - input);
+    case LEX_FAST_UNTIL:
+        return (size_t)(simd_find_byte2(input + pos, info->stop1, info->stop2) - input);
+    default:
+        return pos;
+    }
+}
 
-        token.lexeme[i] = '\0';
+Token get_next_token(Lexer *lexer)
+{
+    const char *input = lexer->input;
+    size_t *pos = &lexer->position;
+    Token token = {TOKEN_ERROR, ERROR_NONE, *pos, 0, INTERN_NONE};
 
-        // Check if it's a keyword
-        TokenType keyword_type = is_keyword(token.lexeme);
-        if (keyword_type)
-        {
-            token.type = keyword_type;
-        }
-        else
+    for (;;)
+    {
+        token.start = *pos;
+        if (input[*pos] == '\0')
         {
-            token.type = TOKEN_IDENTIFIER;
+            token.type = TOKEN_EOF;
+            return token;
         }
-        return token;
-    }
-
-    //String handeling
-    if (c == '"') {
-        int i = 0;
 
-        (*pos)++; // skip opening quote
-        c = input[*pos];
-        
-        while (c != '\0' && c != '"') {
-            // handle escape sequences like \n, \t, etc
-            if (c == '\\') {
-                (*pos)++;
-                c = input[*pos];
-                switch (c) {
-                    case 'n':
-                        token.lexeme[i++] = '\n';
-                        break;
-                    case 't':
-                        token.lexeme[i++] = '\t';
-                        break;
-                    case '\\':
-                        token.lexeme[i++] = '\\';
-                        break;
-                    case '"':
-                        token.lexeme[i++] = '"';
-                        break;
-                    default:
-                        token.error = ERROR_UNKNOWN_ESCAPE_SEQUENCE;
-                        token.lexeme[i++] = c;
+        // Run the DFA to the longest match: one class lookup and one
+        // transition lookup per input byte, no per-token-class branching.
+        // On entering a state with a long self-loop (whitespace, identifier,
+        // string or comment body) a SIMD kernel skips the rest of the run.
+        int state = LEX_START;
+        int next;
+        size_t end = *pos;
+        while ((next = lex_transition[state][lex_char_class[(unsigned char)input[end]]]) != LEX_DEAD)
+        {
+            end++;
+            if (next != state)
+            {
+                state = next;
+                if (lex_state_info[state].fast)
+                {
+                    end = fast_forward(input, end, &lex_state_info[state]);
                 }
-            } else {
-                token.lexeme[i++] = c;
             }
-            (*pos)++;
-            c = input[*pos];
-            if (i >= (int)sizeof(token.lexeme) - 1) break; // Avoid overflow
         }
-        if (c == '"') {
-            // Found closing quote
-            (*pos)++; // skip closing quote
-            token.lexeme[i] = '\0';
-            token.type = TOKEN_STRING_LITERAL;
-        } else {
-            // Unterminated string
-            token.type = TOKEN_ERROR;
-            token.error = ERROR_UNTERMINATED_STRING;
-            token.lexeme[i] = '\0';
+
+        const LexStateInfo *info = &lex_state_info[state];
+        if (info->action == LEX_SKIP)
+        {
+            // Whitespace or comment; line numbers are recovered from offsets
+            // when needed
+            *pos = end;
+            continue;
         }
-        return token;
-    }
 
-    TokenType operator_type = is_operator_char(c);
-    if (operator_type) {
-        int i = 0;
-        token.type = operator_type;
-        token.lexeme[i++] = c;
-        (*pos)++;
-        char next_c = input[*pos];
+        // No rule starts with this byte: consume it as an invalid character
+        if (end == *pos)
+        {
+            end++;
+        }
+        *pos = end;
 
-        // raise error for consecutive operators
-        if ((c == '+' || c == '-' || c == '*' || c == '/') && (next_c == '+' || next_c == '-' || next_c == '*' || next_c == '/')) {
+        token.length = end - token.start;
+        token.error = info->error;
+        if (info->action != LEX_ACCEPT)
+        {
             token.type = TOKEN_ERROR;
-            token.error = ERROR_CONSECUTIVE_OPERATORS;
             return token;
         }
-        /* Check for double-character operators (==, !=, etc.) */
-        if (
-            (c == '=' && next_c == '=') ||
-            (c == '!' && next_c == '=') ||
-            (c == '|' && next_c == '|') ||
-            (c == '<' && next_c == '=') ||
-            (c == '>' && next_c == '=') ) {
-            token.lexeme[i++] = next_c;
-            (*pos)++;
-        }
 
-        if (c == '=' && next_c == '=') {
-            token.type = TOKEN_COMPARISON; // or else is token_equals by default
+        token.type = info->token;
+        if (info->trim)
+        {
+            // Quoted literals: the lexeme is the body between the quotes
+            token.start++;
+            token.length -= 2;
+            if (lexer->interner)
+            {
+                token.id = intern_string_literal(lexer->interner, input + token.start, token.length);
+            }
+        }
+        else if (token.type == TOKEN_IDENTIFIER)
+        {
+            TokenType keyword_type = is_keyword(input + token.start, token.length);
+            if (keyword_type)
+            {
+                token.type = keyword_type;
+            }
+            else if (lexer->interner)
+            {
+                token.id = intern(lexer->interner, input + token.start, token.length);
+            }
         }
-
-        token.lexeme[i] = '\0';
-        return token;
-    }
-    // TODO: Add delimiter handling here
-    TokenType delimeter_type = is_delimiter(c);
-    if (delimeter_type) {
-        token.type = delimeter_type;
-        token.lexeme[0] = c;
-        token.lexeme[1] = '\0';
-        (*pos)++;
         return token;
     }
-    
-
-    // Handle invalid characters
-    token.type = TOKEN_ERROR;
-    token.error = ERROR_INVALID_CHAR;
-    token.lexeme[0] = c;
-    token.lexeme[1] = '\0';
-    (*pos)++;
-    return token;
-
-    return token;
-}
\ No newline at end of file
+}
@@ -0,0 +1,255 @@
+/* lexer_simd.c */
+#include <stdint.h>
+#include <stddef.h>
+
+#include "../../include/lexer_simd.h"
+
+#if !defined(LEXER_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LEXER_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+typedef struct {
+    const char *(*skip_space)(const char *p);
+    const char *(*skip_ident)(const char *p);
+    const char *(*find_byte2)(const char *p, char a, char b);
+    size_t (*count_newlines)(const char *p);
+    const char *name;
+} SimdKernels;
+
+// Scalar fallback
+
+static const char *scalar_skip_space(const char *p) {
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+    return p;
+}
+
+static int is_ident_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static const char *scalar_skip_ident(const char *p) {
+    while (is_ident_char(*p)) p++;
+    return p;
+}
+
+static const char *scalar_find_byte2(const char *p, char a, char b) {
+    while (*p != '\0' && *p != a && *p != b) p++;
+    return p;
+}
+
+static size_t scalar_count_newlines(const char *p) {
+    size_t count = 0;
+    for (; *p != '\0'; p++) count += *p == '\n';
+    return count;
+}
+
+static const SimdKernels scalar_kernels = {
+    scalar_skip_space, scalar_skip_ident, scalar_find_byte2, scalar_count_newlines, "scalar"
+};
+
+#ifdef LEXER_X86_SIMD
+
+// All kernels start from the aligned block containing p and mask off the
+// bytes before p: aligned loads cannot cross into an unmapped page, so
+// reading the rest of the block holding the terminator is safe.
+
+#define ALIGN_DOWN(p, n) ((const char *)((uintptr_t)(p) & ~(uintptr_t)((n) - 1)))
+
+// SSE2, 16 bytes per step
+
+static __m128i sse2_ident_mask(__m128i v) {
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                  _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                  _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    __m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+    return _mm_or_si128(_mm_or_si128(alpha, digit), under);
+}
+
+static __m128i sse2_space_mask(__m128i v) {
+    __m128i sp = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+    __m128i nl = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+    return _mm_or_si128(sp, nl);
+}
+
+static const char *sse2_skip_space(const char *p) {
+    const char *block = ALIGN_DOWN(p, 16);
+    unsigned keep = 0xFFFFu << (p - block);
+    for (;;) {
+        __m128i v = _mm_load_si128((const __m128i *)block);
+        unsigned end = ~(unsigned)_mm_movemask_epi8(sse2_space_mask(v)) & keep;
+        if (end) return block + __builtin_ctz(end);
+        block += 16;
+        keep = 0xFFFFu;
+    }
+}
+
+static const char *sse2_skip_ident(const char *p) {
+    const char *block = ALIGN_DOWN(p, 16);
+    unsigned keep = 0xFFFFu << (p - block);
+    for (;;) {
+        __m128i v = _mm_load_si128((const __m128i *)block);
+        unsigned end = ~(unsigned)_mm_movemask_epi8(sse2_ident_mask(v)) & keep;
+        if (end) return block + __builtin_ctz(end);
+        block += 16;
+        keep = 0xFFFFu;
+    }
+}
+
+static const char *sse2_find_byte2(const char *p, char a, char b) {
+    const char *block = ALIGN_DOWN(p, 16);
+    unsigned keep = 0xFFFFu << (p - block);
+    __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b), zero = _mm_setzero_si128();
+    for (;;) {
+        __m128i v = _mm_load_si128((const __m128i *)block);
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)),
+                                   _mm_cmpeq_epi8(v, zero));
+        unsigned end = (unsigned)_mm_movemask_epi8(hit) & keep;
+        if (end) return block + __builtin_ctz(end);
+        block += 16;
+        keep = 0xFFFFu;
+    }
+}
+
+static size_t sse2_count_newlines(const char *p) {
+    const char *block = ALIGN_DOWN(p, 16);
+    unsigned keep = 0xFFFFu << (p - block);
+    __m128i nl = _mm_set1_epi8('\n'), zero = _mm_setzero_si128();
+    size_t count = 0;
+    for (;;) {
+        __m128i v = _mm_load_si128((const __m128i *)block);
+        unsigned lines = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)) & keep;
+        unsigned nul = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) & keep;
+        if (nul) {
+            // Only count newlines before the terminator
+            lines &= (nul & -nul) - 1;
+            return count + __builtin_popcount(lines);
+        }
+        count += __builtin_popcount(lines);
+        block += 16;
+        keep = 0xFFFFu;
+    }
+}
+
+static const SimdKernels sse2_kernels = {
+    sse2_skip_space, sse2_skip_ident, sse2_find_byte2, sse2_count_newlines, "sse2"
+};
+
+// AVX2, 32 bytes per step
+
+#define AVX2 __attribute__((target("avx2,popcnt")))
+
+AVX2 static __m256i avx2_ident_mask(__m256i v) {
+    __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    __m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+    __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+    __m256i under = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+    return _mm256_or_si256(_mm256_or_si256(alpha, digit), under);
+}
+
+AVX2 static __m256i avx2_space_mask(__m256i v) {
+    __m256i sp = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                 _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+    __m256i nl = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')),
+                                 _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+    return _mm256_or_si256(sp, nl);
+}
+
+AVX2 static const char *avx2_skip_space(const char *p) {
+    const char *block = ALIGN_DOWN(p, 32);
+    uint32_t keep = 0xFFFFFFFFu << (p - block);
+    for (;;) {
+        __m256i v = _mm256_load_si256((const __m256i *)block);
+        uint32_t end = ~(uint32_t)_mm256_movemask_epi8(avx2_space_mask(v)) & keep;
+        if (end) return block + __builtin_ctz(end);
+        block += 32;
+        keep = 0xFFFFFFFFu;
+    }
+}
+
+AVX2 static const char *avx2_skip_ident(const char *p) {
+    const char *block = ALIGN_DOWN(p, 32);
+    uint32_t keep = 0xFFFFFFFFu << (p - block);
+    for (;;) {
+        __m256i v = _mm256_load_si256((const __m256i *)block);
+        uint32_t end = ~(uint32_t)_mm256_movemask_epi8(avx2_ident_mask(v)) & keep;
+        if (end) return block + __builtin_ctz(end);
+        block += 32;
+        keep = 0xFFFFFFFFu;
+    }
+}
+
+AVX2 static const char *avx2_find_byte2(const char *p, char a, char b) {
+    const char *block = ALIGN_DOWN(p, 32);
+    uint32_t keep = 0xFFFFFFFFu << (p - block);
+    __m256i va = _mm256_set1_epi8(a), vb = _mm256_set1_epi8(b), zero = _mm256_setzero_si256();
+    for (;;) {
+        __m256i v = _mm256_load_si256((const __m256i *)block);
+        __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)),
+                                      _mm256_cmpeq_epi8(v, zero));
+        uint32_t end = (uint32_t)_mm256_movemask_epi8(hit) & keep;
+        if (end) return block + __builtin_ctz(end);
+        block += 32;
+        keep = 0xFFFFFFFFu;
+    }
+}
+
+AVX2 static size_t avx2_count_newlines(const char *p) {
+    const char *block = ALIGN_DOWN(p, 32);
+    uint32_t keep = 0xFFFFFFFFu << (p - block);
+    __m256i nl = _mm256_set1_epi8('\n'), zero = _mm256_setzero_si256();
+    size_t count = 0;
+    for (;;) {
+        __m256i v = _mm256_load_si256((const __m256i *)block);
+        uint32_t lines = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl)) & keep;
+        uint32_t nul = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero)) & keep;
+        if (nul) {
+            lines &= (nul & -nul) - 1;
+            return count + __builtin_popcount(lines);
+        }
+        count += __builtin_popcount(lines);
+        block += 32;
+        keep = 0xFFFFFFFFu;
+    }
+}
+
+static const SimdKernels avx2_kernels = {
+    avx2_skip_space, avx2_skip_ident, avx2_find_byte2, avx2_count_newlines, "avx2"
+};
+
+#endif /* LEXER_X86_SIMD */
+
+// Runtime dispatch
+
+static const SimdKernels *selected = NULL;
+
+static const SimdKernels *kernels(void) {
+    const SimdKernels *k = __atomic_load_n(&selected, __ATOMIC_ACQUIRE);
+    if (k) return k;
+
+    k = &scalar_kernels;
+#ifdef LEXER_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        k = &avx2_kernels;
+    } else if (__builtin_cpu_supports("sse2")) {
+        k = &sse2_kernels;
+    }
+#endif
+    __atomic_store_n(&selected, k, __ATOMIC_RELEASE);
+    return k;
+}
+
+const char *simd_skip_space(const char *p) { return kernels()->skip_space(p); }
+
+const char *simd_skip_ident(const char *p) { return kernels()->skip_ident(p); }
+
+const char *simd_find_byte2(const char *p, char a, char b) { return kernels()->find_byte2(p, a, b); }
+
+size_t simd_count_newlines(const char *p) { return kernels()->count_newlines(p); }
+
+const char *simd_implementation(void) { return kernels()->name; }
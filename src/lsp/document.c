@@ -0,0 +1,626 @@
+/* document.c
+ * Incremental checking of an open document, one top-level statement at a
+ * time; see lsp.h.
+ *
+ * Each segment records the names it uses, and each name the segments that
+ * use it, in document order, with the state the name was in on entry to
+ * each when it was last checked and is in on exit. A name's state on entry
+ * to a segment is its state on exit from the previous segment that uses
+ * it, so when a segment is checked only the next use of each of its names
+ * can see a change; that segment is queued, and checked again if it does.
+ * The queue is taken in document order, so every segment is checked at
+ * most once per edit, after everything before it has settled.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/lsp.h"
+#include "../../include/parser.h"
+#include "../../include/semantic.h"
+
+// State of a name at some point of the document: 0 while undeclared, else
+// its VarType plus one, with NAME_ASSIGNED if every path so far assigns it
+#define NAME_ASSIGNED 0x80
+
+// A segment using a name, with the name's state on entry to it as of its
+// last check, and on exit
+typedef struct {
+    Segment *segment;
+    uint8_t entry;
+    uint8_t exit;
+} NameUse;
+
+struct Name {
+    char *text;
+    size_t length;
+    uint32_t hash;
+    uint32_t mark;          // Document mark when last gathered
+    InternId id;            // In the unit, while a check gathers it
+    NameUse *uses;          // In document order
+    size_t use_count, use_capacity;
+};
+
+// A diagnostic of a segment. Offsets are relative to the segment's start,
+// so it stays valid as edits before the segment move it.
+typedef struct {
+    size_t offset;
+    size_t length;
+    size_t json;            // The rest of the LSP Diagnostic, after its
+    size_t json_length;     // range, in the segment's json
+} SegmentDiagnostic;
+
+struct Segment {
+    size_t length;          // From its start to the end of its last token
+    size_t scan_length;     // To the end of the token after it, the last
+                            // one its parse looked at
+    uint64_t label;         // Orders it: labels increase along the
+                            // document, spaced so new segments fit between
+    int queued;
+    int unchecked;          // Parsed by an edit, not checked since
+    Name **names;           // Used by it
+    size_t name_count;
+    SegmentDiagnostic *diags;
+    size_t diag_count;
+    char *json;
+};
+
+// Extent of a statement found by an edit's parse
+typedef struct {
+    size_t start, length, scan_length;
+} Extent;
+
+static void *grow(void *items, size_t *capacity, size_t needed, size_t size) {
+    if (needed <= *capacity) return items;
+    size_t new_capacity = *capacity ? *capacity * 2 : 16;
+    while (new_capacity < needed) new_capacity *= 2;
+    items = realloc(items, new_capacity * size);
+    if (!items) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    *capacity = new_capacity;
+    return items;
+}
+
+static uint32_t hash_name(const char *text, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t)text[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// The document's Name for text, added if it has none
+static Name *find_name(Document *doc, const char *text, size_t length) {
+    if (doc->name_count * 2 >= doc->name_capacity) {
+        uint32_t capacity = doc->name_capacity ? doc->name_capacity * 2 : 1024;
+        Name **names = calloc(capacity, sizeof(Name *));
+        if (!names) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+        for (uint32_t i = 0; i < doc->name_capacity; i++) {
+            Name *name = doc->names[i];
+            if (!name) continue;
+            uint32_t slot = name->hash & (capacity - 1);
+            while (names[slot]) slot = (slot + 1) & (capacity - 1);
+            names[slot] = name;
+        }
+        free(doc->names);
+        doc->names = names;
+        doc->name_capacity = capacity;
+    }
+
+    uint32_t hash = hash_name(text, length);
+    uint32_t slot = hash & (doc->name_capacity - 1);
+    for (Name *name; (name = doc->names[slot]); slot = (slot + 1) & (doc->name_capacity - 1)) {
+        if (name->hash == hash && name->length == length && memcmp(name->text, text, length) == 0) {
+            return name;
+        }
+    }
+    Name *name = calloc(1, sizeof(Name));
+    if (!name || !(name->text = malloc(length + 1))) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    memcpy(name->text, text, length);
+    name->text[length] = '\0';
+    name->length = length;
+    name->hash = hash;
+    doc->names[slot] = name;
+    doc->name_count++;
+    return name;
+}
+
+// Position in name's uses of the first segment labelled label or later
+static size_t find_use(const Name *name, uint64_t label) {
+    size_t lo = 0, hi = name->use_count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (name->uses[mid].segment->label < label) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// State of name on entry to the segment labelled label
+static uint8_t state_before(const Name *name, uint64_t label) {
+    size_t use = find_use(name, label);
+    return use > 0 ? name->uses[use - 1].exit : 0;
+}
+
+static void remove_use(Name *name, const Segment *segment) {
+    size_t use = find_use(name, segment->label);
+    if (use == name->use_count || name->uses[use].segment != segment) return;
+    memmove(name->uses + use, name->uses + use + 1, (name->use_count - use - 1) * sizeof(NameUse));
+    name->use_count--;
+}
+
+static void insert_use(Name *name, Segment *segment, uint8_t entry, uint8_t exit) {
+    size_t use = find_use(name, segment->label);
+    name->uses = grow(name->uses, &name->use_capacity, name->use_count + 1, sizeof(NameUse));
+    memmove(name->uses + use + 1, name->uses + use, (name->use_count - use) * sizeof(NameUse));
+    name->uses[use] = (NameUse){segment, entry, exit};
+    name->use_count++;
+}
+
+// Queue of segments to check, a binary heap by label
+static void queue_push(Document *doc, Segment *segment) {
+    if (segment->queued) return;
+    segment->queued = 1;
+    doc->queue = grow(doc->queue, &doc->queue_capacity, doc->queue_count + 1, sizeof(Segment *));
+    size_t i = doc->queue_count++;
+    while (i > 0 && doc->queue[(i - 1) / 2]->label > segment->label) {
+        doc->queue[i] = doc->queue[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    doc->queue[i] = segment;
+}
+
+static Segment *queue_pop(Document *doc) {
+    Segment *top = doc->queue[0];
+    Segment *last = doc->queue[--doc->queue_count];
+    size_t i = 0;
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= doc->queue_count) break;
+        if (child + 1 < doc->queue_count && doc->queue[child + 1]->label < doc->queue[child]->label) child++;
+        if (doc->queue[child]->label >= last->label) break;
+        doc->queue[i] = doc->queue[child];
+        i = child;
+    }
+    if (doc->queue_count > 0) doc->queue[i] = last;
+    top->queued = 0;
+    return top;
+}
+
+// Queue the first segment after the one labelled label that uses name
+static void queue_next_use(Document *doc, const Name *name, uint64_t label) {
+    size_t use = find_use(name, label + 1);
+    if (use < name->use_count) queue_push(doc, name->uses[use].segment);
+}
+
+// Has the state of one of segment's names on entry changed since its last
+// check?
+static int entry_changed(const Segment *segment) {
+    for (size_t i = 0; i < segment->name_count; i++) {
+        const Name *name = segment->names[i];
+        size_t use = find_use(name, segment->label);
+        uint8_t entry = use > 0 ? name->uses[use - 1].exit : 0;
+        if (use == name->use_count || name->uses[use].entry != entry) return 1;
+    }
+    return 0;
+}
+
+// Position in the document of segment
+static size_t find_segment(const Document *doc, const Segment *segment) {
+    size_t lo = 0, hi = doc->segment_count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (doc->segments[mid].segment->label < segment->label) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Add segment to, or drop it from, the ones with diagnostics
+static void set_diagnosed(Document *doc, Segment *segment, int diagnosed) {
+    size_t lo = 0, hi = doc->diagnosed_count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (doc->diagnosed[mid]->label < segment->label) lo = mid + 1;
+        else hi = mid;
+    }
+    int present = lo < doc->diagnosed_count && doc->diagnosed[lo] == segment;
+    if (diagnosed && !present) {
+        doc->diagnosed = grow(doc->diagnosed, &doc->diagnosed_capacity, doc->diagnosed_count + 1,
+                              sizeof(Segment *));
+        memmove(doc->diagnosed + lo + 1, doc->diagnosed + lo, (doc->diagnosed_count - lo) * sizeof(Segment *));
+        doc->diagnosed[lo] = segment;
+        doc->diagnosed_count++;
+    } else if (!diagnosed && present) {
+        memmove(doc->diagnosed + lo, doc->diagnosed + lo + 1, (doc->diagnosed_count - lo - 1) * sizeof(Segment *));
+        doc->diagnosed_count--;
+    }
+}
+
+static void free_segment(Segment *segment) {
+    free(segment->names);
+    free(segment->diags);
+    free(segment->json);
+    free(segment);
+}
+
+// Parse and analyze segment with its names in the states they are in on
+// entry to it, then record its diagnostics and the states on exit
+static void check_segment(Document *doc, Segment *segment) {
+    CompilationUnit *unit = &doc->unit;
+    Ast *ast = &unit->ast;
+    size_t start = doc->segments[find_segment(doc, segment)].start;
+
+    // Cut off after the token following it, the statement parses alone
+    // just as it did in place
+    doc->scratch = grow(doc->scratch, &doc->scratch_capacity, segment->scan_length + 1, 1);
+    memcpy(doc->scratch, doc->text + start, segment->scan_length);
+    doc->scratch[segment->scan_length] = '\0';
+    unit_load_source(unit, doc->scratch, segment->scan_length);
+    unit->diags.trace = 0;
+    Parser parser;
+    parser_init(&parser, unit);
+    NodeId statement = parse_next_statement(&parser);
+    NodeId program = ast_add_node(ast, AST_PROGRAM, ast_add_token(ast, (Token){0}));
+    ast->first_child[program] = statement;
+
+    // Gather the names it uses, in the order they are first used
+    uint32_t *position = arena_calloc(&unit->arena, unit->interner.count * sizeof(uint32_t));
+    Name **names = malloc((ast->count + 1) * sizeof(Name *));
+    size_t name_count = 0;
+    if (!names) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    for (NodeId node = 1; node < program; node++) {
+        if (ast->kind[node] != AST_IDENTIFIER && ast->kind[node] != AST_VARDECL) continue;
+        InternId id = AST_ID(ast, node);
+        if (id == INTERN_NONE || position[id] != 0) continue;
+        size_t length;
+        const char *text = intern_text(&unit->interner, id, &length);
+        Name *name = find_name(doc, text, length);
+        name->id = id;
+        names[name_count++] = name;
+        position[id] = (uint32_t)name_count;
+    }
+
+    // The declared ones are the outer variables
+    uint8_t *entries = arena_alloc(&unit->arena, name_count + 1);
+    uint8_t *exits = arena_calloc(&unit->arena, name_count + 1);
+    OuterVariable *outer = arena_alloc(&unit->arena, (name_count + 1) * sizeof(OuterVariable));
+    size_t outer_count = 0;
+    for (size_t i = 0; i < name_count; i++) {
+        entries[i] = state_before(names[i], segment->label);
+        if (entries[i] == 0) continue;
+        outer[outer_count].name = names[i]->id;
+        outer[outer_count].type = (VarType)((entries[i] & ~NAME_ASSIGNED) - 1);
+        outer[outer_count].assigned = (entries[i] & NAME_ASSIGNED) != 0;
+        outer_count++;
+    }
+
+    OuterVariable *scope;
+    size_t scope_count;
+    analyze_fragment(program, unit, outer, outer_count, &scope, &scope_count);
+    for (size_t i = 0; i < scope_count; i++) {
+        uint32_t name = scope[i].name < unit->interner.count ? position[scope[i].name] : 0;
+        if (name == 0) continue;
+        exits[name - 1] = (uint8_t)((scope[i].type + 1) | (scope[i].assigned ? NAME_ASSIGNED : 0));
+    }
+
+    // Swap its uses for the new ones; the next use of each name, old or
+    // new, may now start differently
+    for (size_t i = 0; i < segment->name_count; i++) {
+        remove_use(segment->names[i], segment);
+        queue_next_use(doc, segment->names[i], segment->label);
+    }
+    for (size_t i = 0; i < name_count; i++) {
+        insert_use(names[i], segment, entries[i], exits[i]);
+        queue_next_use(doc, names[i], segment->label);
+    }
+    free(segment->names);
+    segment->names = names;
+    segment->name_count = name_count;
+
+    // Render the diagnostics now, while their text is at hand
+    free(segment->diags);
+    free(segment->json);
+    segment->diags = NULL;
+    segment->json = NULL;
+    segment->diag_count = 0;
+    if (unit->diags.count > 0) {
+        size_t json_length = 0;
+        FILE *out = open_memstream(&segment->json, &json_length);
+        segment->diags = malloc(unit->diags.count * sizeof(SegmentDiagnostic));
+        if (!out || !segment->diags) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+        for (size_t i = 0; i < unit->diags.count; i++) {
+            const Diagnostic *diag = &unit->diags.items[i];
+            SegmentDiagnostic *d = &segment->diags[segment->diag_count++];
+            int severity = diag->severity == DIAG_ERROR ? 1 : diag->severity == DIAG_WARNING ? 2 : 3;
+            d->offset = diag->offset;
+            d->length = diag->length;
+            d->json = (size_t)ftell(out);
+            fprintf(out, "\"severity\":%d,\"code\":\"%s\",\"source\":\"semantic_main\",\"message\":", severity,
+                    diag_code_name(diag));
+            diag_write_json_message(diag, out);
+            fputc('}', out);
+            d->json_length = (size_t)ftell(out) - d->json;
+        }
+        fclose(out);
+    }
+    set_diagnosed(doc, segment, segment->diag_count > 0);
+    segment->unchecked = 0;
+    doc->checked++;
+}
+
+static void splice_text(Document *doc, size_t start, size_t end, const char *text, size_t length) {
+    size_t new_length = doc->length - (end - start) + length;
+    doc->text = grow(doc->text, &doc->capacity, new_length + 1, 1);
+    memmove(doc->text + start + length, doc->text + end, doc->length - end + 1);
+    memcpy(doc->text + start, text, length);
+    doc->length = new_length;
+}
+
+// First line starting after offset
+static size_t line_after(const Document *doc, size_t offset) {
+    size_t lo = 0, hi = doc->line_count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (doc->line_starts[mid] <= offset) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Drop the lines starting inside the replaced bytes, move the ones after
+// them and add the ones the new text starts
+static void splice_lines(Document *doc, size_t start, size_t end, const char *text, size_t length) {
+    size_t first = line_after(doc, start);
+    size_t last = line_after(doc, end);
+    size_t added = 0;
+    for (const char *p = text; (p = memchr(p, '\n', length - (size_t)(p - text))); p++) {
+        added++;
+    }
+
+    size_t count = doc->line_count - (last - first) + added;
+    doc->line_starts = grow(doc->line_starts, &doc->line_capacity, count, sizeof(size_t));
+    memmove(doc->line_starts + first + added, doc->line_starts + last,
+            (doc->line_count - last) * sizeof(size_t));
+    for (size_t i = first + added; i < count; i++) {
+        doc->line_starts[i] = doc->line_starts[i] - end + start + length;
+    }
+    size_t line = first;
+    for (const char *p = text; (p = memchr(p, '\n', length - (size_t)(p - text))); p++) {
+        doc->line_starts[line++] = start + (size_t)(p - text) + 1;
+    }
+    doc->line_count = count;
+}
+
+// Parse the edited document from offset from, up to the first statement
+// that starts where an old segment wholly after the edit does, or to the
+// end. Returns the new statements' extents, sets *kept to the first old
+// segment that still stands.
+static Extent *find_statements(Document *doc, size_t from, size_t first, size_t end, size_t shift,
+                               size_t *count, size_t *kept) {
+    CompilationUnit *unit = &doc->unit;
+    Extent *extents = NULL;
+    size_t capacity = 0;
+    *count = 0;
+    *kept = first;
+
+    unit_load_source(unit, doc->text, doc->length);
+    unit->diags.trace = 0;
+    unit->lexer.position = from;
+    Parser parser;
+    parser_init(&parser, unit);
+    for (;;) {
+        size_t start = parser.previous_end;
+        if (parser.current_token.type == TOKEN_EOF) {
+            *kept = doc->segment_count;
+            break;
+        }
+        // Old offsets after the edit's end are shift - end + offset now
+        while (*kept < doc->segment_count && (doc->segments[*kept].start <= end ||
+                                              doc->segments[*kept].start + shift - end < start)) {
+            (*kept)++;
+        }
+        if (*kept < doc->segment_count && doc->segments[*kept].start + shift - end == start) break;
+
+        parse_next_statement(&parser);
+        doc->parsed++;
+        extents = grow(extents, &capacity, *count + 1, sizeof(Extent));
+        Extent *extent = &extents[(*count)++];
+        extent->start = start;
+        extent->length = parser.previous_end - start;
+        extent->scan_length = unit->lexer.position - start;
+        if (parser.stopped) {
+            // The parser gave up; the rest of the document is part of it
+            extent->length = extent->scan_length = doc->length - start;
+            *kept = doc->segment_count;
+            break;
+        }
+    }
+    unit_reset(unit);
+    return extents;
+}
+
+void document_edit(Document *doc, size_t start, size_t end, const char *text, size_t length) {
+    if (end > doc->length) end = doc->length;
+    if (start > end) start = end;
+    doc->parsed = 0;
+    doc->checked = 0;
+    splice_text(doc, start, end, text, length);
+    splice_lines(doc, start, end, text, length);
+
+    // Segments whose parse stopped short of the edit stand as they are
+    size_t lo = 0, hi = doc->segment_count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (doc->segments[mid].start + doc->segments[mid].segment->scan_length < start) lo = mid + 1;
+        else hi = mid;
+    }
+    size_t first = lo;
+    size_t from = first > 0 ? doc->segments[first - 1].start + doc->segments[first - 1].segment->length : 0;
+
+    size_t shift = start + length;
+    size_t count, kept;
+    Extent *extents = find_statements(doc, from, first, end, shift, &count, &kept);
+
+    // Drop the segments the new ones replace, noting their names
+    Name **touched = NULL;
+    size_t touched_count = 0, touched_capacity = 0;
+    doc->mark++;
+    for (size_t i = first; i < kept; i++) {
+        Segment *segment = doc->segments[i].segment;
+        for (size_t j = 0; j < segment->name_count; j++) {
+            Name *name = segment->names[j];
+            remove_use(name, segment);
+            if (name->mark == doc->mark) continue;
+            name->mark = doc->mark;
+            touched = grow(touched, &touched_capacity, touched_count + 1, sizeof(Name *));
+            touched[touched_count++] = name;
+        }
+        set_diagnosed(doc, segment, 0);
+        free_segment(segment);
+    }
+
+    // Label the new segments evenly between their neighbours, or relabel
+    // the whole document once labels run out between them
+    uint64_t below = first > 0 ? doc->segments[first - 1].segment->label : 0;
+    uint64_t above = kept < doc->segment_count ? doc->segments[kept].segment->label : UINT64_MAX;
+    uint64_t gap = (above - below) / (count + 1);
+
+    size_t total = doc->segment_count - (kept - first) + count;
+    doc->segments = grow(doc->segments, &doc->segment_capacity, total, sizeof(PlacedSegment));
+    memmove(doc->segments + first + count, doc->segments + kept,
+            (doc->segment_count - kept) * sizeof(PlacedSegment));
+    for (size_t i = 0; i < count; i++) {
+        Segment *segment = calloc(1, sizeof(Segment));
+        if (!segment) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+        segment->length = extents[i].length;
+        segment->scan_length = extents[i].scan_length;
+        segment->label = below + gap * (i + 1);
+        segment->unchecked = 1;
+        doc->segments[first + i] = (PlacedSegment){extents[i].start, segment};
+    }
+    for (size_t i = first + count; i < total; i++) {
+        doc->segments[i].start = doc->segments[i].start + shift - end;
+    }
+    doc->segment_count = total;
+    if (gap == 0) {
+        for (size_t i = 0; i < total; i++) {
+            doc->segments[i].segment->label = (uint64_t)(i + 1) << 32;
+        }
+    }
+    free(extents);
+
+    // Check the new segments, and whatever follows that sees a change
+    for (size_t i = first; i < first + count; i++) {
+        queue_push(doc, doc->segments[i].segment);
+    }
+    for (size_t i = 0; i < touched_count; i++) {
+        size_t use = first > 0 ? find_use(touched[i], doc->segments[first - 1].segment->label + 1) : 0;
+        if (use < touched[i]->use_count) queue_push(doc, touched[i]->uses[use].segment);
+    }
+    free(touched);
+    while (doc->queue_count > 0) {
+        Segment *segment = queue_pop(doc);
+        if (segment->unchecked || entry_changed(segment)) check_segment(doc, segment);
+    }
+    unit_reset(&doc->unit);
+}
+
+Document *document_open(const char *text, size_t length) {
+    Document *doc = calloc(1, sizeof(Document));
+    if (!doc) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    doc->text = grow(NULL, &doc->capacity, 1, 1);
+    doc->text[0] = '\0';
+    doc->line_starts = grow(NULL, &doc->line_capacity, 1, sizeof(size_t));
+    doc->line_starts[0] = 0;
+    doc->line_count = 1;
+    unit_init(&doc->unit);
+    document_edit(doc, 0, 0, text, length);
+    return doc;
+}
+
+void document_close(Document *doc) {
+    for (size_t i = 0; i < doc->segment_count; i++) {
+        free_segment(doc->segments[i].segment);
+    }
+    for (uint32_t i = 0; i < doc->name_capacity; i++) {
+        if (!doc->names[i]) continue;
+        free(doc->names[i]->text);
+        free(doc->names[i]->uses);
+        free(doc->names[i]);
+    }
+    free(doc->segments);
+    free(doc->diagnosed);
+    free(doc->names);
+    free(doc->queue);
+    free(doc->scratch);
+    free(doc->text);
+    free(doc->line_starts);
+    unit_free(&doc->unit);
+    free(doc);
+}
+
+size_t document_offset(const Document *doc, uint32_t line, uint32_t character) {
+    if (line >= doc->line_count) return doc->length;
+    size_t offset = doc->line_starts[line];
+    uint32_t units = 0;
+    while (offset < doc->length && doc->text[offset] != '\n') {
+        // Four-byte sequences are two UTF-16 code units
+        uint32_t width = (uint8_t)doc->text[offset] >= 0xf0 ? 2 : 1;
+        if (units + width > character) break;
+        units += width;
+        offset++;
+        while (offset < doc->length && ((uint8_t)doc->text[offset] & 0xc0) == 0x80) offset++;
+    }
+    return offset;
+}
+
+static void write_position(const Document *doc, size_t offset, FILE *out) {
+    if (offset > doc->length) offset = doc->length;
+    size_t line = line_after(doc, offset) - 1;
+    uint32_t character = 0;
+    for (size_t i = doc->line_starts[line]; i < offset; i++) {
+        uint8_t byte = (uint8_t)doc->text[i];
+        if ((byte & 0xc0) != 0x80) character += byte >= 0xf0 ? 2 : 1;
+    }
+    fprintf(out, "{\"line\":%zu,\"character\":%u}", line, character);
+}
+
+void document_write_diagnostics(const Document *doc, FILE *out) {
+    int first = 1;
+    fputc('[', out);
+    for (size_t i = 0; i < doc->diagnosed_count; i++) {
+        const Segment *segment = doc->diagnosed[i];
+        size_t start = doc->segments[find_segment(doc, segment)].start;
+        for (size_t j = 0; j < segment->diag_count; j++) {
+            const SegmentDiagnostic *diag = &segment->diags[j];
+            fputs(first ? "{\"range\":{\"start\":" : ",{\"range\":{\"start\":", out);
+            write_position(doc, start + diag->offset, out);
+            fputs(",\"end\":", out);
+            write_position(doc, start + diag->offset + diag->length, out);
+            fputs("},", out);
+            fwrite(segment->json + diag->json, 1, diag->json_length, out);
+            first = 0;
+        }
+    }
+    fputc(']', out);
+}
@@ -0,0 +1,232 @@
+/* json.c
+ * JSON reader for the language server's messages: recursive descent over
+ * the text into a tree of JsonValues, with strings decoded to UTF-8.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/json.h"
+
+typedef struct {
+    Arena *arena;
+    const char *text;
+    const char *end;
+    int depth;
+} JsonReader;
+
+static void skip_space(JsonReader *r) {
+    while (r->text < r->end && (*r->text == ' ' || *r->text == '\t' || *r->text == '\n' || *r->text == '\r')) {
+        r->text++;
+    }
+}
+
+static int literal(JsonReader *r, const char *word) {
+    size_t length = strlen(word);
+    if ((size_t)(r->end - r->text) < length || memcmp(r->text, word, length) != 0) return 0;
+    r->text += length;
+    return 1;
+}
+
+static int hex4(const char *text, uint32_t *value) {
+    *value = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = text[i];
+        int digit = c >= '0' && c <= '9' ? c - '0'
+                  : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                  : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (digit < 0) return 0;
+        *value = *value * 16 + (uint32_t)digit;
+    }
+    return 1;
+}
+
+static char *put_utf8(char *out, uint32_t code) {
+    if (code < 0x80) {
+        *out++ = (char)code;
+    } else if (code < 0x800) {
+        *out++ = (char)(0xc0 | code >> 6);
+        *out++ = (char)(0x80 | (code & 0x3f));
+    } else if (code < 0x10000) {
+        *out++ = (char)(0xe0 | code >> 12);
+        *out++ = (char)(0x80 | (code >> 6 & 0x3f));
+        *out++ = (char)(0x80 | (code & 0x3f));
+    } else {
+        *out++ = (char)(0xf0 | code >> 18);
+        *out++ = (char)(0x80 | (code >> 12 & 0x3f));
+        *out++ = (char)(0x80 | (code >> 6 & 0x3f));
+        *out++ = (char)(0x80 | (code & 0x3f));
+    }
+    return out;
+}
+
+// String starting at the opening quote; the decoded text is never longer
+// than the encoded one
+static int read_string(JsonReader *r, const char **string, size_t *length) {
+    const char *start = ++r->text;
+    const char *close = start;
+    int escaped = 0;
+    while (close < r->end && *close != '"') {
+        if (*close == '\\') {
+            escaped = 1;
+            close++;
+        }
+        close++;
+    }
+    if (close >= r->end) return 0;
+
+    char *out = arena_alloc(r->arena, (size_t)(close - start) + 1);
+    if (!escaped) {
+        memcpy(out, start, (size_t)(close - start));
+        out[close - start] = '\0';
+        *string = out;
+        *length = (size_t)(close - start);
+        r->text = close + 1;
+        return 1;
+    }
+
+    char *p = out;
+    for (const char *s = start; s < close; s++) {
+        if (*s != '\\') {
+            *p++ = *s;
+            continue;
+        }
+        switch (*++s) {
+        case '"': *p++ = '"'; break;
+        case '\\': *p++ = '\\'; break;
+        case '/': *p++ = '/'; break;
+        case 'b': *p++ = '\b'; break;
+        case 'f': *p++ = '\f'; break;
+        case 'n': *p++ = '\n'; break;
+        case 'r': *p++ = '\r'; break;
+        case 't': *p++ = '\t'; break;
+        case 'u': {
+            uint32_t code, low;
+            if (close - s < 5 || !hex4(s + 1, &code)) return 0;
+            s += 4;
+            // A surrogate pair encodes one code point beyond the BMP
+            if (code >= 0xd800 && code < 0xdc00 && close - s >= 7 && s[1] == '\\' && s[2] == 'u' &&
+                hex4(s + 3, &low) && low >= 0xdc00 && low < 0xe000) {
+                code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                s += 6;
+            }
+            p = put_utf8(p, code);
+            break;
+        }
+        default:
+            return 0;
+        }
+    }
+    *p = '\0';
+    *string = out;
+    *length = (size_t)(p - out);
+    r->text = close + 1;
+    return 1;
+}
+
+static JsonValue *read_value(JsonReader *r);
+
+static JsonValue *new_value(JsonReader *r, JsonType type) {
+    JsonValue *value = arena_calloc(r->arena, sizeof(JsonValue));
+    value->type = type;
+    return value;
+}
+
+// Array or object, starting at its opening bracket
+static JsonValue *read_container(JsonReader *r, JsonType type) {
+    char close = type == JSON_ARRAY ? ']' : '}';
+    JsonValue *value = new_value(r, type);
+    JsonValue **tail = &value->first;
+    if (++r->depth > JSON_MAX_DEPTH) return NULL;
+    r->text++;
+
+    skip_space(r);
+    if (r->text < r->end && *r->text == close) {
+        r->text++;
+        r->depth--;
+        return value;
+    }
+    for (;;) {
+        const char *key = NULL;
+        size_t key_length = 0;
+        if (type == JSON_OBJECT) {
+            skip_space(r);
+            if (r->text >= r->end || *r->text != '"' || !read_string(r, &key, &key_length)) return NULL;
+            skip_space(r);
+            if (r->text >= r->end || *r->text++ != ':') return NULL;
+        }
+        JsonValue *element = read_value(r);
+        if (!element) return NULL;
+        element->key = key;
+        element->key_length = key_length;
+        *tail = element;
+        tail = &element->next;
+
+        skip_space(r);
+        if (r->text >= r->end) return NULL;
+        if (*r->text == ',') {
+            r->text++;
+        } else if (*r->text == close) {
+            r->text++;
+            r->depth--;
+            return value;
+        } else {
+            return NULL;
+        }
+    }
+}
+
+static JsonValue *read_value(JsonReader *r) {
+    skip_space(r);
+    if (r->text >= r->end) return NULL;
+
+    switch (*r->text) {
+    case '{':
+        return read_container(r, JSON_OBJECT);
+    case '[':
+        return read_container(r, JSON_ARRAY);
+    case '"': {
+        JsonValue *value = new_value(r, JSON_STRING);
+        return read_string(r, &value->string, &value->length) ? value : NULL;
+    }
+    case 'n':
+        return literal(r, "null") ? new_value(r, JSON_NULL) : NULL;
+    case 't':
+        return literal(r, "true") ? new_value(r, JSON_TRUE) : NULL;
+    case 'f':
+        return literal(r, "false") ? new_value(r, JSON_FALSE) : NULL;
+    default: {
+        // strtod needs a terminator; numbers are short
+        char number[64];
+        size_t length = 0;
+        while (r->text + length < r->end && length + 1 < sizeof(number) &&
+               strchr("+-0123456789.eE", r->text[length])) {
+            number[length] = r->text[length];
+            length++;
+        }
+        number[length] = '\0';
+        char *end;
+        JsonValue *value = new_value(r, JSON_NUMBER);
+        value->number = strtod(number, &end);
+        if (length == 0 || end != number + length) return NULL;
+        r->text += length;
+        return value;
+    }
+    }
+}
+
+JsonValue *json_parse(Arena *arena, const char *text, size_t length) {
+    JsonReader reader = {arena, text, text + length, 0};
+    JsonValue *value = read_value(&reader);
+    skip_space(&reader);
+    return reader.text == reader.end ? value : NULL;
+}
+
+const JsonValue *json_get(const JsonValue *value, const char *key) {
+    if (!value || value->type != JSON_OBJECT) return NULL;
+    size_t length = strlen(key);
+    for (const JsonValue *member = value->first; member; member = member->next) {
+        if (member->key_length == length && memcmp(member->key, key, length) == 0) return member;
+    }
+    return NULL;
+}
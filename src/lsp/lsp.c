@@ -0,0 +1,293 @@
+/* lsp.c
+ * Language Server Protocol over stdio: JSON-RPC messages, each framed by a
+ * Content-Length header. Handles the lifecycle (initialize, shutdown,
+ * exit) and textDocument/didOpen, didChange and didClose, publishing each
+ * document's diagnostics after every change; other requests are answered
+ * with MethodNotFound.
+ */
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "../../include/json.h"
+#include "../../include/lsp.h"
+#include "../../include/server.h"
+
+// JSON-RPC error codes
+#define PARSE_ERROR -32700
+#define INVALID_REQUEST -32600
+#define METHOD_NOT_FOUND -32601
+
+typedef struct {
+    char *uri;
+    Document *doc;
+} OpenDocument;
+
+typedef struct {
+    FILE *out;
+    OpenDocument *documents;
+    size_t count, capacity;
+    int shutdown;            // The client has asked for shutdown
+} Server;
+
+// Next message: 1 with its body, NUL-terminated, in *body; -1 if it was
+// longer than SERVER_MAX_SOURCE or too large to hold, and was skipped; 0
+// at the end of the input
+static int read_message(FILE *in, char **body, size_t *length) {
+    char line[1024];
+    for (;;) {
+        unsigned long long content_length = ULLONG_MAX;
+        for (;;) {
+            if (!fgets(line, sizeof(line), in)) return 0;
+            if (strcmp(line, "\r\n") == 0 || strcmp(line, "\n") == 0) break;
+            if (strncasecmp(line, "Content-Length:", 15) == 0) {
+                content_length = strtoull(line + 15, NULL, 10);
+            }
+        }
+        // Headers without a length cannot be framed; look for the next ones
+        if (content_length == ULLONG_MAX) continue;
+
+        *body = content_length <= SERVER_MAX_SOURCE ? malloc((size_t)content_length + 1) : NULL;
+        if (!*body) {
+            // Read past it, so the next message is still found
+            char skipped[4096];
+            while (content_length > 0) {
+                size_t chunk = content_length < sizeof(skipped) ? (size_t)content_length : sizeof(skipped);
+                size_t n = fread(skipped, 1, chunk, in);
+                if (n == 0) return 0;
+                content_length -= n;
+            }
+            return -1;
+        }
+        if (fread(*body, 1, content_length, in) != content_length) {
+            free(*body);
+            return 0;
+        }
+        (*body)[content_length] = '\0';
+        *length = (size_t)content_length;
+        return 1;
+    }
+}
+
+static void send_message(Server *server, const char *body, size_t length) {
+    fprintf(server->out, "Content-Length: %zu\r\n\r\n", length);
+    fwrite(body, 1, length, server->out);
+    fflush(server->out);
+}
+
+// A message built up in memory, sent once complete
+typedef struct {
+    FILE *out;
+    char *body;
+    size_t length;
+} Message;
+
+static void begin_message(Message *message) {
+    message->out = open_memstream(&message->body, &message->length);
+    if (!message->out) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    fputs("{\"jsonrpc\":\"2.0\",", message->out);
+}
+
+static void end_message(Server *server, Message *message) {
+    fputc('}', message->out);
+    fclose(message->out);
+    send_message(server, message->body, message->length);
+    free(message->body);
+}
+
+static void write_id(const JsonValue *id, FILE *out) {
+    fputs("\"id\":", out);
+    if (id && id->type == JSON_NUMBER) {
+        fprintf(out, "%.17g", id->number);
+    } else if (id && id->type == JSON_STRING) {
+        diag_write_json_string(id->string, id->length, out);
+    } else {
+        fputs("null", out);
+    }
+}
+
+// Reply to request id with result, raw JSON
+static void reply(Server *server, const JsonValue *id, const char *result) {
+    Message message;
+    begin_message(&message);
+    FILE *out = message.out;
+    write_id(id, out);
+    fprintf(out, ",\"result\":%s", result);
+    end_message(server, &message);
+}
+
+static void reply_error(Server *server, const JsonValue *id, int code, const char *text) {
+    Message message;
+    begin_message(&message);
+    FILE *out = message.out;
+    write_id(id, out);
+    fprintf(out, ",\"error\":{\"code\":%d,\"message\":\"%s\"}", code, text);
+    end_message(server, &message);
+}
+
+// Send uri's diagnostics, none if doc is NULL
+static void publish(Server *server, const char *uri, const Document *doc) {
+    Message message;
+    begin_message(&message);
+    FILE *out = message.out;
+    fputs("\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":", out);
+    diag_write_json_string(uri, strlen(uri), out);
+    fputs(",\"diagnostics\":", out);
+    if (doc) {
+        document_write_diagnostics(doc, out);
+    } else {
+        fputs("[]", out);
+    }
+    fputc('}', out);
+    end_message(server, &message);
+}
+
+static const char *get_string(const JsonValue *value, const char *key) {
+    const JsonValue *member = json_get(value, key);
+    return member && member->type == JSON_STRING ? member->string : NULL;
+}
+
+static uint32_t get_number(const JsonValue *value, const char *key) {
+    const JsonValue *member = json_get(value, key);
+    if (!member || member->type != JSON_NUMBER || member->number < 0) return 0;
+    return member->number > UINT32_MAX ? UINT32_MAX : (uint32_t)member->number;
+}
+
+static OpenDocument *find_document(Server *server, const char *uri) {
+    for (size_t i = 0; uri && i < server->count; i++) {
+        if (strcmp(server->documents[i].uri, uri) == 0) return &server->documents[i];
+    }
+    return NULL;
+}
+
+static size_t position_offset(const Document *doc, const JsonValue *position) {
+    return document_offset(doc, get_number(position, "line"), get_number(position, "character"));
+}
+
+static void did_open(Server *server, const JsonValue *params) {
+    const JsonValue *item = json_get(params, "textDocument");
+    const char *uri = get_string(item, "uri");
+    const JsonValue *text = json_get(item, "text");
+    if (!uri || !text || text->type != JSON_STRING) return;
+
+    OpenDocument *open = find_document(server, uri);
+    if (open) {
+        document_close(open->doc);
+    } else {
+        if (server->count == server->capacity) {
+            server->capacity = server->capacity ? server->capacity * 2 : 8;
+            server->documents = realloc(server->documents, server->capacity * sizeof(OpenDocument));
+        }
+        open = server->documents ? &server->documents[server->count++] : NULL;
+        if (!open || !(open->uri = strdup(uri))) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    open->doc = document_open(text->string, text->length);
+    publish(server, open->uri, open->doc);
+}
+
+static void did_change(Server *server, const JsonValue *params) {
+    OpenDocument *open = find_document(server, get_string(json_get(params, "textDocument"), "uri"));
+    const JsonValue *changes = json_get(params, "contentChanges");
+    if (!open || !changes || changes->type != JSON_ARRAY) return;
+
+    Document *doc = open->doc;
+    for (const JsonValue *change = changes->first; change; change = change->next) {
+        const JsonValue *text = json_get(change, "text");
+        const JsonValue *range = json_get(change, "range");
+        if (!text || text->type != JSON_STRING) continue;
+        if (range) {
+            size_t start = position_offset(doc, json_get(range, "start"));
+            size_t end = position_offset(doc, json_get(range, "end"));
+            document_edit(doc, start, end < start ? start : end, text->string, text->length);
+            continue;
+        }
+
+        // The whole text: edit only what differs from the old one
+        size_t prefix = 0, suffix = 0;
+        while (prefix < doc->length && prefix < text->length && doc->text[prefix] == text->string[prefix]) {
+            prefix++;
+        }
+        while (suffix < doc->length - prefix && suffix < text->length - prefix &&
+               doc->text[doc->length - 1 - suffix] == text->string[text->length - 1 - suffix]) {
+            suffix++;
+        }
+        document_edit(doc, prefix, doc->length - suffix, text->string + prefix,
+                      text->length - prefix - suffix);
+    }
+    publish(server, open->uri, doc);
+}
+
+static void did_close(Server *server, const JsonValue *params) {
+    OpenDocument *open = find_document(server, get_string(json_get(params, "textDocument"), "uri"));
+    if (!open) return;
+    publish(server, open->uri, NULL);
+    document_close(open->doc);
+    free(open->uri);
+    *open = server->documents[--server->count];
+}
+
+int lsp_run(FILE *in, FILE *out) {
+    Server server = {out, NULL, 0, 0, 0};
+    Arena arena;
+    arena_init(&arena);
+    int status = 1;
+
+    char *body;
+    size_t length;
+    int read;
+    while ((read = read_message(in, &body, &length)) != 0) {
+        if (read < 0) {
+            reply_error(&server, NULL, INVALID_REQUEST, "Message too long");
+            continue;
+        }
+        arena_reset(&arena);
+        const JsonValue *message = json_parse(&arena, body, length);
+        const char *method = get_string(message, "method");
+        const JsonValue *id = json_get(message, "id");
+        const JsonValue *params = json_get(message, "params");
+
+        if (!message) {
+            reply_error(&server, NULL, PARSE_ERROR, "Parse error");
+        } else if (!method) {
+            // A response to a request of ours; none are sent
+        } else if (strcmp(method, "exit") == 0) {
+            status = !server.shutdown;
+            free(body);
+            break;
+        } else if (server.shutdown && id) {
+            reply_error(&server, id, INVALID_REQUEST, "Server is shut down");
+        } else if (strcmp(method, "initialize") == 0) {
+            reply(&server, id,
+                  "{\"capabilities\":{\"textDocumentSync\":{\"openClose\":true,\"change\":2}},"
+                  "\"serverInfo\":{\"name\":\"semantic_main\"}}");
+        } else if (strcmp(method, "shutdown") == 0) {
+            server.shutdown = 1;
+            reply(&server, id, "null");
+        } else if (strcmp(method, "textDocument/didOpen") == 0) {
+            did_open(&server, params);
+        } else if (strcmp(method, "textDocument/didChange") == 0) {
+            did_change(&server, params);
+        } else if (strcmp(method, "textDocument/didClose") == 0) {
+            did_close(&server, params);
+        } else if (id) {
+            reply_error(&server, id, METHOD_NOT_FOUND, "Method not found");
+        }
+        // Other notifications, initialized among them, need nothing
+        free(body);
+    }
+
+    for (size_t i = 0; i < server.count; i++) {
+        document_close(server.documents[i].doc);
+        free(server.documents[i].uri);
+    }
+    free(server.documents);
+    arena_free(&arena);
+    return status;
+}
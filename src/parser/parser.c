@@ -1,574 +1,633 @@
-/* parser.c */
-#include <stdio.h>
-#include <stdlib.h>
-#include "../../include/parser.h"
-#include "../../include/lexer.h"
-#include "../../include/tokens.h"
-
-static ASTNode *parse_program(void);
-static ASTNode *parse_expression(void);
-static ASTNode *parse_primary(void);
-static ASTNode *parse_statement(void);
-static ASTNode *parse_assignment(void);
-static ASTNode* parse_if_statement(void);
-static ASTNode* parse_while_statement(void);
-static ASTNode* parse_repeat_statement(void);
-static ASTNode* parse_print_statement(void);
-static ASTNode* parse_block(void);
-static ASTNode* parse_factorial(void);
-
-static Token current_token;
-static int position = 0;
-static const char *source;
-
-static void parse_error(ParseError error, Token token) {
-    printf("Parse Error at line %d: ", token.line);
-    switch (error) {
-        case PARSE_ERROR_UNEXPECTED_TOKEN:
-            printf("Unexpected token '%s'\n", token.lexeme);
-            break;
-        case PARSE_ERROR_MISSING_SEMICOLON:
-            printf("Missing semicolon after '%s'\n", token.lexeme);
-            break;
-        case PARSE_ERROR_MISSING_IDENTIFIER:
-            printf("Expected identifier after '%s'\n", token.lexeme);
-            break;
-        case PARSE_ERROR_MISSING_EQUALS:
-            printf("Expected '=' after '%s'\n", token.lexeme);
-            break;
-        case PARSE_ERROR_INVALID_EXPRESSION:
-            printf("Invalid expression after '%s'\n", token.lexeme);
-            break;
-        case PARSE_ERROR_INVALID_STATEMENT:
-            printf("Invalid statement after '%s'\n", token.lexeme);
-            break;
-        case PARSE_ERROR_MISSING_LPAREN:
-            printf("Expected '(' after '%s'\n", token.lexeme);
-            break;
-        case PARSE_ERROR_MISSING_RPAREN:
-            printf("Expected ')' after '%s'\n", token.lexeme);
-            break;
-        case PARSE_ERROR_MISSING_LBRACE:
-            printf("Expected '{' after '%s'\n", token.lexeme);
-            break;
-        case PARSE_ERROR_MISSING_RBRACE:
-            printf("Expected '}' after '%s'\n", token.lexeme);
-            break;
-        case PARSE_ERROR_MISSING_LBRACK:
-            printf("Expected '[' after '%s'\n", token.lexeme);
-            break;
-        case PARSE_ERROR_MISSING_RBRACK:
-            printf("Expected ']' after '%s'\n", token.lexeme);
-            break;
-        case PARSE_ERROR_MISSING_UNTIL:
-            printf("Expected 'until' after '%s'\n", token.lexeme);
-            break;
-        case PARSE_ERROR_INVALID_COMPARISON:
-            printf("Invalid comparison at '%s'\n", token.lexeme);
-        default:
-            printf("Unknown error\n");
-    }
-}
-
-//create new AST node
-static ASTNode *create_node(ASTNodeType type) {
-    ASTNode *node = malloc(sizeof(ASTNode));
-    if (node) {
-        node->type = type;
-        node->token = current_token;
-        node->left = NULL;
-        node->right = NULL;
-        node->next = NULL;  
-    }
-
-    if (type == AST_VARDECL) {
-        switch (current_token.type) {
-            case TOKEN_INT: node->var_type = TYPE_INT; break;
-            case TOKEN_CHAR: node->var_type = TYPE_CHAR; break;
-            case TOKEN_FLOAT: node->var_type = TYPE_FLOAT; break; 
-            case TOKEN_STRING: node->var_type = TYPE_STRING; break;
-            default: break;
-        }
-    }
-
-    return node;
-}
-
-//get next token
-static void advance(void) {
-    current_token = get_next_token(source, &position);
-}
-
-
-static int match(TokenType type) {
-    return current_token.type == type;
-}
-
-
-static void expect(TokenType type) {
-    if (match(type)) {
-        advance();
-    } else {
-        parse_error(PARSE_ERROR_UNEXPECTED_TOKEN, current_token);
-        exit(1); 
-    }
-}
-
-
-//parse factorial function
-static ASTNode *parse_factorial(void) {
-    ASTNode *node = create_node(AST_FACTORIAL);
-    advance();
-
-    expect(TOKEN_LPAREN);
-    ASTNode *expression = parse_expression();
-    if (expression) {
-        node->left = expression;
-    } else {
-        parse_error(PARSE_ERROR_INVALID_EXPRESSION, current_token);
-        exit(1);
-    }
-
-    expect(TOKEN_RPAREN);
-    expect(TOKEN_SEMICOLON);
-
-    return node;
-}
-
-
-//forward declarations
-static ASTNode *parse_statement(void);
-
-//parse block
-static ASTNode *parse_block(void) {
-    ASTNode *node = create_node(AST_BLOCK);
-    ASTNode *current = node;
-    advance();
-
-    while (!match(TOKEN_RBRACE)) {
-        ASTNode *statement = parse_statement();
-        if (statement) {
-            current->next = statement;
-            current = current->next;
-        } else {
-            parse_error(PARSE_ERROR_UNEXPECTED_TOKEN, current_token);
-            exit(1);
-        }
-    }
-    if (!match(TOKEN_RBRACE)) {
-        parse_error(PARSE_ERROR_MISSING_RBRACE, current_token);
-        exit(1);
-    }
-    advance();
-    return node;
-}
-
-//parse if statement 
-static ASTNode *parse_if_statement(void) {
-    ASTNode *node = create_node(AST_IF);
-    advance();
-
-    expect(TOKEN_LPAREN);
-    node->left = parse_expression();
-    expect(TOKEN_RPAREN);
-    if (match(TOKEN_LBRACE)) {
-        node->right = parse_block();
-    } else {
-        ASTNode *statement = parse_statement();
-        if (statement) {
-            node->right = statement;
-        } else {
-            parse_error(PARSE_ERROR_INVALID_STATEMENT, current_token);
-            exit(1);
-        }
-    }
-    return node;
-}
-
-//parse while statement
-static ASTNode *parse_while_statement(void) {
-    ASTNode *node = create_node(AST_WHILE);
-    advance(); 
-
-    expect(TOKEN_LPAREN);
-    node->left = parse_expression();
-    expect(TOKEN_RPAREN);
-    if (match(TOKEN_LBRACE)) {
-        node->right = parse_block();
-    } else {
-        ASTNode *statement = parse_statement();
-        if (statement) {
-            node->right = statement;
-        } else {
-            parse_error(PARSE_ERROR_INVALID_STATEMENT, current_token);
-            exit(1);
-        }
-    }
-
-    return node;
-}
-
-//Parse repeat until statement
-static ASTNode *parse_repeat_statement(void) {
-    ASTNode *node = create_node(AST_REPEAT);
-    advance();
-
-    if (!match(TOKEN_LBRACE)) {
-        parse_error(PARSE_ERROR_MISSING_LBRACE, current_token);
-        exit(1);
-    }
-
-    node->left = parse_block();
-    expect(TOKEN_UNTIL);
-    expect(TOKEN_LPAREN);
-
-    node->right = create_node(AST_CONDITION);
-    node->right->left = parse_expression();
-    expect(TOKEN_RPAREN);
-    expect(TOKEN_SEMICOLON);
-
-    return node;
-}
-
-//parse print statement
-static ASTNode *parse_print_statement(void) {
-    ASTNode *node = create_node(AST_PRINT);
-    advance();
-    ASTNode *expression = parse_expression();
-    if (expression) {
-        node->left = expression;
-    } else {
-        parse_error(PARSE_ERROR_INVALID_EXPRESSION, current_token);
-        exit(1);
-    }
-    expect(TOKEN_SEMICOLON);
-    return node;
-}
-
-static ASTNode *parse_expression(void);
-
-//parse variable declaration: int x;
-static ASTNode *parse_declaration(void) {
-    ASTNode *node = create_node(AST_VARDECL);
-    advance();
-
-    if (!match(TOKEN_IDENTIFIER)) {
-        parse_error(PARSE_ERROR_MISSING_IDENTIFIER, current_token);
-        exit(1);
-    }
-
-    node->token = current_token;
-    advance();
-    if (!match(TOKEN_SEMICOLON)) {
-        parse_error(PARSE_ERROR_MISSING_SEMICOLON, current_token);
-        exit(1);
-    }
-    advance();
-    return node;
-}
-
-//Parse assignment: x = 5;
-static ASTNode *parse_assignment(void) {
-    ASTNode *node = create_node(AST_ASSIGN);
-    node->left = create_node(AST_IDENTIFIER);
-    node->left->token = current_token;
-    advance();
-
-    if (!match(TOKEN_EQUALS)) {
-        parse_error(PARSE_ERROR_MISSING_EQUALS, current_token);
-        exit(1);
-    }
-    advance();
-
-    node->right = parse_expression();
-    if (!match(TOKEN_SEMICOLON)) {
-        parse_error(PARSE_ERROR_MISSING_SEMICOLON, current_token);
-        exit(1);
-    }
-    advance();
-    return node;
-}
-
-static ASTNode *parse_binop(void) {
-    ASTNode *node = parse_expression(); 
-    if (!match(TOKEN_SEMICOLON)) {
-        parse_error(PARSE_ERROR_MISSING_SEMICOLON, current_token);
-        exit(1);
-    }
-    advance(); 
-
-    return node;
-}
-
-//Parse statement
-static ASTNode *parse_statement(void) {
-    if (match(TOKEN_INT) || match(TOKEN_FLOAT) || match(TOKEN_CHAR) || match(TOKEN_STRING))    return parse_declaration();
-    else if (match(TOKEN_IDENTIFIER))   return parse_assignment();
-    else if (match(TOKEN_LBRACE))   return parse_block();
-    else if (match(TOKEN_IF))   return parse_if_statement();
-    else if (match(TOKEN_WHILE))    return parse_while_statement();
-    else if (match(TOKEN_REPEAT))   return parse_repeat_statement();
-    else if (match(TOKEN_PRINT))    return parse_print_statement();
-    else if (match(TOKEN_FACTORIAL))    return parse_factorial();
-    else if (match(TOKEN_OPERATOR)) return parse_binop();
-    printf("Syntax Error: Unexpected token\n");
-    exit(1);
-}
-
-//Parse expression
-static ASTNode *parse_expression(void) {
-    //parse primary expression
-    ASTNode *node = parse_primary();
-
-    while (match(TOKEN_OPERATOR) || match(TOKEN_COMPARISON)) {
-        if (match(TOKEN_COMPARISON)) {
-            ASTNode *condNode = create_node(AST_CONDITION);
-            ASTNode *compNode = create_node(AST_COMPARISON);
-            compNode->token = current_token;
-            compNode->left = node;
-            advance();
-            compNode->right = parse_primary();
-            condNode->left = compNode;
-            node = condNode;
-        }
-        else {
-            ASTNode *binopNode = create_node(AST_BINOP);
-            binopNode->token = current_token;
-            binopNode->left = node;
-            advance();
-            binopNode->right = parse_primary();
-            node = binopNode;
-        }
-    }
-
-    return node;
-}
-
-static ASTNode *parse_primary(void) {
-    if (match(TOKEN_LPAREN)) {
-        advance();
-        ASTNode *sub_expr = parse_expression();
-
-        if (!match(TOKEN_RPAREN)) {
-            parse_error(PARSE_ERROR_MISSING_RPAREN, current_token);
-            exit(1);
-        }
-        advance();
-
-        return sub_expr;
-    }
-    else if (match(TOKEN_NUMBER)) {
-        ASTNode *node = create_node(AST_NUMBER);
-        advance();
-        return node;
-    }
-    else if (match(TOKEN_STRING_LITERAL)) {
-        ASTNode *node = create_node(AST_STRING_LITERAL);
-        advance();
-        return node;
-    }
-    else if (match(TOKEN_IDENTIFIER)) {
-        ASTNode *node = create_node(AST_IDENTIFIER);
-        advance();
-        return node;
-    }
-    else {
-        parse_error(PARSE_ERROR_INVALID_EXPRESSION, current_token);
-        exit(1);
-    }
-}
-
-//parse program
-static ASTNode *parse_program(void) {
-    ASTNode *program = create_node(AST_PROGRAM);
-    ASTNode *current = program;
-
-    while (!match(TOKEN_EOF)) {
-        current->next = parse_statement();
-        current = current->next;
-    }
-
-    return program;
-}
-
-//initialize parser
-void parser_init(const char *input) {
-    source = input;
-    position = 0;
-    advance();
-}
-
-//Main parse function
-ASTNode *parse(void) {
-    return parse_program();
-}
-
-//debug function
-const char* token_type_to_string(TokenType type) {
-    switch (type) {
-        case TOKEN_NUMBER: return "NUMBER";
-        case TOKEN_IDENTIFIER: return "IDENTIFIER";
-        case TOKEN_STRING_LITERAL: return "STRING_LITERAL";
-        case TOKEN_OPERATOR: return "OPERATOR";
-        case TOKEN_COMPARISON: return "COMPARISON";
-        case TOKEN_EQUALS: return "EQUALS";
-        case TOKEN_SEMICOLON: return "SEMICOLON";
-        case TOKEN_LPAREN: return "LPAREN";
-        case TOKEN_RPAREN: return "RPAREN";
-        case TOKEN_LBRACE: return "LBRACE";
-        case TOKEN_RBRACE: return "RBRACE";
-        case TOKEN_LBRACK: return "LBRACK";
-        case TOKEN_RBRACK: return "RBRACK";
-        case TOKEN_IF: return "IF";
-        case TOKEN_ELSE: return "ELSE";
-        case TOKEN_REPEAT: return "REPEAT";
-        case TOKEN_UNTIL: return "UNTIL";
-        case TOKEN_FOR: return "FOR";
-        case TOKEN_WHILE: return "WHILE";
-        case TOKEN_BREAK: return "BREAK";
-        case TOKEN_PRINT: return "PRINT";
-        case TOKEN_FACTORIAL: return "FACTORIAL";
-        case TOKEN_RETURN: return "RETURN";
-        case TOKEN_VOID: return "VOID";
-        case TOKEN_CONST: return "CONST";
-        case TOKEN_INT: return "INT";
-        case TOKEN_FLOAT: return "FLOAT";
-        case TOKEN_CHAR: return "CHAR";
-        case TOKEN_STRING: return "STRING";
-        case TOKEN_EOF: return "EOF";
-        case TOKEN_ERROR: return "ERROR";
-        default: return "UNKNOWN";
-    }
-}
-
-const char* var_type_to_string(VarType type) {
-    switch (type) {
-        case TYPE_INT: return "int";
-        case TYPE_CHAR: return "char";
-        case TYPE_FLOAT: return "float";
-        case TYPE_STRING: return "string";
-        default: return "unknown";
-    }
-}
-
-//print AST tree
-void print_ast(ASTNode *node, int level) {
-    if (!node) return;
-    for (int i = 0; i < level; i++) printf("--");
-    const char *lexeme = (node->token.lexeme ? node->token.lexeme : "(null)");
-    
-    switch (node->type) {
-        case AST_PROGRAM:       printf("Program\n"); break;
-        case AST_VARDECL:       printf("VarDecl: %s, Type: %s\n", lexeme, var_type_to_string(node->var_type)); break;
-        case AST_ASSIGN:        printf("Assign\n"); break;
-        case AST_NUMBER:        printf("Number: %s\n", lexeme); break;
-        case AST_IDENTIFIER:    printf("Identifier: %s\n", lexeme); break;
-        case AST_CONDITION:     printf("Condition\n"); break;
-        case AST_IF:            printf("If\n"); break;
-        case AST_WHILE:         printf("While\n"); break;
-        case AST_REPEAT:        printf("Repeat-Until\n"); break;
-        case AST_BLOCK:         printf("Block\n"); break;
-        case AST_BINOP:         printf("BinaryOp: %s\n", lexeme); break;
-        case AST_PRINT:         printf("Print\n"); break;
-        case AST_FACTORIAL:     printf("Factorial\n"); break;
-        case AST_COMPARISON:    printf("Comparison: %s\n", lexeme); break;
-        default:
-            printf("Unknown type of node\n");
-    }
-        switch (node->type) {
-            case AST_PROGRAM:
-            case AST_BLOCK:
-                print_ast(node->next, level + 1);
-                break;
-            case AST_VARDECL:
-            case AST_ASSIGN:
-            case AST_NUMBER:
-            case AST_IDENTIFIER:
-            case AST_CONDITION:
-            case AST_COMPARISON:
-            case AST_IF:
-            case AST_WHILE:
-            case AST_REPEAT:
-            case AST_BINOP:
-            case AST_PRINT:
-            case AST_FACTORIAL:
-                print_ast(node->left, level + 1);
-                print_ast(node->right, level + 1);
-                if (node->next) print_ast(node->next, level);
-                break;
-        }
-}
-
-//print all the tokens, like lexer output
-void print_token_stream(const char* input) {
-    int position = 0;
-    Token token;
-    do {
-        token = get_next_token(input, &position);
-        print_token(token);
-    } while (token.type != TOKEN_EOF);
-}
-
-//free memory for ast
-void free_ast(ASTNode *node) {
-    if (!node) return;
-    free_ast(node->left);
-    free_ast(node->right);
-    free(node);
-}
-
-//Main function
-// int main() {
-//     //test both valid and invalid
-//     const char *input = "int x;\n" //Valid declaration
-//                         "x = 42;\n" //Valid assignment;
-//                         "if (1) {\nx = 5;\n}"  //Valid if statement
-//                         "while (1) {\nx = 5;\ny = 4;\n}"
-//                         "repeat {\nx = 5;\n} until (1);"
-//                         "print x;\n"
-//                         "y = x + 5;\n"
-//                         "if (x == 1) {\nx = 5;\n}"  //Valid if statement
-//                         "factorial(4);\n"
-//                         "x = (3 + 7) * (10 - 4);"; //Valid assignment;
-//     const char *invalid_input = "int x;\n"
-//                                 "x = 42;\n"
-//                                 "int ;";
-
-//     printf("Parsing input:\n%s\n", input);
-//     parser_init(input);
-//     ASTNode *ast = parse();
-
-//     printf("\nAbstract Syntax Tree:\n");
-//     print_ast(ast, 0);
-//     free_ast(ast);
-//     return 0;
-// }
-
-// Main function for testing
-// int main() {
-//     // Test with both valid and invalid inputs
-//     const char *valid_input = "int x;\n" // Valid declaration
-//                         "x = 42;\n" // Valid assignment;
-//                         "if (1) {x = 5;\n}"  // Valid if statement
-//                         "while (1) {x = 5;y = 4;}\n"
-//                         "repeat {x = 5;} until (1);\n"
-//                         "print x;\n"
-//                         "y = x + 5;\n"
-//                         "if (x == 1) {x = 5;}\n"  // Valid if statement
-//                         "factorial(4);\n"
-//                         "x = (3 + 7) * (10 - 4);";
-
-//     const char *invalid_input = "int x;\n"
-//                                 "x = 42;\n"
-//                                 "int ;\n"
-//                                 "x@ + 4\n;"
-//                                 "x +- y;\n"
-//                                 "x = (x + 1;";
-
-//     printf("Parsing input:\n%s\n", invalid_input);
-//     parser_init(invalid_input);
-//     ASTNode *ast = parse();
-//     print_ast(ast, 0);
-//     free_ast(ast);
-//     return 0;
-// }
+/* parser.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include "../../include/parser.h"
+#include "../../include/lexer.h"
+#include "../../include/tokens.h"
+
+static NodeId parse_program(Parser *p);
+static NodeId parse_expression(Parser *p);
+static NodeId parse_primary(Parser *p);
+static NodeId parse_statement(Parser *p);
+static NodeId parse_assignment(Parser *p);
+static NodeId parse_if_statement(Parser *p);
+static NodeId parse_while_statement(Parser *p);
+static NodeId parse_repeat_statement(Parser *p);
+static NodeId parse_print_statement(Parser *p);
+static NodeId parse_block(Parser *p);
+static NodeId parse_factorial(Parser *p);
+
+// Record current_token in the AST on first use, so that nodes built from the
+// same token share its entry
+static uint32_t current_token_ref(Parser *p) {
+    if (!p->current_token_recorded) {
+        p->current_token_index = ast_add_token(p->ast, p->current_token);
+        p->current_token_recorded = 1;
+    }
+    return p->current_token_index;
+}
+
+//create new AST node
+static NodeId create_node(Parser *p, ASTNodeType type) {
+    NodeId node = ast_add_node(p->ast, type, current_token_ref(p));
+
+    if (type == AST_VARDECL) {
+        switch (p->current_token.type) {
+            case TOKEN_INT: p->ast->var_type[node] = TYPE_INT; break;
+            case TOKEN_CHAR: p->ast->var_type[node] = TYPE_CHAR; break;
+            case TOKEN_FLOAT: p->ast->var_type[node] = TYPE_FLOAT; break; 
+            case TOKEN_STRING: p->ast->var_type[node] = TYPE_STRING; break;
+            default: break;
+        }
+    }
+
+    return node;
+}
+
+// Point node at current_token instead of the one it was created with
+static void set_token(Parser *p, NodeId node) {
+    p->ast->token[node] = current_token_ref(p);
+}
+
+// Make first, followed by second (if any), the children of parent
+static void set_children(Parser *p, NodeId parent, NodeId first, NodeId second) {
+    p->ast->first_child[parent] = first;
+    if (first != AST_NONE) {
+        p->ast->next_sibling[first] = second;
+    }
+}
+
+// Append a statement to the children of a program or block; *last tracks
+// the list's tail
+static void append_statement(Parser *p, NodeId list, NodeId *last, NodeId statement) {
+    if (*last == AST_NONE) {
+        p->ast->first_child[list] = statement;
+    } else {
+        p->ast->next_sibling[*last] = statement;
+    }
+    *last = statement;
+}
+
+// Report a syntax error at token, unless one is already being recovered
+// from
+static void syntax_error(Parser *p, ParseError error, Token token) {
+    if (p->panicking || p->stopped) return;
+    p->panicking = 1;
+
+    if (p->error_count == p->max_errors) {
+        diag_add(p->diags, DIAG_ERROR, DIAG_SYNTAX, PARSE_ERROR_TOO_MANY_ERRORS, 0, token.start, 0);
+        p->stopped = 1;
+        return;
+    }
+    p->error_count++;
+
+    Diagnostic *diag;
+    if (token.type == TOKEN_ERROR && token.error != ERROR_NONE) {
+        // The lexer already knows what is wrong with the token
+        diag = diag_add(p->diags, DIAG_ERROR, DIAG_LEXICAL, token.error, token_line(p->lexer, token),
+                        token.start, token.length);
+    } else {
+        diag = diag_add(p->diags, DIAG_ERROR, DIAG_SYNTAX, error, token_line(p->lexer, token),
+                        token.start, token.length);
+        diag->args[0] = p->max_depth;
+    }
+    if (token.type == TOKEN_EOF) {
+        diag->text = "EOF";
+        diag->text_length = 3;
+    }
+}
+
+// The parser recurses once per nesting level; refuse to go deeper than
+// max_depth rather than run out of C stack
+static int enter_nesting(Parser *p) {
+    if (++p->depth > p->max_depth) {
+        syntax_error(p, PARSE_ERROR_NESTING_TOO_DEEP, p->current_token);
+        p->stopped = 1;
+        return 0;
+    }
+    return 1;
+}
+
+static void leave_nesting(Parser *p) {
+    p->depth--;
+}
+
+//get next token
+static void advance(Parser *p) {
+    p->previous_end = p->lexer->position;
+    p->current_token = get_next_token(p->lexer);
+    p->current_token_recorded = 0;
+    STATS_INC(p->tokens);
+}
+
+
+static int match(Parser *p, TokenType type) {
+    return p->current_token.type == type;
+}
+
+// No more statements to parse: end of input, or the parser gave up
+static int at_end(Parser *p) {
+    return match(p, TOKEN_EOF) || p->stopped;
+}
+
+
+static int expect(Parser *p, TokenType type) {
+    if (match(p, type)) {
+        advance(p);
+        return 1;
+    }
+    syntax_error(p, PARSE_ERROR_UNEXPECTED_TOKEN, p->current_token);
+    return 0;
+}
+
+// Panic-mode recovery: skip the rest of a broken statement, up to and
+// including its ';', or up to the '}' closing the enclosing block. A block
+// opened inside the statement is skipped whole and ends it.
+static void synchronize(Parser *p) {
+    int braces = 0;
+
+    while (!match(p, TOKEN_EOF)) {
+        if (match(p, TOKEN_SEMICOLON) && braces == 0) {
+            advance(p);
+            break;
+        }
+        if (match(p, TOKEN_LBRACE)) {
+            braces++;
+        } else if (match(p, TOKEN_RBRACE)) {
+            if (braces == 0) break;
+            if (--braces == 0) {
+                advance(p);
+                break;
+            }
+        }
+        advance(p);
+    }
+    p->panicking = 0;
+}
+
+
+//parse factorial function
+static NodeId parse_factorial(Parser *p) {
+    NodeId node = create_node(p, AST_FACTORIAL);
+    advance(p);
+
+    if (!expect(p, TOKEN_LPAREN)) return node;
+    NodeId expression = parse_expression(p);
+    if (p->panicking) return node;
+    set_children(p, node, expression, AST_NONE);
+
+    if (!expect(p, TOKEN_RPAREN)) return node;
+    expect(p, TOKEN_SEMICOLON);
+
+    return node;
+}
+
+
+//forward declarations
+static NodeId parse_statement(Parser *p);
+
+//parse block
+static NodeId parse_block(Parser *p) {
+    NodeId node = create_node(p, AST_BLOCK);
+    NodeId last = AST_NONE;
+    advance(p);
+
+    while (!match(p, TOKEN_RBRACE) && !at_end(p)) {
+        append_statement(p, node, &last, parse_statement(p));
+    }
+    if (!match(p, TOKEN_RBRACE)) {
+        syntax_error(p, PARSE_ERROR_MISSING_RBRACE, p->current_token);
+        return node;
+    }
+    advance(p);
+    return node;
+}
+
+// Body of an if or while: a block or a single statement
+static NodeId parse_body(Parser *p) {
+    if (match(p, TOKEN_LBRACE)) {
+        return parse_block(p);
+    }
+    return parse_statement(p);
+}
+
+//parse if statement 
+static NodeId parse_if_statement(Parser *p) {
+    NodeId node = create_node(p, AST_IF);
+    advance(p);
+
+    if (!expect(p, TOKEN_LPAREN)) return node;
+    NodeId condition = parse_expression(p);
+    if (p->panicking || !expect(p, TOKEN_RPAREN)) return node;
+    set_children(p, node, condition, parse_body(p));
+    return node;
+}
+
+//parse while statement
+static NodeId parse_while_statement(Parser *p) {
+    NodeId node = create_node(p, AST_WHILE);
+    advance(p); 
+
+    if (!expect(p, TOKEN_LPAREN)) return node;
+    NodeId condition = parse_expression(p);
+    if (p->panicking || !expect(p, TOKEN_RPAREN)) return node;
+    set_children(p, node, condition, parse_body(p));
+
+    return node;
+}
+
+//Parse repeat until statement
+static NodeId parse_repeat_statement(Parser *p) {
+    NodeId node = create_node(p, AST_REPEAT);
+    advance(p);
+
+    if (!match(p, TOKEN_LBRACE)) {
+        syntax_error(p, PARSE_ERROR_MISSING_LBRACE, p->current_token);
+        return node;
+    }
+
+    NodeId body = parse_block(p);
+    if (p->panicking) return node;
+    if (!match(p, TOKEN_UNTIL)) {
+        syntax_error(p, PARSE_ERROR_MISSING_UNTIL, p->current_token);
+        return node;
+    }
+    advance(p);
+    if (!expect(p, TOKEN_LPAREN)) return node;
+
+    NodeId condition = create_node(p, AST_CONDITION);
+    set_children(p, condition, parse_expression(p), AST_NONE);
+    set_children(p, node, body, condition);
+    if (p->panicking || !expect(p, TOKEN_RPAREN)) return node;
+    expect(p, TOKEN_SEMICOLON);
+
+    return node;
+}
+
+//parse print statement
+static NodeId parse_print_statement(Parser *p) {
+    NodeId node = create_node(p, AST_PRINT);
+    advance(p);
+    NodeId expression = parse_expression(p);
+    if (p->panicking) return node;
+    set_children(p, node, expression, AST_NONE);
+    expect(p, TOKEN_SEMICOLON);
+    return node;
+}
+
+static NodeId parse_expression(Parser *p);
+
+//parse variable declaration: int x;
+static NodeId parse_declaration(Parser *p) {
+    NodeId node = create_node(p, AST_VARDECL);
+    advance(p);
+
+    if (!match(p, TOKEN_IDENTIFIER)) {
+        syntax_error(p, PARSE_ERROR_MISSING_IDENTIFIER, p->current_token);
+        return node;
+    }
+
+    set_token(p, node);
+    advance(p);
+    if (!match(p, TOKEN_SEMICOLON)) {
+        syntax_error(p, PARSE_ERROR_MISSING_SEMICOLON, p->current_token);
+        return node;
+    }
+    advance(p);
+    return node;
+}
+
+//Parse assignment: x = 5;
+static NodeId parse_assignment(Parser *p) {
+    NodeId node = create_node(p, AST_ASSIGN);
+    NodeId target = create_node(p, AST_IDENTIFIER);
+    advance(p);
+
+    if (!match(p, TOKEN_EQUALS)) {
+        syntax_error(p, PARSE_ERROR_MISSING_EQUALS, p->current_token);
+        return node;
+    }
+    advance(p);
+
+    set_children(p, node, target, parse_expression(p));
+    if (p->panicking) return node;
+    if (!match(p, TOKEN_SEMICOLON)) {
+        syntax_error(p, PARSE_ERROR_MISSING_SEMICOLON, p->current_token);
+        return node;
+    }
+    advance(p);
+    return node;
+}
+
+static NodeId parse_binop(Parser *p) {
+    NodeId node = parse_expression(p); 
+    if (p->panicking) return node;
+    if (!match(p, TOKEN_SEMICOLON)) {
+        syntax_error(p, PARSE_ERROR_MISSING_SEMICOLON, p->current_token);
+        return node;
+    }
+    advance(p); 
+
+    return node;
+}
+
+//Parse statement
+// A statement with a syntax error is skipped and replaced by an AST_ERROR
+// node, so that parsing and analysis can carry on after it
+static NodeId parse_statement(Parser *p) {
+    NodeId node;
+    Token start = p->current_token;
+
+    if (!enter_nesting(p)) {
+        leave_nesting(p);
+        return ast_add_node(p->ast, AST_ERROR, current_token_ref(p));
+    }
+    if (match(p, TOKEN_INT) || match(p, TOKEN_FLOAT) || match(p, TOKEN_CHAR) || match(p, TOKEN_STRING))    node = parse_declaration(p);
+    else if (match(p, TOKEN_IDENTIFIER))   node = parse_assignment(p);
+    else if (match(p, TOKEN_LBRACE))   node = parse_block(p);
+    else if (match(p, TOKEN_IF))   node = parse_if_statement(p);
+    else if (match(p, TOKEN_WHILE))    node = parse_while_statement(p);
+    else if (match(p, TOKEN_REPEAT))   node = parse_repeat_statement(p);
+    else if (match(p, TOKEN_PRINT))    node = parse_print_statement(p);
+    else if (match(p, TOKEN_FACTORIAL))    node = parse_factorial(p);
+    else if (match(p, TOKEN_OPERATOR)) node = parse_binop(p);
+    else {
+        syntax_error(p, PARSE_ERROR_UNEXPECTED_TOKEN, p->current_token);
+        node = AST_NONE;
+    }
+    leave_nesting(p);
+
+    if (p->panicking || p->stopped) {
+        if (p->current_token.start == start.start && !match(p, TOKEN_EOF)) {
+            // Nothing could be parsed: drop the offending token alone
+            advance(p);
+            p->panicking = 0;
+        } else {
+            synchronize(p);
+        }
+        node = ast_add_node(p->ast, AST_ERROR, ast_add_token(p->ast, start));
+    }
+    return node;
+}
+
+//Parse expression
+static NodeId parse_expression(Parser *p) {
+    //parse primary expression
+    NodeId node = parse_primary(p);
+
+    while (!p->panicking && (match(p, TOKEN_OPERATOR) || match(p, TOKEN_COMPARISON))) {
+        if (match(p, TOKEN_COMPARISON)) {
+            NodeId condNode = create_node(p, AST_CONDITION);
+            NodeId compNode = create_node(p, AST_COMPARISON);
+            NodeId left = node;
+            advance(p);
+            set_children(p, compNode, left, parse_primary(p));
+            set_children(p, condNode, compNode, AST_NONE);
+            node = condNode;
+        }
+        else {
+            NodeId binopNode = create_node(p, AST_BINOP);
+            NodeId left = node;
+            advance(p);
+            set_children(p, binopNode, left, parse_primary(p));
+            node = binopNode;
+        }
+    }
+
+    return node;
+}
+
+static NodeId parse_primary(Parser *p) {
+    if (match(p, TOKEN_LPAREN)) {
+        if (!enter_nesting(p)) {
+            leave_nesting(p);
+            return AST_NONE;
+        }
+        advance(p);
+        NodeId sub_expr = parse_expression(p);
+        leave_nesting(p);
+        if (p->panicking) return sub_expr;
+
+        if (!match(p, TOKEN_RPAREN)) {
+            syntax_error(p, PARSE_ERROR_MISSING_RPAREN, p->current_token);
+            return sub_expr;
+        }
+        advance(p);
+
+        return sub_expr;
+    }
+    else if (match(p, TOKEN_NUMBER)) {
+        NodeId node = create_node(p, AST_NUMBER);
+        advance(p);
+        return node;
+    }
+    else if (match(p, TOKEN_STRING_LITERAL)) {
+        NodeId node = create_node(p, AST_STRING_LITERAL);
+        advance(p);
+        return node;
+    }
+    else if (match(p, TOKEN_IDENTIFIER)) {
+        NodeId node = create_node(p, AST_IDENTIFIER);
+        advance(p);
+        return node;
+    }
+    else {
+        syntax_error(p, PARSE_ERROR_INVALID_EXPRESSION, p->current_token);
+        return AST_NONE;
+    }
+}
+
+//parse program
+static NodeId parse_program(Parser *p) {
+    NodeId program = create_node(p, AST_PROGRAM);
+    NodeId last = AST_NONE;
+
+    while (!at_end(p)) {
+        append_statement(p, program, &last, parse_statement(p));
+    }
+
+    return program;
+}
+
+//initialize parser
+void parser_init(Parser *p, CompilationUnit *unit) {
+    p->lexer = &unit->lexer;
+    p->ast = &unit->ast;
+    p->source = unit->input.data;
+    p->diags = &unit->diags;
+    p->depth = 0;
+    p->max_depth = PARSER_MAX_DEPTH;
+    p->panicking = 0;
+    p->stopped = 0;
+    p->tokens = 0;
+    p->error_count = 0;
+    p->max_errors = PARSER_MAX_ERRORS;
+    advance(p);
+}
+
+void parser_set_max_depth(Parser *p, int limit) {
+    p->max_depth = limit;
+}
+
+void parser_set_max_errors(Parser *p, int limit) {
+    p->max_errors = limit;
+}
+
+int parser_error_count(const Parser *p) {
+    return p->error_count;
+}
+
+//Main parse function
+NodeId parse(Parser *p) {
+    return parse_program(p);
+}
+
+NodeId parse_next_statement(Parser *p) {
+    p->error_count = 0;
+    if (at_end(p)) return AST_NONE;
+    return parse_statement(p);
+}
+
+//debug function
+const char* token_type_to_string(TokenType type) {
+    switch (type) {
+#define TOKEN(name) case name: return #name + 6;
+#include "../../include/tokens.def"
+        default: return "UNKNOWN";
+    }
+}
+
+//print AST tree
+// Pre-order with an explicit stack, so deep trees do not recurse
+void print_ast(const CompilationUnit *unit, NodeId root, int level) {
+    const Ast *ast = &unit->ast;
+    const char *source = unit->input.data;
+    typedef struct { NodeId node; int level; } Pending;
+    Pending *stack = NULL;
+    size_t count = 0, capacity = 0;
+
+    if (root == AST_NONE) return;
+    stack = malloc(sizeof(Pending) * (capacity = 64));
+    if (!stack) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    stack[count++] = (Pending){root, level};
+
+    while (count > 0) {
+        Pending item = stack[--count];
+        NodeId node = item.node;
+        for (int i = 0; i < item.level; i++) printf("--");
+        const char *lexeme = source + AST_START(ast, node);
+        int length = (int)AST_LENGTH(ast, node);
+    
+        switch (ast->kind[node]) {
+            case AST_PROGRAM:       printf("Program\n"); break;
+            case AST_VARDECL:       printf("VarDecl: %.*s, Type: %s\n", length, lexeme, var_type_to_string(ast->var_type[node])); break;
+            case AST_ASSIGN:        printf("Assign\n"); break;
+            case AST_NUMBER:        printf("Number: %.*s\n", length, lexeme); break;
+            case AST_STRING_LITERAL: printf("String: %.*s\n", length, lexeme); break;
+            case AST_IDENTIFIER:    printf("Identifier: %.*s\n", length, lexeme); break;
+            case AST_CONDITION:     printf("Condition\n"); break;
+            case AST_IF:            printf("If\n"); break;
+            case AST_WHILE:         printf("While\n"); break;
+            case AST_REPEAT:        printf("Repeat-Until\n"); break;
+            case AST_BLOCK:         printf("Block\n"); break;
+            case AST_BINOP:         printf("BinaryOp: %.*s\n", length, lexeme); break;
+            case AST_PRINT:         printf("Print\n"); break;
+            case AST_FACTORIAL:     printf("Factorial\n"); break;
+            case AST_COMPARISON:    printf("Comparison: %.*s\n", length, lexeme); break;
+            case AST_ERROR:         printf("Error\n"); break;
+            default:
+                printf("Unknown type of node\n");
+        }
+
+        // Push the children, then reverse them so the first is printed first
+        size_t first = count;
+        for (NodeId child = ast->first_child[node]; child != AST_NONE; child = ast->next_sibling[child]) {
+            if (count == capacity) {
+                stack = realloc(stack, sizeof(Pending) * (capacity *= 2));
+                if (!stack) {
+                    fprintf(stderr, "Memory allocation failed\n");
+                    exit(1);
+                }
+            }
+            stack[count++] = (Pending){child, item.level + 1};
+        }
+        for (size_t i = first, j = count; i + 1 < j; i++, j--) {
+            Pending swap = stack[i];
+            stack[i] = stack[j - 1];
+            stack[j - 1] = swap;
+        }
+    }
+
+    free(stack);
+}
+
+//print all the tokens, like lexer output
+void print_token_stream(const char* input) {
+    Lexer lexer;
+    Token token;
+    lexer_init(&lexer, input, NULL);
+    do {
+        token = get_next_token(&lexer);
+        print_token(&lexer, token);
+    } while (token.type != TOKEN_EOF);
+    lexer_free(&lexer);
+}
+
+//Main function
+// int main() {
+//     //test both valid and invalid
+//     const char *input = "int x;\n" //Valid declaration
+//                         "x = 42;\n" //Valid assignment;
+//                         "if (1) {\nx = 5;\n}"  //Valid if statement
+//                         "while (1) {\nx = 5;\ny = 4;\n}"
+//                         "repeat {\nx = 5;\n} until (1);"
+//                         "print x;\n"
+//                         "y = x + 5;\n"
+//                         "if (x == 1) {\nx = 5;\n}"  //Valid if statement
+//                         "factorial(4);\n"
+//                         "x = (3 + 7) * (10 - 4);"; //Valid assignment;
+//     const char *invalid_input = "int x;\n"
+//                                 "x = 42;\n"
+//                                 "int ;";
+
+//     printf("Parsing input:\n%s\n", input);
+//     parser_init(input);
+//     ASTNode *ast = parse();
+
+//     printf("\nAbstract Syntax Tree:\n");
+//     print_ast(ast, 0);
+//     free_ast(ast);
+//     return 0;
+// }
+
+// Main function for testing
+// int main() {
+//     // Test with both valid and invalid inputs
+//     const char *valid_input = "int x;\n" // Valid declaration
+//                         "x = 42;\n" // Valid assignment;
+//                         "if (1) {x = 5;\n}"  // Valid if statement
+//                         "while (1) {x = 5;y = 4;}\n"
+//                         "repeat {x = 5;} until (1);\n"
+//                         "print x;\n"
+//                         "y = x + 5;\n"
+//                         "if (x == 1) {x = 5;}\n"  // Valid if statement
+//                         "factorial(4);\n"
+//                         "x = (3 + 7) * (10 - 4);";
+
+//     const char *invalid_input = "int x;\n"
+//                                 "x = 42;\n"
+//                                 "int ;\n"
+//                                 "x@ + 4\n;"
+//                                 "x +- y;\n"
+//                                 "x = (x + 1;";
+
+//     printf("Parsing input:\n%s\n", invalid_input);
+//     parser_init(invalid_input);
+//     ASTNode *ast = parse();
+//     print_ast(ast, 0);
+//     free_ast(ast);
+//     return 0;
+// }
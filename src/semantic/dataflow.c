@@ -0,0 +1,365 @@
+/* dataflow.c
+ * Definite initialisation, as a dataflow problem over the statements'
+ * control-flow graph.
+ *
+ * Each block of the graph lists what happens in it, in order: declarations,
+ * assignments and reads of variables. The analysis works on frame slots,
+ * one bit each in a dense bit vector per block, and finds the slots
+ * assigned on every path into each block: a forward problem whose meet is
+ * intersection, solved with a worklist. A declaration clears its slot's
+ * bit, as slots are reused across sibling scopes, and an assignment sets
+ * it. Reads of a slot whose bit is clear are flagged for check_operand,
+ * which reports them.
+ *
+ * The language has no break or goto, so the graph follows the structure of
+ * the statements: an if branches around its body, a while loop tests at its
+ * header, and a repeat loop at its end. Like the checks, the walk that
+ * builds it uses an explicit stack.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/semantic.h"
+
+#define FLOW_INITIAL_CAPACITY 64
+
+// Columns of a node
+#define NODE_KIND(node) ((ASTNodeType)sema->ast->kind[node])
+#define NODE_LEFT(node) (sema->ast->first_child[node])
+#define NODE_RIGHT(node) AST_SECOND_CHILD(sema->ast, node)
+#define NODE_BINDING(node) (sema->ast->binding[node])
+
+typedef uint64_t Word;
+
+#define WORD_BITS 64
+
+// Basic block: events[first] to events[first + count - 1] happen in it
+typedef struct {
+    uint32_t first, count;
+    uint32_t preds[2];
+    uint32_t pred_count;
+    uint32_t succs[2];
+    uint32_t succ_count;
+} FlowBlock;
+
+// A statement being added to the graph; state counts its parts added
+typedef struct {
+    NodeId node;
+    int state;
+    uint32_t head;         // Block an if branches from, first block of a loop
+    NodeId cursor;         // Next statement of a block
+} FlowFrame;
+
+typedef struct {
+    Analyzer *sema;
+    FlowBlock *blocks;
+    size_t block_count, block_capacity;
+    NodeId *events;        // VARDECLs, ASSIGNs and IDENTIFIERs read
+    size_t event_count, event_capacity;
+    uint32_t current;      // Block being appended to, always the newest
+
+    FlowFrame *frames;
+    size_t frame_count, frame_capacity;
+    NodeId *scan;
+    size_t scan_count, scan_capacity;
+} Flow;
+
+static void *grow(void *array, size_t *capacity, size_t count, size_t size) {
+    if (count < *capacity) return array;
+    *capacity = *capacity ? *capacity * 2 : FLOW_INITIAL_CAPACITY;
+    array = realloc(array, *capacity * size);
+    if (!array) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    return array;
+}
+
+static void *allocate(size_t count, size_t size) {
+    void *array = calloc(count ? count : 1, size);
+    if (!array) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    return array;
+}
+
+// Graph construction
+
+static uint32_t new_block(Flow *flow) {
+    flow->blocks = grow(flow->blocks, &flow->block_capacity, flow->block_count, sizeof(FlowBlock));
+    FlowBlock *block = &flow->blocks[flow->block_count];
+    memset(block, 0, sizeof(FlowBlock));
+    block->first = (uint32_t)flow->event_count;
+    return (uint32_t)flow->block_count++;
+}
+
+static void add_edge(Flow *flow, uint32_t from, uint32_t to) {
+    flow->blocks[from].succs[flow->blocks[from].succ_count++] = to;
+    flow->blocks[to].preds[flow->blocks[to].pred_count++] = from;
+}
+
+// Start a new block, entered from the current one
+static uint32_t follow(Flow *flow) {
+    uint32_t from = flow->current;
+    flow->current = new_block(flow);
+    add_edge(flow, from, flow->current);
+    return flow->current;
+}
+
+static void add_event(Flow *flow, NodeId node) {
+    flow->events = grow(flow->events, &flow->event_capacity, flow->event_count, sizeof(NodeId));
+    flow->events[flow->event_count++] = node;
+    flow->blocks[flow->current].count++;
+}
+
+// Add the variables read by an expression
+static void add_reads(Flow *flow, NodeId node) {
+    Analyzer *sema = flow->sema;
+    if (node == AST_NONE) return;
+    flow->scan_count = 0;
+    flow->scan = grow(flow->scan, &flow->scan_capacity, flow->scan_count, sizeof(NodeId));
+    flow->scan[flow->scan_count++] = node;
+    while (flow->scan_count > 0) {
+        node = flow->scan[--flow->scan_count];
+        if (NODE_KIND(node) == AST_IDENTIFIER && NODE_BINDING(node) != AST_NONE) add_event(flow, node);
+        for (NodeId child = NODE_LEFT(node); child != AST_NONE; child = sema->ast->next_sibling[child]) {
+            flow->scan = grow(flow->scan, &flow->scan_capacity, flow->scan_count, sizeof(NodeId));
+            flow->scan[flow->scan_count++] = child;
+        }
+    }
+}
+
+static void push_frame(Flow *flow, NodeId node) {
+    flow->frames = grow(flow->frames, &flow->frame_capacity, flow->frame_count, sizeof(FlowFrame));
+    flow->frames[flow->frame_count++] = (FlowFrame){node, 0, 0, AST_NONE};
+}
+
+// Add one step of the statement on top of the stack
+static void build_step(Flow *flow) {
+    Analyzer *sema = flow->sema;
+    FlowFrame *frame = &flow->frames[flow->frame_count - 1];
+    NodeId node = frame->node;
+
+    switch (NODE_KIND(node)) {
+    case AST_PROGRAM:
+    case AST_BLOCK:
+        if (frame->state == 0) {
+            frame->state = 1;
+            frame->cursor = NODE_LEFT(node);
+        }
+        if (frame->cursor == AST_NONE) {
+            flow->frame_count--;
+        } else {
+            NodeId child = frame->cursor;
+            frame->cursor = sema->ast->next_sibling[child];
+            push_frame(flow, child);
+        }
+        return;
+
+    case AST_VARDECL:
+        // An assigned outer variable is never declared unassigned
+        if (NODE_BINDING(node) != SLOT_NONE && NODE_BINDING(node) >= sema->assigned_slots) {
+            add_event(flow, node);
+        }
+        break;
+    case AST_ASSIGN:
+        add_reads(flow, NODE_RIGHT(node));
+        if (NODE_LEFT(node) != AST_NONE && NODE_BINDING(NODE_LEFT(node)) != AST_NONE) add_event(flow, node);
+        break;
+    case AST_PRINT:
+        add_reads(flow, NODE_LEFT(node));
+        break;
+    case AST_FACTORIAL:
+        add_reads(flow, node);
+        break;
+
+    case AST_IF:
+        if (frame->state == 0) {
+            // Branch around the body
+            add_reads(flow, NODE_LEFT(node));
+            frame->state = 1;
+            frame->head = flow->current;
+            follow(flow);
+            push_frame(flow, NODE_RIGHT(node));
+            return;
+        }
+        follow(flow);
+        add_edge(flow, frame->head, flow->current);
+        break;
+
+    case AST_WHILE:
+        if (frame->state == 0) {
+            frame->state = 1;
+            frame->head = follow(flow);
+            add_reads(flow, NODE_LEFT(node));
+            follow(flow);
+            push_frame(flow, NODE_RIGHT(node));
+            return;
+        }
+        add_edge(flow, flow->current, frame->head);
+        flow->current = new_block(flow);
+        add_edge(flow, frame->head, flow->current);
+        break;
+
+    case AST_REPEAT:
+        if (frame->state == 0) {
+            frame->state = 1;
+            frame->head = follow(flow);
+            push_frame(flow, NODE_LEFT(node));
+            return;
+        }
+        // The condition is read at the end of the body
+        add_reads(flow, NODE_RIGHT(node));
+        add_edge(flow, flow->current, frame->head);
+        follow(flow);
+        break;
+
+    default:
+        // AST_ERROR: already reported by the parser
+        break;
+    }
+    flow->frame_count--;
+}
+
+// Solving
+
+typedef enum {
+    EVENT_READ,
+    EVENT_DECLARE,
+    EVENT_ASSIGN,
+} EventKind;
+
+// What an event does, and to which slot
+static EventKind event_kind(const Analyzer *sema, NodeId event, uint32_t *slot) {
+    switch (NODE_KIND(event)) {
+    case AST_VARDECL:
+        *slot = NODE_BINDING(event);
+        return EVENT_DECLARE;
+    case AST_ASSIGN:
+        *slot = NODE_BINDING(NODE_BINDING(NODE_LEFT(event)));
+        return EVENT_ASSIGN;
+    default:
+        *slot = NODE_BINDING(NODE_BINDING(event));
+        return EVENT_READ;
+    }
+}
+
+static int test_bit(const Word *set, uint32_t bit) {
+    return (int)(set[bit / WORD_BITS] >> (bit % WORD_BITS)) & 1;
+}
+
+static void set_bit(Word *set, uint32_t bit, int value) {
+    Word mask = (Word)1 << (bit % WORD_BITS);
+    if (value) set[bit / WORD_BITS] |= mask;
+    else set[bit / WORD_BITS] &= ~mask;
+}
+
+// Slots assigned on every path into block: the intersection of what its
+// predecessors leave assigned; for the entry, only the assigned outer
+// variables
+static void block_entry(const Flow *flow, const Word *out, size_t words, uint32_t block, Word *in) {
+    const FlowBlock *b = &flow->blocks[block];
+    if (b->pred_count == 0) {
+        memset(in, 0, words * sizeof(Word));
+        for (uint32_t slot = 0; slot < flow->sema->assigned_slots; slot++) {
+            set_bit(in, slot, 1);
+        }
+        return;
+    }
+    memcpy(in, out + b->preds[0] * words, words * sizeof(Word));
+    for (uint32_t p = 1; p < b->pred_count; p++) {
+        const Word *pred = out + b->preds[p] * words;
+        for (size_t w = 0; w < words; w++) in[w] &= pred[w];
+    }
+}
+
+// Apply the events of block to set, the slots assigned on entry to it; with
+// flag, flag the reads of slots not assigned
+static void transfer(const Flow *flow, uint32_t block, Word *set, int flag) {
+    const Analyzer *sema = flow->sema;
+    const FlowBlock *b = &flow->blocks[block];
+    for (uint32_t e = b->first; e < b->first + b->count; e++) {
+        uint32_t slot;
+        EventKind kind = event_kind(sema, flow->events[e], &slot);
+        if (slot >= sema->ast->slot_count) continue;
+        if (kind != EVENT_READ) {
+            set_bit(set, slot, kind == EVENT_ASSIGN);
+        } else if (flag && !test_bit(set, slot)) {
+            sema->uninitialized[flow->events[e]] = 1;
+        }
+    }
+}
+
+void analyze_initialization(Analyzer *sema, NodeId root) {
+    uint32_t slots = sema->ast->slot_count;
+    if (root == AST_NONE || slots == 0) return;
+
+    Flow flow = {0};
+    flow.sema = sema;
+    flow.current = new_block(&flow);
+    push_frame(&flow, root);
+    while (flow.frame_count > 0) {
+        build_step(&flow);
+    }
+
+    // Start from every slot assigned everywhere and shrink to the fixed
+    // point. Blocks are queued in the order they were made, which visits a
+    // block's predecessors first except along back edges.
+    size_t words = (slots + WORD_BITS - 1) / WORD_BITS;
+    size_t count = flow.block_count;
+    Word *out = allocate(count * words, sizeof(Word));
+    Word *in = allocate(words, sizeof(Word));
+    uint32_t *queue = allocate(count, sizeof(uint32_t));
+    uint8_t *queued = allocate(count, 1);
+    size_t head = 0, length = count;
+    memset(out, 0xff, count * words * sizeof(Word));
+    for (size_t b = 0; b < count; b++) {
+        queue[b] = (uint32_t)b;
+        queued[b] = 1;
+    }
+    while (length > 0) {
+        uint32_t b = queue[head];
+        head = (head + 1) % count;
+        length--;
+        queued[b] = 0;
+
+        block_entry(&flow, out, words, b, in);
+        transfer(&flow, b, in, 0);
+        Word *block_out = out + b * words;
+        if (memcmp(in, block_out, words * sizeof(Word)) == 0) continue;
+        memcpy(block_out, in, words * sizeof(Word));
+        for (uint32_t s = 0; s < flow.blocks[b].succ_count; s++) {
+            uint32_t succ = flow.blocks[b].succs[s];
+            if (queued[succ]) continue;
+            queued[succ] = 1;
+            queue[(head + length) % count] = succ;
+            length++;
+        }
+    }
+
+    // Go through each block once more from its entry, flagging the reads
+    for (uint32_t b = 0; b < count; b++) {
+        block_entry(&flow, out, words, b, in);
+        transfer(&flow, b, in, 1);
+    }
+
+    // The block being appended to when the walk ended is the program's last
+    if (sema->exit_assigned) {
+        const Word *exit = out + flow.current * words;
+        for (uint32_t slot = 0; slot < slots; slot++) {
+            sema->exit_assigned[slot] = (uint8_t)test_bit(exit, slot);
+        }
+    }
+
+    free(out);
+    free(in);
+    free(queue);
+    free(queued);
+    free(flow.blocks);
+    free(flow.events);
+    free(flow.frames);
+    free(flow.scan);
+}
@@ -1,133 +1,451 @@
 #include "../../include/semantic.h"
+#include "../../include/input.h"
+#include "../../include/lexer.h"
 #include "../../include/tokens.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define SEMANTIC_INPUT_FILE "test/input_semantic_error.txt"
+// Columns of a node
+#define NODE_KIND(node) ((ASTNodeType)sema->ast->kind[node])
+#define NODE_ID(node) AST_ID(sema->ast, node)
+#define NODE_LEFT(node) (sema->ast->first_child[node])
+#define NODE_RIGHT(node) AST_SECOND_CHILD(sema->ast, node)
+
+// Declared type of a VARDECL, synthesized type of an expression
+#define NODE_TYPE(node) (sema->ast->var_type[node])
+
+// VARDECL an IDENTIFIER is bound to, or frame slot of a VARDECL
+#define NODE_BINDING(node) (sema->ast->binding[node])
+
+// Span and line of a node's token
+#define NODE_SPAN(node) AST_START(sema->ast, node), AST_LENGTH(sema->ast, node)
+#define NODE_LINE(node) source_line(sema->lexer, AST_START(sema->ast, node))
+
+// Make room for one more entry on a work stack
+static void *reserve(void *stack, size_t *capacity, size_t count, size_t size) {
+    if (count < *capacity) return stack;
+    *capacity = *capacity ? *capacity * 2 : 64;
+    stack = realloc(stack, *capacity * size);
+    if (!stack) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    return stack;
+}
+
+static void push_resolve(Analyzer *sema, NodeId node, int exit_scope, uint32_t live) {
+    sema->resolve_stack = reserve(sema->resolve_stack, &sema->resolve_capacity, sema->resolve_count, sizeof(ResolveFrame));
+    sema->resolve_stack[sema->resolve_count++] = (ResolveFrame){node, exit_scope, live};
+}
+
+static void push_statement(Analyzer *sema, NodeId node) {
+    sema->statement_stack = reserve(sema->statement_stack, &sema->statement_capacity, sema->statement_count, sizeof(StatementFrame));
+    sema->statement_stack[sema->statement_count++] = (StatementFrame){node, 0, AST_NONE};
+}
+
+static void push_expression(Analyzer *sema, NodeId node) {
+    sema->expression_stack = reserve(sema->expression_stack, &sema->expression_capacity, sema->expression_count, sizeof(ExpressionFrame));
+    sema->expression_stack[sema->expression_count++] = (ExpressionFrame){node, 0, 1};
+}
+
+#define SYMBOL_TABLE_INITIAL_CAPACITY 64
+#define SCOPE_STACK_INITIAL_CAPACITY 16
+
+// Interned ids are small consecutive integers; spread them over the table
+#define SLOT_HASH(name, mask) (((uint32_t)(name) * 2654435761u) & (mask))
 
 // Initialize symbol table
-SymbolTable *init_symbol_table() {
-    SymbolTable *table = malloc(sizeof(SymbolTable));
+SymbolTable *init_symbol_table(Arena *arena) {
+    SymbolTable *table = arena_alloc(arena, sizeof(SymbolTable));
     if (table) {
-        table->head = NULL;
+        table->capacity = SYMBOL_TABLE_INITIAL_CAPACITY;
+        table->slots = arena_calloc(arena, table->capacity * sizeof(SymbolSlot));
+        table->used = 0;
+        table->scope_capacity = SCOPE_STACK_INITIAL_CAPACITY;
+        table->scopes = arena_calloc(arena, table->scope_capacity * sizeof(Symbol *));
         table->current_scope = 0;
+        table->arena = arena;
+        table->free_list = NULL;
+        table->names = NULL;
+        table->trace = NULL;
+        table->symbols = table->lookups = table->probes = 0;
+        table->scopes_entered = table->scopes_exited = 0;
     }
     return table;
 }
 
+// Slot holding name, or the empty slot where it belongs
+static SymbolSlot *find_slot(SymbolSlot *slots, uint32_t capacity, InternId name) {
+    uint32_t mask = capacity - 1;
+    uint32_t i = SLOT_HASH(name, mask);
+    while (slots[i].name != name && slots[i].name != INTERN_NONE) {
+        i = (i + 1) & mask;
+    }
+    return &slots[i];
+}
+
+// Double the slot array once it is half full. The old array stays in the
+// arena; growth is geometric, so that wastes less than the table's size.
+static void grow_slots(SymbolTable *table) {
+    uint32_t capacity = table->capacity * 2;
+    SymbolSlot *slots = arena_calloc(table->arena, capacity * sizeof(SymbolSlot));
+    for (uint32_t i = 0; i < table->capacity; i++) {
+        if (table->slots[i].name != INTERN_NONE) {
+            *find_slot(slots, capacity, table->slots[i].name) = table->slots[i];
+        }
+    }
+    table->slots = slots;
+    table->capacity = capacity;
+}
+
 // Add symbol to table
-void add_symbol(SymbolTable *table, const char *name, VarType type, int line) {
-    Symbol *symbol = malloc(sizeof(Symbol));
+void add_symbol(SymbolTable *table, InternId name, VarType type, int line) {
+    if (name == INTERN_NONE) {
+        return;
+    }
+
+    Symbol *symbol = table->free_list;
+    if (symbol) {
+        table->free_list = symbol->scope_next;
+    } else {
+        symbol = arena_alloc(table->arena, sizeof(Symbol));
+    }
     if (symbol) {
-        strcpy(symbol->name, name);
+        symbol->name = name;
         symbol->type = type;
         symbol->scope_level = table->current_scope;
         symbol->line_declared = line;
-        symbol->is_initialized = 0;
-
-        // Add to beginning of list
-        symbol->next = table->head;
-        table->head = symbol;
-
-        printf("Added symbol: %s, Type: %s, Scope: %d, Line: %d\n", name, var_type_to_string(type), table->current_scope, line);
+        symbol->decl = AST_NONE;
+        STATS_INC(table->symbols);
+
+        // Shadow any outer declaration of the name
+        SymbolSlot *slot = find_slot(table->slots, table->capacity, name);
+        if (slot->name == INTERN_NONE) {
+            if (2 * (table->used + 1) > table->capacity) {
+                grow_slots(table);
+                slot = find_slot(table->slots, table->capacity, name);
+            }
+            slot->name = name;
+            table->used++;
+        }
+        symbol->shadowed = slot->symbol;
+        slot->symbol = symbol;
+
+        // Record it in the current scope
+        symbol->scope_next = table->scopes[table->current_scope];
+        table->scopes[table->current_scope] = symbol;
+
+        if (table->trace) {
+            size_t length;
+            Diagnostic *note = diag_add(table->trace, DIAG_NOTE, DIAG_SYMBOL, 0, line, 0, 0);
+            note->text = intern_text(table->names, name, &length);
+            note->text_length = (int)length;
+            note->args[0] = type;
+            note->args[1] = table->current_scope;
+        }
     }
 }
 
 // Look up symbol by name
-Symbol *lookup_symbol(SymbolTable *table, const char *name) {
-    Symbol *current = table->head;
-    while (current) {
-        if (strcmp(current->name, name) == 0) {
-            return current;
-        }
-        current = current->next;
+Symbol *lookup_symbol(SymbolTable *table, InternId name) {
+    if (name == INTERN_NONE) {
+        return NULL;
     }
-    return NULL;
+    STATS_INC(table->lookups);
+#if STATS
+    // find_slot, counting the slots examined
+    uint32_t mask = table->capacity - 1;
+    uint32_t i = SLOT_HASH(name, mask);
+    table->probes++;
+    while (table->slots[i].name != name && table->slots[i].name != INTERN_NONE) {
+        i = (i + 1) & mask;
+        table->probes++;
+    }
+    return table->slots[i].symbol;
+#else
+    return find_slot(table->slots, table->capacity, name)->symbol;
+#endif
 }
 
 // Look up symbol in current scope only
-Symbol *lookup_symbol_current_scope(SymbolTable *table, const char *name) {
-    Symbol *current = table->head;
-    while (current) {
-        if (strcmp(current->name, name) == 0 &&
-            current->scope_level == table->current_scope) {
-            return current;
-        }
-        current = current->next;
+Symbol *lookup_symbol_current_scope(SymbolTable *table, InternId name) {
+    Symbol *symbol = lookup_symbol(table, name);
+    if (symbol && symbol->scope_level == table->current_scope) {
+        return symbol;
     }
     return NULL;
 }
 
+// Analyzer and symbol table for the unit's AST as it stands
+static SymbolTable *start_analysis(Analyzer *sema, CompilationUnit *unit) {
+    memset(sema, 0, sizeof(*sema));
+    sema->ast = &unit->ast;
+    sema->source = unit->input.data;
+    sema->lexer = &unit->lexer;
+    sema->diags = &unit->diags;
+    sema->uninitialized = arena_calloc(&unit->arena, sema->ast->count);
+
+    SymbolTable *table = init_symbol_table(&unit->arena);
+    table->names = &unit->interner;
+    table->trace = unit->diags.trace ? &unit->diags : NULL;
+    return table;
+}
+
+// Resolve, check and release the work stacks
+static int run_analysis(Analyzer *sema, NodeId root, CompilationUnit *unit, SymbolTable *table) {
+    int result = resolve_names(sema, root, table);
+    analyze_initialization(sema, root);
+    result = check_program(sema, root) && result;
+
+#if STATS
+    Stats *stats = &unit->stats;
+    stats->symbols += table->symbols;
+    stats->lookups += table->lookups;
+    stats->probes += table->probes;
+    stats->scopes_entered += table->scopes_entered;
+    stats->scopes_exited += table->scopes_exited;
+    if (table->used > stats->peak_names) stats->peak_names = table->used;
+    if (table->capacity > stats->peak_slots) stats->peak_slots = table->capacity;
+#else
+    (void)unit;
+#endif
+
+    free(sema->resolve_stack);
+    free(sema->statement_stack);
+    free(sema->expression_stack);
+    sema->resolve_stack = NULL;
+    sema->statement_stack = NULL;
+    sema->expression_stack = NULL;
+    return result;
+}
+
 // Analyze AST semantically
-int analyze_semantics(ASTNode *ast) {
-    SymbolTable *table = init_symbol_table();
-    int result = check_program(ast, table);
-    free_symbol_table(table);
+int analyze_semantics(NodeId root, CompilationUnit *unit) {
+    Analyzer sema;
+    SymbolTable *table = start_analysis(&sema, unit);
+    return run_analysis(&sema, root, unit, table);
+}
+
+int analyze_fragment(NodeId root, CompilationUnit *unit, const OuterVariable *outer,
+                     size_t outer_count, OuterVariable **scope, size_t *scope_count) {
+    Ast *ast = &unit->ast;
+    *scope = NULL;
+    *scope_count = 0;
+    if (root == AST_NONE) return 1;
+
+    // Declare the outer variables ahead of the program's statements, the
+    // assigned ones first so their slots come first
+    NodeId first = ast->first_child[root];
+    NodeId last = AST_NONE;
+    uint32_t assigned = 0;
+    for (int pass = 1; pass >= 0; pass--) {
+        for (size_t i = 0; i < outer_count; i++) {
+            if ((outer[i].assigned != 0) != pass) continue;
+            Token token = {TOKEN_IDENTIFIER, ERROR_NONE, 0, 0, outer[i].name};
+            NodeId decl = ast_add_node(ast, AST_VARDECL, ast_add_token(ast, token));
+            ast->var_type[decl] = (uint8_t)outer[i].type;
+            if (last == AST_NONE) ast->first_child[root] = decl;
+            else ast->next_sibling[last] = decl;
+            last = decl;
+            assigned += (uint32_t)pass;
+        }
+    }
+    if (last != AST_NONE) ast->next_sibling[last] = first;
+
+    Analyzer sema;
+    SymbolTable *table = start_analysis(&sema, unit);
+    sema.assigned_slots = assigned;
+    sema.exit_assigned = arena_calloc(&unit->arena, ast->count);
+    int result = run_analysis(&sema, root, unit, table);
+
+    size_t count = 0;
+    for (Symbol *symbol = table->scopes[0]; symbol; symbol = symbol->scope_next) {
+        count++;
+    }
+    *scope = arena_alloc(&unit->arena, (count ? count : 1) * sizeof(OuterVariable));
+    for (Symbol *symbol = table->scopes[0]; symbol; symbol = symbol->scope_next) {
+        uint32_t slot = ast->binding[symbol->decl];
+        (*scope)[*scope_count].name = symbol->name;
+        (*scope)[*scope_count].type = symbol->type;
+        (*scope)[*scope_count].assigned = slot != SLOT_NONE && sema.exit_assigned[slot];
+        (*scope_count)++;
+    }
+    return result;
+}
+
+// Resolve names
+// Walks the tree once in source order with an explicit stack, declaring
+// each VARDECL in its scope and binding each IDENTIFIER to the VARDECL it
+// refers to. The checks below, and any later pass, follow the binding
+// instead of looking names up.
+int resolve_names(Analyzer *sema, NodeId root, SymbolTable *table) {
+    int result = 1;
+    uint32_t live = 0; // Slots used by the variables in scope
+
+    sema->ast->slot_count = 0;
+    if (root == AST_NONE)
+        return 1;
+    push_resolve(sema, root, 0, 0);
+
+    while (sema->resolve_count > 0) {
+        ResolveFrame frame = sema->resolve_stack[--sema->resolve_count];
+        NodeId node = frame.node;
+
+        if (frame.exit_scope) {
+            exit_scope(table);
+            live = frame.live;
+            continue;
+        }
+
+        switch (NODE_KIND(node)) {
+        case AST_VARDECL:
+            if (check_declaration(sema, node, table)) {
+                // Slots of a scope follow those of the scopes enclosing it
+                // and are reused once it ends
+                NODE_BINDING(node) = live++;
+                if (live > sema->ast->slot_count) sema->ast->slot_count = live;
+            } else {
+                NODE_BINDING(node) = SLOT_NONE;
+                result = 0;
+            }
+            break;
+        case AST_IDENTIFIER: {
+            Symbol *symbol = lookup_symbol(table, NODE_ID(node));
+            if (!symbol) {
+                semantic_error(sema->diags, SEM_ERROR_UNDECLARED_VARIABLE, NODE_SPAN(node), NODE_LINE(node));
+                result = 0;
+            } else {
+                NODE_BINDING(node) = symbol->decl;
+            }
+            break;
+        }
+        case AST_BLOCK:
+            enter_scope(table);
+            push_resolve(sema, node, 1, live);
+            break;
+        default:
+            break;
+        }
+
+        // Push the children, then reverse them so the first is visited first
+        size_t first = sema->resolve_count;
+        for (NodeId child = NODE_LEFT(node); child != AST_NONE; child = sema->ast->next_sibling[child]) {
+            push_resolve(sema, child, 0, 0);
+        }
+        for (size_t i = first, j = sema->resolve_count; i + 1 < j; i++, j--) {
+            ResolveFrame swap = sema->resolve_stack[i];
+            sema->resolve_stack[i] = sema->resolve_stack[j - 1];
+            sema->resolve_stack[j - 1] = swap;
+        }
+    }
+
     return result;
 }
 
 // Check program node
-int check_program(ASTNode *node, SymbolTable *table) {
-    if (!node)
+int check_program(Analyzer *sema, NodeId node) {
+    if (node == AST_NONE)
         return 1;
 
     int result = 1;
 
-    if (node->type == AST_PROGRAM) {
-        result = check_statement(node->next, table) && result;
+    if (NODE_KIND(node) == AST_PROGRAM) {
+        result = check_statements(sema, NODE_LEFT(node)) && result;
+    }
+
+    return result;
+}
+
+// Check a statement and the siblings following it
+int check_statements(Analyzer *sema, NodeId node) {
+    int result = 1;
+
+    for (; node != AST_NONE; node = sema->ast->next_sibling[node]) {
+        result = check_statement(sema, node) && result;
     }
 
     return result;
 }
 
 // Check statement node
-int check_statement(ASTNode *node, SymbolTable *table) {
-    if (!node)
+// Nested statements are walked with an explicit stack rather than by
+// recursion, so nesting depth is bounded by memory, not the C stack
+int check_statement(Analyzer *sema, NodeId node) {
+    if (node == AST_NONE)
         return 1;
 
     int result = 1;
+    size_t base = sema->statement_count;
+    push_statement(sema, node);
+
+    while (sema->statement_count > base) {
+        StatementFrame *frame = &sema->statement_stack[sema->statement_count - 1];
+        node = frame->node;
+
+        if (frame->started) {
+            // Resuming a statement whose nested statements are being checked
+            if (NODE_KIND(node) == AST_BLOCK) {
+                NodeId child = frame->cursor;
+                if (child != AST_NONE) {
+                    frame->cursor = sema->ast->next_sibling[child];
+                    push_statement(sema, child);
+                } else {
+                    sema->statement_count--;
+                }
+            } else {
+                // Repeat: the condition is evaluated after the body
+                result = check_expression(sema, NODE_RIGHT(node)) && result;
+                sema->statement_count--;
+            }
+            continue;
+        }
 
-    switch (node->type) {
-    case AST_VARDECL:
-        result = check_declaration(node, table) && result;
-        result = check_statement(node->next, table) && result;
-        break;
-    case AST_ASSIGN:
-        result = check_assignment(node, table) && result;
-        result = check_statement(node->next, table) && result;
-        break;
-    case AST_IF:
-        result = check_expression(node->left, table) && result;
-        result = check_statement(node->right, table) && result;
-        result = check_statement(node->next, table) && result;
-        break;
-    case AST_PRINT:
-        result = check_expression(node, table) && result;
-        result = check_statement(node->next, table);
-        break;
-    case AST_WHILE:
-        result = check_expression(node->left, table) && result;
-        result = check_statement(node->right, table) && result;
-        result = check_statement(node->next, table) && result;
-        break;
-    case AST_REPEAT: // TODO: come back to this
-        result = check_expression(node->left, table) && result;
-        result = check_statement(node->right, table) && result;
-        result = check_statement(node->next, table) && result;
-        break;
-    case AST_BLOCK:
-        enter_scope(table);
-        result = check_statement(node->next, table) && result;
-        exit_scope(table);
-        break;
-    case AST_FACTORIAL:
-        result = check_expression(node, table) && result;
-        result = check_statement(node->next, table);
-        break;
-    default:
-        semantic_error(SEM_ERROR_SEMANTIC_ERROR, "Unknown Statement", node->token.line);
-        return 0;
+        switch (NODE_KIND(node)) {
+        case AST_VARDECL:
+            // Declared by resolve_names
+            sema->statement_count--;
+            break;
+        case AST_ASSIGN:
+            result = check_assignment(sema, node) && result;
+            sema->statement_count--;
+            break;
+        case AST_IF:
+        case AST_WHILE:
+            result = check_expression(sema, NODE_LEFT(node)) && result;
+            sema->statement_count--;
+            push_statement(sema, NODE_RIGHT(node));
+            break;
+        case AST_PRINT:
+            result = check_expression(sema, NODE_LEFT(node)) && result;
+            sema->statement_count--;
+            break;
+        case AST_REPEAT:
+            frame->started = 1;
+            push_statement(sema, NODE_LEFT(node));
+            break;
+        case AST_BLOCK:
+            frame->started = 1;
+            frame->cursor = NODE_LEFT(node);
+            break;
+        case AST_FACTORIAL:
+            result = check_expression(sema, node) && result;
+            sema->statement_count--;
+            break;
+        case AST_ERROR:
+            // Already reported by the parser
+            sema->statement_count--;
+            break;
+        default: {
+            Diagnostic *diag = diag_add(sema->diags, DIAG_ERROR, DIAG_SEMANTIC, SEM_ERROR_SEMANTIC_ERROR,
+                                        NODE_LINE(node), NODE_SPAN(node));
+            diag->text = "Unknown Statement";
+            diag->text_length = 17;
+            result = 0;
+            sema->statement_count--;
+            break;
+        }
+        }
     }
 
     return result;
@@ -135,334 +453,226 @@ int check_statement(ASTNode *node, SymbolTable *table) {
 
 
 // Check declaration node
-int check_declaration(ASTNode *node, SymbolTable *table) {
-    if (node->type != AST_VARDECL) {
+// Declares the variable in the current scope and records its symbol's
+// VARDECL
+int check_declaration(Analyzer *sema, NodeId node, SymbolTable *table) {
+    if (NODE_KIND(node) != AST_VARDECL) {
         return 0;
     }
 
-    const char *name = node->token.lexeme;
-
     // Check if variable already declared in current scope
-    Symbol *existing = lookup_symbol_current_scope(table, name);
+    Symbol *existing = lookup_symbol_current_scope(table, NODE_ID(node));
     if (existing) {
-        semantic_error(SEM_ERROR_REDECLARED_VARIABLE, name, node->token.line);
+        semantic_error(sema->diags, SEM_ERROR_REDECLARED_VARIABLE, NODE_SPAN(node), NODE_LINE(node));
         return 0;
     }
 
     // Add to symbol table
-    add_symbol(table, name, node->var_type, node->token.line);
+    add_symbol(table, NODE_ID(node), (VarType)NODE_TYPE(node), NODE_LINE(node));
+    Symbol *symbol = lookup_symbol(table, NODE_ID(node));
+    if (!symbol) {
+        return 0;
+    }
+    symbol->decl = node;
     return 1;
 }
 
 // Check assignment node
-int check_assignment(ASTNode *node, SymbolTable *table) {
-    if (node->type != AST_ASSIGN || !node->left || !node->right) {
+int check_assignment(Analyzer *sema, NodeId node) {
+    NodeId target = NODE_LEFT(node);
+    if (NODE_KIND(node) != AST_ASSIGN || target == AST_NONE || NODE_RIGHT(node) == AST_NONE) {
         return 0;
     }
 
-    const char *name = node->left->token.lexeme;
-
-    Symbol *symbol = lookup_symbol(table, name);
-    if (!symbol) {
-        semantic_error(SEM_ERROR_UNDECLARED_VARIABLE, name, node->token.line);
+    // Undeclared: reported by resolve_names
+    NodeId decl = NODE_BINDING(target);
+    if (decl == AST_NONE) {
         return 0;
     }
 
     //check expression
-    int expr_valid = check_expression(node->right, table);
+    int expr_valid = check_expression(sema, NODE_RIGHT(node));
     if (!expr_valid) return 0;
 
-    //assume number since they are allowed to interchange using implicit conversion
-    VarType expr_type = TYPE_INT;
-
-    ASTNode *expr = node->right;
-    if (expr->type == AST_IDENTIFIER) {
-        Symbol *sym = lookup_symbol(table, expr->token.lexeme);
-        if (sym) expr_type = sym->type;
-    } else if (expr->type == AST_STRING_LITERAL) {
-        expr_type = TYPE_STRING;
-    } else if (expr->type == AST_NUMBER) {
-        expr_type = TYPE_INT;
-    } else if (expr->type == AST_BINOP) {
-        //handle binops
-        VarType left_type = TYPE_INT, right_type = TYPE_INT;
-
-        if (expr->left->type == AST_IDENTIFIER) {
-            Symbol *sym = lookup_symbol(table, expr->left->token.lexeme);
-            if (sym) left_type = sym->type;
-        } else if (expr->left->type == AST_STRING_LITERAL) {
-            left_type = TYPE_STRING;
-        } else if (expr->left->type == AST_NUMBER) {
-            left_type = TYPE_INT;
-        }
-
-        if (expr->right->type == AST_IDENTIFIER) {
-            Symbol *sym = lookup_symbol(table, expr->right->token.lexeme);
-            if (sym) right_type = sym->type;
-        } else if (expr->right->type == AST_STRING_LITERAL) {
-            right_type = TYPE_STRING;
-        } else if (expr->right->type == AST_NUMBER) {
-            right_type = TYPE_INT;
-        }
-
-        if (left_type == TYPE_STRING || right_type == TYPE_STRING) {
-            if (left_type == TYPE_STRING && right_type == TYPE_STRING &&
-                strcmp(expr->token.lexeme, "+") == 0) {
-                expr_type = TYPE_STRING; //string + string
-            } else {
-                semantic_error(SEM_ERROR_TYPE_MISMATCH, expr->token.lexeme, expr->token.line);
-                return 0;
-            }
-        } else {
-            //number ops are allowed to interchange (int float and char)
-            expr_type = TYPE_INT;
-        }
-    }
+    // Synthesized while checking the expression
+    VarType expr_type = NODE_TYPE(NODE_RIGHT(node));
 
     //check if type is compatible with the variable type
-    VarType var_type = symbol->type;
+    VarType var_type = NODE_TYPE(decl);
 
     if (var_type == TYPE_STRING) {
         if (expr_type != TYPE_STRING) {
-            semantic_error(SEM_ERROR_TYPE_MISMATCH, name, node->token.line);
+            semantic_error(sema->diags, SEM_ERROR_TYPE_MISMATCH, NODE_SPAN(target), NODE_LINE(node));
             return 0;
         }
     } else {
         if (expr_type == TYPE_STRING) {
-            semantic_error(SEM_ERROR_TYPE_MISMATCH, name, node->token.line);
+            semantic_error(sema->diags, SEM_ERROR_TYPE_MISMATCH, NODE_SPAN(target), NODE_LINE(node));
             return 0;
         }
     }
 
-    symbol->is_initialized = 1;
     return 1;
 }
 
-void semantic_error(SemanticErrorType error, const char *name, int line) {
-    printf("Semantic Error at line %d: ", line);
-
-    switch (error) {
-    case SEM_ERROR_UNDECLARED_VARIABLE:
-        printf("Undeclared variable '%s'\n", name);
-        break;
-    case SEM_ERROR_REDECLARED_VARIABLE:
-        printf("Variable '%s' already declared in this scope\n", name);
-        break;
-    case SEM_ERROR_TYPE_MISMATCH:
-        printf("Type mismatch involving '%s'\n", name);
-        break;
-    case SEM_ERROR_UNINITIALIZED_VARIABLE:
-        printf("Variable '%s' may be used uninitialized\n", name);
-        break;
-    case SEM_ERROR_INVALID_OPERATION:
-        printf("Invalid operation involving '%s'\n", name);
-        break;
-    default:
-        printf("Unknown semantic error with '%s'\n", name);
-    }
+void semantic_error(Diagnostics *diags, SemanticErrorType error, size_t offset, size_t length, int line) {
+    diag_add(diags, DIAG_ERROR, DIAG_SEMANTIC, error, line, offset, length);
 }
 
-void enter_scope(SymbolTable *table) { table->current_scope++; }
+void enter_scope(SymbolTable *table) {
+    STATS_INC(table->scopes_entered);
+    table->current_scope++;
+    if (table->current_scope == table->scope_capacity) {
+        // Scope stack lives in the arena too; copy it into one twice the size
+        Symbol **scopes = arena_alloc(table->arena, 2 * table->scope_capacity * sizeof(Symbol *));
+        memcpy(scopes, table->scopes, table->scope_capacity * sizeof(Symbol *));
+        table->scopes = scopes;
+        table->scope_capacity *= 2;
+    }
+    table->scopes[table->current_scope] = NULL;
+}
 
 void exit_scope(SymbolTable *table) {
+    STATS_INC(table->scopes_exited);
     remove_symbols_in_current_scope(table);
     table->current_scope--;
 }
 
-void free_symbol_table(SymbolTable *table) {
-    Symbol *current = table->head;
+void remove_symbols_in_current_scope(SymbolTable *table) {
+    Symbol *current = table->scopes[table->current_scope];
+
     while (current) {
-        Symbol *temp = current;
-        current = current->next;
-        free(temp);
+        Symbol *next = current->scope_next;
+
+        // The outer declaration, if any, becomes visible again
+        find_slot(table->slots, table->capacity, current->name)->symbol = current->shadowed;
+
+        current->scope_next = table->free_list;
+        table->free_list = current;
+        current = next;
     }
-    free(table);
+    table->scopes[table->current_scope] = NULL;
 }
 
-void remove_symbols_in_current_scope(SymbolTable *table) {
-    Symbol *current = table->head;
-    Symbol *prev = NULL;
+// Type rules of a binary operation or comparision, applied to the types
+// already synthesized for its operands; stores the node's own type
+static int check_operand_types(Analyzer *sema, NodeId node) {
+    VarType left_type = NODE_TYPE(NODE_LEFT(node));
+    VarType right_type = NODE_TYPE(NODE_RIGHT(node));
 
-    while (current) {
-        if (current->scope_level == table->current_scope) {
-            if (prev) {
-                prev->next = current->next;
-            } else {
-                table->head = current->next;
+    //number ops are allowed to interchange (int float and char)
+    NODE_TYPE(node) = TYPE_INT;
+
+    if (NODE_KIND(node) == AST_BINOP) {
+        // Handle string compatibility
+        if (left_type == TYPE_STRING || right_type == TYPE_STRING) {
+            if (!(left_type == TYPE_STRING && right_type == TYPE_STRING && sema->source[AST_START(sema->ast, node)] == '+')) {
+                semantic_error(sema->diags, SEM_ERROR_TYPE_MISMATCH, NODE_SPAN(node), NODE_LINE(node));
+                return 0;
             }
-            free(current);
-            current = (prev) ? prev->next : table->head;
-        } else {
-            prev = current;
-            current = current->next;
+            NODE_TYPE(node) = TYPE_STRING; //string + string
+        }
+    } else {
+        if ((left_type == TYPE_STRING && right_type != TYPE_STRING) ||
+            (left_type != TYPE_STRING && right_type == TYPE_STRING)) {
+            semantic_error(sema->diags, SEM_ERROR_TYPE_MISMATCH, NODE_SPAN(node), NODE_LINE(node));
+            return 0;
         }
     }
-}
 
-// check expression temporary for testing
-int check_expression(ASTNode *node, SymbolTable *table) {
-    if (!node)
-        return 1;
+    return 1;
+}
 
-    int result = 1;
+// Check a node without operands and store its type
+static int check_operand(Analyzer *sema, NodeId node) {
+    //defaults to int, because any number can work with any other number
+    NODE_TYPE(node) = TYPE_INT;
 
-    switch (node->type) {
+    switch (NODE_KIND(node)) {
         case AST_IDENTIFIER: {
-            const char *name = node->token.lexeme;
-            Symbol *symbol = lookup_symbol(table, name);
-            if (!symbol) {
-                semantic_error(SEM_ERROR_UNDECLARED_VARIABLE, name, node->token.line);
+            // Undeclared: reported by resolve_names
+            NodeId decl = NODE_BINDING(node);
+            if (decl == AST_NONE) {
                 return 0;
             }
-            if (!symbol->is_initialized) {
-                semantic_error(SEM_ERROR_UNINITIALIZED_VARIABLE, name, node->token.line);
+            NODE_TYPE(node) = NODE_TYPE(decl);
+            if (sema->uninitialized[node]) {
+                semantic_error(sema->diags, SEM_ERROR_UNINITIALIZED_VARIABLE, NODE_SPAN(node), NODE_LINE(node));
                 return 0;
             }
-            break;
+            return 1;
         }
 
         case AST_STRING_LITERAL:
+            NODE_TYPE(node) = TYPE_STRING;
+            return 1;
+
         case AST_NUMBER:
             // Literals are always valid
-            break;
-
-        //factorial function
-        case AST_FACTORIAL: {
-            result = check_expression(node->left, table);
-            break;
-        }
-
-        //binary operations and comparisions
-        case AST_BINOP: {
-            result = check_expression(node->left, table) && check_expression(node->right, table);
-            
-            //defaults to int, because any number can work with any other number
-            VarType left_type = TYPE_INT;
-            VarType right_type = TYPE_INT;
-        
-            if (node->left->type == AST_IDENTIFIER) {
-                Symbol *sym = lookup_symbol(table, node->left->token.lexeme);
-                if (sym) left_type = sym->type;
-            } else if (node->left->type == AST_STRING_LITERAL) {
-                left_type = TYPE_STRING;
-            }
-        
-            if (node->right->type == AST_IDENTIFIER) {
-                Symbol *sym = lookup_symbol(table, node->right->token.lexeme);
-                if (sym) right_type = sym->type;
-            } else if (node->right->type == AST_STRING_LITERAL) {
-                right_type = TYPE_STRING;
-            }
-        
-            // Handle string compatibility
-            if (left_type == TYPE_STRING || right_type == TYPE_STRING) {
-                if (!(left_type == TYPE_STRING && right_type == TYPE_STRING && strcmp(node->token.lexeme, "+") == 0)) {
-                    semantic_error(SEM_ERROR_TYPE_MISMATCH, node->token.lexeme, node->token.line);
-                    result = 0;
-                }
-            }
-        
-            break;
-        }
-
-        case AST_CONDITION:
-            result = check_expression(node->left, table);
-            break;
-
-            case AST_COMPARISON: {
-                result = check_expression(node->left, table) && check_expression(node->right, table);
-            
-                VarType left_type = TYPE_INT;
-                VarType right_type = TYPE_INT;
-            
-                if (node->left->type == AST_IDENTIFIER) {
-                    Symbol *sym = lookup_symbol(table, node->left->token.lexeme);
-                    if (sym) left_type = sym->type;
-                } else if (node->left->type == AST_STRING_LITERAL) {
-                    left_type = TYPE_STRING;
-                }
-            
-                if (node->right->type == AST_IDENTIFIER) {
-                    Symbol *sym = lookup_symbol(table, node->right->token.lexeme);
-                    if (sym) right_type = sym->type;
-                } else if (node->right->type == AST_STRING_LITERAL) {
-                    right_type = TYPE_STRING;
-                }
-            
-                if ((left_type == TYPE_STRING && right_type != TYPE_STRING) ||
-                    (left_type != TYPE_STRING && right_type == TYPE_STRING)) {
-                    semantic_error(SEM_ERROR_TYPE_MISMATCH, node->token.lexeme, node->token.line);
-                    result = 0;
-                }
-            
-                break;
-        }
+            return 1;
 
         default:
-            semantic_error(SEM_ERROR_INVALID_OPERATION, node->token.lexeme, node->token.line);
+            semantic_error(sema->diags, SEM_ERROR_INVALID_OPERATION, NODE_SPAN(node), NODE_LINE(node));
             return 0;
     }
-
-    // printf("Checked expression: %s, Result: %d\n", node->token.lexeme, result);
-
-    return result;
 }
 
-char *read_file(const char *filename) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        perror("Error opening file");
-        return NULL;
-    }
-
-    fseek(file, 0, SEEK_END);
-    long length = ftell(file);
-    fseek(file, 0, SEEK_SET);
-
-    char *buffer = (char *)malloc(length + 1);
-    if (!buffer) {
-        perror("Memory allocation failed");
-        fclose(file);
-        return NULL;
-    }
-
-    fread(buffer, 1, length, file);
-    buffer[length] = '\0';
-    fclose(file);
-
-    //remove carriagre returns, keep only \n
-    char *src = buffer, *dst = buffer;
-    while (*src) {
-        if (*src != '\r') {
-            *dst++ = *src;
+// check expression temporary for testing
+// Checks and types the expression in one post-order walk: every node's type
+// is synthesized once, from its operands' cached types, and stored in its
+// var_type column. The walk uses an explicit stack, so long operator chains
+// and deep parenthesisation do not recurse.
+int check_expression(Analyzer *sema, NodeId node) {
+    int result = 1; // Result of the most recently finished node
+    size_t base = sema->expression_count;
+    push_expression(sema, node);
+
+    while (sema->expression_count > base) {
+        ExpressionFrame *frame = &sema->expression_stack[sema->expression_count - 1];
+        node = frame->node;
+
+        if (node == AST_NONE) {
+            result = 1;
+            sema->expression_count--;
+            continue;
+        }
+        if (frame->state > 0) {
+            // An operand just finished
+            frame->result = frame->result && result;
         }
-        src++;
-    }
-    *dst = '\0';
-
-    return buffer;
-}
-
-int main() {
-    char *sem_input = read_file(SEMANTIC_INPUT_FILE);
-
-    if (sem_input) {
-        parser_init(sem_input);
-        ASTNode *ast = parse();
 
-        // print_ast(ast, 0);
+        switch (NODE_KIND(node)) {
+            //factorial function and conditions
+            case AST_FACTORIAL:
+            case AST_CONDITION:
+                if (frame->state == 0) {
+                    frame->state = 1;
+                    push_expression(sema, NODE_LEFT(node));
+                    continue;
+                }
+                NODE_TYPE(node) = NODE_KIND(node) == AST_FACTORIAL ? TYPE_INT : NODE_TYPE(NODE_LEFT(node));
+                break;
 
-        int result = analyze_semantics(ast);
+            //binary operations and comparisions
+            case AST_BINOP:
+            case AST_COMPARISON:
+                if (frame->state < 2) {
+                    frame->state++;
+                    push_expression(sema, frame->state == 1 ? NODE_LEFT(node) : NODE_RIGHT(node));
+                    continue;
+                }
+                if (!check_operand_types(sema, node)) frame->result = 0;
+                break;
 
-        if (result) {
-            printf("Semantic analysis passed.\n");
-        } else {
-            printf("Semantic analysis failed.\n");
+            default:
+                frame->result = check_operand(sema, node);
         }
 
-        free_ast(ast);
-        free(sem_input);
+        // printf("Checked expression: %.*s, Result: %d\n", NODE_SPAN(node), frame->result);
+
+        result = frame->result;
+        sema->expression_count--;
     }
 
-    return 0;
+    return result;
 }
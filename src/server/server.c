@@ -0,0 +1,433 @@
+/* server.c
+ * Compile server and its client; see server.h for the protocol.
+ *
+ * The server's workers all accept on the one listening socket, and each
+ * serves a connection from start to end with its own CompilationUnit and
+ * buffers, which are reused from request to request and connection to
+ * connection.
+ */
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../../include/server.h"
+
+// Longest header line accepted
+#define SERVER_MAX_HEADER (PATH_MAX * 2 + 256)
+
+#define SERVER_BUFFER_SIZE (64 * 1024)
+
+// Longest reply the client takes: a program run through the server may
+// print more than its source holds
+#define SERVER_MAX_REPLY ((size_t)1 << 30)
+
+// One end of a connection: bytes read but not yet consumed are
+// buffer[start] to buffer[end - 1]
+typedef struct {
+    int fd;
+    char *buffer;
+    size_t start, end, capacity;
+    char *body;            // Source of a request, or a reply's output
+    size_t body_capacity;
+} Connection;
+
+typedef struct {
+    int listen_fd;
+    pthread_t thread;
+    CompilationUnit unit;
+    Connection connection;
+} Worker;
+
+static void *checked_realloc(void *ptr, size_t size) {
+    ptr = realloc(ptr, size);
+    if (!ptr) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    return ptr;
+}
+
+static void connection_init(Connection *connection, int fd) {
+    memset(connection, 0, sizeof(Connection));
+    connection->fd = fd;
+    connection->capacity = SERVER_BUFFER_SIZE;
+    connection->buffer = checked_realloc(NULL, connection->capacity);
+}
+
+static void connection_free(Connection *connection) {
+    free(connection->buffer);
+    free(connection->body);
+}
+
+// Next line, without its LF; NULL at the end of the stream, on an error or
+// if the line is longer than SERVER_MAX_HEADER
+static char *read_line(Connection *connection) {
+    size_t scanned = connection->start;
+    for (;;) {
+        char *newline = memchr(connection->buffer + scanned, '\n', connection->end - scanned);
+        if (newline) {
+            char *line = connection->buffer + connection->start;
+            *newline = '\0';
+            connection->start = (size_t)(newline - connection->buffer) + 1;
+            return line;
+        }
+        if (connection->end - connection->start >= SERVER_MAX_HEADER) return NULL;
+
+        // Move what is left to the front to make room
+        if (connection->start > 0) {
+            size_t left = connection->end - connection->start;
+            memmove(connection->buffer, connection->buffer + connection->start, left);
+            connection->start = 0;
+            connection->end = left;
+        }
+        scanned = connection->end;
+        ssize_t n = read(connection->fd, connection->buffer + connection->end,
+                         connection->capacity - connection->end);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return NULL;
+        connection->end += (size_t)n;
+    }
+}
+
+// Read length bytes into the body buffer, NUL-terminated, growing it as
+// needed. Returns 0 on success; EFBIG if length is over limit and ENOMEM if
+// the memory is not there, which only the message asking for it should pay
+// for; -1 if the connection failed. Leaves the buffer in place, so a line
+// just read stays valid.
+static int read_body(Connection *connection, size_t length, size_t limit) {
+    if (length > limit) return EFBIG;
+    if (length + 1 > connection->body_capacity) {
+        char *body = realloc(connection->body, length + 1);
+        if (!body) return ENOMEM;
+        connection->body = body;
+        connection->body_capacity = length + 1;
+    }
+
+    size_t have = connection->end - connection->start;
+    if (have > length) have = length;
+    memcpy(connection->body, connection->buffer + connection->start, have);
+    connection->start += have;
+
+    while (have < length) {
+        ssize_t n = read(connection->fd, connection->body + have, length - have);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        have += (size_t)n;
+    }
+    connection->body[length] = '\0';
+    return 0;
+}
+
+// Write a header line of tab-separated fields, and then body, in as few
+// system calls as the socket allows
+static int write_message(int fd, const char *const *fields, int count, const char *body,
+                         size_t length) {
+    char header[SERVER_MAX_HEADER + 1];
+    size_t header_length = 0;
+    for (int i = 0; i < count; i++) {
+        size_t field_length = strlen(fields[i]);
+        if (header_length + field_length + 1 > sizeof(header)) return -1;
+        memcpy(header + header_length, fields[i], field_length);
+        header_length += field_length;
+        header[header_length++] = i + 1 < count ? '\t' : '\n';
+    }
+
+    struct iovec parts[2] = {{header, header_length}, {(void *)body, length}};
+    struct msghdr message = {0};
+    message.msg_iov = parts;
+    message.msg_iovlen = 2;
+    while (parts[0].iov_len + parts[1].iov_len > 0) {
+        ssize_t n = sendmsg(fd, &message, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        // Skip what was sent
+        for (int i = 0; i < 2; i++) {
+            size_t sent = (size_t)n < parts[i].iov_len ? (size_t)n : parts[i].iov_len;
+            parts[i].iov_base = (char *)parts[i].iov_base + sent;
+            parts[i].iov_len -= sent;
+            n -= (ssize_t)sent;
+        }
+    }
+    return 0;
+}
+
+static int reply(Connection *connection, const char *status, const char *body, size_t length) {
+    char size[32];
+    snprintf(size, sizeof(size), "%zu", length);
+    const char *fields[] = {status, size};
+    return write_message(connection->fd, fields, 2, body, length);
+}
+
+// Split line at its first count - 1 tabs; returns 0 unless there are
+// exactly that many fields
+static int split_fields(char *line, char **fields, int count) {
+    for (int i = 0; i < count; i++) {
+        fields[i] = line;
+        if (i + 1 == count) return strchr(line, '\t') ? -1 : 0;
+        line = strchr(line, '\t');
+        if (!line) return -1;
+        *line++ = '\0';
+    }
+    return 0;
+}
+
+// Parse the options field of a request; returns 0 on success
+static int parse_options(char *field, Options *options) {
+    char *save;
+    *options = (Options){DIAG_FORMAT_TEXT, 0, BACKEND_NONE, STATS_OFF, NULL};
+    for (char *arg = strtok_r(field, " ", &save); arg; arg = strtok_r(NULL, " ", &save)) {
+        if (!check_option(arg, options)) return -1;
+    }
+    // Timings would only pile up on the worker
+    options->stats = STATS_OFF;
+    return 0;
+}
+
+// Answer one request; returns 0 once the connection is to be closed
+static int serve_request(Worker *worker) {
+    Connection *connection = &worker->connection;
+    char *line = read_line(connection);
+    if (!line) return 0;
+
+    static const char malformed[] = "malformed request";
+    static const char too_long[] = "source too long";
+    char *fields[4];
+    Options options;
+    if (split_fields(line, fields, 4) != 0 || parse_options(fields[1], &options) != 0) {
+        reply(connection, "error", malformed, sizeof(malformed) - 1);
+        return 0;
+    }
+
+    const char *name = fields[2];
+    if (strcmp(fields[0], "check") == 0) {
+        if (unit_load(&worker->unit, fields[3]) != 0) {
+            const char *message = strerror(errno ? errno : EIO);
+            return reply(connection, "error", message, strlen(message)) == 0;
+        }
+    } else if (strcmp(fields[0], "source") == 0) {
+        char *end;
+        errno = 0;
+        unsigned long long length = strtoull(fields[3], &end, 10);
+        if (fields[3][0] < '0' || fields[3][0] > '9' || *end != '\0' || errno) {
+            reply(connection, "error", malformed, sizeof(malformed) - 1);
+            return 0;
+        }
+        size_t size = length > SERVER_MAX_SOURCE ? SERVER_MAX_SOURCE + 1 : (size_t)length;
+        int result = read_body(connection, size, SERVER_MAX_SOURCE);
+        if (result > 0) {
+            const char *message = result == EFBIG ? too_long : strerror(result);
+            reply(connection, "error", message, strlen(message));
+        }
+        if (result != 0) return 0;
+        unit_load_source(&worker->unit, connection->body, size);
+    } else {
+        reply(connection, "error", malformed, sizeof(malformed) - 1);
+        return 0;
+    }
+
+    char *output;
+    size_t output_length;
+    int failed = check_unit(&worker->unit, name, &options, &output, &output_length);
+    int sent = reply(connection, failed ? "failed" : "passed", output, output_length);
+    free(output);
+    return sent == 0;
+}
+
+static void *server_worker(void *arg) {
+    Worker *worker = arg;
+    unit_init(&worker->unit);
+    connection_init(&worker->connection, -1);
+
+    for (;;) {
+        int fd = accept(worker->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+        worker->connection.fd = fd;
+        worker->connection.start = worker->connection.end = 0;
+        while (serve_request(worker)) {
+        }
+        close(fd);
+    }
+    return NULL;
+}
+
+static int socket_address(const char *socket_path, struct sockaddr_un *address) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address->sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socket_path);
+        return -1;
+    }
+    strcpy(address->sun_path, socket_path);
+    return 0;
+}
+
+// Is a server listening at address? Leaves errno as it was.
+static int socket_live(const struct sockaddr_un *address) {
+    int saved_errno = errno;
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    int live = probe >= 0 && connect(probe, (const struct sockaddr *)address, sizeof(*address)) == 0;
+    if (probe >= 0) close(probe);
+    errno = saved_errno;
+    return live;
+}
+
+// Bind a listening socket at socket_path, replacing a socket left behind
+// by a server that is gone; returns the socket or -1
+static int listen_socket(const char *socket_path) {
+    struct sockaddr_un address;
+    if (socket_address(socket_path, &address) != 0) return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        fprintf(stderr, "Could not create socket: %s\n", strerror(errno));
+        return -1;
+    }
+    int bound = bind(fd, (struct sockaddr *)&address, sizeof(address)) == 0;
+    if (!bound && errno == EADDRINUSE && !socket_live(&address)) {
+        unlink(socket_path);
+        bound = bind(fd, (struct sockaddr *)&address, sizeof(address)) == 0;
+    }
+    if (!bound || listen(fd, SOMAXCONN) != 0) {
+        fprintf(stderr, "Could not listen on %s: %s\n", socket_path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int server_run(const char *socket_path, int worker_count) {
+    // The main thread alone takes the signals that stop the server
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    int fd = listen_socket(socket_path);
+    if (fd < 0) return 1;
+    if (worker_count < 1) worker_count = 1;
+
+    Worker *workers = checked_realloc(NULL, worker_count * sizeof(Worker));
+    for (int i = 0; i < worker_count; i++) {
+        workers[i].listen_fd = fd;
+        if (pthread_create(&workers[i].thread, NULL, server_worker, &workers[i]) != 0) {
+            fprintf(stderr, "Could not start worker thread\n");
+            exit(1);
+        }
+    }
+
+    int received;
+    sigwait(&signals, &received);
+
+    // Workers may be in the middle of a connection, so they are not joined:
+    // the process exits under them
+    unlink(socket_path);
+    return 0;
+}
+
+// Client
+
+// Options as the space-separated field of a request
+static void format_options(const Options *options, char *field, size_t size) {
+    static const char *const backends[] = {"", " --run", " --jit", " --emit-c", " --dump-ir"};
+    snprintf(field, size, "%s%s%s", options->quiet ? "-q" : "",
+             options->format == DIAG_FORMAT_JSONL ? " --format=jsonl" : "", backends[options->backend]);
+}
+
+// Send a request for path, then read the reply's status and its output
+// into the body buffer. Returns 0 on success, or an errno describing why
+// path could not be sent; -1 if the connection failed, or minus an errno
+// if the reply could not be read, which leaves the connection unusable too.
+static int request(Connection *connection, const char *options, const char *path, char *status,
+                   size_t *length) {
+    if (strchr(path, '\t') || strchr(path, '\n')) return EINVAL;
+
+    int sent;
+    if (strcmp(path, "-") == 0) {
+        SourceInput input;
+        if (input_open(&input, "-") != 0) return errno ? errno : EIO;
+        char size[32];
+        snprintf(size, sizeof(size), "%zu", input.length);
+        const char *fields[] = {"source", options, path, size};
+        sent = write_message(connection->fd, fields, 4, input.data, input.length);
+        input_close(&input);
+    } else {
+        // The server has its own working directory
+        char resolved[PATH_MAX];
+        if (!realpath(path, resolved)) return errno;
+        const char *fields[] = {"check", options, path, resolved};
+        sent = write_message(connection->fd, fields, 4, "", 0);
+    }
+    if (sent != 0) return -1;
+
+    char *line = read_line(connection);
+    char *fields[2];
+    if (!line || split_fields(line, fields, 2) != 0 || strlen(fields[0]) >= 16) return -1;
+    strcpy(status, fields[0]);
+    char *end;
+    errno = 0;
+    unsigned long long reply_length = strtoull(fields[1], &end, 10);
+    if (fields[1][0] < '0' || fields[1][0] > '9' || *end != '\0' || errno) return -1;
+    *length = reply_length > SERVER_MAX_REPLY ? SERVER_MAX_REPLY + 1 : (size_t)reply_length;
+    int result = read_body(connection, *length, SERVER_MAX_REPLY);
+    return result > 0 ? -result : result;
+}
+
+int client_run(const char *socket_path, char *const *paths, size_t count, const Options *options) {
+    struct sockaddr_un address;
+    if (socket_address(socket_path, &address) != 0) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        fprintf(stderr, "Could not connect to %s: %s\n", socket_path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+
+    Connection connection;
+    connection_init(&connection, fd);
+    char option_field[64];
+    format_options(options, option_field, sizeof(option_field));
+
+    int failures = 0;
+    for (size_t i = 0; i < count; i++) {
+        char status[16];
+        size_t length;
+        int error = request(&connection, option_field, paths[i], status, &length);
+        if (error < 0) {
+            fflush(stdout);
+            if (error == -1) fprintf(stderr, "Lost connection to %s\n", socket_path);
+            else fprintf(stderr, "Could not read reply from %s: %s\n", socket_path,
+                         error == -EFBIG ? "reply too long" : strerror(-error));
+            failures = -1;
+            break;
+        }
+
+        if (count > 1 && options->format == DIAG_FORMAT_TEXT) {
+            printf("== %s ==\n", paths[i]);
+        }
+        if (error == 0 && strcmp(status, "error") != 0) {
+            fwrite(connection.body, 1, length, stdout);
+            if (options->backend != BACKEND_NONE && strcmp(status, "failed") == 0) failures++;
+        } else {
+            fflush(stdout);
+            fprintf(stderr, "Error reading file %s: %s\n", paths[i],
+                    error ? strerror(error) : connection.body);
+            failures++;
+        }
+    }
+    connection_free(&connection);
+    close(fd);
+    return failures;
+}
@@ -0,0 +1,145 @@
+/* stats.c */
+#include <time.h>
+
+#include "../../include/stats.h"
+
+static const char *phase_names[PHASE_COUNT] = {
+    [PHASE_LOAD] = "load",
+    [PHASE_CACHE] = "cache",
+    [PHASE_PARSE] = "lex+parse",
+    [PHASE_ANALYZE] = "analyze",
+    [PHASE_RUN] = "run",
+    [PHASE_RENDER] = "render",
+};
+
+static double seconds(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+StatsTime stats_now(void) {
+    StatsTime t;
+    t.wall = seconds(CLOCK_MONOTONIC);
+    t.cpu = seconds(CLOCK_THREAD_CPUTIME_ID);
+    return t;
+}
+
+void stats_phase(Stats *stats, Phase phase, StatsTime *since) {
+    StatsTime now = stats_now();
+    stats->wall[phase] += now.wall - since->wall;
+    stats->cpu[phase] += now.cpu - since->cpu;
+    *since = now;
+}
+
+void stats_count_ast(Stats *stats, const Ast *ast) {
+    // Slot 0 is AST_NONE, not a node
+    for (uint32_t node = 1; node < ast->count; node++) {
+        if (ast->kind[node] < AST_KIND_COUNT) {
+            stats->nodes[ast->kind[node]]++;
+        }
+    }
+    size_t bytes = ast_memory(ast);
+    if (bytes > stats->peak_ast_bytes) stats->peak_ast_bytes = bytes;
+}
+
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+void stats_merge(Stats *into, const Stats *from) {
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        into->wall[i] += from->wall[i];
+        into->cpu[i] += from->cpu[i];
+    }
+    into->files += from->files;
+    into->tokens += from->tokens;
+    for (int i = 0; i < AST_KIND_COUNT; i++) {
+        into->nodes[i] += from->nodes[i];
+    }
+    into->peak_ast_bytes = MAX(into->peak_ast_bytes, from->peak_ast_bytes);
+    into->symbols += from->symbols;
+    into->peak_names = MAX(into->peak_names, from->peak_names);
+    into->peak_slots = MAX(into->peak_slots, from->peak_slots);
+    into->lookups += from->lookups;
+    into->probes += from->probes;
+    into->scopes_entered += from->scopes_entered;
+    into->scopes_exited += from->scopes_exited;
+    into->cache_hits += from->cache_hits;
+    into->cache_misses += from->cache_misses;
+    into->cache_evicted += from->cache_evicted;
+    into->cache_evicted_bytes += from->cache_evicted_bytes;
+}
+
+static uint64_t total_nodes(const Stats *stats) {
+    uint64_t total = 0;
+    for (int i = 0; i < AST_KIND_COUNT; i++) total += stats->nodes[i];
+    return total;
+}
+
+#if STATS
+static double average_probes(const Stats *stats) {
+    return stats->lookups ? (double)stats->probes / stats->lookups : 0.0;
+}
+#endif
+
+void stats_print_text(const Stats *stats, double elapsed, FILE *out) {
+    fprintf(out, "Files:            %llu\n", (unsigned long long)stats->files);
+    fprintf(out, "Elapsed:          %.3f s\n", elapsed);
+    fprintf(out, "Phase                wall (s)    cpu (s)\n");
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        fprintf(out, "  %-16s %10.3f %10.3f\n", phase_names[i], stats->wall[i], stats->cpu[i]);
+    }
+    fprintf(out, "Tokens:           %llu\n", (unsigned long long)stats->tokens);
+    fprintf(out, "AST nodes:        %llu\n", (unsigned long long)total_nodes(stats));
+    for (int i = 0; i < AST_KIND_COUNT; i++) {
+        if (stats->nodes[i]) {
+            fprintf(out, "  %-16s %llu\n", ast_kind_name((ASTNodeType)i), (unsigned long long)stats->nodes[i]);
+        }
+    }
+    fprintf(out, "Peak AST bytes:   %zu\n", stats->peak_ast_bytes);
+    uint64_t lookups = stats->cache_hits + stats->cache_misses;
+    if (lookups) {
+        fprintf(out, "Cache:            %llu hits, %llu misses (%.1f%% hit), %llu evicted (%llu bytes)\n",
+                (unsigned long long)stats->cache_hits, (unsigned long long)stats->cache_misses,
+                100.0 * (double)stats->cache_hits / (double)lookups, (unsigned long long)stats->cache_evicted,
+                (unsigned long long)stats->cache_evicted_bytes);
+    }
+#if STATS
+    fprintf(out, "Symbols:          %llu (peak %llu names in %llu slots)\n",
+            (unsigned long long)stats->symbols, (unsigned long long)stats->peak_names,
+            (unsigned long long)stats->peak_slots);
+    fprintf(out, "Lookups:          %llu (%.2f probes on average)\n",
+            (unsigned long long)stats->lookups, average_probes(stats));
+    fprintf(out, "Scopes:           %llu entered, %llu exited\n",
+            (unsigned long long)stats->scopes_entered, (unsigned long long)stats->scopes_exited);
+#else
+    fprintf(out, "Symbol counters:  disabled (built with STATS=0)\n");
+#endif
+}
+
+void stats_print_json(const Stats *stats, double elapsed, FILE *out) {
+    fprintf(out, "{\"files\":%llu,\"elapsed\":%.6f,\"phases\":{", (unsigned long long)stats->files, elapsed);
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        fprintf(out, "%s\"%s\":{\"wall\":%.6f,\"cpu\":%.6f}", i ? "," : "", phase_names[i],
+                stats->wall[i], stats->cpu[i]);
+    }
+    fprintf(out, "}");
+    fprintf(out, ",\"tokens\":%llu,\"nodes\":{\"total\":%llu", (unsigned long long)stats->tokens,
+            (unsigned long long)total_nodes(stats));
+    for (int i = 0; i < AST_KIND_COUNT; i++) {
+        fprintf(out, ",\"%s\":%llu", ast_kind_name((ASTNodeType)i), (unsigned long long)stats->nodes[i]);
+    }
+    fprintf(out, "},\"peak_ast_bytes\":%zu", stats->peak_ast_bytes);
+    fprintf(out, ",\"cache\":{\"hits\":%llu,\"misses\":%llu,\"evicted\":%llu,\"evicted_bytes\":%llu}",
+            (unsigned long long)stats->cache_hits, (unsigned long long)stats->cache_misses,
+            (unsigned long long)stats->cache_evicted, (unsigned long long)stats->cache_evicted_bytes);
+#if STATS
+    fprintf(out, ",\"symbols\":{\"declared\":%llu,\"peak_names\":%llu,\"peak_slots\":%llu,"
+                 "\"lookups\":%llu,\"probes\":%llu,\"average_probes\":%.4f}",
+            (unsigned long long)stats->symbols, (unsigned long long)stats->peak_names,
+            (unsigned long long)stats->peak_slots, (unsigned long long)stats->lookups,
+            (unsigned long long)stats->probes, average_probes(stats));
+    fprintf(out, ",\"scopes\":{\"entered\":%llu,\"exited\":%llu}",
+            (unsigned long long)stats->scopes_entered, (unsigned long long)stats->scopes_exited);
+#endif
+    fprintf(out, "}\n");
+}
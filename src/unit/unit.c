@@ -0,0 +1,54 @@
+/* unit.c */
+#include <string.h>
+
+#include "../../include/unit.h"
+
+void unit_init(CompilationUnit *unit) {
+    arena_init(&unit->arena);
+    intern_init(&unit->interner, &unit->arena);
+    ast_init(&unit->ast);
+    lexer_init(&unit->lexer, "", NULL);
+    diag_init(&unit->diags);
+    memset(&unit->stats, 0, sizeof(unit->stats));
+    unit->loaded = 0;
+}
+
+int unit_load(CompilationUnit *unit, const char *path) {
+    unit_reset(unit);
+    if (input_open(&unit->input, path) != 0) {
+        return -1;
+    }
+    lexer_init(&unit->lexer, unit->input.data, &unit->interner);
+    diag_reset(&unit->diags, unit->input.data);
+    unit->loaded = 1;
+    return 0;
+}
+
+void unit_load_source(CompilationUnit *unit, const char *source, size_t length) {
+    unit_reset(unit);
+    input_borrow(&unit->input, source, length);
+    lexer_init(&unit->lexer, unit->input.data, &unit->interner);
+    diag_reset(&unit->diags, unit->input.data);
+    unit->loaded = 1;
+}
+
+void unit_reset(CompilationUnit *unit) {
+    if (unit->loaded) {
+        input_close(&unit->input);
+        unit->loaded = 0;
+    }
+    lexer_free(&unit->lexer);
+    lexer_init(&unit->lexer, "", NULL);
+    diag_reset(&unit->diags, NULL);
+    ast_reset(&unit->ast);
+    intern_reset(&unit->interner);
+    arena_reset(&unit->arena);
+}
+
+void unit_free(CompilationUnit *unit) {
+    unit_reset(unit);
+    ast_free(&unit->ast);
+    diag_free(&unit->diags);
+    intern_free(&unit->interner);
+    arena_free(&unit->arena);
+}
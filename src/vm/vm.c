@@ -0,0 +1,245 @@
+/* vm.c
+ * Stack VM for the bytecode in bytecode.h.
+ *
+ * Dispatch is threaded through a table of label addresses (computed goto)
+ * where the compiler supports it, so every instruction ends in its own
+ * indirect jump; elsewhere it falls back to a switch in a loop.
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/vm.h"
+
+#if defined(__GNUC__)
+#define VM_COMPUTED_GOTO 1
+#else
+#define VM_COMPUTED_GOTO 0
+#endif
+
+static uint32_t read_operand(const uint8_t *code) {
+    return (uint32_t)code[0] | (uint32_t)code[1] << 8 | (uint32_t)code[2] << 16 | (uint32_t)code[3] << 24;
+}
+
+int64_t vm_factorial(int64_t n) {
+    // 66! and above are multiples of 2^64, so they wrap around to 0
+    if (n >= 66) return 0;
+    uint64_t result = 1;
+    for (int64_t i = 2; i <= n; i++) result *= (uint64_t)i;
+    return (int64_t)result;
+}
+
+int64_t vm_float_to_int(double f) {
+    if (f != f) return 0;
+    if (f >= 9223372036854775807.0) return INT64_MAX;
+    if (f <= -9223372036854775808.0) return INT64_MIN;
+    return (int64_t)f;
+}
+
+static size_t string_length(const VmString *s) {
+    return s ? s->length : 0;
+}
+
+int vm_compare_strings(const VmString *a, const VmString *b) {
+    size_t a_length = string_length(a), b_length = string_length(b);
+    size_t length = a_length < b_length ? a_length : b_length;
+    int order = length ? memcmp(a->bytes, b->bytes, length) : 0;
+    if (order != 0) return order;
+    return (a_length > b_length) - (a_length < b_length);
+}
+
+static const VmString *concat(Arena *arena, const VmString *a, const VmString *b) {
+    size_t a_length = string_length(a), b_length = string_length(b);
+    if (b_length == 0) return a;
+    if (a_length == 0) return b;
+    VmString *result = arena_alloc(arena, sizeof(VmString) + a_length + b_length + 1);
+    result->length = a_length + b_length;
+    memcpy(result->bytes, a->bytes, a_length);
+    memcpy(result->bytes + a_length, b->bytes, b_length);
+    result->bytes[result->length] = '\0';
+    return result;
+}
+
+static void runtime_error(const Chunk *chunk, uint32_t offset, RuntimeError error, Diagnostics *diags) {
+    const LineEntry *position = chunk_line(chunk, offset);
+    if (position) {
+        diag_add(diags, DIAG_ERROR, DIAG_RUNTIME, error, position->line, position->start, position->length);
+    } else {
+        diag_add(diags, DIAG_ERROR, DIAG_RUNTIME, error, 0, 0, 0);
+    }
+}
+
+int vm_run(const Chunk *chunk, FILE *out, Diagnostics *diags) {
+    // Frame slots, then the operand stack
+    Value *slots = calloc((size_t)chunk->slot_count + chunk->max_stack + 1, sizeof(Value));
+    if (!slots) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    Value *sp = slots + chunk->slot_count;   // Next free stack entry
+    const Value *constants = chunk->constants;
+    const uint8_t *code = chunk->code;
+    const uint8_t *pc = code;
+    Arena strings;                           // Strings built while running
+    int completed = 0;
+
+    arena_init(&strings);
+
+#define OPERAND() (pc += 4, read_operand(pc - 4))
+#define TOP (sp[-1])
+
+#if VM_COMPUTED_GOTO
+    static const void *labels[OPCODE_COUNT] = {
+#define OPCODE(name) &&do_##name,
+#include "../../include/opcodes.def"
+    };
+#define DISPATCH() goto *labels[*pc++]
+#define CASE(name) do_##name:
+    DISPATCH();
+#else
+#define DISPATCH() goto dispatch
+#define CASE(name) case name:
+dispatch:
+    switch ((Opcode)*pc++) {
+#endif
+
+    CASE(OP_HALT)
+        completed = 1;
+        goto done;
+
+    CASE(OP_CONST)
+        *sp++ = constants[OPERAND()];
+        DISPATCH();
+    CASE(OP_LOAD)
+        *sp++ = slots[OPERAND()];
+        DISPATCH();
+    CASE(OP_STORE)
+        slots[OPERAND()] = *--sp;
+        DISPATCH();
+
+    CASE(OP_INT_TO_FLOAT)
+        TOP.f = (double)TOP.i;
+        DISPATCH();
+    CASE(OP_FLOAT_TO_INT)
+        TOP.i = vm_float_to_int(TOP.f);
+        DISPATCH();
+    CASE(OP_TO_CHAR)
+        TOP.i = (signed char)TOP.i;
+        DISPATCH();
+
+    // Integer arithmetic wraps around, computed unsigned to stay defined
+#define INT_OP(name, op)                                                     \
+    CASE(name)                                                               \
+        sp--;                                                                \
+        TOP.i = (int64_t)((uint64_t)TOP.i op (uint64_t)sp->i);               \
+        DISPATCH();
+    INT_OP(OP_ADD_INT, +)
+    INT_OP(OP_SUB_INT, -)
+    INT_OP(OP_MUL_INT, *)
+    CASE(OP_DIV_INT)
+        sp--;
+        if (sp->i == 0) {
+            runtime_error(chunk, (uint32_t)(pc - 1 - code), RUNTIME_ERROR_DIVISION_BY_ZERO, diags);
+            goto done;
+        }
+        // INT64_MIN / -1 overflows; it wraps to INT64_MIN
+        TOP.i = sp->i == -1 ? (int64_t)(0 - (uint64_t)TOP.i) : TOP.i / sp->i;
+        DISPATCH();
+
+#define FLOAT_OP(name, op)                                                   \
+    CASE(name)                                                               \
+        sp--;                                                                \
+        TOP.f = TOP.f op sp->f;                                              \
+        DISPATCH();
+    FLOAT_OP(OP_ADD_FLOAT, +)
+    FLOAT_OP(OP_SUB_FLOAT, -)
+    FLOAT_OP(OP_MUL_FLOAT, *)
+    FLOAT_OP(OP_DIV_FLOAT, /)
+
+    CASE(OP_CONCAT)
+        sp--;
+        TOP.s = concat(&strings, TOP.s, sp->s);
+        DISPATCH();
+
+#define COMPARE_OP(name, member, op)                                         \
+    CASE(name)                                                               \
+        sp--;                                                                \
+        TOP.i = TOP.member op sp->member;                                    \
+        DISPATCH();
+#define COMPARE_STRING_OP(name, op)                                          \
+    CASE(name)                                                               \
+        sp--;                                                                \
+        TOP.i = vm_compare_strings(TOP.s, sp->s) op 0;                          \
+        DISPATCH();
+    COMPARE_OP(OP_LT_INT, i, <)
+    COMPARE_OP(OP_LE_INT, i, <=)
+    COMPARE_OP(OP_GT_INT, i, >)
+    COMPARE_OP(OP_GE_INT, i, >=)
+    COMPARE_OP(OP_EQ_INT, i, ==)
+    COMPARE_OP(OP_NE_INT, i, !=)
+    COMPARE_OP(OP_LT_FLOAT, f, <)
+    COMPARE_OP(OP_LE_FLOAT, f, <=)
+    COMPARE_OP(OP_GT_FLOAT, f, >)
+    COMPARE_OP(OP_GE_FLOAT, f, >=)
+    COMPARE_OP(OP_EQ_FLOAT, f, ==)
+    COMPARE_OP(OP_NE_FLOAT, f, !=)
+    COMPARE_STRING_OP(OP_LT_STRING, <)
+    COMPARE_STRING_OP(OP_LE_STRING, <=)
+    COMPARE_STRING_OP(OP_GT_STRING, >)
+    COMPARE_STRING_OP(OP_GE_STRING, >=)
+    COMPARE_STRING_OP(OP_EQ_STRING, ==)
+    COMPARE_STRING_OP(OP_NE_STRING, !=)
+
+    CASE(OP_BOOL_INT)
+        TOP.i = TOP.i != 0;
+        DISPATCH();
+    CASE(OP_BOOL_FLOAT)
+        TOP.i = TOP.f != 0.0;
+        DISPATCH();
+    CASE(OP_BOOL_STRING)
+        TOP.i = string_length(TOP.s) != 0;
+        DISPATCH();
+
+    CASE(OP_JUMP)
+        pc = code + read_operand(pc);
+        DISPATCH();
+    CASE(OP_JUMP_IF_FALSE)
+        if ((--sp)->i == 0) pc = code + read_operand(pc);
+        else pc += 4;
+        DISPATCH();
+
+    CASE(OP_FACTORIAL)
+        TOP.i = vm_factorial(TOP.i);
+        DISPATCH();
+
+    CASE(OP_PRINT_INT)
+        sp--;
+        fprintf(out, "%" PRId64 "\n", sp->i);
+        DISPATCH();
+    CASE(OP_PRINT_FLOAT)
+        sp--;
+        fprintf(out, "%g\n", sp->f);
+        DISPATCH();
+    CASE(OP_PRINT_CHAR)
+        sp--;
+        fputc((unsigned char)sp->i, out);
+        fputc('\n', out);
+        DISPATCH();
+    CASE(OP_PRINT_STRING)
+        sp--;
+        if (sp->s) fwrite(sp->s->bytes, 1, sp->s->length, out);
+        fputc('\n', out);
+        DISPATCH();
+
+#if !VM_COMPUTED_GOTO
+    default:
+        goto done;
+    }
+#endif
+
+done:
+    arena_free(&strings);
+    free(slots);
+    return completed;
+}
@@ -0,0 +1,95 @@
+/* gen_keywords.c
+ * Build-time generator for the lexer's keyword perfect hash.
+ *
+ * Reads the KEYWORD entries of include/tokens.def and searches for
+ * multipliers (a, b, c) and the smallest power-of-two table size such that
+ *
+ *     hash(s, len) = (len * a + s[0] * b + s[len - 1] * c) & (size - 1)
+ *
+ * is collision free over all keywords. The result is written to stdout as a
+ * header holding the hash macro and the keyword table, so recognising a
+ * keyword costs one hash, one table load and one memcmp.
+ */
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+    const char *word;
+    const char *token;
+} Keyword;
+
+static const Keyword keywords[] = {
+#define KEYWORD(word, token) {word, #token},
+#include "tokens.def"
+};
+
+#define KEYWORD_COUNT ((int)(sizeof(keywords) / sizeof(keywords[0])))
+#define MAX_MULTIPLIER 64
+#define MAX_TABLE_SIZE 256
+
+static unsigned hash(const char *s, unsigned a, unsigned b, unsigned c, unsigned mask) {
+    unsigned len = (unsigned)strlen(s);
+    return (len * a + (unsigned char)s[0] * b + (unsigned char)s[len - 1] * c) & mask;
+}
+
+// Try one parameter set; on success fill slots[] with keyword indices
+static int try_params(unsigned a, unsigned b, unsigned c, unsigned size, int *slots) {
+    for (unsigned i = 0; i < size; i++) slots[i] = -1;
+    for (int k = 0; k < KEYWORD_COUNT; k++) {
+        unsigned h = hash(keywords[k].word, a, b, c, size - 1);
+        if (slots[h] != -1) return 0;
+        slots[h] = k;
+    }
+    return 1;
+}
+
+int main(void) {
+    int slots[MAX_TABLE_SIZE];
+    int min_len = 1 << 30, max_len = 0;
+
+    for (int k = 0; k < KEYWORD_COUNT; k++) {
+        int len = (int)strlen(keywords[k].word);
+        if (len < min_len) min_len = len;
+        if (len > max_len) max_len = len;
+    }
+
+    unsigned size = 1;
+    while (size < (unsigned)KEYWORD_COUNT) size *= 2;
+
+    for (; size <= MAX_TABLE_SIZE; size *= 2) {
+        for (unsigned a = 0; a < MAX_MULTIPLIER; a++)
+        for (unsigned b = 1; b < MAX_MULTIPLIER; b++)
+        for (unsigned c = 0; c < MAX_MULTIPLIER; c++) {
+            if (!try_params(a, b, c, size, slots)) continue;
+
+            printf("/* keyword_hash.h\n");
+            printf(" * Generated by tools/gen_keywords.c from include/tokens.def - do not edit.\n");
+            printf(" */\n");
+            printf("#ifndef KEYWORD_HASH_H\n#define KEYWORD_HASH_H\n\n");
+            printf("#define KEYWORD_MIN_LENGTH %d\n", min_len);
+            printf("#define KEYWORD_MAX_LENGTH %d\n", max_len);
+            printf("#define KEYWORD_TABLE_SIZE %u\n\n", size);
+            printf("#define KEYWORD_HASH(s, len) \\\n");
+            printf("    (((unsigned)(len) * %uu + (unsigned char)(s)[0] * %uu + \\\n", a, b);
+            printf("      (unsigned char)(s)[(len) - 1] * %uu) & %uu)\n\n", c, size - 1);
+            printf("static const struct {\n");
+            printf("    const char *word;\n");
+            printf("    int length;\n");
+            printf("    TokenType type;\n");
+            printf("} keyword_table[KEYWORD_TABLE_SIZE] = {\n");
+            for (unsigned i = 0; i < size; i++) {
+                if (slots[i] < 0) {
+                    printf("    {\"\", 0, TOKEN_IDENTIFIER},\n");
+                } else {
+                    const Keyword *kw = &keywords[slots[i]];
+                    printf("    {\"%s\", %d, %s},\n", kw->word, (int)strlen(kw->word), kw->token);
+                }
+            }
+            printf("};\n\n#endif /* KEYWORD_HASH_H */\n");
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "gen_keywords: no collision-free hash found, widen the search\n");
+    return 1;
+}
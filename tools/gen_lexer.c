@@ -0,0 +1,280 @@
+/* gen_lexer.c
+ * Build-time generator for the lexer's DFA.
+ *
+ * Compiles the lexical rules of include/tokens.def (SKIP, RUN, QUOTED,
+ * LINE_COMMENT, BLOCK_COMMENT, LEXEME, ERROR_LEXEME) into a DFA over bytes,
+ * then merges bytes whose columns are identical in every state into
+ * character classes. The result is written to stdout as a header holding a
+ * 256-entry class table, a dense [state][class] transition table and
+ * per-state accept information, so the lexer does one table lookup per
+ * input byte.
+ *
+ * States that loop on themselves over a long run (whitespace, identifiers,
+ * string and comment bodies) are also tagged with the SIMD kernel that can
+ * skip the same run 16/32 bytes at a time; see include/lexer_simd.h.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_STATES 256
+#define DEAD 0
+#define START 1
+
+typedef enum {
+    KIND_NONE,   // start state / unused
+    KIND_SKIP,
+    KIND_RUN,
+    KIND_QUOTED,
+    KIND_COMMENT,
+    KIND_LEXEME  // trie node of the fixed spellings
+} StateKind;
+
+// Byte sets the lexer's SIMD kernels classify; a state is tagged with a
+// kernel only if its self-loop set matches exactly
+#define SPACE_CHARS " \t\r\n"
+#define IDENT_CHARS "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789"
+
+
+typedef struct {
+    StateKind kind;
+    const char *action; // LEX_REJECT, LEX_ACCEPT or LEX_SKIP
+    const char *token;  // TokenType name when accepting
+    const char *error;  // ErrorType carried by the token / reported on death
+    int trim;           // strip the quotes from the lexeme
+    const char *rule;   // spelling of the rule, for conflict reports
+} State;
+
+static int trans[MAX_STATES][256];
+static State states[MAX_STATES];
+static int state_count = 0;
+
+static int new_state(StateKind kind, const char *action, const char *token,
+                     const char *error, const char *rule) {
+    if (state_count == MAX_STATES) {
+        fprintf(stderr, "gen_lexer: too many DFA states\n");
+        exit(1);
+    }
+    int s = state_count++;
+    states[s] = (State){kind, action, token, error, 0, rule};
+    return s;
+}
+
+static void set_transition(int from, unsigned char c, int to) {
+    if (trans[from][c] != DEAD && trans[from][c] != to) {
+        fprintf(stderr, "gen_lexer: rules '%s' and '%s' conflict on byte 0x%02x\n",
+                states[trans[from][c]].rule, states[to].rule, c);
+        exit(1);
+    }
+    trans[from][c] = to;
+}
+
+static void add_skip(const char *chars) {
+    int s = new_state(KIND_SKIP, "LEX_SKIP", "TOKEN_ERROR", "ERROR_NONE", "SKIP");
+    for (const char *p = chars; *p; p++) {
+        set_transition(START, (unsigned char)*p, s);
+        set_transition(s, (unsigned char)*p, s);
+    }
+}
+
+static void add_run(const char *token, const char *first, const char *rest) {
+    int s = new_state(KIND_RUN, "LEX_ACCEPT", token, "ERROR_NONE", token);
+    for (const char *p = first; *p; p++) set_transition(START, (unsigned char)*p, s);
+    for (const char *p = rest; *p; p++) set_transition(s, (unsigned char)*p, s);
+}
+
+static void add_quoted(const char *token, char quote, const char *escapes,
+                       const char *unterminated, const char *bad_escape) {
+    // Clean and bad-escape variants of the body, so the error is known on accept
+    int body = new_state(KIND_QUOTED, "LEX_REJECT", token, unterminated, token);
+    int esc = new_state(KIND_QUOTED, "LEX_REJECT", token, unterminated, token);
+    int end = new_state(KIND_QUOTED, "LEX_ACCEPT", token, "ERROR_NONE", token);
+    int bad_body = new_state(KIND_QUOTED, "LEX_REJECT", token, unterminated, token);
+    int bad_esc = new_state(KIND_QUOTED, "LEX_REJECT", token, unterminated, token);
+    int bad_end = new_state(KIND_QUOTED, "LEX_ACCEPT", token, bad_escape, token);
+    states[end].trim = states[bad_end].trim = 1;
+
+    set_transition(START, (unsigned char)quote, body);
+    // Byte 0 terminates the input, so it never continues a literal
+    for (int c = 1; c < 256; c++) {
+        int next = c == quote ? end : c == '\\' ? esc : body;
+        int bad_next = c == quote ? bad_end : c == '\\' ? bad_esc : bad_body;
+        set_transition(body, c, next);
+        set_transition(bad_body, c, bad_next);
+        set_transition(esc, c, strchr(escapes, c) ? body : bad_body);
+        set_transition(bad_esc, c, bad_body);
+    }
+}
+
+// Walk (creating as needed) the trie path for the first `length` bytes of
+// spelling and return the state reached
+static int trie_path(const char *spelling, int length) {
+    int s = START;
+    for (const char *p = spelling; p < spelling + length; p++) {
+        unsigned char c = (unsigned char)*p;
+        int next = trans[s][c];
+        if (next == DEAD) {
+            next = new_state(KIND_LEXEME, "LEX_REJECT", "TOKEN_ERROR", "ERROR_INVALID_CHAR", spelling);
+            set_transition(s, c, next);
+        } else if (states[next].kind != KIND_LEXEME) {
+            fprintf(stderr, "gen_lexer: '%s' conflicts with rule '%s'\n", spelling, states[next].rule);
+            exit(1);
+        }
+        s = next;
+    }
+    return s;
+}
+
+static void add_lexeme(const char *spelling, const char *token, const char *error) {
+    int s = trie_path(spelling, (int)strlen(spelling));
+    if (strcmp(states[s].action, "LEX_ACCEPT") == 0) {
+        fprintf(stderr, "gen_lexer: '%s' is specified twice\n", spelling);
+        exit(1);
+    }
+    states[s].action = "LEX_ACCEPT";
+    states[s].token = token;
+    states[s].error = error;
+    states[s].rule = spelling;
+}
+
+// The opener shares trie states with the fixed spellings (e.g. "/"); its
+// last byte enters a body that is skipped up to the end of the line
+static void add_line_comment(const char *opener) {
+    int len = (int)strlen(opener);
+    int prefix = trie_path(opener, len - 1);
+    int body = new_state(KIND_COMMENT, "LEX_SKIP", "TOKEN_ERROR", "ERROR_NONE", opener);
+    set_transition(prefix, (unsigned char)opener[len - 1], body);
+    for (int c = 1; c < 256; c++) {
+        if (c != '\n') set_transition(body, c, body);
+    }
+}
+
+// Body runs until the two-byte closer; running into the end of input
+// reports unterminated
+static void add_block_comment(const char *opener, const char *closer, const char *unterminated) {
+    int len = (int)strlen(opener);
+    int prefix = trie_path(opener, len - 1);
+    int body = new_state(KIND_COMMENT, "LEX_REJECT", "TOKEN_ERROR", unterminated, opener);
+    int close = new_state(KIND_COMMENT, "LEX_REJECT", "TOKEN_ERROR", unterminated, opener);
+    int end = new_state(KIND_COMMENT, "LEX_SKIP", "TOKEN_ERROR", "ERROR_NONE", opener);
+    if (strlen(closer) != 2 || closer[0] == closer[1]) {
+        fprintf(stderr, "gen_lexer: block comment closer must be two distinct bytes\n");
+        exit(1);
+    }
+    set_transition(prefix, (unsigned char)opener[len - 1], body);
+    for (int c = 1; c < 256; c++) {
+        set_transition(body, c, c == closer[0] ? close : body);
+        set_transition(close, c, c == closer[1] ? end : c == closer[0] ? close : body);
+    }
+}
+
+// Pick the SIMD kernel that reproduces state s's self-loop, if any
+static void fast_path(int s, const char **kind, int *stop1, int *stop2) {
+    char loop[256] = {0};
+    int loop_count = 0;
+    for (int c = 1; c < 256; c++) {
+        if (trans[s][c] == s) {
+            loop[c] = 1;
+            loop_count++;
+        }
+    }
+
+    *kind = "LEX_FAST_NONE";
+    *stop1 = *stop2 = 0;
+    if (s == DEAD || loop_count == 0) return;
+
+    int is_space = loop_count == (int)strlen(SPACE_CHARS);
+    for (const char *p = SPACE_CHARS; *p; p++) is_space = is_space && loop[(unsigned char)*p];
+    int is_ident = loop_count == (int)strlen(IDENT_CHARS);
+    for (const char *p = IDENT_CHARS; *p; p++) is_ident = is_ident && loop[(unsigned char)*p];
+
+    if (is_space) {
+        *kind = "LEX_FAST_SPACE";
+    } else if (is_ident) {
+        *kind = "LEX_FAST_IDENT";
+    } else if (loop_count >= 253) {
+        // Everything but one or two stop bytes (and the terminating 0)
+        int stops[2] = {0, 0}, n = 0;
+        for (int c = 1; c < 256; c++) {
+            if (!loop[c]) stops[n++] = c;
+        }
+        *kind = "LEX_FAST_UNTIL";
+        *stop1 = stops[0];
+        *stop2 = n == 2 ? stops[1] : stops[0];
+    }
+}
+
+int main(void) {
+    new_state(KIND_NONE, "LEX_REJECT", "TOKEN_ERROR", "ERROR_INVALID_CHAR", "DEAD");
+    new_state(KIND_NONE, "LEX_REJECT", "TOKEN_ERROR", "ERROR_INVALID_CHAR", "START");
+
+#define SKIP(chars) add_skip(chars);
+#define RUN(token, first, rest) add_run(#token, first, rest);
+#define QUOTED(token, quote, escapes, unterminated, bad_escape) \
+    add_quoted(#token, quote, escapes, #unterminated, #bad_escape);
+#define LINE_COMMENT(opener) add_line_comment(opener);
+#define BLOCK_COMMENT(opener, closer, unterminated) add_block_comment(opener, closer, #unterminated);
+#define LEXEME(spelling, token) add_lexeme(spelling, #token, "ERROR_NONE");
+#define ERROR_LEXEME(spelling, error) add_lexeme(spelling, "TOKEN_ERROR", #error);
+#include "tokens.def"
+
+    // Group bytes whose transition column is identical in every state
+    int byte_class[256];
+    int class_count = 0;
+    int class_rep[256];
+    for (int c = 0; c < 256; c++) {
+        int k;
+        for (k = 0; k < class_count; k++) {
+            int same = 1;
+            for (int s = 0; s < state_count && same; s++)
+                same = trans[s][c] == trans[s][class_rep[k]];
+            if (same) break;
+        }
+        if (k == class_count) class_rep[class_count++] = c;
+        byte_class[c] = k;
+    }
+
+    printf("/* lexer_tables.h\n");
+    printf(" * Generated by tools/gen_lexer.c from include/tokens.def - do not edit.\n");
+    printf(" * %d states, %d character classes.\n", state_count, class_count);
+    printf(" */\n");
+    printf("#ifndef LEXER_TABLES_H\n#define LEXER_TABLES_H\n\n");
+    printf("#define LEX_STATE_COUNT %d\n", state_count);
+    printf("#define LEX_CLASS_COUNT %d\n", class_count);
+    printf("#define LEX_DEAD %d\n", DEAD);
+    printf("#define LEX_START %d\n\n", START);
+    printf("typedef enum { LEX_REJECT, LEX_ACCEPT, LEX_SKIP } LexAction;\n");
+    printf("typedef enum { LEX_FAST_NONE, LEX_FAST_SPACE, LEX_FAST_IDENT, LEX_FAST_UNTIL } LexFastPath;\n\n");
+    printf("typedef struct {\n");
+    printf("    unsigned char action; // LexAction when the DFA stops in this state\n");
+    printf("    unsigned char trim;   // lexeme excludes the first and last byte\n");
+    printf("    unsigned char token;  // TokenType produced on accept\n");
+    printf("    unsigned char error;  // ErrorType on the token, or reported on reject\n");
+    printf("    unsigned char fast;   // LexFastPath kernel that skips this state's self-loop\n");
+    printf("    unsigned char stop1;  // LEX_FAST_UNTIL: bytes that leave the state\n");
+    printf("    unsigned char stop2;\n");
+    printf("} LexStateInfo;\n\n");
+
+    printf("static const unsigned char lex_char_class[256] = {");
+    for (int c = 0; c < 256; c++) printf("%s%d,", c % 16 ? " " : "\n    ", byte_class[c]);
+    printf("\n};\n\n");
+
+    printf("static const unsigned char lex_transition[LEX_STATE_COUNT][LEX_CLASS_COUNT] = {\n");
+    for (int s = 0; s < state_count; s++) {
+        printf("    /* %3d */ {", s);
+        for (int k = 0; k < class_count; k++) printf("%s%d", k ? ", " : "", trans[s][class_rep[k]]);
+        printf("},\n");
+    }
+    printf("};\n\n");
+
+    printf("static const LexStateInfo lex_state_info[LEX_STATE_COUNT] = {\n");
+    for (int s = 0; s < state_count; s++) {
+        const char *fast;
+        int stop1, stop2;
+        fast_path(s, &fast, &stop1, &stop2);
+        printf("    {%s, %d, %s, %s, %s, %d, %d},\n", states[s].action, states[s].trim,
+               states[s].token, states[s].error, fast, stop1, stop2);
+    }
+    printf("};\n\n#endif /* LEXER_TABLES_H */\n");
+    return 0;
+}
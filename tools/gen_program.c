@@ -0,0 +1,278 @@
+/* gen_program.c
+ * Synthetic program generator for the benchmarks.
+ *
+ * Writes a semantically valid program to stdout: every variable is declared
+ * and initialised up front, then the body's statements assign expressions
+ * to them and print them. The shape is tunable:
+ *
+ *     -S N   statements in the body                       (default 100000)
+ *     -d N   variables declared                           (default 1000)
+ *     -n N   nesting depth of if/while/repeat blocks      (default 0)
+ *     -b N   statements per nested block                  (default 4)
+ *     -e N   operands per expression                      (default 4)
+ *     -i N   identifier length                            (default 8)
+ *     -s N   percentage of string variables and literals  (default 10)
+ *     -r N   random seed                                  (default 1)
+ *     -l N   counted while loops in place of the statements (default 0)
+ *
+ * With -n, the body is a sequence of chains of n nested blocks, cycling
+ * through if, while and repeat, each holding -b statements before the next
+ * block of the chain. With -l, it is instead N while loops, in chains of
+ * -n nested ones sharing a counter that only the innermost steps, so each
+ * runs once or three times; each loop adds the counter to -b int variables,
+ * which are all printed at the end. Output depends only on the options.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct {
+    long statements;
+    int declarations;
+    int depth;
+    int block_statements;
+    int operands;
+    int identifier_length;
+    int string_percent;
+    uint64_t seed;
+    long loops;
+} Shape;
+
+static Shape shape = {100000, 1000, 0, 4, 4, 8, 10, 1, 0};
+
+// Variables, split by type so expressions stay well typed
+static int *int_vars, *string_vars;
+static int int_count, string_count;
+static long emitted;
+
+// xorshift64*, so a seed gives the same program everywhere
+static uint64_t next_random(void) {
+    shape.seed ^= shape.seed >> 12;
+    shape.seed ^= shape.seed << 25;
+    shape.seed ^= shape.seed >> 27;
+    return shape.seed * 2685821657736338717ull;
+}
+
+static int random_below(int n) {
+    return (int)(next_random() % (uint64_t)n);
+}
+
+// "v<index>", padded with '_' to the identifier length
+static void put_name(int index) {
+    int length = printf("v%d", index);
+    for (; length < shape.identifier_length; length++) putchar('_');
+}
+
+static void put_string_literal(void) {
+    static const char *words[] = {"alpha", "beta", "gamma", "delta", "a\\tb", "line\\n"};
+    printf("\"%s%d\"", words[random_below(6)], random_below(1000));
+}
+
+static void put_int_operand(void) {
+    if (int_count == 0 || random_below(3) == 0) {
+        printf("%d", random_below(10000));
+    } else {
+        put_name(int_vars[random_below(int_count)]);
+    }
+}
+
+static void put_string_operand(void) {
+    if (string_count == 0 || random_below(2) == 0) {
+        put_string_literal();
+    } else {
+        put_name(string_vars[random_below(string_count)]);
+    }
+}
+
+static void put_expression(int string) {
+    static const char ops[] = "+-*/";
+    for (int i = 0; i < shape.operands; i++) {
+        if (i > 0) {
+            printf(" %c ", string ? '+' : ops[random_below(4)]);
+        }
+        if (string) put_string_operand();
+        else put_int_operand();
+    }
+}
+
+static void put_indent(int level) {
+    for (int i = 0; i < level; i++) fputs("    ", stdout);
+}
+
+// One assignment or print
+static void put_simple_statement(int level) {
+    int string = string_count > 0 && (int_count == 0 || random_below(100) < shape.string_percent);
+    int var = string ? string_vars[random_below(string_count)] : int_vars[random_below(int_count)];
+
+    put_indent(level);
+    if (random_below(8) == 0) {
+        fputs("print ", stdout);
+        put_name(var);
+    } else {
+        put_name(var);
+        fputs(" = ", stdout);
+        put_expression(string);
+    }
+    fputs(";\n", stdout);
+    emitted++;
+}
+
+static void put_condition(void) {
+    static const char *comparisons[] = {"<", ">", "<=", ">=", "==", "!="};
+    putchar('(');
+    put_int_operand();
+    printf(" %s ", comparisons[random_below(6)]);
+    put_int_operand();
+    putchar(')');
+}
+
+// A chain of nested blocks from level down to the configured depth
+static void put_block_chain(int level) {
+    int kind = level % 3;
+
+    put_indent(level);
+    if (kind == 0) {
+        fputs("if ", stdout);
+        put_condition();
+        fputs(" {\n", stdout);
+    } else if (kind == 1) {
+        fputs("while ", stdout);
+        put_condition();
+        fputs(" {\n", stdout);
+    } else {
+        fputs("repeat {\n", stdout);
+    }
+    emitted++;
+
+    for (int i = 0; i < shape.block_statements && emitted < shape.statements; i++) {
+        put_simple_statement(level + 1);
+    }
+    if (level + 1 < shape.depth && emitted < shape.statements) {
+        put_block_chain(level + 1);
+    }
+
+    put_indent(level);
+    if (kind == 2) {
+        fputs("} until ", stdout);
+        put_condition();
+        fputs(";\n", stdout);
+    } else {
+        fputs("}\n", stdout);
+    }
+}
+
+// A chain of counted loops from level down to the configured depth; the
+// counter is the variable declared after the others
+static void put_loop_chain(int level) {
+    put_indent(level);
+    fputs("while (", stdout);
+    put_name(shape.declarations);
+    fputs(" < 3) {\n", stdout);
+    emitted++;
+
+    for (int i = 0; i < shape.block_statements && int_count > 0; i++) {
+        int var = int_vars[random_below(int_count)];
+        put_indent(level + 1);
+        put_name(var);
+        fputs(" = ", stdout);
+        put_name(var);
+        fputs(" + ", stdout);
+        put_name(shape.declarations);
+        fputs(";\n", stdout);
+    }
+    if (level + 1 < shape.depth && emitted < shape.loops) {
+        put_loop_chain(level + 1);
+    } else {
+        put_indent(level + 1);
+        put_name(shape.declarations);
+        fputs(" = ", stdout);
+        put_name(shape.declarations);
+        fputs(" + 1;\n", stdout);
+    }
+
+    put_indent(level);
+    fputs("}\n", stdout);
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: gen_program [-S statements] [-d declarations] [-n depth] [-b per-block]\n"
+                    "                   [-e operands] [-i identifier-length] [-s string-percent] [-r seed]\n"
+                    "                   [-l loops]\n");
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-' || argv[i][1] == '\0' || argv[i][2] != '\0' || i + 1 == argc) usage();
+        long value = atol(argv[++i]);
+        switch (argv[i - 1][1]) {
+            case 'S': shape.statements = value; break;
+            case 'd': shape.declarations = (int)value; break;
+            case 'n': shape.depth = (int)value; break;
+            case 'b': shape.block_statements = (int)value; break;
+            case 'e': shape.operands = (int)value; break;
+            case 'i': shape.identifier_length = (int)value; break;
+            case 's': shape.string_percent = (int)value; break;
+            case 'r': shape.seed = (uint64_t)value; break;
+            case 'l': shape.loops = value; break;
+            default: usage();
+        }
+    }
+    if (shape.declarations < 1 || shape.operands < 1 || shape.depth < 0 || shape.block_statements < 0 ||
+        shape.string_percent < 0 || shape.string_percent > 100 || shape.loops < 0) {
+        usage();
+    }
+    if (shape.seed == 0) shape.seed = 1;
+
+    int_vars = malloc(shape.declarations * sizeof(int));
+    string_vars = malloc(shape.declarations * sizeof(int));
+    char *is_string = malloc(shape.declarations);
+    if (!int_vars || !string_vars || !is_string) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+
+    for (int i = 0; i < shape.declarations; i++) {
+        int string = random_below(100) < shape.string_percent;
+        is_string[i] = (char)string;
+        if (string) string_vars[string_count++] = i;
+        else int_vars[int_count++] = i;
+        fputs(string ? "string " : "int ", stdout);
+        put_name(i);
+        fputs(";\n", stdout);
+    }
+    if (shape.loops > 0) {
+        fputs("int ", stdout);
+        put_name(shape.declarations);
+        fputs(";\n", stdout);
+    }
+    for (int i = 0; i < shape.declarations; i++) {
+        put_name(i);
+        fputs(" = ", stdout);
+        if (is_string[i]) put_string_literal();
+        else printf("%d", random_below(10000));
+        fputs(";\n", stdout);
+    }
+
+    if (shape.loops > 0) {
+        while (emitted < shape.loops) {
+            put_name(shape.declarations);
+            fputs(" = 0;\n", stdout);
+            put_loop_chain(0);
+        }
+        for (int i = 0; i < int_count; i++) {
+            fputs("print ", stdout);
+            put_name(int_vars[i]);
+            fputs(";\n", stdout);
+        }
+    }
+    while (shape.loops == 0 && emitted < shape.statements) {
+        if (shape.depth > 0) put_block_chain(0);
+        else put_simple_statement(0);
+    }
+
+    free(is_string);
+    free(int_vars);
+    free(string_vars);
+    return 0;
+}